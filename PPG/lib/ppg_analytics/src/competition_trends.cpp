@@ -0,0 +1,267 @@
+#include "competition_trends.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+  const char *METRIC_NAMES[CompetitionTrends::METRIC_COUNT] = {"hrv", "heartRate", "sbp", "dbp"};
+  const char *ANSWER_NAMES[CompetitionTrends::ANSWER_COUNT] = {"sleepQuality", "hadCoffee", "stressLevel",
+                                                               "daysPreCompetition"};
+  // Day-to-day variation below this is noise, not a trend
+  const float SD_FLOOR[CompetitionTrends::METRIC_COUNT] = {3.0f, 2.0f, 3.0f, 2.0f};
+
+  bool measured(float v) { return v > 0 && !isinf(v); }
+
+  void appendf(std::string &s, const char *format, double v)
+  {
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), format, v);
+    s += buffer;
+  }
+
+  // ,"key":value if value is known
+  void field(std::string &s, const char *key, double v, const char *format)
+  {
+    if (isnan(v))
+      return;
+    s += ",\"";
+    s += key;
+    s += "\":";
+    appendf(s, format, v);
+  }
+}
+
+const float CompetitionTrends::CUSUM_K = 0.5f;
+const float CompetitionTrends::CUSUM_H = 4.0f;
+const int CompetitionTrends::BASELINE_DAYS;
+const int CompetitionTrends::MIN_BASELINE_DAYS;
+const int CompetitionTrends::LEAD_UP_DAYS;
+const int32_t CompetitionTrends::NO_DAY;
+const uint8_t CompetitionTrends::VERSION;
+
+void CompetitionTrends::reset()
+{
+  memset(&st, 0, sizeof(st));
+  st.version = VERSION;
+  st.day = NO_DAY;
+  for (int m = 0; m < METRIC_COUNT; m++)
+  {
+    st.lastMean[m] = NAN;
+    st.lastDay[m] = NO_DAY;
+    st.changeDay[m] = NO_DAY;
+  }
+}
+
+bool CompetitionTrends::restore(const State &s)
+{
+  if (s.version != VERSION || s.closed > BASELINE_DAYS || s.head >= BASELINE_DAYS)
+    return false;
+  st = s;
+  return true;
+}
+
+bool CompetitionTrends::baseline(Metric m, float &mean, float &sd, uint16_t &days) const
+{
+  double sum = 0, sq = 0;
+  days = 0;
+  for (int i = 0; i < st.closed; i++)
+  {
+    float v = st.closedMean[i][m];
+    if (st.closedDay[i] < st.day - BASELINE_DAYS || st.closedDay[i] >= st.day || isnan(v))
+      continue;
+    sum += v;
+    sq += (double)v * v;
+    days++;
+  }
+  if (days < MIN_BASELINE_DAYS)
+  {
+    mean = sd = NAN;
+    return false;
+  }
+  mean = (float)(sum / days);
+  double var = (sq - sum * sum / days) / (days - 1);
+  sd = (float)sqrt(var > 0 ? var : 0);
+  if (sd < SD_FLOOR[m])
+    sd = SD_FLOOR[m];
+  return true;
+}
+
+void CompetitionTrends::closeDay()
+{
+  float means[METRIC_COUNT];
+  for (int m = 0; m < METRIC_COUNT; m++)
+  {
+    means[m] = st.openCount[m] > 0 ? (float)(st.openSum[m] / st.openCount[m]) : NAN;
+    if (isnan(means[m]))
+      continue;
+    float mean, sd;
+    uint16_t days;
+    if (baseline((Metric)m, mean, sd, days))
+    {
+      float z = (means[m] - mean) / sd;
+      float high = st.cusumHigh[m] + z - CUSUM_K;
+      float low = st.cusumLow[m] - z - CUSUM_K;
+      st.cusumHigh[m] = high > 0 ? high : 0;
+      st.cusumLow[m] = low > 0 ? low : 0;
+      if (st.cusumHigh[m] > CUSUM_H || st.cusumLow[m] > CUSUM_H)
+      {
+        st.changeDay[m] = st.day;
+        st.changeDirection[m] = st.cusumHigh[m] > CUSUM_H ? 1 : -1;
+        st.cusumHigh[m] = st.cusumLow[m] = 0;
+      }
+    }
+    st.lastMean[m] = means[m];
+    st.lastDay[m] = st.day;
+    st.openSum[m] = 0;
+    st.openCount[m] = 0;
+  }
+  st.closedDay[st.head] = st.day;
+  memcpy(st.closedMean[st.head], means, sizeof(means));
+  st.head = (st.head + 1) % BASELINE_DAYS;
+  if (st.closed < BASELINE_DAYS)
+    st.closed++;
+}
+
+bool CompetitionTrends::addSession(const Session &s)
+{
+  if (st.day != NO_DAY && s.day < st.day)
+    return false;
+  if (st.day != NO_DAY && s.day > st.day)
+    closeDay();
+  st.day = s.day;
+  st.sessions++;
+
+  float days = s.answers[DAYS_PRE_COMPETITION];
+  int leadUp = !isnan(days) && days >= 1 && days <= LEAD_UP_DAYS ? (int)(days + 0.5f) - 1 : -1;
+  for (int m = 0; m < METRIC_COUNT; m++)
+  {
+    float v = s.metrics[m];
+    if (!measured(v))
+      continue;
+    // Against the baseline as it stood before today
+    float mean, sd;
+    uint16_t baselineDays;
+    if (leadUp >= 0 && baseline((Metric)m, mean, sd, baselineDays))
+    {
+      st.leadUpSum[m][leadUp] += 100.0 * (v - mean) / mean;
+      st.leadUpCount[m][leadUp]++;
+    }
+    st.openSum[m] += v;
+    st.openCount[m]++;
+    for (int a = 0; a < ANSWER_COUNT; a++)
+    {
+      float x = s.answers[a];
+      if (isnan(x))
+        continue;
+      // Welford's update of the co-moment, one pass and stable
+      Comoment &c = st.moments[m][a];
+      c.n++;
+      double dy = x - c.meanY;
+      double dx = v - c.meanX;
+      c.meanX += dx / c.n;
+      c.meanY += dy / c.n;
+      c.m2x += dx * (v - c.meanX);
+      c.m2y += dy * (x - c.meanY);
+      c.cxy += dx * (x - c.meanY);
+    }
+  }
+  return true;
+}
+
+CompetitionTrends::Trend CompetitionTrends::trend(Metric m) const
+{
+  Trend t;
+  t.today = st.openCount[m] > 0 ? (float)(st.openSum[m] / st.openCount[m]) : NAN;
+  baseline(m, t.baseline, t.sd, t.baselineDays);
+  t.z = (t.today - t.baseline) / t.sd;
+  bool compare = !isnan(t.today) && st.lastDay[m] != NO_DAY;
+  t.delta = compare ? t.today - st.lastMean[m] : NAN;
+  t.deltaDays = compare ? st.day - st.lastDay[m] : 0;
+  t.changeDay = st.changeDay[m];
+  t.changeDirection = st.changeDirection[m];
+  return t;
+}
+
+float CompetitionTrends::correlation(Metric m, Answer a) const
+{
+  const Comoment &c = st.moments[m][a];
+  if (c.n < 3 || c.m2x <= 0 || c.m2y <= 0)
+    return NAN;
+  return (float)(c.cxy / sqrt(c.m2x * c.m2y));
+}
+
+float CompetitionTrends::leadUp(Metric m, int daysBefore) const
+{
+  if (daysBefore < 1 || daysBefore > LEAD_UP_DAYS || st.leadUpCount[m][daysBefore - 1] == 0)
+    return NAN;
+  return (float)(st.leadUpSum[m][daysBefore - 1] / st.leadUpCount[m][daysBefore - 1]);
+}
+
+void CompetitionTrends::toJson(std::string &json) const
+{
+  json = "{\"sessions\":";
+  appendf(json, "%.0f", (double)st.sessions);
+  if (st.day != NO_DAY)
+    appendf(json, ",\"day\":%.0f", (double)st.day);
+  json += ",\"metrics\":{";
+  for (int m = 0; m < METRIC_COUNT; m++)
+  {
+    Trend t = trend((Metric)m);
+    if (m > 0)
+      json += ',';
+    json += '"';
+    json += METRIC_NAMES[m];
+    appendf(json, "\":{\"baselineDays\":%.0f", (double)t.baselineDays);
+    field(json, "today", t.today, "%.2f");
+    field(json, "baseline", t.baseline, "%.2f");
+    field(json, "sd", t.sd, "%.2f");
+    field(json, "z", t.z, "%.2f");
+    field(json, "delta", t.delta, "%.2f");
+    if (!isnan(t.delta))
+      appendf(json, ",\"deltaDays\":%.0f", (double)t.deltaDays);
+    if (t.changeDay != NO_DAY)
+    {
+      appendf(json, ",\"changeDay\":%.0f", (double)t.changeDay);
+      json += t.changeDirection > 0 ? ",\"change\":\"up\"" : ",\"change\":\"down\"";
+    }
+    json += '}';
+  }
+  json += "},\"correlations\":{";
+  for (int m = 0; m < METRIC_COUNT; m++)
+  {
+    if (m > 0)
+      json += ',';
+    json += '"';
+    json += METRIC_NAMES[m];
+    json += "\":{";
+    std::string fields;
+    for (int a = 0; a < ANSWER_COUNT; a++)
+      field(fields, ANSWER_NAMES[a], correlation((Metric)m, (Answer)a), "%.3f");
+    if (!fields.empty())
+      json += fields.substr(1);
+    json += '}';
+  }
+  json += "},\"leadUp\":{";
+  for (int m = 0; m < METRIC_COUNT; m++)
+  {
+    if (m > 0)
+      json += ',';
+    json += '"';
+    json += METRIC_NAMES[m];
+    json += "\":[";
+    for (int d = 1; d <= LEAD_UP_DAYS; d++)
+    {
+      if (d > 1)
+        json += ',';
+      float v = leadUp((Metric)m, d);
+      if (isnan(v))
+        json += "null";
+      else
+        appendf(json, "%.2f", v);
+    }
+    json += ']';
+  }
+  json += "}}";
+}
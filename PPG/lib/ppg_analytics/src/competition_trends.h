@@ -0,0 +1,139 @@
+#ifndef PPG_COMPETITION_TRENDS_H
+#define PPG_COMPETITION_TRENDS_H
+
+#include <stdint.h>
+
+#include <string>
+
+// Trends across days for one athlete in the lead-up to competitions,
+// updated as each session closes so nothing is recomputed over the
+// history. Sessions come in with their HRV, mean heart rate and blood
+// pressure and the questionnaire's answers, in day order:
+//   baseline    mean and SD of each metric's daily means over the last
+//               BASELINE_DAYS days, once there are MIN_BASELINE_DAYS
+//   delta       today's mean against the last day the metric was measured
+//   changepoint two-sided CUSUM of each closed day's z against the
+//               baseline before it (slack CUSUM_K, threshold CUSUM_H in
+//               SDs); the day it fires and the direction are kept and
+//               the sums restart
+//   correlation Pearson r of each metric with sleep quality, coffee,
+//               reported stress and days before competition, over all
+//               sessions, by running co-moments
+//   lead-up     mean % deviation from baseline by days before competition
+// A day closes when the first session of a later day arrives; until then
+// its figures are provisional. Metrics of 0 or NAN and NAN answers were
+// not measured.
+//
+// The state is a fixed-size struct, persisted as is by the app, hence the
+// version.
+class CompetitionTrends
+{
+public:
+  enum Metric : uint8_t
+  {
+    HRV,
+    HEART_RATE,
+    SBP,
+    DBP,
+    METRIC_COUNT
+  };
+
+  enum Answer : uint8_t
+  {
+    SLEEP_QUALITY,
+    HAD_COFFEE, // 0 or 1
+    STRESS_LEVEL,
+    DAYS_PRE_COMPETITION,
+    ANSWER_COUNT
+  };
+
+  static const int BASELINE_DAYS = 28;
+  static const int MIN_BASELINE_DAYS = 7;
+  static const int LEAD_UP_DAYS = 10; // the questionnaire's range
+  static const float CUSUM_K;
+  static const float CUSUM_H;
+  static const int32_t NO_DAY = INT32_MIN;
+
+  struct Session
+  {
+    int32_t day; // day number, e.g. local days since 1970
+    float metrics[METRIC_COUNT];
+    float answers[ANSWER_COUNT];
+  };
+
+  struct Comoment
+  {
+    uint32_t n;
+    double meanX, meanY, m2x, m2y, cxy;
+  };
+
+  struct State
+  {
+    uint8_t version;
+    uint32_t sessions;
+    int32_t day; // open day, NO_DAY before the first session
+    double openSum[METRIC_COUNT];
+    uint16_t openCount[METRIC_COUNT];
+    // Closed days, a ring of the last BASELINE_DAYS; NAN if not measured
+    uint16_t closed, head;
+    int32_t closedDay[BASELINE_DAYS];
+    float closedMean[BASELINE_DAYS][METRIC_COUNT];
+    float lastMean[METRIC_COUNT];
+    int32_t lastDay[METRIC_COUNT];
+    float cusumHigh[METRIC_COUNT], cusumLow[METRIC_COUNT];
+    int32_t changeDay[METRIC_COUNT];
+    int8_t changeDirection[METRIC_COUNT]; // 1 up, -1 down, 0 none yet
+    Comoment moments[METRIC_COUNT][ANSWER_COUNT];
+    double leadUpSum[METRIC_COUNT][LEAD_UP_DAYS];
+    uint32_t leadUpCount[METRIC_COUNT][LEAD_UP_DAYS];
+  };
+
+  // One metric as of the open day; NAN where not known
+  struct Trend
+  {
+    float today;
+    float baseline, sd;
+    uint16_t baselineDays;
+    float z;
+    float delta;
+    int32_t deltaDays; // since the day delta compares with, 0 if none
+    int32_t changeDay; // NO_DAY if none yet
+    int8_t changeDirection;
+  };
+
+  CompetitionTrends() { reset(); }
+
+  void reset();
+  // false (and nothing learned) for a session from before the open day
+  bool addSession(const Session &s);
+  uint32_t sessions() const { return st.sessions; }
+
+  Trend trend(Metric m) const;
+  // NAN with fewer than 3 sessions measuring both, or no variation
+  float correlation(Metric m, Answer a) const;
+  // daysBefore 1..LEAD_UP_DAYS
+  float leadUp(Metric m, int daysBefore) const;
+  // {"sessions":n,"day":d,"metrics":{"hrv":{"today":..,"baseline":..,
+  //  "sd":..,"baselineDays":..,"z":..,"delta":..,"deltaDays":..,
+  //  "changeDay":..,"change":"up"|"down"},..},
+  //  "correlations":{"hrv":{"sleepQuality":r,"hadCoffee":r,
+  //  "stressLevel":r,"daysPreCompetition":r},..},
+  //  "leadUp":{"hrv":[% 1 day before,..],..}}
+  // Unknown values are left out; lead-up days without data are null.
+  void toJson(std::string &json) const;
+
+  const State &state() const { return st; }
+  // false (and the trends unchanged) when s is from another version
+  bool restore(const State &s);
+
+private:
+  static const uint8_t VERSION = 1;
+
+  void closeDay();
+  // Over the closed days before the open day, within BASELINE_DAYS
+  bool baseline(Metric m, float &mean, float &sd, uint16_t &days) const;
+
+  State st;
+};
+
+#endif
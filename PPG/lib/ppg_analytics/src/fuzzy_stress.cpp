@@ -0,0 +1,87 @@
+#include "fuzzy_stress.h"
+
+#include <math.h>
+#include <stddef.h>
+
+namespace
+{
+  // 0 up to a, rising to 1 at b, 1 up to c, falling to 0 at d; infinite
+  // a = b or c = d make a shoulder. Unmeasured (NAN) inputs belong nowhere.
+  float trapezoid(float x, float a, float b, float c, float d)
+  {
+    if (isnan(x))
+      return 0;
+    if (x < b)
+      return x <= a ? 0 : (x - a) / (b - a);
+    if (x <= c)
+      return 1;
+    return x >= d ? 0 : (d - x) / (d - c);
+  }
+
+  float low(float x, float c, float d) { return trapezoid(x, -INFINITY, -INFINITY, c, d); }
+  float high(float x, float a, float b) { return trapezoid(x, a, b, INFINITY, INFINITY); }
+
+  float zHigh(float z) { return high(z, 1, 2); }
+  float zLow(float z) { return zHigh(-z); }
+  float zNormal(float z) { return 1 - fmaxf(zHigh(z), zLow(z)); }
+
+  float min3(float a, float b, float c) { return fminf(fminf(a, b), c); }
+
+  struct Levels
+  {
+    float low, normal, high;
+  };
+
+  Levels heartRateLevels(float hr, float z)
+  {
+    if (!isnan(z))
+      return Levels{zLow(z), zNormal(z), zHigh(z)};
+    return Levels{low(hr, 45, 55), trapezoid(hr, 50, 60, 85, 95), high(hr, 90, 95)};
+  }
+
+  Levels hrvLevels(float rmssd, float z)
+  {
+    if (!isnan(z))
+      return Levels{zLow(z), zNormal(z), zHigh(z)};
+    return Levels{low(rmssd, 25, 45), trapezoid(rmssd, 40, 55, 150, 165), high(rmssd, 160, 200)};
+  }
+}
+
+float fuzzyStressScore(const StressInputs &in)
+{
+  Levels hr = heartRateLevels(in.heartRate, in.hrZ);
+  Levels hrv = hrvLevels(in.hrv, in.hrvZ);
+  Levels sleep = {low(in.sleepScore, 2, 3), trapezoid(in.sleepScore, 2, 3, 3, 4), high(in.sleepScore, 3, 4)};
+  Levels sbp = {low(in.sbp, 115, 120), trapezoid(in.sbp, 120, 125, 135, 140), high(in.sbp, 140, 145)};
+  Levels dbp = {low(in.dbp, 75, 80), trapezoid(in.dbp, 80, 85, 90, 95), high(in.dbp, 90, 95)};
+  float coffee = in.hadCoffee ? 1 : 0;
+  float spo2Low = low(in.spo2, 94, 95);
+
+  float highRules[] = {
+      spo2Low,
+      hrv.low,
+      min3(sleep.low, hr.high, coffee),
+      min3(sleep.low, hr.high, 1 - coffee),
+      min3(hrv.normal, hr.high, 1 - coffee),
+      fminf(sbp.high, dbp.high),
+      min3(hr.high, hrv.low, coffee),
+  };
+  float lowRules[] = {
+      min3(hr.high, sleep.high, coffee),
+      min3(hr.normal, sleep.high, 1 - coffee),
+      fminf(hr.low, sleep.high),
+      fminf(hrv.high, sleep.high),
+      fminf(hr.low, hrv.high),
+      min3(sbp.normal, dbp.normal, hr.normal),
+      fminf(sbp.low, dbp.low),
+  };
+  float stressHigh = 0, stressLow = 0;
+  for (size_t i = 0; i < sizeof(highRules) / sizeof(highRules[0]); i++)
+    stressHigh = fmaxf(stressHigh, highRules[i]);
+  for (size_t i = 0; i < sizeof(lowRules) / sizeof(lowRules[0]); i++)
+    stressLow = fmaxf(stressLow, lowRules[i]);
+  float stressMedium = min3(hr.high, coffee, sleep.normal);
+
+  float total = stressLow + stressMedium + stressHigh;
+  return total == 0 ? 5.0f : (stressLow * 2 + stressMedium * 5 + stressHigh * 8) / total;
+}
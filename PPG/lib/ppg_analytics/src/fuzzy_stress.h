@@ -0,0 +1,27 @@
+#ifndef PPG_FUZZY_STRESS_H
+#define PPG_FUZZY_STRESS_H
+
+// The post-session stress score shown in the app, 2 (low) to 8 (high):
+// a Mamdani-style rule base over trapezoid memberships of the session
+// means and the athlete's questionnaire answers, defuzzified as the
+// weighted mean of the low (2), medium (5) and high (8) outputs; 5 when
+// no rule fires.
+//
+// hrZ and hrvZ are the session's mean z-scores against the athlete's
+// baseline (athlete_baseline.h), NAN when the sensor had none. When
+// present they replace the absolute HR and HRV ranges: "high" ramps in
+// from 1 to 2 standard deviations above the athlete's own mean.
+struct StressInputs
+{
+  float heartRate;  // bpm
+  float sleepScore; // 1 (poor) to 5 (good)
+  bool hadCoffee;
+  float spo2; // %
+  float hrv;  // session RMSSD, ms
+  float sbp, dbp;
+  float hrZ, hrvZ;
+};
+
+float fuzzyStressScore(const StressInputs &in);
+
+#endif
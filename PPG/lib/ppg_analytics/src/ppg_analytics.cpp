@@ -0,0 +1,487 @@
+#include "ppg_analytics.h"
+
+#include <math.h>
+#include <new>
+#include <string.h>
+
+#include "competition_trends.h"
+#include "fuzzy_stress.h"
+#include "rolling_series.h"
+#include "session_cache.h"
+#include "session_finaliser.h"
+#include "trend_store.h"
+#include "write_behind.h"
+
+struct PpgSession
+{
+  TrendAccumulator means;
+};
+
+struct PpgSeries
+{
+  PpgSeries(RollingSeries::Slot *slots, float *points, uint32_t capacity, float emaAlpha)
+      : window(slots, capacity, emaAlpha), slots(slots), points(points)
+  {
+  }
+
+  ~PpgSeries()
+  {
+    delete[] slots;
+    delete[] points;
+  }
+
+  RollingSeries window;
+  RollingSeries::Slot *slots;
+  float *points;
+};
+
+struct PpgWriteBehind
+{
+  WriteBehind buffer;
+};
+
+struct PpgSessionCache
+{
+  SessionCache cache;
+  std::string text;
+  std::vector<float> readings;
+
+  bool has(uint32_t index) const { return index < cache.size(); }
+};
+
+struct PpgFinaliser
+{
+  SessionFinaliser finaliser;
+  std::string json;
+};
+
+struct PpgTrends
+{
+  CompetitionTrends trends;
+  std::string json;
+};
+
+uint32_t ppg_analytics_abi_version(void)
+{
+  return PPG_ANALYTICS_ABI_VERSION;
+}
+
+PpgSession *ppg_session_new(void)
+{
+  return new (std::nothrow) PpgSession;
+}
+
+void ppg_session_free(PpgSession *session)
+{
+  delete session;
+}
+
+void ppg_session_reset(PpgSession *session)
+{
+  session->means.reset();
+}
+
+void ppg_session_add_heart(PpgSession *session, float heartRate, float spo2, float sbp, float dbp)
+{
+  session->means.addHeart(heartRate, spo2, sbp, dbp);
+}
+
+void ppg_session_add_hrv(PpgSession *session, float rmssd, float sdnn, float stressZ)
+{
+  session->means.addHrv(rmssd, sdnn, stressZ);
+}
+
+float ppg_session_mean(const PpgSession *session, int32_t field)
+{
+  if (field < 0 || field >= PPG_FIELD_COUNT)
+    return NAN;
+  TrendRecord r;
+  session->means.result(r);
+  const float values[PPG_FIELD_COUNT] = {r.heartRate, r.rmssd, r.sdnn, r.spo2, r.sbp, r.dbp, r.stress};
+  return values[field];
+}
+
+PpgSeries *ppg_series_new(uint32_t capacity, float emaAlpha)
+{
+  if (capacity == 0 || !(emaAlpha > 0 && emaAlpha <= 1))
+    return nullptr;
+  RollingSeries::Slot *slots = new (std::nothrow) RollingSeries::Slot[capacity];
+  float *points = new (std::nothrow) float[2 * (size_t)capacity];
+  PpgSeries *series = slots && points ? new (std::nothrow) PpgSeries(slots, points, capacity, emaAlpha) : nullptr;
+  if (!series)
+  {
+    delete[] slots;
+    delete[] points;
+  }
+  return series;
+}
+
+void ppg_series_free(PpgSeries *series)
+{
+  delete series;
+}
+
+void ppg_series_reset(PpgSeries *series)
+{
+  series->window.reset();
+}
+
+void ppg_series_push(PpgSeries *series, uint32_t x, float value)
+{
+  series->window.push(x, value);
+}
+
+uint32_t ppg_series_size(const PpgSeries *series)
+{
+  return series->window.size();
+}
+
+float ppg_series_stat(const PpgSeries *series, int32_t stat)
+{
+  const RollingSeries &w = series->window;
+  switch (stat)
+  {
+  case PPG_STAT_MEAN:
+    return w.mean();
+  case PPG_STAT_MIN:
+    return w.min();
+  case PPG_STAT_MAX:
+    return w.max();
+  case PPG_STAT_LAST:
+    return w.last();
+  case PPG_STAT_EMA:
+    return w.ema();
+  default:
+    return NAN;
+  }
+}
+
+uint32_t ppg_series_decimate(PpgSeries *series, uint32_t maxPoints)
+{
+  uint32_t cap = series->window.capacity();
+  return series->window.decimate(maxPoints < cap ? maxPoints : cap, series->points);
+}
+
+const float *ppg_series_points(const PpgSeries *series)
+{
+  return series->points;
+}
+
+PpgWriteBehind *ppg_wb_open(const char *journalPath, uint32_t writerId, uint32_t flushIntervalMs,
+                            uint32_t maxBatchBytes)
+{
+  PpgWriteBehind *wb = new (std::nothrow) PpgWriteBehind;
+  if (wb && !wb->buffer.open(journalPath, writerId, flushIntervalMs, maxBatchBytes))
+  {
+    delete wb;
+    return nullptr;
+  }
+  return wb;
+}
+
+void ppg_wb_close(PpgWriteBehind *wb)
+{
+  delete wb;
+}
+
+int32_t ppg_wb_append(PpgWriteBehind *wb, const char *path, const char *json, int64_t nowMs)
+{
+  return wb->buffer.append(path, json, nowMs) ? 1 : 0;
+}
+
+void ppg_wb_flush_soon(PpgWriteBehind *wb)
+{
+  wb->buffer.flushSoon();
+}
+
+int32_t ppg_wb_due(const PpgWriteBehind *wb, int64_t nowMs)
+{
+  return wb->buffer.due(nowMs) ? 1 : 0;
+}
+
+uint32_t ppg_wb_take_batch(PpgWriteBehind *wb, int64_t nowMs)
+{
+  return (uint32_t)wb->buffer.takeBatch(nowMs).size();
+}
+
+const char *ppg_wb_batch_body(const PpgWriteBehind *wb)
+{
+  return wb->buffer.lastBatch().c_str();
+}
+
+const char *ppg_wb_batch_path(const PpgWriteBehind *wb)
+{
+  return wb->buffer.batchPath().c_str();
+}
+
+void ppg_wb_ack(PpgWriteBehind *wb, int32_t ok, int64_t nowMs)
+{
+  wb->buffer.ack(ok != 0, nowMs);
+}
+
+uint32_t ppg_wb_pending(const PpgWriteBehind *wb)
+{
+  return (uint32_t)wb->buffer.pending();
+}
+
+uint64_t ppg_wb_stat(const PpgWriteBehind *wb, int32_t stat)
+{
+  const WriteBehind::Stats &s = wb->buffer.stats();
+  switch (stat)
+  {
+  case PPG_WB_APPENDED:
+    return s.appended;
+  case PPG_WB_SENT:
+    return s.sent;
+  case PPG_WB_BATCHES:
+    return s.batches;
+  case PPG_WB_FAILURES:
+    return s.failures;
+  case PPG_WB_BODY_BYTES:
+    return s.bodyBytes;
+  default:
+    return 0;
+  }
+}
+
+PpgSessionCache *ppg_cache_open(const char *dir)
+{
+  PpgSessionCache *c = new (std::nothrow) PpgSessionCache;
+  if (c && !c->cache.open(dir))
+  {
+    delete c;
+    return nullptr;
+  }
+  return c;
+}
+
+void ppg_cache_close(PpgSessionCache *cache)
+{
+  delete cache;
+}
+
+int64_t ppg_cache_watermark(const PpgSessionCache *cache)
+{
+  return cache->cache.watermark();
+}
+
+void ppg_cache_set_watermark(PpgSessionCache *cache, int64_t ms)
+{
+  cache->cache.setWatermark(ms);
+}
+
+uint32_t ppg_cache_size(const PpgSessionCache *cache)
+{
+  return (uint32_t)cache->cache.size();
+}
+
+int32_t ppg_cache_find(const PpgSessionCache *cache, const char *sessionId)
+{
+  return cache->cache.find(sessionId);
+}
+
+int32_t ppg_cache_upsert(PpgSessionCache *cache, const char *sessionId, int64_t modifiedMs)
+{
+  return cache->cache.upsert(sessionId, modifiedMs);
+}
+
+const char *ppg_cache_session_id(const PpgSessionCache *cache, uint32_t index)
+{
+  return cache->has(index) ? cache->cache.summary(index).sessionId : "";
+}
+
+const char *ppg_cache_last_key(const PpgSessionCache *cache, uint32_t index)
+{
+  return cache->has(index) ? cache->cache.summary(index).lastKey : "";
+}
+
+int64_t ppg_cache_modified(const PpgSessionCache *cache, uint32_t index)
+{
+  return cache->has(index) ? cache->cache.summary(index).modifiedMs : 0;
+}
+
+uint32_t ppg_cache_reading_count(const PpgSessionCache *cache, uint32_t index)
+{
+  return cache->has(index) ? cache->cache.summary(index).readings : 0;
+}
+
+int32_t ppg_cache_ended(const PpgSessionCache *cache, uint32_t index)
+{
+  return cache->has(index) && (cache->cache.summary(index).flags & SessionCache::ENDED) ? 1 : 0;
+}
+
+float ppg_cache_stat(const PpgSessionCache *cache, uint32_t index, int32_t stat)
+{
+  if (!cache->has(index) || stat < 0 || stat >= PPG_CACHE_STAT_COUNT)
+    return NAN;
+  return cache->cache.stat(index, (SessionCache::Stat)stat);
+}
+
+int32_t ppg_cache_add_reading(PpgSessionCache *cache, uint32_t index, const char *key, float heartRate, float spo2,
+                              float sbp, float dbp)
+{
+  SessionCache::Reading r = {heartRate, spo2, sbp, dbp};
+  return cache->has(index) && cache->cache.addReading(index, key, r) ? 1 : 0;
+}
+
+void ppg_cache_set_session(PpgSessionCache *cache, uint32_t index, float hrv, float stressScore, int32_t ended)
+{
+  if (cache->has(index))
+    cache->cache.setSession(index, hrv, stressScore, ended != 0);
+}
+
+int32_t ppg_cache_set_meta(PpgSessionCache *cache, uint32_t index, const char *json)
+{
+  return cache->has(index) && cache->cache.setMeta(index, json) ? 1 : 0;
+}
+
+const char *ppg_cache_meta(PpgSessionCache *cache, uint32_t index)
+{
+  if (!cache->has(index) || !cache->cache.readMeta(index, cache->text))
+    return nullptr;
+  return cache->text.c_str();
+}
+
+int32_t ppg_cache_set_finalised(PpgSessionCache *cache, uint32_t index, const char *json)
+{
+  return cache->has(index) && cache->cache.setFinalised(index, json) ? 1 : 0;
+}
+
+const char *ppg_cache_finalised(PpgSessionCache *cache, uint32_t index)
+{
+  if (!cache->has(index) || !cache->cache.readFinalised(index, cache->text))
+    return nullptr;
+  return cache->text.c_str();
+}
+
+uint32_t ppg_cache_load_readings(PpgSessionCache *cache, uint32_t index)
+{
+  cache->readings.clear();
+  std::vector<SessionCache::Reading> rows;
+  if (!cache->has(index))
+    return 0;
+  cache->cache.readReadings(index, rows);
+  cache->readings.reserve(4 * rows.size());
+  for (size_t i = 0; i < rows.size(); i++)
+  {
+    cache->readings.push_back(rows[i].heartRate);
+    cache->readings.push_back(rows[i].spo2);
+    cache->readings.push_back(rows[i].sbp);
+    cache->readings.push_back(rows[i].dbp);
+  }
+  return (uint32_t)rows.size();
+}
+
+const float *ppg_cache_readings(const PpgSessionCache *cache)
+{
+  return cache->readings.empty() ? nullptr : &cache->readings[0];
+}
+
+int32_t ppg_cache_commit(PpgSessionCache *cache)
+{
+  return cache->cache.commit() ? 1 : 0;
+}
+
+PpgFinaliser *ppg_finaliser_new(void)
+{
+  return new (std::nothrow) PpgFinaliser;
+}
+
+void ppg_finaliser_free(PpgFinaliser *finaliser)
+{
+  delete finaliser;
+}
+
+void ppg_finaliser_reset(PpgFinaliser *finaliser)
+{
+  finaliser->finaliser.reset();
+  finaliser->json.clear();
+}
+
+void ppg_finaliser_add(PpgFinaliser *finaliser, float heartRate, float spo2, float sbp, float dbp)
+{
+  finaliser->finaliser.add(heartRate, spo2, sbp, dbp);
+}
+
+uint32_t ppg_finaliser_size(const PpgFinaliser *finaliser)
+{
+  return (uint32_t)finaliser->finaliser.size();
+}
+
+uint32_t ppg_finaliser_finish(PpgFinaliser *finaliser)
+{
+  finaliser->finaliser.finish(finaliser->json);
+  return (uint32_t)finaliser->json.size();
+}
+
+const char *ppg_finaliser_json(const PpgFinaliser *finaliser)
+{
+  return finaliser->json.c_str();
+}
+
+PpgTrends *ppg_trends_new(void)
+{
+  return new (std::nothrow) PpgTrends;
+}
+
+void ppg_trends_free(PpgTrends *trends)
+{
+  delete trends;
+}
+
+void ppg_trends_reset(PpgTrends *trends)
+{
+  trends->trends.reset();
+  trends->json.clear();
+}
+
+int32_t ppg_trends_add_session(PpgTrends *trends, int32_t day, float hrv, float heartRate, float sbp, float dbp,
+                               float sleepQuality, float hadCoffee, float stressLevel, float daysPreCompetition)
+{
+  CompetitionTrends::Session s = {day,
+                                  {hrv, heartRate, sbp, dbp},
+                                  {sleepQuality, hadCoffee, stressLevel, daysPreCompetition}};
+  return trends->trends.addSession(s) ? 1 : 0;
+}
+
+uint32_t ppg_trends_sessions(const PpgTrends *trends)
+{
+  return trends->trends.sessions();
+}
+
+uint32_t ppg_trends_state_size(void)
+{
+  return (uint32_t)sizeof(CompetitionTrends::State);
+}
+
+const uint8_t *ppg_trends_state(const PpgTrends *trends)
+{
+  return (const uint8_t *)&trends->trends.state();
+}
+
+int32_t ppg_trends_restore(PpgTrends *trends, const uint8_t *state, uint32_t size)
+{
+  if (size != sizeof(CompetitionTrends::State))
+    return 0;
+  CompetitionTrends::State s;
+  memcpy(&s, state, sizeof(s));
+  return trends->trends.restore(s) ? 1 : 0;
+}
+
+uint32_t ppg_trends_report(PpgTrends *trends)
+{
+  trends->trends.toJson(trends->json);
+  return (uint32_t)trends->json.size();
+}
+
+const char *ppg_trends_json(const PpgTrends *trends)
+{
+  return trends->json.c_str();
+}
+
+float ppg_stress_score(float heartRate, float sleepScore, int32_t hadCoffee, float spo2, float hrv, float sbp,
+                       float dbp, float hrZ, float hrvZ)
+{
+  StressInputs in = {heartRate, sleepScore, hadCoffee != 0, spo2, hrv, sbp, dbp, hrZ, hrvZ};
+  return fuzzyStressScore(in);
+}
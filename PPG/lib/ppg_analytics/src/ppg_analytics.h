@@ -0,0 +1,238 @@
+#ifndef PPG_ANALYTICS_H
+#define PPG_ANALYTICS_H
+
+#include <stdint.h>
+
+// C ABI over the analytics the app shares with the firmware, for dart:ffi
+// (app/lib/native/ppg_core.dart) and anything else that cannot link C++.
+// Built as libppg_core.so by the Linux desktop runner (app/linux), from
+// this library and the parts of lib/ppg_core it uses. The modules in this
+// directory are the app's own and never built for the ESP32.
+//
+// Stable: functions are only ever added. A change to an existing
+// signature or meaning bumps PPG_ANALYTICS_ABI_VERSION, which the binding
+// checks before using the library. Values are float, NAN where nothing
+// was measured; handles are opaque and owned by the caller.
+#define PPG_ANALYTICS_ABI_VERSION 2
+
+#if defined(_WIN32)
+#define PPG_ANALYTICS_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define PPG_ANALYTICS_API __attribute__((visibility("default")))
+#else
+#define PPG_ANALYTICS_API
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  // Session means, as the sensor keeps them for its session trend record
+  // (TrendAccumulator, trend_store.h). Adding is O(1); readings of 0 count
+  // as "not measured yet", as the sensor's pipeline reports them.
+  enum
+  {
+    PPG_FIELD_HEART_RATE = 0,
+    PPG_FIELD_RMSSD = 1,
+    PPG_FIELD_SDNN = 2,
+    PPG_FIELD_SPO2 = 3,
+    PPG_FIELD_SBP = 4,
+    PPG_FIELD_DBP = 5,
+    PPG_FIELD_STRESS_Z = 6,
+    PPG_FIELD_COUNT = 7
+  };
+
+  typedef struct PpgSession PpgSession;
+
+  PPG_ANALYTICS_API uint32_t ppg_analytics_abi_version(void);
+
+  // Returns NULL if out of memory
+  PPG_ANALYTICS_API PpgSession *ppg_session_new(void);
+  PPG_ANALYTICS_API void ppg_session_free(PpgSession *session);
+  PPG_ANALYTICS_API void ppg_session_reset(PpgSession *session);
+  PPG_ANALYTICS_API void ppg_session_add_heart(PpgSession *session, float heartRate, float spo2, float sbp,
+                                               float dbp);
+  // stressZ is the window's baseline stress z, NAN without a baseline
+  PPG_ANALYTICS_API void ppg_session_add_hrv(PpgSession *session, float rmssd, float sdnn, float stressZ);
+  // NAN for an unknown field or one never measured
+  PPG_ANALYTICS_API float ppg_session_mean(const PpgSession *session, int32_t field);
+
+  // A live chart series: the last `capacity` points with running window
+  // statistics (rolling_series.h). Pushing is O(1); NAN values are
+  // dropped. The EMA covers every point since the last reset.
+  enum
+  {
+    PPG_STAT_MEAN = 0,
+    PPG_STAT_MIN = 1,
+    PPG_STAT_MAX = 2,
+    PPG_STAT_LAST = 3,
+    PPG_STAT_EMA = 4,
+    PPG_STAT_COUNT = 5
+  };
+
+  typedef struct PpgSeries PpgSeries;
+
+  // Returns NULL if capacity is 0, emaAlpha is outside (0, 1] or out of
+  // memory
+  PPG_ANALYTICS_API PpgSeries *ppg_series_new(uint32_t capacity, float emaAlpha);
+  PPG_ANALYTICS_API void ppg_series_free(PpgSeries *series);
+  PPG_ANALYTICS_API void ppg_series_reset(PpgSeries *series);
+  PPG_ANALYTICS_API void ppg_series_push(PpgSeries *series, uint32_t x, float value);
+  PPG_ANALYTICS_API uint32_t ppg_series_size(const PpgSeries *series);
+  // NAN for an unknown statistic or an empty series
+  PPG_ANALYTICS_API float ppg_series_stat(const PpgSeries *series, int32_t stat);
+  // Decimates the window to at most maxPoints points (min and max per
+  // bucket, the newest point alone for a maxPoints of 1) into the series'
+  // own buffer, as interleaved x, y floats.
+  // Returns the point count; ppg_series_points stays valid until the next
+  // call on the series.
+  PPG_ANALYTICS_API uint32_t ppg_series_decimate(PpgSeries *series, uint32_t maxPoints);
+  PPG_ANALYTICS_API const float *ppg_series_points(const PpgSeries *series);
+
+  // Write-behind buffer for cloud writes of live readings, journalled to
+  // a local file (write_behind.h). The caller sends each batch body as one
+  // update of the batch's path and reports the outcome.
+  enum
+  {
+    PPG_WB_APPENDED = 0,
+    PPG_WB_SENT = 1,
+    PPG_WB_BATCHES = 2,
+    PPG_WB_FAILURES = 3,
+    PPG_WB_BODY_BYTES = 4,
+    PPG_WB_STAT_COUNT = 5
+  };
+
+  typedef struct PpgWriteBehind PpgWriteBehind;
+
+  // Returns NULL if the journal cannot be created or out of memory
+  PPG_ANALYTICS_API PpgWriteBehind *ppg_wb_open(const char *journalPath, uint32_t writerId, uint32_t flushIntervalMs,
+                                                uint32_t maxBatchBytes);
+  PPG_ANALYTICS_API void ppg_wb_close(PpgWriteBehind *wb);
+  // path is the readings node, json one reading's object (UTF-8). Returns
+  // 0 if the reading was not kept.
+  PPG_ANALYTICS_API int32_t ppg_wb_append(PpgWriteBehind *wb, const char *path, const char *json, int64_t nowMs);
+  PPG_ANALYTICS_API void ppg_wb_flush_soon(PpgWriteBehind *wb);
+  PPG_ANALYTICS_API int32_t ppg_wb_due(const PpgWriteBehind *wb, int64_t nowMs);
+  // Takes the next batch, skipping paths still backing off after a failed
+  // batch; returns its body length, 0 if there is none. Body and path stay
+  // valid until the next call on wb.
+  PPG_ANALYTICS_API uint32_t ppg_wb_take_batch(PpgWriteBehind *wb, int64_t nowMs);
+  PPG_ANALYTICS_API const char *ppg_wb_batch_body(const PpgWriteBehind *wb);
+  PPG_ANALYTICS_API const char *ppg_wb_batch_path(const PpgWriteBehind *wb);
+  PPG_ANALYTICS_API void ppg_wb_ack(PpgWriteBehind *wb, int32_t ok, int64_t nowMs);
+  PPG_ANALYTICS_API uint32_t ppg_wb_pending(const PpgWriteBehind *wb);
+  // 0 for an unknown statistic
+  PPG_ANALYTICS_API uint64_t ppg_wb_stat(const PpgWriteBehind *wb, int32_t stat);
+
+  // Local cache of an athlete's sessions for the history page, synced by
+  // delta from the database (session_cache.h). Sessions are indexed
+  // 0..size-1 in id order; an upsert can shift the ones after it. Out of
+  // range indices give 0, NAN or empty strings.
+  enum
+  {
+    PPG_CACHE_MEAN_HEART_RATE = 0,
+    PPG_CACHE_MEAN_SPO2 = 1,
+    PPG_CACHE_MEAN_SBP = 2,
+    PPG_CACHE_MEAN_DBP = 3,
+    PPG_CACHE_MIN_HEART_RATE = 4,
+    PPG_CACHE_MAX_HEART_RATE = 5,
+    PPG_CACHE_HRV = 6,
+    PPG_CACHE_STRESS_SCORE = 7,
+    PPG_CACHE_STAT_COUNT = 8
+  };
+
+  typedef struct PpgSessionCache PpgSessionCache;
+
+  // dir must exist. Returns NULL if its index cannot be created or out of
+  // memory.
+  PPG_ANALYTICS_API PpgSessionCache *ppg_cache_open(const char *dir);
+  PPG_ANALYTICS_API void ppg_cache_close(PpgSessionCache *cache);
+  PPG_ANALYTICS_API int64_t ppg_cache_watermark(const PpgSessionCache *cache);
+  // Only ever raises it
+  PPG_ANALYTICS_API void ppg_cache_set_watermark(PpgSessionCache *cache, int64_t ms);
+  PPG_ANALYTICS_API uint32_t ppg_cache_size(const PpgSessionCache *cache);
+  // -1 if not cached
+  PPG_ANALYTICS_API int32_t ppg_cache_find(const PpgSessionCache *cache, const char *sessionId);
+  // Adds the session if new; -1 for an id that cannot be cached
+  PPG_ANALYTICS_API int32_t ppg_cache_upsert(PpgSessionCache *cache, const char *sessionId, int64_t modifiedMs);
+  PPG_ANALYTICS_API const char *ppg_cache_session_id(const PpgSessionCache *cache, uint32_t index);
+  // Key of the newest cached reading, where the next sync resumes
+  PPG_ANALYTICS_API const char *ppg_cache_last_key(const PpgSessionCache *cache, uint32_t index);
+  PPG_ANALYTICS_API int64_t ppg_cache_modified(const PpgSessionCache *cache, uint32_t index);
+  PPG_ANALYTICS_API uint32_t ppg_cache_reading_count(const PpgSessionCache *cache, uint32_t index);
+  PPG_ANALYTICS_API int32_t ppg_cache_ended(const PpgSessionCache *cache, uint32_t index);
+  PPG_ANALYTICS_API float ppg_cache_stat(const PpgSessionCache *cache, uint32_t index, int32_t stat);
+  // Readings in key order; returns 0 for a repeated key or a write error
+  PPG_ANALYTICS_API int32_t ppg_cache_add_reading(PpgSessionCache *cache, uint32_t index, const char *key,
+                                                  float heartRate, float spo2, float sbp, float dbp);
+  // NAN leaves hrv or stressScore unchanged
+  PPG_ANALYTICS_API void ppg_cache_set_session(PpgSessionCache *cache, uint32_t index, float hrv, float stressScore,
+                                               int32_t ended);
+  PPG_ANALYTICS_API int32_t ppg_cache_set_meta(PpgSessionCache *cache, uint32_t index, const char *json);
+  // NULL if the session has none; valid until the next call on cache
+  PPG_ANALYTICS_API const char *ppg_cache_meta(PpgSessionCache *cache, uint32_t index);
+  // The session's finalised stats and charts (ppg_finaliser_finish), as
+  // stored with the session; NULL if it has none yet
+  PPG_ANALYTICS_API int32_t ppg_cache_set_finalised(PpgSessionCache *cache, uint32_t index, const char *json);
+  PPG_ANALYTICS_API const char *ppg_cache_finalised(PpgSessionCache *cache, uint32_t index);
+  // Reads the session's readings into the cache's buffer as heart rate,
+  // SpO2, SBP, DBP floats per reading. Returns the reading count;
+  // ppg_cache_readings stays valid until the next call on cache.
+  PPG_ANALYTICS_API uint32_t ppg_cache_load_readings(PpgSessionCache *cache, uint32_t index);
+  PPG_ANALYTICS_API const float *ppg_cache_readings(const PpgSessionCache *cache);
+  // Writes what changed to disk; 0 on failure
+  PPG_ANALYTICS_API int32_t ppg_cache_commit(PpgSessionCache *cache);
+
+  // Session finaliser, run at STOP (session_finaliser.h): summary stats and
+  // LTTB-downsampled charts of the session's readings, as JSON
+  typedef struct PpgFinaliser PpgFinaliser;
+
+  // Returns NULL if out of memory
+  PPG_ANALYTICS_API PpgFinaliser *ppg_finaliser_new(void);
+  PPG_ANALYTICS_API void ppg_finaliser_free(PpgFinaliser *finaliser);
+  PPG_ANALYTICS_API void ppg_finaliser_reset(PpgFinaliser *finaliser);
+  // One reading, in session order; 0 where not measured
+  PPG_ANALYTICS_API void ppg_finaliser_add(PpgFinaliser *finaliser, float heartRate, float spo2, float sbp, float dbp);
+  PPG_ANALYTICS_API uint32_t ppg_finaliser_size(const PpgFinaliser *finaliser);
+  // Builds the summary; returns its length. ppg_finaliser_json stays valid
+  // until the next call on finaliser.
+  PPG_ANALYTICS_API uint32_t ppg_finaliser_finish(PpgFinaliser *finaliser);
+  PPG_ANALYTICS_API const char *ppg_finaliser_json(const PpgFinaliser *finaliser);
+
+  // Pre-competition trends of one athlete across days, updated as each
+  // session closes (competition_trends.h)
+  typedef struct PpgTrends PpgTrends;
+
+  // Returns NULL if out of memory
+  PPG_ANALYTICS_API PpgTrends *ppg_trends_new(void);
+  PPG_ANALYTICS_API void ppg_trends_free(PpgTrends *trends);
+  PPG_ANALYTICS_API void ppg_trends_reset(PpgTrends *trends);
+  // A closed session: its day number, HRV, mean heart rate, SBP and DBP (0
+  // where not measured), and the questionnaire's sleep quality, coffee (0
+  // or 1), stress level and days before competition (NAN if not
+  // answered). Returns 0, learning nothing, for a day before the last one.
+  PPG_ANALYTICS_API int32_t ppg_trends_add_session(PpgTrends *trends, int32_t day, float hrv, float heartRate,
+                                                   float sbp, float dbp, float sleepQuality, float hadCoffee,
+                                                   float stressLevel, float daysPreCompetition);
+  PPG_ANALYTICS_API uint32_t ppg_trends_sessions(const PpgTrends *trends);
+  // The state to persist between runs, ppg_trends_state_size() bytes
+  PPG_ANALYTICS_API uint32_t ppg_trends_state_size(void);
+  PPG_ANALYTICS_API const uint8_t *ppg_trends_state(const PpgTrends *trends);
+  // Returns 0, leaving the trends unchanged, for a state of another size
+  // or version
+  PPG_ANALYTICS_API int32_t ppg_trends_restore(PpgTrends *trends, const uint8_t *state, uint32_t size);
+  // Builds the trends as JSON (CompetitionTrends::toJson); returns its
+  // length. ppg_trends_json stays valid until the next call on trends.
+  PPG_ANALYTICS_API uint32_t ppg_trends_report(PpgTrends *trends);
+  PPG_ANALYTICS_API const char *ppg_trends_json(const PpgTrends *trends);
+
+  // fuzzy_stress.h; hrZ and hrvZ NAN when the sensor had no baseline
+  PPG_ANALYTICS_API float ppg_stress_score(float heartRate, float sleepScore, int32_t hadCoffee, float spo2,
+                                           float hrv, float sbp, float dbp, float hrZ, float hrvZ);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,139 @@
+#include "rolling_series.h"
+
+#include <math.h>
+
+RollingSeries::RollingSeries(Slot *slots, uint32_t capacity, float emaAlpha)
+    : slots(slots), cap(capacity), alpha(emaAlpha)
+{
+  reset();
+}
+
+void RollingSeries::reset()
+{
+  total = count = sinceResum = 0;
+  sum = 0;
+  smoothed = NAN;
+  minHead = minCount = maxHead = maxCount = 0;
+}
+
+void RollingSeries::push(uint32_t x, float value)
+{
+  if (isnan(value) || cap == 0)
+    return;
+  if (count == cap)
+  {
+    uint32_t oldest = total - cap;
+    sum -= valueAt(oldest);
+    if (minCount > 0 && slots[minHead % cap].minQueue == oldest)
+    {
+      minHead++;
+      minCount--;
+    }
+    if (maxCount > 0 && slots[maxHead % cap].maxQueue == oldest)
+    {
+      maxHead++;
+      maxCount--;
+    }
+    count--;
+  }
+
+  Slot &slot = slots[total % cap];
+  slot.x = x;
+  slot.value = value;
+  sum += value;
+  count++;
+
+  // Later points that are no larger (smaller) make earlier ones useless
+  while (minCount > 0 && valueAt(slots[(minHead + minCount - 1) % cap].minQueue) >= value)
+    minCount--;
+  slots[(minHead + minCount++) % cap].minQueue = total;
+  while (maxCount > 0 && valueAt(slots[(maxHead + maxCount - 1) % cap].maxQueue) <= value)
+    maxCount--;
+  slots[(maxHead + maxCount++) % cap].maxQueue = total;
+  total++;
+
+  smoothed = isnan(smoothed) ? value : smoothed + alpha * (value - smoothed);
+  if (++sinceResum >= cap)
+    resum();
+}
+
+void RollingSeries::resum()
+{
+  sum = 0;
+  for (uint32_t seq = total - count; seq != total; seq++)
+    sum += valueAt(seq);
+  sinceResum = 0;
+}
+
+float RollingSeries::mean() const
+{
+  return count > 0 ? (float)(sum / count) : NAN;
+}
+
+float RollingSeries::min() const
+{
+  return minCount > 0 ? valueAt(slots[minHead % cap].minQueue) : NAN;
+}
+
+float RollingSeries::max() const
+{
+  return maxCount > 0 ? valueAt(slots[maxHead % cap].maxQueue) : NAN;
+}
+
+float RollingSeries::last() const
+{
+  return count > 0 ? valueAt(total - 1) : NAN;
+}
+
+float RollingSeries::ema() const
+{
+  return smoothed;
+}
+
+uint32_t RollingSeries::decimate(uint32_t maxPoints, float *out) const
+{
+  uint32_t first = total - count;
+  uint32_t n = 0;
+  if (count <= maxPoints)
+  {
+    for (uint32_t seq = first; seq != total; seq++, n++)
+    {
+      out[2 * n] = (float)slots[seq % cap].x;
+      out[2 * n + 1] = valueAt(seq);
+    }
+    return n;
+  }
+  if (maxPoints < 2)
+  {
+    // No room for a bucket's min and max: the newest point, as the chart
+    // ends on it
+    if (maxPoints == 1)
+    {
+      out[0] = (float)slots[(total - 1) % cap].x;
+      out[1] = valueAt(total - 1);
+      n = 1;
+    }
+    return n;
+  }
+  uint32_t buckets = maxPoints / 2;
+  for (uint32_t b = 0; b < buckets; b++)
+  {
+    uint32_t from = first + (uint32_t)((uint64_t)count * b / buckets);
+    uint32_t to = first + (uint32_t)((uint64_t)count * (b + 1) / buckets);
+    uint32_t lo = from, hi = from;
+    for (uint32_t seq = from + 1; seq != to; seq++)
+    {
+      if (valueAt(seq) < valueAt(lo))
+        lo = seq;
+      if (valueAt(seq) > valueAt(hi))
+        hi = seq;
+    }
+    uint32_t pair[2] = {lo - first < hi - first ? lo : hi, lo - first < hi - first ? hi : lo};
+    for (int i = 0; i < (lo == hi ? 1 : 2); i++, n++)
+    {
+      out[2 * n] = (float)slots[pair[i] % cap].x;
+      out[2 * n + 1] = valueAt(pair[i]);
+    }
+  }
+  return n;
+}
@@ -0,0 +1,61 @@
+#ifndef PPG_ROLLING_SERIES_H
+#define PPG_ROLLING_SERIES_H
+
+#include <stdint.h>
+
+// The last `capacity` points of one live series (a chart's window), with
+// its mean, min, max, last value and an EMA kept up to date as points
+// arrive, so adding a point costs O(1) (amortised, for min and max)
+// however often the statistics are read. Min and max come from monotonic
+// queues of the window's points; the running sum is recomputed from the
+// window once per `capacity` points so rounding cannot build up.
+//
+// The caller provides the slots, which keeps the class allocation-free.
+// x is the caller's time axis (a tick count); NAN values are not points.
+class RollingSeries
+{
+public:
+  struct Slot
+  {
+    uint32_t x;
+    float value;
+    uint32_t minQueue, maxQueue; // queue rings, indexed like the slots
+  };
+
+  RollingSeries(Slot *slots, uint32_t capacity, float emaAlpha);
+
+  void reset();
+  void push(uint32_t x, float value);
+
+  uint32_t size() const { return count; }
+  uint32_t capacity() const { return cap; }
+  // NAN while empty
+  float mean() const;
+  float min() const;
+  float max() const;
+  float last() const;
+  // Over every point since reset, not just the window
+  float ema() const;
+
+  // At most maxPoints (x, y) pairs in time order, interleaved in out. A
+  // window longer than that is cut into maxPoints / 2 buckets and each
+  // gives its min and max, so peaks survive; with room for one point it
+  // gives the newest. Returns the pairs written.
+  uint32_t decimate(uint32_t maxPoints, float *out) const;
+
+private:
+  float valueAt(uint32_t seq) const { return slots[seq % cap].value; }
+  void resum();
+
+  Slot *slots;
+  uint32_t cap;
+  float alpha;
+  uint32_t total; // points pushed since reset; the window is [total - count, total)
+  uint32_t count;
+  uint32_t sinceResum;
+  double sum;
+  float smoothed;
+  uint32_t minHead, minCount, maxHead, maxCount;
+};
+
+#endif
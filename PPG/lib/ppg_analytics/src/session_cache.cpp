@@ -0,0 +1,492 @@
+#include "session_cache.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "crc16.h"
+
+namespace
+{
+  const char MAGIC[4] = {'P', 'S', 'C', '1'};
+  const size_t HEADER_SIZE = 16;
+  const char *INDEX_NAME = "sessions.idx";
+
+  void put16(uint8_t *p, uint16_t v)
+  {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+  }
+
+  void put32(uint8_t *p, uint32_t v)
+  {
+    for (int i = 0; i < 4; i++)
+      p[i] = (v >> (8 * i)) & 0xFF;
+  }
+
+  void put64(uint8_t *p, uint64_t v)
+  {
+    put32(p, (uint32_t)v);
+    put32(p + 4, (uint32_t)(v >> 32));
+  }
+
+  uint16_t get16(const uint8_t *p)
+  {
+    return p[0] | p[1] << 8;
+  }
+
+  uint32_t get32(const uint8_t *p)
+  {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+  }
+
+  uint64_t get64(const uint8_t *p)
+  {
+    return get32(p) | (uint64_t)get32(p + 4) << 32;
+  }
+
+  void putFloat(uint8_t *p, float v)
+  {
+    uint32_t bits;
+    memcpy(&bits, &v, 4);
+    put32(p, bits);
+  }
+
+  float getFloat(const uint8_t *p)
+  {
+    uint32_t bits = get32(p);
+    float v;
+    memcpy(&v, &bits, 4);
+    return v;
+  }
+
+  void putDouble(uint8_t *p, double v)
+  {
+    uint64_t bits;
+    memcpy(&bits, &v, 8);
+    put64(p, bits);
+  }
+
+  double getDouble(const uint8_t *p)
+  {
+    uint64_t bits = get64(p);
+    double v;
+    memcpy(&v, &bits, 8);
+    return v;
+  }
+
+  uint16_t packTenths(float v)
+  {
+    if (!(v > 0))
+      return 0;
+    return v >= 6553.5f ? 0xFFFF : (uint16_t)lroundf(v * 10);
+  }
+
+  bool validId(const char *id)
+  {
+    size_t n = strlen(id);
+    if (n == 0 || n >= SessionCache::ID_CAPACITY)
+      return false;
+    for (size_t i = 0; i < n; i++)
+    {
+      char c = id[i];
+      if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '-'))
+        return false;
+    }
+    return true;
+  }
+
+  void encodeSummary(const SessionCache::Summary &s, uint8_t *out)
+  {
+    memset(out, 0, SessionCache::SUMMARY_SIZE);
+    memcpy(out, s.sessionId, SessionCache::ID_CAPACITY);
+    memcpy(out + 22, s.lastKey, SessionCache::ID_CAPACITY);
+    put64(out + 44, (uint64_t)s.modifiedMs);
+    put32(out + 52, s.readings);
+    put32(out + 56, s.flags);
+    for (int f = 0; f < 4; f++)
+    {
+      putDouble(out + 60 + 8 * f, s.sums[f]);
+      put32(out + 92 + 4 * f, s.counts[f]);
+    }
+    putFloat(out + 108, s.minHeartRate);
+    putFloat(out + 112, s.maxHeartRate);
+    putFloat(out + 116, s.hrv);
+    putFloat(out + 120, s.stressScore);
+    put16(out + 126, crc16Ccitt(out, SessionCache::SUMMARY_SIZE - 2));
+  }
+
+  bool decodeSummary(const uint8_t *in, SessionCache::Summary &s)
+  {
+    if (crc16Ccitt(in, SessionCache::SUMMARY_SIZE - 2) != get16(in + 126))
+      return false;
+    memcpy(s.sessionId, in, SessionCache::ID_CAPACITY);
+    memcpy(s.lastKey, in + 22, SessionCache::ID_CAPACITY);
+    s.sessionId[SessionCache::ID_CAPACITY - 1] = s.lastKey[SessionCache::ID_CAPACITY - 1] = '\0';
+    s.modifiedMs = (int64_t)get64(in + 44);
+    s.readings = get32(in + 52);
+    s.flags = get32(in + 56);
+    for (int f = 0; f < 4; f++)
+    {
+      s.sums[f] = getDouble(in + 60 + 8 * f);
+      s.counts[f] = get32(in + 92 + 4 * f);
+    }
+    s.minHeartRate = getFloat(in + 108);
+    s.maxHeartRate = getFloat(in + 112);
+    s.hrv = getFloat(in + 116);
+    s.stressScore = getFloat(in + 120);
+    return validId(s.sessionId);
+  }
+}
+
+SessionCache::SessionCache() : opened(false), mark(0), headerDirty(false), reorder(false), readingsFile(nullptr) {}
+
+SessionCache::~SessionCache()
+{
+  close();
+}
+
+bool SessionCache::open(const char *dir)
+{
+  close();
+  dirPath = dir;
+  while (dirPath.size() > 1 && dirPath[dirPath.size() - 1] == '/')
+    dirPath.erase(dirPath.size() - 1);
+  mark = 0;
+  sessions.clear();
+  dirty.clear();
+  headerDirty = reorder = false;
+  if (!loadIndex() && !rewriteIndex())
+    return false;
+  opened = true;
+  return true;
+}
+
+void SessionCache::close()
+{
+  if (readingsFile)
+    fclose(readingsFile);
+  readingsFile = nullptr;
+  readingsFor.clear();
+  opened = false;
+}
+
+std::string SessionCache::filePath(const char *sessionId, const char *suffix) const
+{
+  return dirPath + "/" + sessionId + suffix;
+}
+
+// False if the index is missing or unreadable; a bad summary only cuts
+// it short. The sessions past it are older than the watermark, so it is
+// reset for the next sync to find them, and the next commit rewrites the
+// file rather than leave them behind the ones it writes.
+bool SessionCache::loadIndex()
+{
+  FILE *f = fopen((dirPath + "/" + INDEX_NAME).c_str(), "rb");
+  if (!f)
+    return false;
+  uint8_t buffer[SUMMARY_SIZE];
+  if (fread(buffer, 1, HEADER_SIZE, f) != HEADER_SIZE || memcmp(buffer, MAGIC, 4) != 0 ||
+      crc16Ccitt(buffer, HEADER_SIZE - 2) != get16(buffer + HEADER_SIZE - 2))
+  {
+    fclose(f);
+    return false;
+  }
+  mark = (int64_t)get64(buffer + 4);
+  Summary s;
+  size_t n;
+  bool damaged = false;
+  while ((n = fread(buffer, 1, SUMMARY_SIZE, f)) == SUMMARY_SIZE)
+  {
+    if (!decodeSummary(buffer, s) || (!sessions.empty() && strcmp(sessions.back().sessionId, s.sessionId) >= 0))
+    {
+      damaged = true;
+      break;
+    }
+    sessions.push_back(s);
+  }
+  fclose(f);
+  if (damaged || (n > 0 && n < SUMMARY_SIZE))
+  {
+    mark = 0;
+    reorder = true;
+  }
+  dirty.assign(sessions.size(), false);
+  return true;
+}
+
+bool SessionCache::writeHeader(FILE *f) const
+{
+  uint8_t header[HEADER_SIZE] = {0};
+  memcpy(header, MAGIC, 4);
+  put64(header + 4, (uint64_t)mark);
+  put16(header + HEADER_SIZE - 2, crc16Ccitt(header, HEADER_SIZE - 2));
+  return fseek(f, 0, SEEK_SET) == 0 && fwrite(header, 1, HEADER_SIZE, f) == HEADER_SIZE;
+}
+
+bool SessionCache::writeSummary(FILE *f, size_t i) const
+{
+  uint8_t buffer[SUMMARY_SIZE];
+  encodeSummary(sessions[i], buffer);
+  return fseek(f, (long)(HEADER_SIZE + i * SUMMARY_SIZE), SEEK_SET) == 0 &&
+         fwrite(buffer, 1, SUMMARY_SIZE, f) == SUMMARY_SIZE;
+}
+
+// Whole index into a new file, which then replaces the old one
+bool SessionCache::rewriteIndex()
+{
+  std::string path = dirPath + "/" + INDEX_NAME;
+  std::string tmp = path + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (!f)
+    return false;
+  bool ok = writeHeader(f);
+  for (size_t i = 0; ok && i < sessions.size(); i++)
+    ok = writeSummary(f, i);
+  ok = fflush(f) == 0 && ok;
+  fclose(f);
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+  {
+    remove(tmp.c_str());
+    return false;
+  }
+  dirty.assign(sessions.size(), false);
+  headerDirty = reorder = false;
+  return true;
+}
+
+bool SessionCache::commit()
+{
+  if (!opened)
+    return false;
+  if (readingsFile && fflush(readingsFile) != 0)
+    return false;
+  if (reorder)
+    return rewriteIndex();
+  FILE *f = fopen((dirPath + "/" + INDEX_NAME).c_str(), "r+b");
+  if (!f)
+    return rewriteIndex();
+  bool ok = true;
+  // Summaries first, so a header naming a newer watermark never lands
+  // without the sessions it covers
+  for (size_t i = 0; ok && i < sessions.size(); i++)
+  {
+    if (dirty[i])
+      ok = writeSummary(f, i);
+  }
+  ok = ok && fflush(f) == 0;
+  if (ok && headerDirty)
+    ok = writeHeader(f);
+  ok = fflush(f) == 0 && ok;
+  fclose(f);
+  if (ok)
+  {
+    dirty.assign(sessions.size(), false);
+    headerDirty = false;
+  }
+  return ok;
+}
+
+void SessionCache::setWatermark(int64_t ms)
+{
+  if (ms > mark)
+  {
+    mark = ms;
+    headerDirty = true;
+  }
+}
+
+float SessionCache::stat(size_t i, Stat s) const
+{
+  const Summary &summary = sessions[i];
+  switch (s)
+  {
+  case MEAN_HEART_RATE:
+  case MEAN_SPO2:
+  case MEAN_SBP:
+  case MEAN_DBP:
+    return summary.counts[s] > 0 ? (float)(summary.sums[s] / summary.counts[s]) : NAN;
+  case MIN_HEART_RATE:
+    return summary.minHeartRate;
+  case MAX_HEART_RATE:
+    return summary.maxHeartRate;
+  case HRV:
+    return summary.hrv;
+  case STRESS_SCORE:
+    return summary.stressScore;
+  default:
+    return NAN;
+  }
+}
+
+int SessionCache::find(const char *sessionId) const
+{
+  size_t lo = 0, hi = sessions.size();
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    int c = strcmp(sessions[mid].sessionId, sessionId);
+    if (c == 0)
+      return (int)mid;
+    if (c < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return -1;
+}
+
+int SessionCache::upsert(const char *sessionId, int64_t modifiedMs)
+{
+  if (!opened || !validId(sessionId))
+    return -1;
+  size_t lo = 0, hi = sessions.size();
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (strcmp(sessions[mid].sessionId, sessionId) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < sessions.size() && strcmp(sessions[lo].sessionId, sessionId) == 0)
+  {
+    if (modifiedMs > sessions[lo].modifiedMs)
+    {
+      sessions[lo].modifiedMs = modifiedMs;
+      dirty[lo] = true;
+    }
+    return (int)lo;
+  }
+  Summary s;
+  memset(&s, 0, sizeof(s));
+  strcpy(s.sessionId, sessionId);
+  s.modifiedMs = modifiedMs;
+  s.minHeartRate = s.maxHeartRate = s.hrv = s.stressScore = NAN;
+  // Session ids are start times, so a new one normally goes last
+  if (lo < sessions.size())
+    reorder = true;
+  sessions.insert(sessions.begin() + lo, s);
+  dirty.insert(dirty.begin() + lo, true);
+  return (int)lo;
+}
+
+bool SessionCache::openReadings(size_t i)
+{
+  const char *id = sessions[i].sessionId;
+  if (readingsFile && readingsFor == id)
+    return true;
+  if (readingsFile)
+    fclose(readingsFile);
+  std::string path = filePath(id, ".rd");
+  readingsFile = fopen(path.c_str(), "r+b");
+  if (!readingsFile)
+    readingsFile = fopen(path.c_str(), "w+b");
+  readingsFor = readingsFile ? id : "";
+  return readingsFile != nullptr;
+}
+
+bool SessionCache::addReading(size_t i, const char *key, const Reading &r)
+{
+  Summary &s = sessions[i];
+  if (!validId(key) || (s.lastKey[0] && strcmp(key, s.lastKey) <= 0) || !openReadings(i))
+    return false;
+  uint8_t buffer[READING_SIZE];
+  const float values[4] = {r.heartRate, r.spo2, r.sbp, r.dbp};
+  for (int f = 0; f < 4; f++)
+    put16(buffer + 2 * f, packTenths(values[f]));
+  // At the count, not the end: overwrites anything a crash left uncommitted
+  if (fseek(readingsFile, (long)(s.readings * READING_SIZE), SEEK_SET) != 0 ||
+      fwrite(buffer, 1, READING_SIZE, readingsFile) != READING_SIZE)
+    return false;
+  strcpy(s.lastKey, key);
+  s.readings++;
+  for (int f = 0; f < 4; f++)
+  {
+    if (values[f] > 0)
+    {
+      s.sums[f] += values[f];
+      s.counts[f]++;
+    }
+  }
+  if (r.heartRate > 0)
+  {
+    if (!(r.heartRate >= s.minHeartRate))
+      s.minHeartRate = r.heartRate;
+    if (!(r.heartRate <= s.maxHeartRate))
+      s.maxHeartRate = r.heartRate;
+  }
+  dirty[i] = true;
+  return true;
+}
+
+void SessionCache::setSession(size_t i, float hrv, float stressScore, bool ended)
+{
+  Summary &s = sessions[i];
+  if (!isnan(hrv))
+    s.hrv = hrv;
+  if (!isnan(stressScore))
+    s.stressScore = stressScore;
+  if (ended)
+    s.flags |= ENDED;
+  dirty[i] = true;
+}
+
+bool SessionCache::writeDocument(size_t i, const char *suffix, const char *json)
+{
+  std::string path = filePath(sessions[i].sessionId, suffix);
+  std::string tmp = path + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (!f)
+    return false;
+  size_t len = strlen(json);
+  bool ok = fwrite(json, 1, len, f) == len;
+  ok = fflush(f) == 0 && ok;
+  fclose(f);
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+  {
+    remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool SessionCache::readDocument(size_t i, const char *suffix, std::string &json) const
+{
+  json.clear();
+  FILE *f = fopen(filePath(sessions[i].sessionId, suffix).c_str(), "rb");
+  if (!f)
+    return false;
+  char buffer[512];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    json.append(buffer, n);
+  fclose(f);
+  return true;
+}
+
+bool SessionCache::readReadings(size_t i, std::vector<Reading> &out) const
+{
+  const Summary &s = sessions[i];
+  out.clear();
+  if (s.readings == 0)
+    return true;
+  // Appends since the last commit are still in the write buffer
+  if (readingsFile && readingsFor == s.sessionId)
+    fflush(readingsFile);
+  FILE *f = fopen(filePath(s.sessionId, ".rd").c_str(), "rb");
+  if (!f)
+    return false;
+  std::vector<uint8_t> raw(s.readings * READING_SIZE);
+  size_t got = fread(&raw[0], 1, raw.size(), f) / READING_SIZE;
+  fclose(f);
+  out.resize(got);
+  for (size_t k = 0; k < got; k++)
+  {
+    const uint8_t *p = &raw[k * READING_SIZE];
+    out[k].heartRate = get16(p) / 10.0f;
+    out[k].spo2 = get16(p + 2) / 10.0f;
+    out[k].sbp = get16(p + 4) / 10.0f;
+    out[k].dbp = get16(p + 6) / 10.0f;
+  }
+  return got == s.readings;
+}
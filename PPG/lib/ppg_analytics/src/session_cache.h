@@ -0,0 +1,135 @@
+#ifndef PPG_SESSION_CACHE_H
+#define PPG_SESSION_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+// App-side cache of one athlete's recorded sessions, so the history page
+// opens from local disk and only fetches what changed since the last sync
+// instead of the whole sessions tree. Kept in a directory:
+//   sessions.idx   header, then one summary per session sorted by id
+//   <id>.rd        the session's readings in key order
+//   <id>.meta      the session's questionnaire, as JSON
+//   <id>.final     its stats and charts from the session finaliser
+//                  (session_finaliser.h)
+// Opening reads the index only, so its cost grows with the number of
+// sessions, not with the readings behind them; a session's readings are
+// read when it is shown.
+//
+// Sync state lives with the data: the index header holds the watermark
+// (server time of the newest sessionIndex entry seen) and each summary
+// the key of its newest cached reading, which the next readings query
+// starts after. Changes are written by commit(); a reading appended past
+// a summary's count before a crash is overwritten by the next sync.
+//
+// Stored little endian:
+//   header   "PSC1" watermark(8) reserved(2) crc16(2)
+//   summary  id[22] lastKey[22] modifiedMs(8) readings(4) flags(4)
+//            sum(8) x4 count(4) x4 minHr(4) maxHr(4) hrv(4) stress(4)
+//            reserved(2) crc16(2)
+//   reading  hr(2) spo2(2) sbp(2) dbp(2), in tenths
+// Sums are doubles and the rest floats, by bit pattern. A summary with a
+// bad CRC ends the index and resets the watermark, so the sessions after
+// it are fetched again.
+class SessionCache
+{
+public:
+  enum Stat
+  {
+    MEAN_HEART_RATE,
+    MEAN_SPO2,
+    MEAN_SBP,
+    MEAN_DBP,
+    MIN_HEART_RATE,
+    MAX_HEART_RATE,
+    HRV,
+    STRESS_SCORE,
+    STAT_COUNT
+  };
+
+  // Session ids and reading keys, NUL included
+  static const size_t ID_CAPACITY = 22;
+  static const uint32_t ENDED = 1;
+  static const size_t SUMMARY_SIZE = 128;
+  static const size_t READING_SIZE = 8;
+
+  struct Summary
+  {
+    char sessionId[ID_CAPACITY];
+    char lastKey[ID_CAPACITY]; // empty before the first reading
+    int64_t modifiedMs;
+    uint32_t readings;
+    uint32_t flags;
+    // Heart rate, SpO2, SBP, DBP over the readings that measured them (> 0)
+    double sums[4];
+    uint32_t counts[4];
+    float minHeartRate, maxHeartRate; // NAN before the first heart rate
+    float hrv, stressScore;           // NAN until the session has them
+  };
+
+  struct Reading
+  {
+    float heartRate, spo2, sbp, dbp;
+  };
+
+  SessionCache();
+  ~SessionCache();
+
+  // Creates the index if missing. dir must exist.
+  bool open(const char *dir);
+  void close();
+  bool isOpen() const { return opened; }
+
+  int64_t watermark() const { return mark; }
+  void setWatermark(int64_t ms);
+
+  size_t size() const { return sessions.size(); }
+  const Summary &summary(size_t i) const { return sessions[i]; }
+  float stat(size_t i, Stat s) const;
+  // Binary search; -1 if not cached
+  int find(const char *sessionId) const;
+  // Adds the session if new and raises its modifiedMs. Returns its index,
+  // which may shift the sessions after it, or -1 for an id that is empty,
+  // too long or not [A-Za-z0-9_-].
+  int upsert(const char *sessionId, int64_t modifiedMs);
+
+  // Readings come in key order; a key at or before the session's lastKey
+  // is a repeat and is skipped (returns false, as does a write error).
+  bool addReading(size_t i, const char *key, const Reading &r);
+  // NAN leaves hrv or stressScore as it was
+  void setSession(size_t i, float hrv, float stressScore, bool ended);
+  bool setMeta(size_t i, const char *json) { return writeDocument(i, ".meta", json); }
+  bool readMeta(size_t i, std::string &json) const { return readDocument(i, ".meta", json); }
+  bool setFinalised(size_t i, const char *json) { return writeDocument(i, ".final", json); }
+  bool readFinalised(size_t i, std::string &json) const { return readDocument(i, ".final", json); }
+  bool readReadings(size_t i, std::vector<Reading> &out) const;
+
+  // Writes changed summaries and the header
+  bool commit();
+
+private:
+  std::string filePath(const char *sessionId, const char *suffix) const;
+  bool loadIndex();
+  bool writeHeader(FILE *f) const;
+  bool writeSummary(FILE *f, size_t i) const;
+  bool rewriteIndex();
+  bool openReadings(size_t i);
+  bool writeDocument(size_t i, const char *suffix, const char *json);
+  bool readDocument(size_t i, const char *suffix, std::string &json) const;
+
+  bool opened;
+  std::string dirPath;
+  int64_t mark;
+  std::vector<Summary> sessions;
+  std::vector<bool> dirty;
+  bool headerDirty;
+  bool reorder; // a session was inserted before the end
+  FILE *readingsFile;
+  std::string readingsFor;
+};
+
+#endif
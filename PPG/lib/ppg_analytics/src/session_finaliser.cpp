@@ -0,0 +1,157 @@
+#include "session_finaliser.h"
+
+#include <math.h>
+#include <stdio.h>
+
+namespace
+{
+  const char *CHANNEL_NAMES[SessionFinaliser::CHANNEL_COUNT] = {"heartRate", "spo2", "sbp", "dbp"};
+
+  void appendf(std::string &s, const char *format, double v)
+  {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), format, v);
+    s += buffer;
+  }
+}
+
+const uint32_t SessionFinaliser::RESOLUTIONS[RESOLUTION_COUNT] = {120, 480};
+
+size_t lttb(const float *x, const float *y, size_t n, size_t threshold, uint32_t *indices)
+{
+  if (threshold >= n || threshold < 3)
+  {
+    for (size_t i = 0; i < n; i++)
+      indices[i] = (uint32_t)i;
+    return n;
+  }
+  // Buckets over the points between the first and the last
+  double every = (double)(n - 2) / (threshold - 2);
+  size_t out = 0;
+  size_t a = 0;
+  indices[out++] = 0;
+  for (size_t b = 0; b < threshold - 2; b++)
+  {
+    size_t start = (size_t)(b * every) + 1;
+    size_t end = (size_t)((b + 1) * every) + 1;
+    size_t nextEnd = (size_t)((b + 2) * every) + 1;
+    if (nextEnd > n)
+      nextEnd = n;
+    double avgX = 0, avgY = 0;
+    for (size_t i = end; i < nextEnd; i++)
+    {
+      avgX += x[i];
+      avgY += y[i];
+    }
+    if (nextEnd > end)
+    {
+      avgX /= nextEnd - end;
+      avgY /= nextEnd - end;
+    }
+    else
+    {
+      // The last bucket looks ahead to the final point
+      avgX = x[n - 1];
+      avgY = y[n - 1];
+    }
+    double best = -1;
+    size_t pick = start;
+    for (size_t i = start; i < end; i++)
+    {
+      // Twice the triangle's area, which ranks the same
+      double area = fabs((x[a] - avgX) * (y[i] - y[a]) - (x[a] - x[i]) * (avgY - y[a]));
+      if (area > best)
+      {
+        best = area;
+        pick = i;
+      }
+    }
+    indices[out++] = (uint32_t)pick;
+    a = pick;
+  }
+  indices[out++] = (uint32_t)(n - 1);
+  return out;
+}
+
+void SessionFinaliser::reset()
+{
+  for (int c = 0; c < CHANNEL_COUNT; c++)
+  {
+    xs[c].clear();
+    ys[c].clear();
+  }
+  count = 0;
+}
+
+void SessionFinaliser::add(float heartRate, float spo2, float sbp, float dbp)
+{
+  const float values[CHANNEL_COUNT] = {heartRate, spo2, sbp, dbp};
+  for (int c = 0; c < CHANNEL_COUNT; c++)
+  {
+    if (values[c] > 0)
+    {
+      xs[c].push_back((float)count);
+      ys[c].push_back(values[c]);
+    }
+  }
+  count++;
+}
+
+void SessionFinaliser::finish(std::string &json) const
+{
+  json = "{\"readings\":";
+  appendf(json, "%.0f", (double)count);
+  json += ",\"stats\":{";
+  for (int c = 0; c < CHANNEL_COUNT; c++)
+  {
+    const std::vector<float> &y = ys[c];
+    double sum = 0;
+    float lo = INFINITY, hi = -INFINITY;
+    for (size_t i = 0; i < y.size(); i++)
+    {
+      sum += y[i];
+      lo = y[i] < lo ? y[i] : lo;
+      hi = y[i] > hi ? y[i] : hi;
+    }
+    if (c > 0)
+      json += ',';
+    json += '"';
+    json += CHANNEL_NAMES[c];
+    json += "\":{\"count\":";
+    appendf(json, "%.0f", (double)y.size());
+    if (!y.empty())
+    {
+      appendf(json, ",\"mean\":%.2f", sum / y.size());
+      appendf(json, ",\"min\":%.1f", lo);
+      appendf(json, ",\"max\":%.1f", hi);
+    }
+    json += '}';
+  }
+  json += "},\"charts\":{";
+  std::vector<uint32_t> picked;
+  for (size_t r = 0; r < RESOLUTION_COUNT; r++)
+  {
+    if (r > 0)
+      json += ',';
+    appendf(json, "\"%.0f\":{", RESOLUTIONS[r]);
+    for (int c = 0; c < CHANNEL_COUNT; c++)
+    {
+      size_t n = ys[c].size();
+      picked.resize(n);
+      size_t kept = n > 0 ? lttb(&xs[c][0], &ys[c][0], n, RESOLUTIONS[r], &picked[0]) : 0;
+      if (c > 0)
+        json += ',';
+      json += '"';
+      json += CHANNEL_NAMES[c];
+      json += "\":{\"x\":[";
+      for (size_t i = 0; i < kept; i++)
+        appendf(json, i > 0 ? ",%.0f" : "%.0f", xs[c][picked[i]]);
+      json += "],\"y\":[";
+      for (size_t i = 0; i < kept; i++)
+        appendf(json, i > 0 ? ",%.1f" : "%.1f", ys[c][picked[i]]);
+      json += "]}";
+    }
+    json += '}';
+  }
+  json += "}}";
+}
@@ -0,0 +1,56 @@
+#ifndef PPG_SESSION_FINALISER_H
+#define PPG_SESSION_FINALISER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Largest-Triangle-Three-Buckets downsampling (Steinarsson, 2013): keeps
+// the first and last of n points and, from each of threshold - 2 equal
+// buckets in between, the point forming the largest triangle with the
+// previous pick and the next bucket's centroid. Writes the picked indices
+// in order and returns their count, which is n if n <= threshold or
+// threshold < 3.
+size_t lttb(const float *x, const float *y, size_t n, size_t threshold, uint32_t *indices);
+
+// Runs when a session stops: takes its readings in order and produces the
+// summary the history page renders from, stored with the session at
+// users/<uid>/sessions/<sid>/summary:
+//   {"readings":n,
+//    "stats":{"heartRate":{"count":..,"mean":..,"min":..,"max":..},..},
+//    "charts":{"120":{"heartRate":{"x":[..],"y":[..]},..},"480":{..}}}
+// A channel's stats and points cover the readings that measured it
+// (> 0); x is the reading's index in the session. Channels are heartRate,
+// spo2, sbp and dbp, and each chart has at most its resolution in points.
+class SessionFinaliser
+{
+public:
+  enum Channel
+  {
+    HEART_RATE,
+    SPO2,
+    SBP,
+    DBP,
+    CHANNEL_COUNT
+  };
+
+  static const size_t RESOLUTION_COUNT = 2;
+  static const uint32_t RESOLUTIONS[RESOLUTION_COUNT];
+
+  SessionFinaliser() : count(0) {}
+
+  void reset();
+  void add(float heartRate, float spo2, float sbp, float dbp);
+  size_t size() const { return count; }
+  void finish(std::string &json) const;
+
+private:
+  // Measured points per channel
+  std::vector<float> xs[CHANNEL_COUNT];
+  std::vector<float> ys[CHANNEL_COUNT];
+  size_t count;
+};
+
+#endif
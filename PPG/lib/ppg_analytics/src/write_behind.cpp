@@ -0,0 +1,332 @@
+#include "write_behind.h"
+
+#include <string.h>
+
+#include "crc16.h"
+
+namespace
+{
+  const char MAGIC[4] = {'P', 'W', 'B', '1'};
+  const size_t HEADER_SIZE = 8;
+  const uint8_t READING = 'R';
+  const uint8_t ACKED = 'A';
+  const size_t KEY_LEN = 20;
+  // "<key>":<json>, around each reading in a body
+  const size_t BODY_OVERHEAD = KEY_LEN + 4;
+
+  void put32(std::string &s, uint32_t v)
+  {
+    for (int i = 0; i < 4; i++)
+      s += (char)((v >> (8 * i)) & 0xFF);
+  }
+
+  uint32_t get32(const uint8_t *p)
+  {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+  }
+
+  size_t bodySize(const std::string &json)
+  {
+    return json.size() + BODY_OVERHEAD;
+  }
+}
+
+WriteBehind::WriteBehind()
+    : journal(nullptr), writer(0), interval(0), maxBytes(0), pendingBytes(0), nextSeq(0), oldestMs(0),
+      flushRequested(false), rng(1)
+{
+  memset(&counters, 0, sizeof(counters));
+}
+
+WriteBehind::~WriteBehind()
+{
+  close();
+}
+
+bool WriteBehind::open(const char *path, uint32_t writerId, uint32_t flushIntervalMs, size_t maxBatchBytes)
+{
+  close();
+  journalPath = path;
+  writer = writerId;
+  interval = flushIntervalMs;
+  maxBytes = maxBatchBytes;
+  records.clear();
+  pendingBytes = 0;
+  nextSeq = 0;
+  oldestMs = 0;
+  flushRequested = false;
+  inFlight.clear();
+  retries.clear();
+  memset(&counters, 0, sizeof(counters));
+
+  FILE *f = fopen(path, "rb");
+  if (f)
+  {
+    replay(f);
+    fclose(f);
+  }
+  rng = writer | 1;
+  return rewrite();
+}
+
+void WriteBehind::close()
+{
+  if (journal)
+    fclose(journal);
+  journal = nullptr;
+}
+
+void WriteBehind::replay(FILE *f)
+{
+  uint8_t header[HEADER_SIZE];
+  if (fread(header, 1, HEADER_SIZE, f) != HEADER_SIZE || memcmp(header, MAGIC, 4) != 0)
+    return;
+  writer = get32(header + 4);
+  uint8_t head[3];
+  std::string body;
+  while (fread(head, 1, 3, f) == 3)
+  {
+    size_t len = head[1] | (size_t)head[2] << 8;
+    body.resize(len + 2);
+    if (fread(&body[0], 1, len + 2, f) != len + 2)
+      return;
+    body.insert(0, (const char *)head, 3);
+    const uint8_t *b = (const uint8_t *)body.data() + 3;
+    if (crc16Ccitt((const uint8_t *)body.data(), len + 3) != (uint16_t)(b[len] | b[len + 1] << 8))
+      return;
+    if (head[0] == READING && len > 12)
+    {
+      const char *text = (const char *)b + 12;
+      size_t pathLen = strnlen(text, len - 12);
+      if (pathLen == len - 12)
+        return;
+      Record r;
+      r.seq = get32(b);
+      r.timestampMs = (int64_t)((uint64_t)get32(b + 4) | (uint64_t)get32(b + 8) << 32);
+      r.path.assign(text, pathLen);
+      r.json.assign(text + pathLen + 1, len - 12 - pathLen - 1);
+      pendingBytes += bodySize(r.json);
+      records.push_back(r);
+      nextSeq = r.seq + 1;
+    }
+    else if (head[0] == ACKED && len % 4 == 0)
+    {
+      std::vector<uint32_t> acked;
+      for (size_t i = 0; i < len; i += 4)
+        acked.push_back(get32(b + i));
+      drop(acked);
+    }
+    else
+    {
+      return;
+    }
+  }
+}
+
+// Header and pending readings into a new file, which then replaces the
+// journal
+bool WriteBehind::rewrite()
+{
+  close();
+  std::string tmp = journalPath + ".tmp";
+  journal = fopen(tmp.c_str(), "wb");
+  if (!journal)
+    return false;
+  std::string header(MAGIC, 4);
+  put32(header, writer);
+  bool ok = fwrite(header.data(), 1, header.size(), journal) == header.size();
+  for (size_t i = 0; ok && i < records.size(); i++)
+  {
+    ok = writeEntry(READING, readingBody(records[i]));
+  }
+  ok = fflush(journal) == 0 && ok;
+  fclose(journal);
+  journal = nullptr;
+  if (!ok || rename(tmp.c_str(), journalPath.c_str()) != 0)
+  {
+    remove(tmp.c_str());
+    return false;
+  }
+  journal = fopen(journalPath.c_str(), "ab");
+  return journal != nullptr;
+}
+
+std::string WriteBehind::readingBody(const Record &r)
+{
+  std::string body;
+  put32(body, r.seq);
+  put32(body, (uint32_t)r.timestampMs);
+  put32(body, (uint32_t)((uint64_t)r.timestampMs >> 32));
+  body += r.path;
+  body += '\0';
+  body += r.json;
+  return body;
+}
+
+bool WriteBehind::writeEntry(uint8_t type, const std::string &body)
+{
+  if (body.size() > 0xFFFF)
+    return false;
+  std::string entry;
+  entry += (char)type;
+  entry += (char)(body.size() & 0xFF);
+  entry += (char)(body.size() >> 8);
+  entry += body;
+  uint16_t crc = crc16Ccitt((const uint8_t *)entry.data(), entry.size());
+  entry += (char)(crc & 0xFF);
+  entry += (char)(crc >> 8);
+  return fwrite(entry.data(), 1, entry.size(), journal) == entry.size();
+}
+
+bool WriteBehind::append(const char *path, const char *json, int64_t nowMs)
+{
+  if (!journal || strpbrk(path, "\"\\") || *json == '\0')
+    return false;
+  Record r;
+  r.seq = nextSeq;
+  r.timestampMs = nowMs;
+  r.path = path;
+  r.json = json;
+  // Flushed to the OS so an app kill loses nothing; not synced to disk
+  if (!writeEntry(READING, readingBody(r)) || fflush(journal) != 0)
+    return false;
+  if (records.empty())
+    oldestMs = nowMs;
+  pendingBytes += bodySize(r.json);
+  records.push_back(r);
+  nextSeq++;
+  counters.appended++;
+  return true;
+}
+
+bool WriteBehind::backingOff(const std::string &path, int64_t nowMs) const
+{
+  std::map<std::string, Retry>::const_iterator it = retries.find(path);
+  return it != retries.end() && nowMs < it->second.atMs;
+}
+
+size_t WriteBehind::nextReady(int64_t nowMs) const
+{
+  size_t i = 0;
+  while (!retries.empty() && i < records.size() && backingOff(records[i].path, nowMs))
+    i++;
+  return i;
+}
+
+bool WriteBehind::due(int64_t nowMs) const
+{
+  if (!inFlight.empty())
+    return false;
+  size_t first = nextReady(nowMs);
+  if (first == records.size())
+    return false;
+  size_t bytes = pendingBytes;
+  if (!retries.empty())
+  {
+    // Readings of paths backing off do not count towards a batch
+    bytes = 0;
+    for (size_t i = first; i < records.size(); i++)
+    {
+      if (!backingOff(records[i].path, nowMs))
+        bytes += bodySize(records[i].json);
+    }
+  }
+  int64_t sinceMs = first == 0 ? oldestMs : records[first].timestampMs;
+  return flushRequested || bytes >= maxBytes || nowMs - sinceMs >= (int64_t)interval;
+}
+
+const std::string &WriteBehind::takeBatch(int64_t nowMs)
+{
+  batch.clear();
+  size_t first = nextReady(nowMs);
+  if (!inFlight.empty() || first == records.size())
+    return batch;
+  path = records[first].path;
+  batch += '{';
+  for (size_t i = first; i < records.size(); i++)
+  {
+    const Record &r = records[i];
+    if (r.path != path)
+      continue;
+    // At least one reading, however large
+    if (!inFlight.empty() && batch.size() + bodySize(r.json) + 1 > maxBytes)
+      break;
+    char key[KEY_LEN + 1];
+    makeRecordKey(r.timestampMs, writer, r.seq, key);
+    if (!inFlight.empty())
+      batch += ',';
+    batch += '"';
+    batch += key;
+    batch += "\":";
+    batch += r.json;
+    inFlight.push_back(r.seq);
+  }
+  batch += '}';
+  counters.bodyBytes += batch.size();
+  return batch;
+}
+
+void WriteBehind::ack(bool ok, int64_t nowMs)
+{
+  if (inFlight.empty())
+    return;
+  if (!ok)
+  {
+    // Only this path waits; the others' readings are not held up by a
+    // node that keeps refusing writes
+    counters.failures++;
+    Retry &retry = retries[path];
+    retry.atMs = nowMs + retry.backoff.next(nextRandom());
+    inFlight.clear();
+    return;
+  }
+  drop(inFlight);
+  counters.sent += inFlight.size();
+  counters.batches++;
+  retries.erase(path);
+  if (records.empty())
+  {
+    inFlight.clear();
+    flushRequested = false;
+    retries.clear();
+    rewrite();
+    return;
+  }
+  // Whatever is left was added while the batch was out, belongs to
+  // another path or did not fit
+  oldestMs = records.front().timestampMs;
+  // A flush is done once only paths backing off are left
+  flushRequested = flushRequested && nextReady(nowMs) < records.size();
+  std::string body;
+  for (size_t i = 0; i < inFlight.size(); i++)
+    put32(body, inFlight[i]);
+  inFlight.clear();
+  if (journal && writeEntry(ACKED, body))
+    fflush(journal);
+}
+
+// seqs ascending, like the records
+void WriteBehind::drop(const std::vector<uint32_t> &seqs)
+{
+  std::deque<Record> kept;
+  size_t next = 0;
+  for (size_t i = 0; i < records.size(); i++)
+  {
+    while (next < seqs.size() && seqs[next] < records[i].seq)
+      next++;
+    if (next < seqs.size() && seqs[next] == records[i].seq)
+      pendingBytes -= bodySize(records[i].json);
+    else
+      kept.push_back(records[i]);
+  }
+  records.swap(kept);
+}
+
+uint32_t WriteBehind::nextRandom()
+{
+  // xorshift32, only for retry jitter
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
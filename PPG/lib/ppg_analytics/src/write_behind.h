@@ -0,0 +1,123 @@
+#ifndef PPG_WRITE_BEHIND_H
+#define PPG_WRITE_BEHIND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "upload_batch.h"
+
+// App-side write-behind buffer for live readings: instead of one Realtime
+// Database write per reading, readings are journalled locally and sent as
+// multi-record updates every flushIntervalMs, when maxBatchBytes have
+// built up, or when the caller asks (session end). A batch holds readings
+// for one readings node, in the body the WiFi uploader sends:
+//   PATCH <db>/<path>.json   {"<key>":<reading>,...}
+// Keys come from makeRecordKey (upload_batch.h) and are fixed when the
+// reading is added, so a batch re-sent after a lost reply or a restart
+// overwrites the same children instead of duplicating them.
+//
+// Readings not acknowledged yet survive an app restart in the journal:
+//   header   "PWB1" writerId(4)
+//   entries  type(1) len(2) body(len) crc16(2), little endian, the CRC
+//            over type, len and body
+//            'R' seq(4) timestampMs(8) path NUL json    a reading
+//            'A' seq(4) ...                             readings acked
+// A torn tail entry ends the replay. The journal is rewritten with only
+// the pending readings on open and whenever the buffer drains.
+class WriteBehind
+{
+public:
+  struct Stats
+  {
+    uint64_t appended;  // readings added
+    uint64_t sent;      // readings acknowledged
+    uint64_t batches;   // batches acknowledged
+    uint64_t failures;  // batches that failed and were kept
+    uint64_t bodyBytes; // update bodies handed out, retries included
+  };
+
+  static const uint32_t RETRY_BASE_MS = 1000;
+  static const uint32_t RETRY_MAX_MS = 60000;
+
+  WriteBehind();
+  ~WriteBehind();
+
+  // Replays the journal at path, creating it if missing. writerId makes
+  // keys unique between installations; an existing journal keeps its own.
+  bool open(const char *path, uint32_t writerId, uint32_t flushIntervalMs, size_t maxBatchBytes);
+  void close();
+  bool isOpen() const { return journal != nullptr; }
+
+  // path is the readings node ("users/<uid>/sessions/<sid>/readings") and
+  // json one reading's object, as received. Fails on a path with quotes
+  // or backslashes, or if the journal cannot be written.
+  bool append(const char *path, const char *json, int64_t nowMs);
+  // Makes the next due() true regardless of the interval (session end)
+  void flushSoon() { flushRequested = true; }
+
+  bool due(int64_t nowMs) const;
+  // Builds the next update body from the oldest pending reading whose path
+  // is not backing off, and as many of that path's readings as fit; empty
+  // if nothing is ready or a batch is already out.
+  const std::string &takeBatch(int64_t nowMs);
+  const std::string &lastBatch() const { return batch; }
+  const std::string &batchPath() const { return path; }
+  size_t batchRecords() const { return inFlight.size(); }
+  // Reports the outcome of the batch from takeBatch(). A failure keeps the
+  // readings and backs their path off exponentially; other paths' readings
+  // keep going out meanwhile.
+  void ack(bool ok, int64_t nowMs);
+
+  size_t pending() const { return records.size(); }
+  const Stats &stats() const { return counters; }
+
+private:
+  struct Record
+  {
+    uint32_t seq;
+    int64_t timestampMs;
+    std::string path, json;
+  };
+
+  struct Retry
+  {
+    Retry() : atMs(0), backoff(RETRY_BASE_MS, RETRY_MAX_MS) {}
+    int64_t atMs;
+    Backoff backoff;
+  };
+
+  static std::string readingBody(const Record &r);
+  bool backingOff(const std::string &path, int64_t nowMs) const;
+  // Index of the oldest reading whose path is not backing off, or
+  // records.size()
+  size_t nextReady(int64_t nowMs) const;
+  bool writeEntry(uint8_t type, const std::string &body);
+  bool rewrite();
+  void drop(const std::vector<uint32_t> &seqs);
+  void replay(FILE *f);
+  uint32_t nextRandom();
+
+  FILE *journal;
+  std::string journalPath;
+  uint32_t writer;
+  uint32_t interval;
+  size_t maxBytes;
+  std::deque<Record> records;
+  size_t pendingBytes;
+  uint32_t nextSeq;
+  int64_t oldestMs; // when the oldest pending reading was added; 0 after a replay
+  bool flushRequested;
+  std::vector<uint32_t> inFlight; // seqs in the batch that is out
+  std::string batch, path;
+  std::map<std::string, Retry> retries; // paths whose last batch failed
+  uint32_t rng;
+  Stats counters;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "athlete_baseline.h"
+
+#include <math.h>
+
+const float AthleteBaseline::ALPHA = 0.005f; // ~200 windows, 100 minutes of recording
+const float AthleteBaseline::ANOMALY_Z = 2.5f;
+const float AthleteBaseline::STRESS_Z = 1.5f;
+const float AthleteBaseline::CLAMP_Z = 3.0f;
+
+namespace
+{
+  // bpm, ms, mmHg
+  const float SD_FLOOR[AthleteBaseline::CHANNEL_COUNT] = {3.0f, 5.0f, 4.0f};
+}
+
+void AthleteBaseline::reset()
+{
+  st.version = VERSION;
+  st.count = 0;
+  for (int c = 0; c < CHANNEL_COUNT; c++)
+    st.mean[c] = st.var[c] = 0;
+}
+
+float AthleteBaseline::sd(Channel c) const
+{
+  float s = sqrtf(st.var[c]);
+  return s > SD_FLOOR[c] ? s : SD_FLOOR[c];
+}
+
+AthleteBaseline::Score AthleteBaseline::observe(float heartRate, float rmssd, float sbp)
+{
+  float x[CHANNEL_COUNT] = {heartRate, rmssd, sbp};
+  Score score;
+  score.ready = ready();
+  score.flags = 0;
+  for (int c = 0; c < CHANNEL_COUNT; c++)
+    score.z[c] = score.ready ? (x[c] - st.mean[c]) / sd((Channel)c) : 0;
+  if (score.ready)
+  {
+    if (score.z[HEART_RATE] > ANOMALY_Z)
+      score.flags |= HR_HIGH;
+    if (score.z[HEART_RATE] < -ANOMALY_Z)
+      score.flags |= HR_LOW;
+    if (score.z[RMSSD] < -ANOMALY_Z)
+      score.flags |= RMSSD_LOW;
+    if (score.z[RMSSD] > ANOMALY_Z)
+      score.flags |= RMSSD_HIGH;
+    if (score.z[SBP] > ANOMALY_Z)
+      score.flags |= SBP_HIGH;
+    if (score.z[HEART_RATE] > STRESS_Z && score.z[RMSSD] < -STRESS_Z)
+      score.flags |= STRESS;
+  }
+
+  float alpha = 1.0f / (st.count + 1);
+  if (alpha < ALPHA)
+    alpha = ALPHA;
+  for (int c = 0; c < CHANNEL_COUNT; c++)
+  {
+    float v = x[c];
+    if (score.ready)
+    {
+      float limit = CLAMP_Z * sd((Channel)c);
+      if (v > st.mean[c] + limit)
+        v = st.mean[c] + limit;
+      else if (v < st.mean[c] - limit)
+        v = st.mean[c] - limit;
+    }
+    // Incremental EW mean and variance (West 1979)
+    float diff = v - st.mean[c];
+    float step = alpha * diff;
+    st.mean[c] += step;
+    st.var[c] = (1 - alpha) * (st.var[c] + diff * step);
+  }
+  if (st.count < 0xFFFF)
+    st.count++;
+  return score;
+}
+
+bool AthleteBaseline::restore(const State &s)
+{
+  if (s.version != VERSION)
+    return false;
+  for (int c = 0; c < CHANNEL_COUNT; c++)
+    if (!(s.mean[c] >= 0 && s.mean[c] < 1000) || !(s.var[c] >= 0 && s.var[c] < 1e6f))
+      return false;
+  st = s;
+  return true;
+}
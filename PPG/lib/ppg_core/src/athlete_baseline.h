@@ -0,0 +1,78 @@
+#ifndef PPG_ATHLETE_BASELINE_H
+#define PPG_ATHLETE_BASELINE_H
+
+#include <stdint.h>
+
+// One athlete's normal range of heart rate, RMSSD and systolic pressure,
+// learned from their own HRV windows. Each channel keeps an exponentially
+// weighted mean and variance; the weight starts at 1/n so the first
+// windows average evenly, then settles at ALPHA (a memory of a few
+// sessions). Each window is scored against the baseline as it stood
+// before the window, so an athlete whose resting HR is 45 sees 60 flagged
+// where absolute thresholds would call it normal.
+//
+// Once ready, values are clamped to CLAMP_Z standard deviations before
+// they update the baseline, so one bad window cannot drag it. Standard
+// deviations are floored per channel, or a very steady athlete would
+// turn every small change into a large z.
+class AthleteBaseline
+{
+public:
+  enum Channel : uint8_t
+  {
+    HEART_RATE,
+    RMSSD,
+    SBP,
+    CHANNEL_COUNT
+  };
+
+  // Flags
+  static const uint8_t HR_HIGH = 1;
+  static const uint8_t HR_LOW = 2;
+  static const uint8_t RMSSD_LOW = 4;
+  static const uint8_t RMSSD_HIGH = 8;
+  static const uint8_t SBP_HIGH = 16;
+  static const uint8_t STRESS = 32; // HR up and RMSSD down together
+
+  static const float ALPHA;
+  static const float ANOMALY_Z;
+  static const float STRESS_Z;
+  static const float CLAMP_Z;
+  static const uint16_t WARMUP = 10; // windows before scores are given
+
+  // Persisted as is (platform settings), hence the version
+  struct State
+  {
+    uint8_t version;
+    uint16_t count; // windows learned, saturates
+    float mean[CHANNEL_COUNT];
+    float var[CHANNEL_COUNT];
+  };
+
+  struct Score
+  {
+    bool ready; // z and flags are meaningful
+    float z[CHANNEL_COUNT];
+    uint8_t flags;
+  };
+
+  AthleteBaseline() { reset(); }
+
+  void reset();
+  // Scores one window against the baseline, then learns from it.
+  Score observe(float heartRate, float rmssd, float sbp);
+  bool ready() const { return st.count >= WARMUP; }
+  float mean(Channel c) const { return st.mean[c]; }
+  float sd(Channel c) const;
+
+  const State &state() const { return st; }
+  // false (and the baseline unchanged) when s is from another version or
+  // not a plausible baseline
+  bool restore(const State &s);
+
+private:
+  static const uint8_t VERSION = 1;
+  State st;
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include "clock_sync.h"
+
+namespace
+{
+  // Crystal tolerance is tens of ppm; anything larger is a bad fit over a
+  // short span, not real drift.
+  const double MAX_DRIFT = 500e-6;
+  // Samples up to this much slower than the best round still count.
+  const double DELAY_SLACK_MS = 2.0;
+  // BLE delivery jitter is several ms, so drift is only trusted once the
+  // fitted samples span at least this long.
+  const double MIN_DRIFT_SPAN_MS = 60000;
+}
+
+void ClockSync::reset()
+{
+  next = 0;
+  samples = 0;
+  nextPending = 0;
+  drift = 0;
+  for (Pending &p : pending)
+    p.used = false;
+}
+
+void ClockSync::begin(uint32_t seq, double t1Ms, int64_t t2Us, int64_t t3Us)
+{
+  pending[nextPending] = {true, seq, t1Ms, t2Us, t3Us};
+  nextPending = (nextPending + 1) % PENDING;
+}
+
+bool ClockSync::finish(uint32_t seq, double t4Ms)
+{
+  for (Pending &p : pending)
+  {
+    if (!p.used || p.seq != seq)
+      continue;
+    p.used = false;
+    addSample(p.t1Ms, p.t2Us, p.t3Us, t4Ms);
+    return true;
+  }
+  return false;
+}
+
+void ClockSync::addSample(double t1Ms, int64_t t2Us, int64_t t3Us, double t4Ms)
+{
+  double delay = (t4Ms - t1Ms) - (t3Us - t2Us) / 1000.0;
+  if (delay < 0)
+    delay = 0;
+  window[next] = {(t2Us + t3Us) / 2, (t1Ms + t4Ms) / 2, delay};
+  next = (next + 1) % WINDOW;
+  if (samples < WINDOW)
+    samples++;
+  lastDelay = delay;
+  fit();
+}
+
+void ClockSync::fit()
+{
+  double minDelay = window[0].delayMs;
+  for (int i = 1; i < samples; i++)
+  {
+    if (window[i].delayMs < minDelay)
+      minDelay = window[i].delayMs;
+  }
+  double limit = minDelay * 2 + DELAY_SLACK_MS;
+
+  // Least squares of host ms against device us, centred on the newest
+  // good sample to keep the doubles well conditioned.
+  int newest = (next + WINDOW - 1) % WINDOW;
+  for (int k = 0; k < samples; k++)
+  {
+    int i = (next + WINDOW - 1 - k) % WINDOW;
+    if (window[i].delayMs <= limit)
+    {
+      newest = i;
+      break;
+    }
+  }
+  int64_t refUs = window[newest].deviceUs;
+  double refMs = window[newest].hostMs;
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  double minX = 0, maxX = 0;
+  int n = 0;
+  for (int i = 0; i < samples; i++)
+  {
+    if (window[i].delayMs > limit)
+      continue;
+    double x = (window[i].deviceUs - refUs) / 1000.0;
+    double y = window[i].hostMs - refMs;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+    minX = x < minX ? x : minX;
+    maxX = x > maxX ? x : maxX;
+    n++;
+  }
+  double slope = 1.0;
+  double den = n * sxx - sx * sx;
+  if (n >= 3 && den > 0 && maxX - minX >= MIN_DRIFT_SPAN_MS)
+    slope = (n * sxy - sx * sy) / den;
+  drift = slope - 1.0;
+  if (drift > MAX_DRIFT)
+    drift = MAX_DRIFT;
+  if (drift < -MAX_DRIFT)
+    drift = -MAX_DRIFT;
+  deviceRefUs = refUs;
+  hostRefMs = refMs + (sy - (1.0 + drift) * sx) / n;
+}
+
+int64_t ClockSync::toHostMs(int64_t deviceUs) const
+{
+  double elapsedMs = (deviceUs - deviceRefUs) / 1000.0;
+  double ms = hostRefMs + elapsedMs * (1.0 + drift);
+  return (int64_t)(ms + 0.5);
+}
+
+void ClockSyncSet::begin(uint16_t connId, uint32_t seq, double t1Ms, int64_t t2Us, int64_t t3Us)
+{
+  Host *free = nullptr;
+  for (Host &h : hosts)
+  {
+    if (h.used && h.connId == connId)
+    {
+      h.sync.begin(seq, t1Ms, t2Us, t3Us);
+      return;
+    }
+    if (!h.used && !free)
+      free = &h;
+  }
+  if (!free)
+    return;
+  free->used = true;
+  free->connId = connId;
+  free->syncedOrder = 0;
+  free->sync.reset();
+  free->sync.begin(seq, t1Ms, t2Us, t3Us);
+}
+
+bool ClockSyncSet::finish(uint16_t connId, uint32_t seq, double t4Ms)
+{
+  for (Host &h : hosts)
+  {
+    if (!h.used || h.connId != connId)
+      continue;
+    if (!h.sync.finish(seq, t4Ms))
+      return false;
+    if (h.syncedOrder == 0)
+      h.syncedOrder = nextOrder++;
+    return true;
+  }
+  return false;
+}
+
+void ClockSyncSet::drop(uint16_t connId)
+{
+  for (Host &h : hosts)
+  {
+    if (h.used && h.connId == connId)
+      h.used = false;
+  }
+}
+
+const ClockSync *ClockSyncSet::find(uint16_t connId) const
+{
+  for (const Host &h : hosts)
+  {
+    if (h.used && h.connId == connId)
+      return &h.sync;
+  }
+  return nullptr;
+}
+
+const ClockSync *ClockSyncSet::reference() const
+{
+  const Host *best = nullptr;
+  for (const Host &h : hosts)
+  {
+    if (h.used && h.syncedOrder != 0 && (!best || h.syncedOrder < best->syncedOrder))
+      best = &h;
+  }
+  return best ? &best->sync : nullptr;
+}
+
+void SampleClock::reset(uint32_t index, int64_t deviceUs)
+{
+  started = true;
+  firstIndex = lastIndex = index;
+  firstUs = lastUs = deviceUs;
+  periodUs = nominalPeriodUs;
+}
+
+void SampleClock::mark(uint32_t index, int64_t deviceUs)
+{
+  if (!started)
+  {
+    reset(index, deviceUs);
+    return;
+  }
+  lastIndex = index;
+  lastUs = deviceUs;
+  uint32_t span = lastIndex - firstIndex;
+  // Wait for a second of samples so loop jitter does not dominate.
+  if (span >= 1000000 / nominalPeriodUs)
+    periodUs = (double)(lastUs - firstUs) / span;
+}
+
+int64_t SampleClock::toDeviceUs(uint32_t index) const
+{
+  return lastUs + (int64_t)(((int32_t)(index - lastIndex)) * periodUs);
+}
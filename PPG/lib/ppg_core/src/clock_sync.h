@@ -0,0 +1,117 @@
+#ifndef PPG_CLOCK_SYNC_H
+#define PPG_CLOCK_SYNC_H
+
+#include <stdint.h>
+
+// Estimates how the device clock maps onto a host's wall clock from
+// NTP-style exchanges over the RX/TX characteristics:
+//   host -> "SYNC <seq> <t1>"            t1 = host epoch ms at send
+//   device -> {"type":"sync",...,t2,t3}  device us at receive / reply
+//   host -> "SYNCFIN <seq> <t4>"         t4 = host epoch ms at receive
+// Each round gives one offset sample with its round-trip delay. Only the
+// lowest-delay samples of the recent window are fitted, which gives both
+// the offset and the drift of the device oscillator in ppm.
+class ClockSync
+{
+public:
+  static const int WINDOW = 16;
+  static const int PENDING = 4;
+
+  // Step 2 of the exchange: remember the device side of round seq.
+  void begin(uint32_t seq, double t1Ms, int64_t t2Us, int64_t t3Us);
+  // Step 3: completes round seq. Returns false for unknown rounds.
+  bool finish(uint32_t seq, double t4Ms);
+
+  void addSample(double t1Ms, int64_t t2Us, int64_t t3Us, double t4Ms);
+  void reset();
+
+  bool synced() const { return samples > 0; }
+  int64_t toHostMs(int64_t deviceUs) const;
+  double offsetMs() const { return hostRefMs - deviceRefUs / 1000.0; }
+  double driftPpm() const { return drift * 1e6; }
+  double lastDelayMs() const { return lastDelay; }
+
+private:
+  struct Sample
+  {
+    int64_t deviceUs; // midpoint of t2/t3
+    double hostMs;    // midpoint of t1/t4
+    double delayMs;
+  };
+  struct Pending
+  {
+    bool used;
+    uint32_t seq;
+    double t1Ms;
+    int64_t t2Us, t3Us;
+  };
+
+  void fit();
+
+  Sample window[WINDOW];
+  Pending pending[PENDING] = {};
+  int next = 0;
+  int samples = 0;
+  int nextPending = 0;
+  // host = hostRefMs + (device - deviceRefUs) / 1000 * (1 + drift)
+  int64_t deviceRefUs = 0;
+  double hostRefMs = 0;
+  double drift = 0;
+  double lastDelay = 0;
+};
+
+// One ClockSync per connected host. Every host numbers its rounds from 0,
+// so rounds are matched on (connection, seq) and each host gets its own
+// fit. Timestamps follow the first host to synchronise until it
+// disconnects, then the next synchronised one.
+class ClockSyncSet
+{
+public:
+  static const int HOSTS = 4;
+
+  // Rounds from a connection beyond HOSTS are ignored.
+  void begin(uint16_t connId, uint32_t seq, double t1Ms, int64_t t2Us, int64_t t3Us);
+  bool finish(uint16_t connId, uint32_t seq, double t4Ms);
+  void drop(uint16_t connId);
+
+  // nullptr for a connection that has not started a round
+  const ClockSync *find(uint16_t connId) const;
+  // The fit timestamps use, or nullptr while no host is synchronised
+  const ClockSync *reference() const;
+
+private:
+  struct Host
+  {
+    bool used = false;
+    uint16_t connId = 0;
+    uint32_t syncedOrder = 0; // when its fit first became usable, 0 before
+    ClockSync sync;
+  };
+
+  Host hosts[HOSTS];
+  uint32_t nextOrder = 1;
+};
+
+// Maps the sensor sample counter onto device microseconds. The MAX30105
+// runs on its own oscillator, so the sample period is measured rather than
+// assumed: anchors are taken as samples arrive and the period is the slope
+// between the first and latest anchor of the session.
+class SampleClock
+{
+public:
+  explicit SampleClock(uint32_t nominalPeriodUs) : nominalPeriodUs(nominalPeriodUs), periodUs(nominalPeriodUs) {}
+
+  void reset(uint32_t index, int64_t deviceUs);
+  void mark(uint32_t index, int64_t deviceUs);
+  int64_t toDeviceUs(uint32_t index) const;
+  double samplePeriodUs() const { return periodUs; }
+
+private:
+  uint32_t nominalPeriodUs;
+  double periodUs;
+  bool started = false;
+  uint32_t firstIndex = 0, lastIndex = 0;
+  int64_t firstUs = 0, lastUs = 0;
+};
+
+#endif
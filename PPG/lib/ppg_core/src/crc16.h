@@ -0,0 +1,12 @@
+#ifndef PPG_CRC16_H
+#define PPG_CRC16_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-16/CCITT-FALSE (polynomial 0x1021, initial 0xFFFF), the check on
+// trend records, the app's write-behind journal and session cache, and
+// the gateway's session files.
+uint16_t crc16Ccitt(const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef PPG_FIXED_POINT_H
+#define PPG_FIXED_POINT_H
+
+#include <stdint.h>
+
+// Signed fixed-point values with FracBits fractional bits stored in Rep.
+// Every operation saturates at the limits of Rep instead of wrapping, and
+// products are rounded to nearest. Mixed-format products keep the format
+// of the left operand, so a Q16.16 reading scaled by a Q15 coefficient
+// stays Q16.16.
+template <int FracBits, typename Rep>
+class Fixed
+{
+public:
+  static const int FRAC_BITS = FracBits;
+  static const Rep MAX_RAW = (Rep)(((uint64_t)1 << (sizeof(Rep) * 8 - 1)) - 1);
+  static const Rep MIN_RAW = (Rep)(-MAX_RAW - 1);
+
+  constexpr Fixed() : value(0) {}
+
+  static constexpr Fixed fromRaw(Rep raw) { return Fixed(raw, 0); }
+  static Fixed fromInt(int64_t v) { return fromRaw(saturate(v * ((int64_t)1 << FracBits))); }
+  // For constants and host-side conversions; never needed per sample.
+  static Fixed fromFloat(double v)
+  {
+    double scaled = v * (double)((int64_t)1 << FracBits);
+    return fromRaw(saturate((int64_t)(scaled < 0 ? scaled - 0.5 : scaled + 0.5)));
+  }
+  // num / den, rounded, e.g. Q16_16::ratio(60000, rrMs) gives BPM.
+  static Fixed ratio(int64_t num, int64_t den)
+  {
+    if (den == 0)
+      return fromRaw(num < 0 ? MIN_RAW : MAX_RAW);
+    if (den < 0)
+    {
+      num = -num;
+      den = -den;
+    }
+    int64_t scaled = num * ((int64_t)1 << FracBits);
+    int64_t half = den / 2;
+    return fromRaw(saturate((scaled + (scaled < 0 ? -half : half)) / den));
+  }
+
+  Rep raw() const { return value; }
+  float toFloat() const { return (float)value / (float)((int64_t)1 << FracBits); }
+  int32_t toInt() const { return (int32_t)(((int64_t)value + ((int64_t)1 << (FracBits - 1))) >> FracBits); }
+
+  Fixed operator+(Fixed b) const { return fromRaw(saturate((int64_t)value + b.value)); }
+  Fixed operator-(Fixed b) const { return fromRaw(saturate((int64_t)value - b.value)); }
+  Fixed operator-() const { return fromRaw(saturate(-(int64_t)value)); }
+  Fixed &operator+=(Fixed b) { return *this = *this + b; }
+  Fixed &operator-=(Fixed b) { return *this = *this - b; }
+
+  template <int F2, typename R2>
+  Fixed operator*(Fixed<F2, R2> b) const
+  {
+    int64_t p = (int64_t)value * b.raw();
+    return fromRaw(saturate((p + ((int64_t)1 << (F2 - 1))) >> F2));
+  }
+  Fixed operator*(int32_t k) const { return fromRaw(saturate((int64_t)value * k)); }
+  Fixed operator/(int32_t k) const { return k == 0 ? fromRaw(value < 0 ? MIN_RAW : MAX_RAW) : fromRaw(saturate((int64_t)value / k)); }
+
+  bool operator<(Fixed b) const { return value < b.value; }
+  bool operator>(Fixed b) const { return value > b.value; }
+  bool operator<=(Fixed b) const { return value <= b.value; }
+  bool operator>=(Fixed b) const { return value >= b.value; }
+  bool operator==(Fixed b) const { return value == b.value; }
+  bool operator!=(Fixed b) const { return value != b.value; }
+
+  static Rep saturate(int64_t v)
+  {
+    if (v > (int64_t)MAX_RAW)
+      return MAX_RAW;
+    if (v < (int64_t)MIN_RAW)
+      return MIN_RAW;
+    return (Rep)v;
+  }
+
+private:
+  constexpr Fixed(Rep raw, int) : value(raw) {}
+  Rep value;
+};
+
+template <int FracBits, typename Rep>
+const Rep Fixed<FracBits, Rep>::MAX_RAW;
+template <int FracBits, typename Rep>
+const Rep Fixed<FracBits, Rep>::MIN_RAW;
+
+// Coefficients in [-1, 1)
+typedef Fixed<15, int16_t> Q15;
+typedef Fixed<31, int32_t> Q31;
+// Rates, pressures and other readings up to +-32767
+typedef Fixed<16, int32_t> Q16_16;
+
+// floor(sqrt(v)) without floating point.
+inline uint32_t isqrt64(uint64_t v)
+{
+  uint64_t root = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  while (bit > v)
+    bit >>= 2;
+  while (bit != 0)
+  {
+    if (v >= root + bit)
+    {
+      v -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+    {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)root;
+}
+
+#endif
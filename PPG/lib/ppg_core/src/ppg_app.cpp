@@ -0,0 +1,727 @@
+#include "ppg_app.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profiler.h"
+
+namespace
+{
+  bool startsWith(const char *s, const char *prefix)
+  {
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+  }
+
+  const char *SPO2_CURVE_KEY = "spo2curve";
+  const size_t TREND_MAX_FRAME = 512;
+
+  // Stands in when the platform has no flash for trends: begin() fails
+  // and nothing is recorded.
+  class NoFlash : public PpgFlash
+  {
+  public:
+    uint32_t size() { return 0; }
+    bool read(uint32_t, void *, size_t) { return false; }
+    bool write(uint32_t, const void *, size_t) { return false; }
+    bool eraseSector(uint32_t) { return false; }
+  };
+  NoFlash noFlash;
+
+  // Settings keys are short (15 characters in NVS), so the athlete's id
+  // is hashed (FNV-1a) into "bl" + 8 hex digits.
+  void baselineKey(const char *userId, char *out, size_t cap)
+  {
+    uint32_t h = 2166136261u;
+    for (const char *p = userId; *p; p++)
+      h = (h ^ (uint8_t)*p) * 16777619u;
+    snprintf(out, cap, "bl%08lx", (unsigned long)h);
+  }
+
+  // ,"ts":<host epoch ms>, or nothing while the clock is not synchronised
+  void timestampField(int64_t ts, char *out, size_t cap)
+  {
+    if (ts == 0)
+      out[0] = '\0';
+    else
+      snprintf(out, cap, ",\"ts\":%lld", (long long)ts);
+  }
+}
+
+PpgApp::PpgApp(PpgPlatform &platform, PpgSensor &sensor, PpgTransport &transport, PpgFlash *flash)
+    : platform(platform), sensor(sensor), transport(transport), rrSeriesCount(0), spo2(), lastValidSpo2(0),
+      sampleCounter(0), lastSampleTime(0), lastSpO2Update(0), needSpO2Update(false),
+      sessionHRV(0), scoredWindows(0), stressWindows(0), anomalyWindows(0), isRecording(false), sessionNumber(0),
+      startRequested(false), stopRequested(false),
+      trendStore(flash ? *flash : noFlash), trendRecorder(trendStore), trendSession(0), trendRead(),
+      trendRequest(), sampleIndex(0), rawFrame(), rawZFrame(), rawFrameSeq(0), rawZFrameSeq(0), lastHRVWindowTime(0),
+      hrvWindowStart(0), lastDataSentTime(0), sampleClock(1000000 / SAMPLE_RATE_HZ), spo2Curve(SPO2_STANDARD_CURVE)
+#ifdef PPG_PROFILE
+      ,
+      lastProfileDump(0), profileDumpRequested(false), profileResetRequested(false)
+#endif
+{
+  baselineKey("", athleteKey, sizeof(athleteKey));
+}
+
+void PpgApp::begin()
+{
+  Spo2Calibration stored;
+  if (platform.loadSetting(SPO2_CURVE_KEY, &stored, sizeof(stored)) && spo2CalibrationValid(stored))
+  {
+    platform.lock();
+    spo2Curve = stored;
+    platform.unlock();
+    logf("SpO2 calibration loaded: %.3f %.3f %.3f", stored.a, stored.b, stored.c);
+  }
+  if (trendStore.begin())
+    logf("Trends: %lu minutes, %lu sessions, %lu days", (unsigned long)trendStore.nextSeq(TREND_MINUTE),
+         (unsigned long)trendStore.nextSeq(TREND_SESSION), (unsigned long)trendStore.nextSeq(TREND_DAY));
+}
+
+void PpgApp::logf(const char *format, ...)
+{
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  platform.log(line);
+}
+
+void PpgApp::handleCommand(const char *command, uint16_t connId)
+{
+  int64_t receivedUs = (int64_t)platform.micros();
+  if (handleClockSync(command, connId, receivedUs))
+    return;
+#ifdef PPG_PROFILE
+  // Served from loop(), which owns the stats
+  if (startsWith(command, "PROF"))
+  {
+    if (strstr(command + 4, "RESET"))
+      profileResetRequested = true;
+    else
+      profileDumpRequested = true;
+    return;
+  }
+#endif
+  logf("Received command from client %u: %s", connId, command);
+  if (startsWith(command, "CAL"))
+    handleCalibration(command + 3, connId);
+  else if (startsWith(command, "TREND"))
+    handleTrendRead(command + 5, connId);
+  else if (startsWith(command, "START"))
+  {
+    const char *userId = command + 5;
+    while (*userId == ' ')
+      userId++;
+    // The lock is a spinlock on the ESP32: format first, only copy under it
+    char key[sizeof(requestedKey)];
+    baselineKey(userId, key, sizeof(key));
+    platform.lock();
+    memcpy(requestedKey, key, sizeof(requestedKey));
+    startRequested = true;
+    platform.unlock();
+  }
+  else if (startsWith(command, "STOP"))
+  {
+    platform.lock();
+    stopRequested = true;
+    startRequested = false;
+    platform.unlock();
+  }
+}
+
+// Sessions start and stop on loop()'s task, which owns the pipeline, the
+// RR cleaner and the baseline being learned.
+void PpgApp::serviceSessions()
+{
+  platform.lock();
+  bool stop = stopRequested, start = startRequested;
+  char key[sizeof(requestedKey)];
+  memcpy(key, requestedKey, sizeof(key));
+  stopRequested = startRequested = false;
+  platform.unlock();
+  if (stop)
+    stopSession();
+  if (start)
+  {
+    memcpy(athleteKey, key, sizeof(athleteKey));
+    startSession();
+  }
+}
+
+void PpgApp::startSession()
+{
+  AthleteBaseline::State stored;
+  athlete.reset();
+  if (platform.loadSetting(athleteKey, &stored, sizeof(stored)) && athlete.restore(stored))
+    logf("Baseline %s: %u windows, HR %.1f, RMSSD %.1f", athleteKey, (unsigned)stored.count,
+         athlete.mean(AthleteBaseline::HEART_RATE), athlete.mean(AthleteBaseline::RMSSD));
+  scoredWindows = stressWindows = anomalyWindows = 0;
+  for (int c = 0; c < AthleteBaseline::CHANNEL_COUNT; c++)
+    sessionZ[c] = 0;
+  sessionNumber++;
+  isRecording = true;
+  ppg.reset();
+  breathing.reset();
+  rrCleaner.reset();
+  rrSeriesCount = 0;
+  spo2 = Spo2Estimate();
+  lastValidSpo2 = 0;
+  sampleIndex = 0;
+  rawFrame.count = 0;
+  rawZFrame.count = 0;
+  hrvWindowStart = 0;
+  lastHRVWindowTime = platform.millis();
+  platform.lock();
+  sampleClock.reset(0, (int64_t)platform.micros());
+  platform.unlock();
+  platform.log("Session started.");
+}
+
+void PpgApp::stopSession()
+{
+  bool wasRecording = isRecording;
+  isRecording = false;
+  rrCleaner.flush();
+  drainRR();
+  sessionHRV = calculateSessionHRV();
+  const AthleteBaseline::State &learned = athlete.state();
+  if (wasRecording && !platform.saveSetting(athleteKey, &learned, sizeof(learned)))
+    platform.log("Baseline not saved.");
+  platform.log("Session stopped.");
+  // Send HRV summary to every client following the session, with the mean
+  // z-scores of the windows scored against the athlete's baseline
+  char summary[200];
+  if (scoredWindows > 0)
+    snprintf(summary, sizeof(summary),
+             "{\"hrv\":%.2f,\"hrZ\":%.2f,\"rmssdZ\":%.2f,\"sbpZ\":%.2f,\"windows\":%d,\"stressWindows\":%d,"
+             "\"anomalyWindows\":%d}",
+             sessionHRV, sessionZ[AthleteBaseline::HEART_RATE] / scoredWindows,
+             sessionZ[AthleteBaseline::RMSSD] / scoredWindows, sessionZ[AthleteBaseline::SBP] / scoredWindows,
+             scoredWindows, stressWindows, anomalyWindows);
+  else
+    snprintf(summary, sizeof(summary), "{\"hrv\":%.2f}", sessionHRV);
+  transport.send(STREAM_SUMMARY, summary);
+}
+
+void PpgApp::loop()
+{
+  transport.poll();
+  serviceSessions();
+  serviceProfiler();
+  serviceTrends();
+  if (!isRecording)
+  {
+    // Keep a bulk read moving while idle
+    platform.sleepMs(trendRead.active ? 5 : 100);
+    return;
+  }
+  PROFILE_BEGIN(PROF_LOOP);
+
+  // Sensor reading, filtering, peak and beat detection
+  PROFILE_BEGIN(PROF_SENSOR_READ);
+  uint32_t irValue, redValue;
+  sensor.read(irValue, redValue);
+  PROFILE_END(PROF_SENSOR_READ);
+  PROFILE_BEGIN(PROF_PIPELINE);
+  uint32_t nowMs = platform.millis();
+  if (ppg.addSample(irValue, redValue, nowMs) & PpgPipeline::PEAK)
+  {
+    breathing.addBeat(nowMs, ppg.beatPeak(), ppg.beatTrough());
+    rrCleaner.addBeat(nowMs);
+    drainRR();
+  }
+  PROFILE_END(PROF_PIPELINE);
+  PROFILE_BEGIN(PROF_RAW_FRAME);
+  sendRawSample(irValue, redValue);
+  PROFILE_END(PROF_RAW_FRAME);
+  sampleIndex++;
+  if (sampleIndex % SAMPLE_RATE_HZ == 0)
+  {
+    platform.lock();
+    sampleClock.mark(sampleIndex, (int64_t)platform.micros());
+    platform.unlock();
+  }
+
+  // SpO2 calculation
+  if (platform.millis() - lastSampleTime > 10)
+  {
+    lastSampleTime = platform.millis();
+    irBuffer[sampleCounter] = ppg.irFiltered();
+    redBuffer[sampleCounter] = ppg.redFiltered();
+    sampleCounter++;
+    if (sampleCounter >= SPO2_BUFFER)
+    {
+      needSpO2Update = true;
+      sampleCounter = 0;
+    }
+  }
+  if (needSpO2Update && platform.millis() - lastSpO2Update > 1000)
+  {
+    PROFILE_BEGIN(PROF_SPO2);
+    platform.lock();
+    Spo2Calibration curve = spo2Curve;
+    platform.unlock();
+    if (estimateSpo2(irBuffer, redBuffer, SPO2_BUFFER, spo2, curve))
+      lastValidSpo2 = spo2.spo2;
+    PROFILE_END(PROF_SPO2);
+    lastSpO2Update = platform.millis();
+    needSpO2Update = false;
+  }
+
+  // --- SEND DATA EVERY SECOND, NO MATTER WHAT ---
+  uint32_t currentTime = platform.millis();
+  if (currentTime - lastHRVWindowTime >= HRV_WINDOW_MS)
+    sendHRVWindow(currentTime);
+  if (currentTime - lastDataSentTime >= 1000)
+  {
+    lastDataSentTime = currentTime;
+    trendRecorder.addSecond(hostEpochS(), ppg.heartRate().toFloat(), spo2.valid ? spo2.spo2 : 0,
+                            ppg.systolic().toFloat(), ppg.diastolic().toFloat());
+    sendSummary();
+  }
+  PROFILE_END(PROF_LOOP);
+}
+
+void PpgApp::sendSummary()
+{
+  // Nobody is listening; skip building the payload entirely.
+  if (!transport.hasSubscribers(STREAM_SUMMARY))
+    return;
+
+  PROFILE_BEGIN(PROF_SUMMARY_BUILD);
+  char ts[24];
+  timestampField(sampleTimestampMs(sampleIndex - 1), ts, sizeof(ts));
+  char data[240];
+  snprintf(data, sizeof(data),
+           "{\"heartRate\":%.1f,\"avgHeartRate\":%.1f,\"sbp\":%.1f,\"dbp\":%.1f,\"oxygen\":%.1f,"
+           "\"spo2Valid\":%d,\"spo2Conf\":%.2f,\"perfusion\":%.2f,\"respRate\":%.1f,\"timestamp\":%lu%s}",
+           ppg.heartRate().toFloat(), ppg.averageHeartRate().toFloat(), ppg.systolic().toFloat(),
+           ppg.diastolic().toFloat(), lastValidSpo2, spo2.valid ? 1 : 0, spo2.confidence, spo2.perfusion,
+           breathing.rate(), (unsigned long)platform.millis(), ts);
+  PROFILE_END(PROF_SUMMARY_BUILD);
+  PROFILE_BEGIN(PROF_NOTIFY);
+  transport.send(STREAM_SUMMARY, data);
+  PROFILE_END(PROF_NOTIFY);
+  PROFILE_BEGIN(PROF_SERIAL);
+  logf("Data sent to app: %s", data);
+  PROFILE_END(PROF_SERIAL);
+}
+
+// Cleaned intervals beyond the session's peak capacity are dropped, as
+// the pipeline drops the peaks.
+void PpgApp::drainRR()
+{
+  RrInterval rr;
+  while (rrCleaner.next(rr))
+  {
+    if (rrSeriesCount < PpgPipeline::MAX_PEAKS)
+      rrSeries[rrSeriesCount++] = rr;
+  }
+}
+
+float PpgApp::calculateSessionHRV()
+{
+  HrvStats hrv;
+  if (!computeHrv(rrSeries, 0, rrSeriesCount, hrv))
+    return 0.0;
+  return hrv.sdnn;
+}
+
+#ifdef PPG_PROFILE
+void PpgApp::emitProfileLine(const char *line, void *context)
+{
+  PpgApp *app = (PpgApp *)context;
+  app->platform.log(line);
+  app->transport.send(STREAM_DIAG, line);
+}
+#endif
+
+// Stage timings go to the log and "diag" subscribers every PROFILE_DUMP_MS
+// while recording, and whenever a client sends PROF.
+void PpgApp::serviceProfiler()
+{
+#ifdef PPG_PROFILE
+  if (profileResetRequested)
+  {
+    profileResetRequested = false;
+    profileReset();
+  }
+  uint32_t now = platform.millis();
+  if (profileDumpRequested || (isRecording && now - lastProfileDump >= PROFILE_DUMP_MS))
+  {
+    profileDumpRequested = false;
+    lastProfileDump = now;
+    profileDump(emitProfileLine, this);
+  }
+#endif
+}
+
+void PpgApp::sendRawSample(uint32_t irValue, uint32_t redValue)
+{
+  packRawSample(rawFrame, STREAM_RAW, irValue, redValue);
+  packRawSample(rawZFrame, STREAM_RAW_Z, irValue, redValue);
+}
+
+// Raw samples are only packed into frames while a client wants them.
+void PpgApp::packRawSample(RawFrame &frame, uint8_t stream, uint32_t irValue, uint32_t redValue)
+{
+  if (!transport.hasSubscribers(stream))
+  {
+    frame.count = 0;
+    return;
+  }
+  if (frame.count == 0)
+  {
+    frame.firstSample = sampleIndex;
+    frame.timestampMs = sampleTimestampMs(sampleIndex);
+    platform.lock();
+    frame.samplePeriodNs = (uint32_t)(sampleClock.samplePeriodUs() * 1000 + 0.5);
+    platform.unlock();
+  }
+  frame.ir[frame.count] = irValue;
+  frame.red[frame.count] = redValue;
+  bool compressed = stream == STREAM_RAW_Z;
+  if (++frame.count < (compressed ? RAW_Z_SAMPLES_PER_FRAME : RAW_SAMPLES_PER_FRAME))
+    return;
+  uint8_t buffer[RAW_Z_FRAME_MAX_SIZE];
+  size_t len;
+  if (compressed)
+  {
+    frame.seq = rawZFrameSeq++;
+    len = encodeCompressedRawFrame(frame, buffer, sizeof(buffer));
+  }
+  else
+  {
+    frame.seq = rawFrameSeq++;
+    len = encodeRawFrame(frame, buffer, sizeof(buffer));
+  }
+  transport.send(stream, buffer, len);
+  frame.count = 0;
+}
+
+void PpgApp::sendHRVWindow(uint32_t now)
+{
+  int from = hrvWindowStart;
+  int count = rrSeriesCount;
+  hrvWindowStart = count;
+  lastHRVWindowTime = now;
+  HrvStats hrv;
+  if (!computeHrv(rrSeries, from, count, hrv))
+    return;
+  RrCorrections fixes = countCorrections(rrSeries, from, count);
+  AthleteBaseline::Score score = scoreWindow(hrv, fixes);
+  trendRecorder.addHrvWindow(hrv.rmssd, hrv.sdnn,
+                             score.ready ? (score.z[AthleteBaseline::HEART_RATE] - score.z[AthleteBaseline::RMSSD]) / 2
+                                         : NAN);
+  if (!transport.hasSubscribers(STREAM_HRV))
+    return;
+  char ts[24];
+  timestampField(sampleTimestampMs(sampleIndex), ts, sizeof(ts));
+  char z[80] = "";
+  if (score.ready)
+    snprintf(z, sizeof(z), ",\"hrZ\":%.2f,\"rmssdZ\":%.2f,\"sbpZ\":%.2f,\"flags\":%u",
+             score.z[AthleteBaseline::HEART_RATE], score.z[AthleteBaseline::RMSSD], score.z[AthleteBaseline::SBP],
+             (unsigned)score.flags);
+  char data[320];
+  snprintf(data, sizeof(data),
+           "{\"type\":\"hrv\",\"sdnn\":%.1f,\"rmssd\":%.1f,\"beats\":%d,\"windowMs\":%lu,\"timestamp\":%lu%s,"
+           "\"missed\":%d,\"extra\":%d,\"ectopic\":%d,\"artifact\":%d%s}",
+           hrv.sdnn, hrv.rmssd, hrv.beats, (unsigned long)HRV_WINDOW_MS, (unsigned long)now, ts, fixes.missed,
+           fixes.extra, fixes.ectopic, fixes.artifact, z);
+  transport.send(STREAM_HRV, data);
+}
+
+// Windows with too few beats or too many corrections are neither scored
+// nor learned from.
+AthleteBaseline::Score PpgApp::scoreWindow(const HrvStats &hrv, const RrCorrections &fixes)
+{
+  AthleteBaseline::Score score = {};
+  int corrected = fixes.missed + fixes.extra + fixes.ectopic + fixes.artifact;
+  if (hrv.beats < BASELINE_MIN_BEATS || hrv.meanRR <= 0 || corrected * 100 > hrv.beats * BASELINE_MAX_CORRECTED_PCT)
+    return score;
+  score = athlete.observe(60000.0f / hrv.meanRR, hrv.rmssd, ppg.systolic().toFloat());
+  if (!score.ready)
+    return score;
+  scoredWindows++;
+  for (int c = 0; c < AthleteBaseline::CHANNEL_COUNT; c++)
+    sessionZ[c] += score.z[c];
+  if (score.flags & AthleteBaseline::STRESS)
+    stressWindows++;
+  if (score.flags & ~AthleteBaseline::STRESS)
+    anomalyWindows++;
+  return score;
+}
+
+// CAL                 reply with the curve in use
+// CAL <a> <b> <c>     use and persist SpO2 = a R^2 + b R + c
+// CAL RESET           back to the standard curve
+// The reply goes to the sender only.
+void PpgApp::handleCalibration(const char *args, uint16_t connId)
+{
+  platform.lock();
+  Spo2Calibration curve = spo2Curve;
+  platform.unlock();
+  const char *error = nullptr;
+  bool saved = false;
+  while (*args == ' ')
+    args++;
+  if (startsWith(args, "RESET"))
+  {
+    curve = SPO2_STANDARD_CURVE;
+    saved = true;
+  }
+  else if (*args)
+  {
+    Spo2Calibration fit;
+    if (sscanf(args, "%f %f %f", &fit.a, &fit.b, &fit.c) != 3)
+      error = "expected CAL <a> <b> <c>";
+    else if (!spo2CalibrationValid(fit))
+      error = "curve must fall from R 0.4 to 1.2 within 50-105%";
+    else
+    {
+      curve = fit;
+      saved = true;
+    }
+  }
+  if (saved)
+  {
+    platform.lock();
+    spo2Curve = curve;
+    platform.unlock();
+    if (!platform.saveSetting(SPO2_CURVE_KEY, &curve, sizeof(curve)))
+      error = "curve in use but not persisted";
+  }
+  char reply[160];
+  if (error)
+    snprintf(reply, sizeof(reply), "{\"type\":\"cal\",\"a\":%.4f,\"b\":%.4f,\"c\":%.4f,\"error\":\"%s\"}", curve.a,
+             curve.b, curve.c, error);
+  else
+    snprintf(reply, sizeof(reply), "{\"type\":\"cal\",\"a\":%.4f,\"b\":%.4f,\"c\":%.4f}", curve.a, curve.b,
+             curve.c);
+  transport.sendTo(connId, reply);
+}
+
+// TREND <minute|session|day> [sinceSeq] [maxBytes]
+// Reads a trend tier back from sinceSeq (default: everything held) to the
+// end. The sender gets {"type":"trend",...} with the range, binary frames
+// (trend_store.h) of at most maxBytes (default 180, which fits a 185 byte
+// MTU), then {"type":"trendEnd",...}. A new TREND replaces a read in
+// progress.
+void PpgApp::handleTrendRead(const char *args, uint16_t connId)
+{
+  char name[12] = "";
+  unsigned long since = 0, maxBytes = 180;
+  TrendTier tier;
+  int fields = sscanf(args, "%11s %lu %lu", name, &since, &maxBytes);
+  const char *error = nullptr;
+  if (fields < 1 || !parseTrendTier(name, tier))
+    error = "expected TREND <minute|session|day> [sinceSeq] [maxBytes]";
+  else if (maxBytes < TREND_FRAME_HEADER_SIZE + TREND_RECORD_SIZE)
+    error = "maxBytes too small for one record";
+  if (error)
+  {
+    char reply[128];
+    snprintf(reply, sizeof(reply), "{\"type\":\"trend\",\"error\":\"%s\"}", error);
+    transport.sendTo(connId, reply);
+    return;
+  }
+  if (maxBytes > TREND_MAX_FRAME)
+    maxBytes = TREND_MAX_FRAME;
+  TrendRead request = {};
+  request.active = true;
+  request.connId = connId;
+  request.tier = tier;
+  request.seq = since;
+  request.frameRecords = (uint8_t)((maxBytes - TREND_FRAME_HEADER_SIZE) / TREND_RECORD_SIZE);
+  platform.lock();
+  trendRequest = request;
+  platform.unlock();
+}
+
+// Follows the sessions into the trend store and serves bulk reads. Flash
+// is only touched from here, whichever task the commands arrive on.
+void PpgApp::serviceTrends()
+{
+  if (trendRecorder.recording() && (!isRecording || trendSession != sessionNumber))
+    trendRecorder.finish(hostEpochS());
+  if (isRecording && !trendRecorder.recording())
+  {
+    trendSession = sessionNumber;
+    trendRecorder.start(hostEpochS());
+  }
+
+  platform.lock();
+  TrendRead request = trendRequest;
+  trendRequest.active = false;
+  platform.unlock();
+  if (request.active)
+  {
+    uint32_t first = trendStore.firstSeq(request.tier);
+    request.end = trendStore.nextSeq(request.tier);
+    if (request.seq < first)
+      request.seq = first;
+    if (request.seq > request.end)
+      request.seq = request.end;
+    trendRead = request;
+  }
+  if (!trendRead.active)
+    return;
+
+  char text[160];
+  const char *tier = trendTierName(trendRead.tier);
+  if (!trendRead.headerSent)
+  {
+    if (!trendStore.isReady())
+      snprintf(text, sizeof(text), "{\"type\":\"trend\",\"tier\":\"%s\",\"error\":\"no trend store\"}", tier);
+    else
+      snprintf(text, sizeof(text),
+               "{\"type\":\"trend\",\"tier\":\"%s\",\"first\":%lu,\"next\":%lu,\"records\":%lu,\"recordSize\":%u}",
+               tier, (unsigned long)trendStore.firstSeq(trendRead.tier), (unsigned long)trendRead.end,
+               (unsigned long)(trendRead.end - trendRead.seq), (unsigned)TREND_RECORD_SIZE);
+    if (!transport.sendTo(trendRead.connId, text))
+    {
+      if (++trendRead.retries > TREND_MAX_RETRIES)
+        trendRead.active = false;
+      return;
+    }
+    trendRead.headerSent = true;
+    trendRead.retries = 0;
+    if (!trendStore.isReady())
+    {
+      trendRead.active = false;
+      return;
+    }
+  }
+  for (int i = 0; i < TREND_FRAMES_PER_LOOP && trendRead.seq < trendRead.end; i++)
+  {
+    if (!sendTrendFrame())
+    {
+      // The link is congested or gone; try again on the next pass
+      if (++trendRead.retries > TREND_MAX_RETRIES)
+      {
+        logf("Trend read to client %u abandoned", trendRead.connId);
+        trendRead.active = false;
+      }
+      return;
+    }
+    trendRead.retries = 0;
+  }
+  if (trendRead.seq < trendRead.end)
+    return;
+  snprintf(text, sizeof(text), "{\"type\":\"trendEnd\",\"tier\":\"%s\",\"sent\":%lu,\"next\":%lu}", tier,
+           (unsigned long)trendRead.sent, (unsigned long)trendRead.end);
+  if (transport.sendTo(trendRead.connId, text))
+    trendRead.active = false;
+  else if (++trendRead.retries > TREND_MAX_RETRIES)
+    trendRead.active = false;
+}
+
+// Sends the next frame of the read. Records that fail their CRC are
+// skipped; on a failed send the read stays where it was.
+bool PpgApp::sendTrendFrame()
+{
+  uint8_t frame[TREND_MAX_FRAME];
+  uint32_t seq = trendRead.seq;
+  uint8_t count = 0;
+  while (count < trendRead.frameRecords && seq < trendRead.end)
+  {
+    TrendRecord r;
+    if (trendStore.read(trendRead.tier, seq++, r))
+      encodeTrendRecord(r, frame + TREND_FRAME_HEADER_SIZE + count++ * TREND_RECORD_SIZE);
+  }
+  if (count > 0)
+  {
+    frame[0] = TREND_FRAME_MAGIC;
+    frame[1] = TREND_FRAME_VERSION;
+    frame[2] = trendRead.tier;
+    frame[3] = count;
+    if (!transport.sendTo(trendRead.connId, frame, TREND_FRAME_HEADER_SIZE + count * TREND_RECORD_SIZE))
+      return false;
+  }
+  trendRead.seq = seq;
+  trendRead.sent += count;
+  return true;
+}
+
+// Host epoch seconds now, or 0 while no host has synchronised the clock
+uint32_t PpgApp::hostEpochS()
+{
+  int64_t ms = 0;
+  platform.lock();
+  const ClockSync *clock = clockSyncs.reference();
+  if (clock)
+    ms = clock->toHostMs((int64_t)platform.micros());
+  platform.unlock();
+  return ms > 0 ? (uint32_t)(ms / 1000) : 0;
+}
+
+// SYNC/SYNCFIN implement the exchange described in clock_sync.h. t2 is
+// taken before any logging so the reply reflects only stack latency.
+bool PpgApp::handleClockSync(const char *command, uint16_t connId, int64_t receivedUs)
+{
+  if (startsWith(command, "SYNCFIN "))
+  {
+    char *end;
+    uint32_t seq = strtoul(command + 8, &end, 10);
+    double t4 = strtod(end, nullptr);
+    platform.lock();
+    clockSyncs.finish(connId, seq, t4);
+    platform.unlock();
+    return true;
+  }
+  if (startsWith(command, "SYNC "))
+  {
+    char *end;
+    uint32_t seq = strtoul(command + 5, &end, 10);
+    double t1 = strtod(end, nullptr);
+    char reply[160];
+    double offset = 0, drift = 0;
+    bool synced = false;
+    platform.lock();
+    const ClockSync *clock = clockSyncs.find(connId);
+    if (clock)
+    {
+      offset = clock->offsetMs();
+      drift = clock->driftPpm();
+      synced = clock->synced();
+    }
+    platform.unlock();
+    int64_t sentUs = (int64_t)platform.micros();
+    snprintf(reply, sizeof(reply),
+             "{\"type\":\"sync\",\"seq\":%u,\"t1\":%.0f,\"t2\":%lld,\"t3\":%lld,\"synced\":%d,"
+             "\"offsetMs\":%.1f,\"driftPpm\":%.1f}",
+             (unsigned)seq, t1, (long long)receivedUs, (long long)sentUs, synced, offset, drift);
+    transport.sendTo(connId, reply);
+    platform.lock();
+    clockSyncs.begin(connId, seq, t1, receivedUs, sentUs);
+    platform.unlock();
+    return true;
+  }
+  return false;
+}
+
+// A host's clock fit goes with its connection.
+void PpgApp::handleDisconnect(uint16_t connId)
+{
+  platform.lock();
+  clockSyncs.drop(connId);
+  platform.unlock();
+}
+
+// Host epoch ms of a sample, derived from the sample counter, or 0 while
+// no host has synchronised the clock yet.
+int64_t PpgApp::sampleTimestampMs(uint32_t index)
+{
+  int64_t ts = 0;
+  platform.lock();
+  const ClockSync *clock = clockSyncs.reference();
+  if (clock)
+    ts = clock->toHostMs(sampleClock.toDeviceUs(index));
+  platform.unlock();
+  return ts;
+}
@@ -0,0 +1,154 @@
+#ifndef PPG_APP_H
+#define PPG_APP_H
+
+#include <stdint.h>
+
+#include "athlete_baseline.h"
+#include "clock_sync.h"
+#include "ppg_hal.h"
+#include "ppg_pipeline.h"
+#include "respiration_estimator.h"
+#include "rr_cleaner.h"
+#include "spo2_estimator.h"
+#include "telemetry.h"
+#include "trend_store.h"
+
+// The sensor application: recording sessions started and stopped by
+// command, the per-sample pipeline, and the summary/raw/HRV/diag streams.
+// Everything hardware specific goes through the HAL, so the same code
+// runs on the ESP32 and as a Linux process.
+//
+// handleCommand() and handleDisconnect() may be called from the transport's task; loop() from
+// the main one, which also runs the START and STOP it queues. begin() loads the persisted settings (the SpO2
+// calibration curve, see CAL in handleCommand()) once the platform is up.
+//
+// "START <user id>" records for that athlete: their baseline is loaded
+// at the start and saved at the end of the session, and every HRV window
+// is scored against it. A bare START uses a shared anonymous baseline.
+//
+// With a flash region, every session also feeds the long-term trend store
+// (trend_store.h), which "TREND" reads back in bulk.
+class PpgApp
+{
+public:
+  static const int SPO2_BUFFER = 100;
+  static const uint32_t HRV_WINDOW_MS = 30000;
+  static const int BASELINE_MIN_BEATS = 20;       // per window, or it is not learned from
+  static const int BASELINE_MAX_CORRECTED_PCT = 20;
+  static const int TREND_FRAMES_PER_LOOP = 4;
+  static const int TREND_MAX_RETRIES = 200; // loop passes without progress before a read is dropped
+
+  PpgApp(PpgPlatform &platform, PpgSensor &sensor, PpgTransport &transport, PpgFlash *flash = nullptr);
+
+  void begin();
+  void handleCommand(const char *command, uint16_t connId);
+  void handleDisconnect(uint16_t connId);
+  void loop();
+
+  bool recording() const { return isRecording; }
+  uint32_t samples() const { return sampleIndex; }
+  const PpgPipeline &pipeline() const { return ppg; }
+  const RespirationEstimator &respiration() const { return breathing; }
+  const Spo2Estimate &oxygen() const { return spo2; }
+  const AthleteBaseline &baseline() const { return athlete; }
+  const TrendStore &trends() const { return trendStore; }
+  const RrInterval *rrIntervals() const { return rrSeries; }
+  int rrCount() const { return rrSeriesCount; }
+
+private:
+  void startSession();
+  void stopSession();
+  void serviceSessions();
+  float calculateSessionHRV();
+  void drainRR();
+  void sendRawSample(uint32_t irValue, uint32_t redValue);
+  void packRawSample(RawFrame &frame, uint8_t stream, uint32_t irValue, uint32_t redValue);
+  void sendHRVWindow(uint32_t now);
+  AthleteBaseline::Score scoreWindow(const HrvStats &hrv, const RrCorrections &fixes);
+  void sendSummary();
+  void handleCalibration(const char *args, uint16_t connId);
+  void handleTrendRead(const char *args, uint16_t connId);
+  void serviceTrends();
+  bool sendTrendFrame();
+  uint32_t hostEpochS();
+  void serviceProfiler();
+  bool handleClockSync(const char *command, uint16_t connId, int64_t receivedUs);
+  int64_t sampleTimestampMs(uint32_t index);
+  void logf(const char *format, ...);
+#ifdef PPG_PROFILE
+  static void emitProfileLine(const char *line, void *context);
+#endif
+
+  PpgPlatform &platform;
+  PpgSensor &sensor;
+  PpgTransport &transport;
+
+  // Sensor variables
+  PpgPipeline ppg;
+  RespirationEstimator breathing;
+  RrCleaner rrCleaner;
+  RrInterval rrSeries[PpgPipeline::MAX_PEAKS];
+  int rrSeriesCount;
+  uint32_t irBuffer[SPO2_BUFFER], redBuffer[SPO2_BUFFER];
+  Spo2Estimate spo2;   // latest window
+  float lastValidSpo2; // what the summary reports, 0 before the first valid window
+  int sampleCounter;
+  uint32_t lastSampleTime, lastSpO2Update;
+  bool needSpO2Update;
+  float sessionHRV;
+
+  // Per-athlete baseline, persisted under athleteKey
+  AthleteBaseline athlete;
+  char athleteKey[12];
+  int scoredWindows, stressWindows, anomalyWindows;
+  float sessionZ[AthleteBaseline::CHANNEL_COUNT]; // sums over scored windows
+  volatile bool isRecording;
+  volatile uint32_t sessionNumber; // counts START commands
+  // Set by START/STOP from the command handler, under platform.lock(); a
+  // STOP cancels a START not yet served
+  bool startRequested, stopRequested;
+  char requestedKey[12];
+
+  // Trend store, only touched from loop()
+  TrendStore trendStore;
+  TrendRecorder trendRecorder;
+  uint32_t trendSession; // sessionNumber the recorder is following
+  struct TrendRead
+  {
+    bool active;
+    bool headerSent;
+    uint16_t connId;
+    TrendTier tier;
+    uint32_t seq;  // next record to send
+    uint32_t end;  // nextSeq when the read started
+    uint8_t frameRecords;
+    uint32_t sent;
+    int retries;
+  };
+  TrendRead trendRead;
+  // Set by TREND from the command handler, under platform.lock()
+  TrendRead trendRequest;
+
+  // Streaming state
+  uint32_t sampleIndex;
+  RawFrame rawFrame, rawZFrame;
+  uint16_t rawFrameSeq, rawZFrameSeq;
+  uint32_t lastHRVWindowTime;
+  int hrvWindowStart; // first rrSeries entry of the next HRV window
+  uint32_t lastDataSentTime;
+
+  // Clock sync: updated from the command handler, read from loop(), both
+  // under platform.lock()
+  ClockSyncSet clockSyncs;
+  SampleClock sampleClock;
+  // Set by CAL from the command handler, under platform.lock()
+  Spo2Calibration spo2Curve;
+
+#ifdef PPG_PROFILE
+  static const uint32_t PROFILE_DUMP_MS = 10000;
+  uint32_t lastProfileDump;
+  volatile bool profileDumpRequested, profileResetRequested;
+#endif
+};
+
+#endif
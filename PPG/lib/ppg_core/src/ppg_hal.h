@@ -0,0 +1,97 @@
+#ifndef PPG_HAL_H
+#define PPG_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// The hardware the application (ppg_app.h) runs on. The ESP32 build
+// implements these over the MAX30105 driver, Bluedroid and the Arduino
+// core (src/hal_esp32.h); the Linux simulator implements them over a
+// synthetic sensor, TCP sockets and a scalable clock (src/host/sim/).
+
+class PpgPlatform
+{
+public:
+  virtual ~PpgPlatform() {}
+
+  // Monotonic time since boot
+  virtual uint64_t micros() = 0;
+  virtual uint32_t millis() { return (uint32_t)(micros() / 1000); }
+  virtual void sleepMs(uint32_t ms) = 0;
+  virtual void log(const char *line) = 0;
+
+  // Guards state shared between the command handler and loop(), which run
+  // on different tasks on the ESP32. Held only for a few instructions.
+  virtual void lock() = 0;
+  virtual void unlock() = 0;
+
+  // Small settings that survive a reboot (NVS on the ESP32). load fails
+  // when the key was never saved or was saved with another size.
+  virtual bool loadSetting(const char *, void *, size_t) { return false; }
+  virtual bool saveSetting(const char *, const void *, size_t) { return false; }
+};
+
+class PpgSensor
+{
+public:
+  virtual ~PpgSensor() {}
+
+  virtual bool begin() = 0;
+  // Blocks until the sensor has a new sample. Both values are 0 if none
+  // arrived in time, as the MAX30105 driver reports a timeout.
+  virtual void read(uint32_t &ir, uint32_t &red) = 0;
+};
+
+// Called for every command that is not a subscription change (SUB/UNSUB
+// are handled by the transport). May run on another task than loop().
+typedef void (*TransportCommandHandler)(const char *command, uint16_t connId);
+// Called once a connection has closed, from the same task as the command
+// handler. Its connId may be reused by a later connection.
+typedef void (*TransportDisconnectHandler)(uint16_t connId);
+
+// Connection-oriented notification channel with per-connection stream
+// subscriptions, i.e. the BLE RX/TX characteristics.
+class PpgTransport
+{
+public:
+  virtual ~PpgTransport() {}
+
+  virtual bool begin(const char *deviceName, TransportCommandHandler handler,
+                     TransportDisconnectHandler disconnected) = 0;
+  // Services connections and commands on transports that are not event
+  // driven; called at the top of every loop().
+  virtual void poll() {}
+
+  // Streams at least one connection is subscribed to; cheap enough to
+  // call per sample.
+  virtual uint8_t subscribedStreams() = 0;
+  bool hasSubscribers(uint8_t stream) { return (subscribedStreams() & stream) != 0; }
+
+  // Sends to every connection subscribed to stream and returns how many
+  // were reached.
+  virtual int send(uint8_t stream, const uint8_t *data, size_t len) = 0;
+  int send(uint8_t stream, const char *text) { return send(stream, (const uint8_t *)text, strlen(text)); }
+  // To one connection regardless of its subscriptions. Returns false when
+  // the link cannot take it now (gone, congested, payload over its MTU).
+  virtual bool sendTo(uint16_t connId, const uint8_t *data, size_t len) = 0;
+  bool sendTo(uint16_t connId, const char *text) { return sendTo(connId, (const uint8_t *)text, strlen(text)); }
+};
+
+// A raw flash region, as NOR flash behaves: erased a SECTOR_SIZE sector
+// at a time to 0xFF, and writes can only clear bits. Holds the trend
+// store (trend_store.h).
+class PpgFlash
+{
+public:
+  static const uint32_t SECTOR_SIZE = 4096;
+
+  virtual ~PpgFlash() {}
+
+  virtual uint32_t size() = 0; // a multiple of SECTOR_SIZE
+  virtual bool read(uint32_t offset, void *data, size_t len) = 0;
+  virtual bool write(uint32_t offset, const void *data, size_t len) = 0;
+  virtual bool eraseSector(uint32_t offset) = 0;
+};
+
+#endif
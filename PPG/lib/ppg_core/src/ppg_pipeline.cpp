@@ -0,0 +1,230 @@
+#include "ppg_pipeline.h"
+
+namespace
+{
+  const Q15 FILTER_ALPHA = Q15::fromFloat(0.7);
+  const Q15 BPM_ALPHA = Q15::fromFloat(0.3);
+  // Beats outside [0.7, 1.3] x the running average are treated as outliers
+  const Q15 OUTLIER_LOW = Q15::fromFloat(0.7);
+  const Q15 OUTLIER_HIGH = Q15::fromFloat(0.3);
+  const Q16_16 BPM_MIN = Q16_16::fromInt(20);
+  const Q16_16 BPM_MAX = Q16_16::fromInt(255);
+  const Q16_16 INITIAL_RATE = Q16_16::fromInt(75);
+
+  // Empirical pulse-shape model: base + amplitude + width + heart rate terms
+  const Q16_16 SBP_BASE = Q16_16::fromInt(115);
+  const Q31 SBP_AMPLITUDE = Q31::fromFloat(0.004);
+  const Q31 SBP_WIDTH = Q31::fromFloat(0.04);
+  const Q15 SBP_RATE = Q15::fromFloat(0.15);
+  const Q16_16 DBP_BASE = Q16_16::fromInt(75);
+  const Q31 DBP_AMPLITUDE = Q31::fromFloat(0.0015);
+  const Q31 DBP_WIDTH = Q31::fromFloat(0.015);
+  const Q15 DBP_RATE = Q15::fromFloat(0.08);
+
+  // Integer reading times a small coefficient; Q31 keeps the amplitude
+  // terms accurate even for swings of a few hundred thousand counts.
+  Q16_16 scaled(int32_t v, Q31 k)
+  {
+    return Q16_16::fromRaw(Q16_16::saturate(((int64_t)v * k.raw() + (1 << 14)) >> 15));
+  }
+}
+
+int32_t emaFilter(int32_t newValue, int32_t prevValue, Q15 alpha)
+{
+  if (prevValue == 0)
+    return newValue;
+  // prev + alpha * (new - prev), floored like the float version truncated
+  int64_t step = ((int64_t)(newValue - prevValue) * alpha.raw()) >> 15;
+  return prevValue + (int32_t)step;
+}
+
+void PpgPipeline::reset()
+{
+  irFilt = redFilt = 0;
+  prev1 = prev2 = prevFiltered = 0;
+  lastPeakTime = 0;
+  troughSincePeak = INT32_MAX;
+  lastBeatPeak = lastBeatTrough = 0;
+  beatAmplitude = 0;
+  refractory = MIN_PEAK_INTERVAL_MS;
+  intervalCount = intervalNext = 0;
+  riseLow = risePrevLow = INT32_MAX;
+  riseBlockMs = 0;
+  peaks = 0;
+  filteredBpm = Q16_16();
+  beatAvg = Q16_16();
+  for (int i = 0; i < RATE_SIZE; i++)
+    rates[i] = INITIAL_RATE;
+  rateSpot = 0;
+  outliers = 0;
+  wasRising = false;
+  pulseMin = 0;
+  pulseMinTime = 0;
+  pulseAmplitude = 0;
+  pulseWidthMs = 0;
+  updateBloodPressure();
+}
+
+uint8_t PpgPipeline::addSample(int32_t ir, int32_t red, uint32_t nowMs)
+{
+  uint8_t events = 0;
+  irFilt = emaFilter(ir, irFilt, FILTER_ALPHA);
+  redFilt = emaFilter(red, redFilt, FILTER_ALPHA);
+
+  if (prev1 != 0 && prev1 < troughSincePeak)
+    troughSincePeak = prev1;
+  int32_t rise = 0;
+  if (prev2 < prev1 && prev1 > irFilt && prev1 > PEAK_THRESHOLD && isBeat(nowMs, rise))
+  {
+    if (peaks < MAX_PEAKS)
+      peakTime[peaks++] = nowMs;
+    events |= PEAK;
+    lastBeatPeak = prev1;
+    lastBeatTrough = troughSincePeak;
+    troughSincePeak = INT32_MAX;
+    if (lastPeakTime > 0)
+    {
+      if (updateHeartRate(nowMs - lastPeakTime))
+        events |= BEAT;
+    }
+    acceptBeat(nowMs, rise);
+  }
+  prev2 = prev1;
+  prev1 = irFilt;
+  // Lowest points of this and the previous RISE_BLOCK_MS, so a rise is
+  // measured over RISE_BLOCK_MS to twice that
+  if (nowMs - riseBlockMs > RISE_BLOCK_MS)
+  {
+    risePrevLow = riseLow;
+    riseLow = irFilt;
+    riseBlockMs = nowMs;
+  }
+  else if (irFilt < riseLow)
+    riseLow = irFilt;
+
+  // prevFiltered is 0 only before the first sample, which is not a minimum
+  if (!wasRising && prevFiltered != 0 && irFilt > prevFiltered)
+  {
+    pulseMin = prevFiltered;
+    pulseMinTime = nowMs;
+    wasRising = true;
+  }
+  else if (wasRising && irFilt < prevFiltered)
+  {
+    pulseAmplitude = prevFiltered - pulseMin;
+    pulseWidthMs = (int32_t)(nowMs - pulseMinTime);
+    wasRising = false;
+    updateBloodPressure();
+    events |= PULSE;
+  }
+  prevFiltered = irFilt;
+  return events;
+}
+
+// Sets rise once past the refractory period
+bool PpgPipeline::isBeat(uint32_t nowMs, int32_t &rise) const
+{
+  uint32_t elapsed = nowMs - lastPeakTime;
+  if (elapsed <= refractory)
+    return false;
+  rise = prev1 - (risePrevLow < riseLow ? risePrevLow : riseLow);
+  if (beatAmplitude == 0 || elapsed > MAX_PEAK_INTERVAL_MS)
+    return true;
+  return (int64_t)rise * 100 >= (int64_t)beatAmplitude * MIN_PROMINENCE_PCT;
+}
+
+void PpgPipeline::acceptBeat(uint32_t nowMs, int32_t rise)
+{
+  uint32_t elapsed = nowMs - lastPeakTime;
+  if (beatAmplitude == 0 || elapsed > MAX_PEAK_INTERVAL_MS)
+    beatAmplitude = rise;
+  else
+    beatAmplitude += (rise - beatAmplitude) / 4;
+  if (lastPeakTime > 0 && elapsed <= MAX_PEAK_INTERVAL_MS)
+  {
+    intervals[intervalNext] = (uint16_t)elapsed;
+    intervalNext = (intervalNext + 1) % INTERVAL_HISTORY;
+    if (intervalCount < INTERVAL_HISTORY)
+      intervalCount++;
+    // Median by insertion sort; at most INTERVAL_HISTORY values
+    uint16_t sorted[INTERVAL_HISTORY];
+    for (int i = 0; i < intervalCount; i++)
+    {
+      int j = i;
+      for (; j > 0 && sorted[j - 1] > intervals[i]; j--)
+        sorted[j] = sorted[j - 1];
+      sorted[j] = intervals[i];
+    }
+    uint32_t median = sorted[intervalCount / 2];
+    refractory = median * REFRACTORY_PCT / 100;
+    if (refractory < MIN_PEAK_INTERVAL_MS)
+      refractory = MIN_PEAK_INTERVAL_MS;
+  }
+  lastPeakTime = nowMs;
+}
+
+bool PpgPipeline::updateHeartRate(uint32_t deltaMs)
+{
+  Q16_16 bpm = Q16_16::ratio(60000, deltaMs);
+  if (bpm >= BPM_MAX || bpm <= BPM_MIN)
+    return false;
+  if (beatAvg > Q16_16() && (bpm < beatAvg * OUTLIER_LOW || bpm > beatAvg + beatAvg * OUTLIER_HIGH))
+  {
+    // A run of "outliers" is the rate itself having moved (or a wrong
+    // start): take it as the new rate rather than reject it for good
+    if (++outliers < OUTLIER_RUN)
+      return false;
+    for (int i = 0; i < RATE_SIZE; i++)
+      rates[i] = bpm;
+    filteredBpm = Q16_16();
+  }
+  outliers = 0;
+  if (filteredBpm == Q16_16())
+    filteredBpm = bpm;
+  else
+    filteredBpm += (bpm - filteredBpm) * BPM_ALPHA;
+  rates[rateSpot++] = filteredBpm;
+  rateSpot %= RATE_SIZE;
+  Q16_16 sum;
+  for (int i = 0; i < RATE_SIZE; i++)
+    sum += rates[i];
+  beatAvg = sum / RATE_SIZE;
+  return true;
+}
+
+void PpgPipeline::updateBloodPressure()
+{
+  sbp = SBP_BASE + scaled(pulseAmplitude, SBP_AMPLITUDE) - scaled(pulseWidthMs, SBP_WIDTH) + filteredBpm * SBP_RATE;
+  dbp = DBP_BASE + scaled(pulseAmplitude, DBP_AMPLITUDE) - scaled(pulseWidthMs, DBP_WIDTH) + filteredBpm * DBP_RATE;
+}
+
+bool HrvAccumulator::finish(HrvStats &out) const
+{
+  out.beats = beats;
+  out.meanRR = beats > 0 ? (float)sum / beats : 0;
+  if (beats < 2)
+    return false;
+  // n^2 * variance = n * sum(rr^2) - sum(rr)^2, exact in integers; the
+  // roots are taken with 8 fractional bits.
+  int64_t n2Var = (int64_t)beats * (int64_t)sumSq - sum * sum;
+  uint32_t sdnnQ8 = isqrt64((uint64_t)(n2Var > 0 ? n2Var : 0) << 16);
+  uint32_t rmssdQ8 = diffs > 0 ? isqrt64((sumDiffSq << 16) / diffs) : 0;
+  out.sdnn = sdnnQ8 / (256.0f * beats);
+  out.rmssd = rmssdQ8 / 256.0f;
+  return true;
+}
+
+bool computeHrv(const uint32_t *peakTimes, int from, int count, HrvStats &out,
+                uint32_t minRR, uint32_t maxRR)
+{
+  HrvAccumulator acc;
+  for (int i = from + 1; i < count; i++)
+  {
+    uint32_t rr = peakTimes[i] - peakTimes[i - 1];
+    if (rr <= minRR || rr >= maxRR)
+      acc.gap();
+    else
+      acc.add(rr);
+  }
+  return acc.finish(out);
+}
@@ -0,0 +1,141 @@
+#ifndef PPG_PIPELINE_H
+#define PPG_PIPELINE_H
+
+#include <stdint.h>
+#include "fixed_point.h"
+
+// Per-sample and per-beat processing of the BLE build, in fixed point:
+// EMA filtering of the raw IR/red counts, peak detection, beat-to-beat
+// heart rate with outlier rejection and smoothing, and the pulse-shape
+// blood pressure estimate. Readings leave as Q16.16 and are only turned
+// into float when a summary is formatted.
+//
+// A local maximum is a beat when it rises at least MIN_PROMINENCE_PCT of
+// the running beat amplitude within the last one to two RISE_BLOCK_MS, an
+// upstroke's length (which rules out the dicrotic wave, and noise and
+// breathing wander on the run-off), and comes
+// after a refractory period of REFRACTORY_PCT of the median of the last
+// INTERVAL_HISTORY intervals, never under MIN_PEAK_INTERVAL_MS (240 bpm).
+// After MAX_PEAK_INTERVAL_MS without a beat the amplitude is learned again
+// from the next maximum.
+class PpgPipeline
+{
+public:
+  static const int RATE_SIZE = 15;
+  static const int MAX_PEAKS = 500;
+  static const int32_t PEAK_THRESHOLD = 50000;
+  static const uint32_t MIN_PEAK_INTERVAL_MS = 250;
+  static const uint32_t MAX_PEAK_INTERVAL_MS = 2000;
+  static const int REFRACTORY_PCT = 55;
+  static const int MIN_PROMINENCE_PCT = 50;
+  static const int INTERVAL_HISTORY = 5;
+  static const uint32_t RISE_BLOCK_MS = 150;
+  static const int OUTLIER_RUN = 4; // rejected beats in a row that reset the average
+
+  // Bits returned by addSample()
+  static const uint8_t PEAK = 1;  // a peak was stored in peakTimes()
+  static const uint8_t BEAT = 2;  // heart rate updated
+  static const uint8_t PULSE = 4; // pulse maximum, blood pressure updated
+
+  PpgPipeline() { reset(); }
+
+  void reset();
+  uint8_t addSample(int32_t ir, int32_t red, uint32_t nowMs);
+
+  int32_t irFiltered() const { return irFilt; }
+  int32_t redFiltered() const { return redFilt; }
+  Q16_16 heartRate() const { return filteredBpm; }
+  Q16_16 averageHeartRate() const { return beatAvg; }
+  Q16_16 systolic() const { return sbp; }
+  Q16_16 diastolic() const { return dbp; }
+  int peakCount() const { return peaks; }
+  // Filtered IR at the most recent peak, and the lowest value before it
+  int32_t beatPeak() const { return lastBeatPeak; }
+  int32_t beatTrough() const { return lastBeatTrough; }
+  const uint32_t *peakTimes() const { return peakTime; }
+  uint32_t refractoryMs() const { return refractory; }
+
+private:
+  bool isBeat(uint32_t nowMs, int32_t &rise) const;
+  void acceptBeat(uint32_t nowMs, int32_t rise);
+  bool updateHeartRate(uint32_t deltaMs);
+  void updateBloodPressure();
+
+  int32_t irFilt, redFilt;
+  int32_t prev1, prev2, prevFiltered;
+  uint32_t lastPeakTime;
+  int32_t troughSincePeak, lastBeatPeak, lastBeatTrough;
+  int32_t beatAmplitude; // 0 until the first beat
+  uint32_t refractory;
+  uint16_t intervals[INTERVAL_HISTORY];
+  int intervalCount, intervalNext;
+  int32_t riseLow, risePrevLow; // lowest filtered IR of this and the last block
+  uint32_t riseBlockMs;
+  uint32_t peakTime[MAX_PEAKS];
+  int peaks;
+
+  Q16_16 filteredBpm, beatAvg;
+  Q16_16 rates[RATE_SIZE];
+  int rateSpot;
+  int outliers;
+
+  bool wasRising;
+  int32_t pulseMin;
+  uint32_t pulseMinTime;
+  int32_t pulseAmplitude;
+  int32_t pulseWidthMs;
+  Q16_16 sbp, dbp;
+};
+
+// Exponential moving average of ADC counts; the first reading after a
+// reset (prevValue == 0) passes through unchanged.
+int32_t emaFilter(int32_t newValue, int32_t prevValue, Q15 alpha);
+
+struct HrvStats
+{
+  float sdnn;
+  float rmssd;
+  float meanRR;
+  int beats;
+};
+
+// Integer sums behind computeHrv(), for callers that already have RR
+// intervals. gap() ends a run of successive intervals, so the next one
+// starts no RMSSD difference.
+struct HrvAccumulator
+{
+  int64_t sum;
+  uint64_t sumSq, sumDiffSq;
+  int32_t prevRR;
+  int diffs, beats;
+
+  HrvAccumulator() : sum(0), sumSq(0), sumDiffSq(0), prevRR(0), diffs(0), beats(0) {}
+
+  void add(uint32_t rr)
+  {
+    sum += rr;
+    sumSq += (uint64_t)rr * rr;
+    if (prevRR > 0)
+    {
+      int64_t d = (int64_t)rr - prevRR;
+      sumDiffSq += (uint64_t)(d * d);
+      diffs++;
+    }
+    prevRR = (int32_t)rr;
+    beats++;
+  }
+  void gap() { prevRR = 0; }
+  bool finish(HrvStats &out) const;
+};
+
+const uint32_t HRV_RR_MIN_MS = 500;
+const uint32_t HRV_RR_MAX_MS = 1200;
+
+// SDNN and RMSSD over the RR intervals between peakTimes[from..count),
+// skipping intervals outside (minRR, maxRR). Sums are kept in integers so
+// only the final two values are converted to float. Returns false when
+// fewer than two intervals were accepted.
+bool computeHrv(const uint32_t *peakTimes, int from, int count, HrvStats &out,
+                uint32_t minRR = HRV_RR_MIN_MS, uint32_t maxRR = HRV_RR_MAX_MS);
+
+#endif
@@ -0,0 +1,239 @@
+#include "ppg_synth.h"
+
+#include <math.h>
+
+namespace
+{
+  const float TWO_PI = 6.2831853f;
+  const float DROPOUT_LEVEL = 1500; // ambient light with no finger
+
+  // Fraction of a cycle, taken in double so the phase of a slow
+  // modulation stays exact hours into a run
+  float cycle(double turns)
+  {
+    return (float)(turns - floor(turns));
+  }
+}
+
+PpgSynth::PpgSynth(const PpgSynthConfig &config) : cfg(config)
+{
+  reset();
+}
+
+void PpgSynth::reset(const PpgSynthConfig &config)
+{
+  cfg = config;
+  reset();
+}
+
+void PpgSynth::reset()
+{
+  rng = cfg.seed ? cfg.seed : 1;
+  index = 0;
+  ratio = ratioForSpo2(cfg.spo2);
+  respPhase = 0;
+  motionLeft = dropoutLeft = 0;
+  motionLength = 1;
+  motionPhase1 = motionPhase2 = 0;
+  // Start part way into a beat so the first peak is not at t = 0
+  beatStartUs = 0;
+  currentRR = nextRR();
+  beatStartUs = -(int64_t)(600.0f * currentRR + 0.5f);
+}
+
+float PpgSynth::ratioForSpo2(float spo2)
+{
+  const float a = -45.060f, b = 30.354f, c = 94.845f - spo2;
+  float disc = b * b - 4 * a * c;
+  if (disc < 0)
+    disc = 0;
+  return (-b - sqrtf(disc)) / (2 * a);
+}
+
+uint64_t PpgSynth::timeUs() const
+{
+  return index * 1000000ULL / cfg.sampleRateHz;
+}
+
+// xorshift32
+float PpgSynth::uniform()
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return (rng >> 8) * (1.0f / 16777216.0f);
+}
+
+// Irwin-Hall approximation, unit variance
+float PpgSynth::gaussian()
+{
+  return (uniform() + uniform() + uniform() + uniform() - 2.0f) * 1.7320508f;
+}
+
+float PpgSynth::nextRR()
+{
+  double t = beatStartUs * 1e-6;
+  float rr = 60000.0f / cfg.heartRate;
+  rr += cfg.lfAmplitudeMs * sinf(TWO_PI * cycle(cfg.lfFrequencyHz * t));
+  rr += cfg.hfAmplitudeMs * sinf(TWO_PI * respPhase);
+  rr += cfg.rrJitterMs * gaussian();
+  return rr < 250 ? 250 : rr;
+}
+
+// One beat from systolic peak (phase 0) to the next (phase 1): the peak,
+// the dicrotic wave, then the diastolic run-off into the next upstroke.
+float PpgSynth::pulseShape(float p) const
+{
+  float systolic = expf(-(p * p) / (0.07f * 0.07f)) + expf(-((p - 1) * (p - 1)) / (0.07f * 0.07f));
+  float d = p - 0.3f;
+  float dicrotic = 0.35f * expf(-(d * d) / (0.1f * 0.1f));
+  return systolic + dicrotic;
+}
+
+PpgSynthSample PpgSynth::next()
+{
+  PpgSynthSample s = {0, 0, 0, 0};
+  float dt = 1.0f / cfg.sampleRateHz;
+
+  // The phase comes from the sample's time in integer microseconds rather
+  // than a running float sum, so peaks and their annotations stay together
+  // however long the run
+  int64_t nowUs = (int64_t)timeUs();
+  int64_t peakUs = beatStartUs + (int64_t)(currentRR * 1000.0f + 0.5f);
+  while (nowUs >= peakUs)
+  {
+    // The peak fell inside this sample period
+    s.flags |= PpgSynthSample::BEAT;
+    s.beatUs = peakUs > 0 ? (uint64_t)peakUs : 0;
+    beatStartUs = peakUs;
+    currentRR = nextRR();
+    peakUs = beatStartUs + (int64_t)(currentRR * 1000.0f + 0.5f);
+  }
+  float phase = (float)(nowUs - beatStartUs) / (currentRR * 1000.0f);
+  respPhase += dt * cfg.respirationRate / 60.0f;
+  respPhase -= floorf(respPhase);
+
+  float resp = sinf(TWO_PI * respPhase);
+  float irDc = cfg.irDc * (1 + cfg.baselineWander * resp);
+  float redDc = irDc * cfg.redDcRatio;
+  float pulse = pulseShape(phase) * (1 + cfg.amplitudeModulation * resp);
+  float ir = irDc * (1 + cfg.perfusion * pulse);
+  float red = redDc * (1 + ratio * cfg.perfusion * pulse);
+
+  if (motionLeft == 0 && cfg.motionPerMinute > 0 && uniform() < cfg.motionPerMinute * dt / 60.0f)
+  {
+    motionLength = motionLeft = (uint32_t)(cfg.motionDurationS * cfg.sampleRateHz) + 1;
+    motionPhase1 = uniform();
+    motionPhase2 = uniform();
+  }
+  if (motionLeft > 0)
+  {
+    // Hann-windowed sway at two incommensurate frequencies
+    float progress = 1.0f - (float)motionLeft / motionLength;
+    float window = 0.5f - 0.5f * cosf(TWO_PI * progress);
+    double t = (double)index / cfg.sampleRateHz;
+    float sway = 0.7f * sinf(TWO_PI * cycle(1.3 * t + motionPhase1)) + 0.3f * sinf(TWO_PI * cycle(2.9 * t + motionPhase2));
+    float offset = cfg.motionAmplitude * window * sway;
+    ir += cfg.irDc * offset;
+    red += redDc * offset;
+    motionLeft--;
+    s.flags |= PpgSynthSample::MOTION;
+  }
+
+  if (dropoutLeft == 0 && cfg.dropoutPerMinute > 0 && uniform() < cfg.dropoutPerMinute * dt / 60.0f)
+    dropoutLeft = (uint32_t)(cfg.dropoutDurationS * cfg.sampleRateHz) + 1;
+  if (dropoutLeft > 0)
+  {
+    ir = red = DROPOUT_LEVEL;
+    dropoutLeft--;
+    s.flags |= PpgSynthSample::DROPOUT;
+  }
+
+  ir += cfg.noise * gaussian();
+  red += cfg.noise * gaussian();
+  float limit = (float)cfg.clipLevel;
+  if (ir >= limit || red >= limit)
+    s.flags |= PpgSynthSample::CLIPPED;
+  s.ir = ir <= 0 ? 0 : ir >= limit ? cfg.clipLevel : (uint32_t)ir;
+  s.red = red <= 0 ? 0 : red >= limit ? cfg.clipLevel : (uint32_t)red;
+  index++;
+  return s;
+}
+
+SimulatedMax30105::SimulatedMax30105(ClockUs clock, const PpgSynthConfig &config)
+    : clock(clock), generator(config), startUs(0), produced(0), newest(), head(0), count(0)
+{
+}
+
+bool SimulatedMax30105::start()
+{
+  generator.reset();
+  startUs = clock();
+  produced = 0;
+  head = count = 0;
+  return true;
+}
+
+uint16_t SimulatedMax30105::check()
+{
+  uint64_t due = (clock() - startUs) * generator.config().sampleRateHz / 1000000ULL;
+  uint16_t added = 0;
+  while (produced < due)
+  {
+    newest = generator.next();
+    produced++;
+    fifo[(head + count) % FIFO_DEPTH] = newest;
+    if (count < FIFO_DEPTH)
+      count++;
+    else
+      head = (head + 1) % FIFO_DEPTH; // overwrite the oldest, as the chip does
+    added++;
+  }
+  return added;
+}
+
+uint64_t SimulatedMax30105::nextSampleUs() const
+{
+  uint32_t rate = generator.config().sampleRateHz;
+  return startUs + ((produced + 1) * 1000000ULL + rate - 1) / rate;
+}
+
+void SimulatedMax30105::nextSample()
+{
+  if (count == 0)
+    return;
+  head = (head + 1) % FIFO_DEPTH;
+  count--;
+}
+
+uint32_t SimulatedMax30105::getFIFOIR() const
+{
+  return count ? fifo[head].ir : 0;
+}
+
+uint32_t SimulatedMax30105::getFIFORed() const
+{
+  return count ? fifo[head].red : 0;
+}
+
+bool SimulatedMax30105::safeCheck(uint32_t maxWaitMs)
+{
+  uint64_t start = clock();
+  while (true)
+  {
+    if (check() > 0)
+      return true;
+    if (clock() - start > maxWaitMs * 1000ULL)
+      return false;
+  }
+}
+
+uint32_t SimulatedMax30105::getIR()
+{
+  return safeCheck(250) ? newest.ir : 0;
+}
+
+uint32_t SimulatedMax30105::getRed()
+{
+  return safeCheck(250) ? newest.red : 0;
+}
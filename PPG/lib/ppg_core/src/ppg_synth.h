@@ -0,0 +1,145 @@
+#ifndef PPG_SYNTH_H
+#define PPG_SYNTH_H
+
+#include <stdint.h>
+
+// Synthetic IR/red PPG for running the firmware and benchmarks without a
+// sensor. Each beat is a systolic peak plus a dicrotic wave, stretched to
+// that beat's RR interval. RR intervals carry LF (Mayer wave) and HF
+// (respiratory sinus arrhythmia) modulation plus jitter; respiration also
+// wanders the baseline and modulates the pulse amplitude. Motion
+// artifacts, finger-off dropouts and ADC clipping can be switched on.
+// The red/IR modulation ratio follows the requested SpO2, and every
+// systolic peak is annotated, so the output carries its own ground truth.
+//
+// Output is deterministic for a given config and seed.
+struct PpgSynthConfig
+{
+  uint16_t sampleRateHz = 100;
+  float heartRate = 70;           // mean, bpm
+  float lfAmplitudeMs = 20;       // RR modulation at lfFrequencyHz
+  float lfFrequencyHz = 0.1f;
+  float hfAmplitudeMs = 25;       // RR modulation at the respiration rate
+  float rrJitterMs = 8;           // beat-to-beat noise (SD)
+  float respirationRate = 15;     // breaths/min
+  float baselineWander = 0.004f;  // of DC, at the respiration rate
+  float amplitudeModulation = 0.1f; // of pulse amplitude, at the respiration rate
+  float spo2 = 97;
+  float perfusion = 0.018f;       // IR AC/DC
+  float irDc = 110000;
+  float redDcRatio = 0.8f;
+  float noise = 20;               // counts, SD
+  float motionPerMinute = 0;      // artifact events
+  float motionAmplitude = 0.05f;  // of DC
+  float motionDurationS = 1.5f;
+  float dropoutPerMinute = 0;     // finger lifted off
+  float dropoutDurationS = 2;
+  uint32_t clipLevel = 262143;    // 18-bit ADC full scale
+  uint32_t seed = 1;
+};
+
+struct PpgSynthSample
+{
+  // Flags
+  static const uint8_t BEAT = 1;    // a systolic peak fell in this sample period
+  static const uint8_t MOTION = 2;  // motion artifact active
+  static const uint8_t DROPOUT = 4; // no finger on the sensor
+  static const uint8_t CLIPPED = 8; // a channel hit the ADC limit
+
+  uint32_t ir;
+  uint32_t red;
+  uint8_t flags;
+  uint64_t beatUs; // time of the systolic peak when BEAT is set
+};
+
+class PpgSynth
+{
+public:
+  explicit PpgSynth(const PpgSynthConfig &config = PpgSynthConfig());
+
+  void reset();
+  void reset(const PpgSynthConfig &config);
+  PpgSynthSample next();
+
+  const PpgSynthConfig &config() const { return cfg; }
+  uint64_t samples() const { return index; }
+  uint64_t timeUs() const; // time of the next sample
+  // Ground truth at the current position
+  float rrMs() const { return currentRR; }
+  float heartRate() const { return 60000.0f / currentRR; }
+  float redIrRatio() const { return ratio; }
+
+  // Ratio of ratios the standard curve (SpO2 = -45.060 R^2 + 30.354 R +
+  // 94.845) maps to spo2, on its falling branch.
+  static float ratioForSpo2(float spo2);
+
+private:
+  float uniform();
+  float gaussian();
+  float nextRR();
+  float pulseShape(float phase) const;
+
+  PpgSynthConfig cfg;
+  uint32_t rng;
+  uint64_t index;
+  float ratio;
+  float currentRR;     // ms
+  int64_t beatStartUs; // the current beat's systolic peak, negative before the first
+  float respPhase;
+  uint32_t motionLeft, dropoutLeft;
+  uint32_t motionLength;
+  float motionPhase1, motionPhase2;
+};
+
+// Simulates the SparkFun MAX30105 interface the firmware uses, fed by a
+// PpgSynth. Samples are produced against an external microsecond clock at
+// the synth's sample rate and queued in a 32-deep FIFO like the chip's,
+// which drops the oldest sample on overflow. getIR()/getRed() behave like
+// the library: each waits (up to 250 ms of clock time) for a new sample
+// and returns the newest one, so the clock must keep advancing while it
+// is polled.
+class SimulatedMax30105
+{
+public:
+  typedef uint64_t (*ClockUs)();
+  static const int FIFO_DEPTH = 32;
+
+  SimulatedMax30105(ClockUs clock, const PpgSynthConfig &config = PpgSynthConfig());
+
+  // Drop-in for the begin()/setup()/amplitude calls; the arguments only
+  // matter for the real part.
+  template <typename Bus>
+  bool begin(Bus &, uint32_t = 0, uint8_t = 0) { return start(); }
+  bool begin() { return start(); }
+  void setup(uint8_t = 0x1F, uint8_t = 4, uint8_t = 3, int = 400, int = 411, int = 4096) {}
+  void setPulseAmplitudeRed(uint8_t) {}
+  void setPulseAmplitudeIR(uint8_t) {}
+  void setPulseAmplitudeGreen(uint8_t) {}
+
+  uint16_t check(); // moves due samples into the FIFO, returns how many
+  uint64_t nextSampleUs() const; // clock time the next sample is due
+  uint8_t available() const { return count; }
+  void nextSample();
+  uint32_t getFIFOIR() const;
+  uint32_t getFIFORed() const;
+  uint32_t getIR();
+  uint32_t getRed();
+
+  PpgSynth &synth() { return generator; }
+  // Ground truth for the newest sample in the FIFO
+  const PpgSynthSample &latest() const { return newest; }
+
+private:
+  bool start();
+  bool safeCheck(uint32_t maxWaitMs);
+
+  ClockUs clock;
+  PpgSynth generator;
+  uint64_t startUs;
+  uint64_t produced;
+  PpgSynthSample fifo[FIFO_DEPTH];
+  PpgSynthSample newest;
+  uint8_t head, count;
+};
+
+#endif
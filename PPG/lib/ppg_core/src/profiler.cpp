@@ -0,0 +1,33 @@
+#include "profiler.h"
+
+#ifdef PPG_PROFILE
+
+StageStats profileStats[PROF_STAGE_COUNT];
+
+namespace
+{
+  const char *const STAGE_NAMES[PROF_STAGE_COUNT] = {
+      "loop", "sensor_read", "pipeline", "raw_frame", "spo2", "summary_build", "notify", "serial",
+  };
+}
+
+void profileDump(void (*emit)(const char *line, void *context), void *context)
+{
+  char line[160];
+  uint32_t cyclesPerUs = profileCyclesPerUs();
+  for (int i = 0; i < PROF_STAGE_COUNT; i++)
+  {
+    if (profileStats[i].count() == 0)
+      continue;
+    if (formatStageStats(STAGE_NAMES[i], profileStats[i], cyclesPerUs, line, sizeof(line)))
+      emit(line, context);
+  }
+}
+
+void profileReset()
+{
+  for (StageStats &s : profileStats)
+    s.reset();
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef PPG_PROFILER_H
+#define PPG_PROFILER_H
+
+// Per-stage timing of the application loop from a cycle counter. Only
+// compiled in with -DPPG_PROFILE; otherwise PROFILE_BEGIN/PROFILE_END
+// expand to nothing and the firmware is unchanged.
+//
+//   PROFILE_BEGIN(PROF_SPO2);
+//   maxim_heart_rate_and_oxygen_saturation(...);
+//   PROFILE_END(PROF_SPO2);
+//
+// Both calls must be in the same scope. Stats are only touched from
+// loop(), so no locking is needed.
+
+#ifdef PPG_PROFILE
+
+#include "stage_stats.h"
+
+enum ProfileStage : uint8_t
+{
+  PROF_LOOP,
+  PROF_SENSOR_READ,
+  PROF_PIPELINE, // filter, peak and beat detection, BP
+  PROF_RAW_FRAME,
+  PROF_SPO2,
+  PROF_SUMMARY_BUILD,
+  PROF_NOTIFY,
+  PROF_SERIAL,
+  PROF_STAGE_COUNT
+};
+
+extern StageStats profileStats[PROF_STAGE_COUNT];
+
+// Provided by the platform: the counter and its rate. The ESP32 uses the
+// CPU cycle counter, the simulator nanoseconds.
+uint32_t profileCycles();
+uint32_t profileCyclesPerUs();
+
+// Passes one JSON line per stage that has samples to emit.
+void profileDump(void (*emit)(const char *line, void *context), void *context);
+void profileReset();
+
+#define PROFILE_BEGIN(stage) const uint32_t profileStart_##stage = profileCycles()
+#define PROFILE_END(stage) profileStats[stage].add(profileCycles() - profileStart_##stage)
+
+#else
+
+#define PROFILE_BEGIN(stage) ((void)0)
+#define PROFILE_END(stage) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,188 @@
+#include "respiration_estimator.h"
+
+#include <math.h>
+
+const float RespirationEstimator::FUSION_SPREAD = 4.0f;
+
+namespace
+{
+  const uint32_t SAMPLE_MS = 1000 / RespirationEstimator::RESAMPLE_HZ;
+  const uint32_t MIN_BREATH_MS = 60000 / 42;
+  const uint32_t MAX_BREATH_MS = 60000 / 6;
+  const float HYSTERESIS = 0.3f;      // of the envelope
+  const float ENVELOPE_ALPHA = 0.05f; // per resampled point
+
+  // RBJ band-pass (0 dB peak) around sqrt(0.1 * 0.7) Hz, spanning
+  // 0.1-0.7 Hz at RESAMPLE_HZ, normalised by a0
+  struct BandPass
+  {
+    float b0, a1, a2;
+
+    BandPass()
+    {
+      const float pi = 3.14159265f;
+      float f0 = sqrtf(0.1f * 0.7f);
+      float octaves = log2f(0.7f / 0.1f);
+      float w0 = 2 * pi * f0 / RespirationEstimator::RESAMPLE_HZ;
+      float alpha = sinf(w0) * sinhf(logf(2.0f) / 2 * octaves * w0 / sinf(w0));
+      float a0 = 1 + alpha;
+      b0 = alpha / a0;
+      a1 = -2 * cosf(w0) / a0;
+      a2 = (1 - alpha) / a0;
+    }
+  };
+
+  const BandPass &bandPass()
+  {
+    static const BandPass filter;
+    return filter;
+  }
+}
+
+void RespirationEstimator::reset()
+{
+  for (Channel &c : channels)
+    resetChannel(c);
+  lastBeatMs = 0;
+  haveBeat = false;
+  fused = 0;
+  fusedValid = false;
+}
+
+void RespirationEstimator::resetChannel(Channel &c)
+{
+  c.primed = false;
+  c.lastValue = 0;
+  c.lastMs = c.nextSampleMs = 0;
+  c.x1 = c.x2 = c.y1 = c.y2 = 0;
+  c.envelope = 0;
+  c.armed = false;
+  c.lastBreathMs = 0;
+  c.intervalCount = c.nextInterval = 0;
+}
+
+bool RespirationEstimator::addBeat(uint32_t timeMs, int32_t peak, int32_t trough)
+{
+  if (haveBeat && timeMs - lastBeatMs > MAX_BEAT_GAP_MS)
+  {
+    for (Channel &c : channels)
+      resetChannel(c);
+    haveBeat = false;
+  }
+  if (haveBeat)
+  {
+    addValue(channels[INTENSITY], timeMs, (float)peak);
+    addValue(channels[AMPLITUDE], timeMs, (float)(peak - trough));
+    addValue(channels[FREQUENCY], timeMs, (float)(timeMs - lastBeatMs));
+  }
+  lastBeatMs = timeMs;
+  haveBeat = true;
+
+  // Smart fusion: the channels with a rate have to agree, but of three the
+  // one furthest from the middle may be left out
+  float rates[MODULATION_COUNT];
+  int n = 0;
+  for (const Channel &c : channels)
+  {
+    float r = channelRate(c);
+    if (r > 0)
+      rates[n++] = r;
+  }
+  for (int i = 1; i < n; i++)
+    for (int j = i; j > 0 && rates[j - 1] > rates[j]; j--)
+    {
+      float swap = rates[j];
+      rates[j] = rates[j - 1];
+      rates[j - 1] = swap;
+    }
+  int first = 0;
+  if (n == 3 && rates[2] - rates[0] > FUSION_SPREAD)
+  {
+    if (rates[1] - rates[0] > rates[2] - rates[1])
+      first = 1;
+    n = 2;
+  }
+  float lo = n > 0 ? rates[first] : 0, hi = n > 0 ? rates[first + n - 1] : 0, sum = 0;
+  for (int i = first; i < first + n; i++)
+    sum += rates[i];
+  bool wasValid = fusedValid;
+  float was = fused;
+  fusedValid = n >= 2 && hi - lo <= FUSION_SPREAD;
+  if (fusedValid)
+    fused = sum / n;
+  return fusedValid != wasValid || (fusedValid && fused != was);
+}
+
+// Linear interpolation from the previous beat onto the resampling grid
+void RespirationEstimator::addValue(Channel &c, uint32_t timeMs, float value)
+{
+  if (!c.primed)
+  {
+    c.primed = true;
+    c.lastValue = value;
+    c.lastMs = timeMs;
+    c.nextSampleMs = timeMs;
+    return;
+  }
+  uint32_t span = timeMs - c.lastMs;
+  while (span > 0 && (int32_t)(timeMs - c.nextSampleMs) >= 0)
+  {
+    float f = (float)(c.nextSampleMs - c.lastMs) / span;
+    addResampled(c, c.nextSampleMs, c.lastValue + f * (value - c.lastValue));
+    c.nextSampleMs += SAMPLE_MS;
+  }
+  c.lastValue = value;
+  c.lastMs = timeMs;
+}
+
+void RespirationEstimator::addResampled(Channel &c, uint32_t timeMs, float x)
+{
+  const BandPass &bp = bandPass();
+  float y = bp.b0 * (x - c.x2) - bp.a1 * c.y1 - bp.a2 * c.y2;
+  c.x2 = c.x1;
+  c.x1 = x;
+  c.y2 = c.y1;
+  c.y1 = y;
+  c.envelope += ENVELOPE_ALPHA * (fabsf(y) - c.envelope);
+
+  float h = HYSTERESIS * c.envelope;
+  if (y < -h)
+    c.armed = true;
+  else if (c.armed && y > h)
+  {
+    c.armed = false;
+    uint32_t interval = timeMs - c.lastBreathMs;
+    if (c.lastBreathMs != 0 && interval >= MIN_BREATH_MS && interval <= MAX_BREATH_MS)
+    {
+      c.intervals[c.nextInterval] = interval;
+      c.nextInterval = (c.nextInterval + 1) % BREATHS;
+      if (c.intervalCount < BREATHS)
+        c.intervalCount++;
+    }
+    c.lastBreathMs = timeMs;
+  }
+}
+
+float RespirationEstimator::channelRate(Modulation m) const
+{
+  return channelRate(channels[m]);
+}
+
+// 60000 / median breath interval, once there are BREATHS of them
+float RespirationEstimator::channelRate(const Channel &c)
+{
+  if (c.intervalCount < BREATHS)
+    return 0;
+  uint32_t sorted[BREATHS];
+  for (int i = 0; i < BREATHS; i++)
+    sorted[i] = c.intervals[i];
+  for (int i = 1; i < BREATHS; i++)
+  {
+    uint32_t v = sorted[i];
+    int j = i - 1;
+    for (; j >= 0 && sorted[j] > v; j--)
+      sorted[j + 1] = sorted[j];
+    sorted[j + 1] = v;
+  }
+  return 60000.0f / sorted[BREATHS / 2];
+}
@@ -0,0 +1,73 @@
+#ifndef PPG_RESPIRATION_ESTIMATOR_H
+#define PPG_RESPIRATION_ESTIMATOR_H
+
+#include <stdint.h>
+
+// Breathing rate from the beat stream. Breathing modulates the PPG in
+// three ways: the baseline intensity (RIIV), the pulse amplitude (RIAV)
+// and the beat interval (RIFV, respiratory sinus arrhythmia). Each per-beat
+// series is resampled to RESAMPLE_HZ, band-passed to 0.1-0.7 Hz (6-42
+// breaths/min), and breaths are counted at its rising zero crossings. The
+// channel rates are fused as in Karlen et al. (2013): averaged when they
+// agree within FUSION_SPREAD, otherwise the estimate is withheld. Two
+// channels that agree outvote a third (in exercise RIFV is often lost in
+// the 10 ms beat timing).
+//
+// Work is per beat (a few biquad steps per channel), so it is cheap
+// enough to run on the ESP32.
+class RespirationEstimator
+{
+public:
+  enum Modulation : uint8_t
+  {
+    INTENSITY,
+    AMPLITUDE,
+    FREQUENCY,
+    MODULATION_COUNT
+  };
+
+  static const int RESAMPLE_HZ = 4;
+  static const int BREATHS = 5;              // intervals behind each channel rate
+  static const uint32_t MAX_BEAT_GAP_MS = 3000; // longer gaps restart the channels
+  static const float FUSION_SPREAD;          // breaths/min
+
+  RespirationEstimator() { reset(); }
+
+  void reset();
+  // One detected beat: its time, the filtered IR at the peak and the
+  // lowest value since the previous beat. Returns true when the fused
+  // estimate was updated.
+  bool addBeat(uint32_t timeMs, int32_t peak, int32_t trough);
+
+  bool valid() const { return fusedValid; }
+  float rate() const { return fusedValid ? fused : 0; } // breaths/min
+  float channelRate(Modulation m) const;                // 0 until enough breaths
+
+private:
+  struct Channel
+  {
+    bool primed;
+    float lastValue;
+    uint32_t lastMs;
+    uint32_t nextSampleMs;
+    float x1, x2, y1, y2; // band-pass state
+    float envelope;       // mean |y|, for the crossing hysteresis
+    bool armed;           // went below -hysteresis since the last breath
+    uint32_t lastBreathMs;
+    uint32_t intervals[BREATHS];
+    int intervalCount, nextInterval;
+  };
+
+  void resetChannel(Channel &c);
+  void addValue(Channel &c, uint32_t timeMs, float value);
+  void addResampled(Channel &c, uint32_t timeMs, float value);
+  static float channelRate(const Channel &c);
+
+  Channel channels[MODULATION_COUNT];
+  uint32_t lastBeatMs;
+  bool haveBeat;
+  float fused;
+  bool fusedValid;
+};
+
+#endif
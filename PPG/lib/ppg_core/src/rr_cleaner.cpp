@@ -0,0 +1,226 @@
+#include "rr_cleaner.h"
+
+void RrCleaner::reset()
+{
+  lastBeatMs = 0;
+  haveBeat = false;
+  pending = false;
+  restart = false;
+  pendingEndMs = pendingRr = 0;
+  historyCount = historyNext = 0;
+  outputHead = outputCount = 0;
+}
+
+void RrCleaner::addBeat(uint32_t timeMs)
+{
+  if (!haveBeat)
+  {
+    haveBeat = true;
+    lastBeatMs = timeMs;
+    return;
+  }
+  uint32_t rr = timeMs - lastBeatMs;
+  lastBeatMs = timeMs;
+  if (rr > MAX_RR_MS * 3)
+  {
+    // Signal lost: restart the series rather than bridge the gap
+    flush();
+    historyCount = historyNext = 0;
+    restart = true;
+    return;
+  }
+  if (pending)
+  {
+    pending = false;
+    decide(pendingEndMs, pendingRr, true, timeMs, rr);
+    return;
+  }
+  pending = true;
+  pendingEndMs = timeMs;
+  pendingRr = rr;
+}
+
+void RrCleaner::flush()
+{
+  if (!pending)
+    return;
+  pending = false;
+  decide(pendingEndMs, pendingRr, false, 0, 0);
+}
+
+bool RrCleaner::next(RrInterval &out)
+{
+  if (outputCount == 0)
+    return false;
+  out = output[outputHead];
+  outputHead = (outputHead + 1) % OUTPUT_CAPACITY;
+  outputCount--;
+  return true;
+}
+
+// Classifies rr. When the following interval is consumed by the
+// correction (extra, ectopic) nothing stays pending; otherwise it becomes
+// the pending one.
+void RrCleaner::decide(uint32_t endMs, uint32_t rr, bool haveNext, uint32_t nextEndMs, uint32_t nextRr)
+{
+  bool nextUsed = false;
+  uint32_t med = historyCount >= WARMUP ? median() : 0;
+  if (med == 0)
+  {
+    // Warm-up: only physiological bounds apply
+    if (rr >= MIN_RR_MS && rr <= MAX_RR_MS)
+    {
+      emit(endMs, rr, 0);
+      remember(rr);
+    }
+    else
+      restart = true;
+  }
+  else if (near(rr, med, med))
+  {
+    emit(endMs, rr, 0);
+    remember(rr);
+  }
+  else if (rr > med)
+  {
+    uint32_t k = (rr + med / 2) / med;
+    if (k >= 2 && k <= 3 && near(rr, k * med, med))
+    {
+      uint32_t startMs = endMs - rr, prevMs = startMs;
+      for (uint32_t i = 1; i <= k; i++)
+      {
+        uint32_t beatMs = startMs + rr * i / k;
+        emit(beatMs, beatMs - prevMs, MISSED);
+        remember(beatMs - prevMs);
+        prevMs = beatMs;
+      }
+    }
+    else
+    {
+      emit(endMs, med, ARTIFACT);
+      remember(rr);
+    }
+  }
+  else if (haveNext && near(rr + nextRr, med, med))
+  {
+    emit(nextEndMs, rr + nextRr, EXTRA);
+    remember(rr + nextRr);
+    nextUsed = true;
+  }
+  else if (haveNext && nextRr > med && near(rr + nextRr, 2 * med, med))
+  {
+    uint32_t half = (rr + nextRr) / 2;
+    emit(endMs - rr + half, half, ECTOPIC);
+    emit(nextEndMs, rr + nextRr - half, ECTOPIC);
+    remember(half);
+    remember(rr + nextRr - half);
+    nextUsed = true;
+  }
+  else
+  {
+    emit(endMs, med, ARTIFACT);
+    remember(rr);
+  }
+
+  if (haveNext && !nextUsed)
+  {
+    pending = true;
+    pendingEndMs = nextEndMs;
+    pendingRr = nextRr;
+  }
+}
+
+// |value - target| within TOLERANCE_PCT of reference
+bool RrCleaner::near(uint32_t value, uint32_t target, uint32_t reference)
+{
+  uint32_t diff = value > target ? value - target : target - value;
+  return diff * 100 <= reference * TOLERANCE_PCT;
+}
+
+uint32_t RrCleaner::median() const
+{
+  uint16_t sorted[MEDIAN_WINDOW];
+  for (int i = 0; i < historyCount; i++)
+  {
+    uint16_t v = history[i];
+    int j = i - 1;
+    for (; j >= 0 && sorted[j] > v; j--)
+      sorted[j + 1] = sorted[j];
+    sorted[j + 1] = v;
+  }
+  return sorted[historyCount / 2];
+}
+
+void RrCleaner::remember(uint32_t rr)
+{
+  history[historyNext] = (uint16_t)(rr > 0xFFFF ? 0xFFFF : rr);
+  historyNext = (historyNext + 1) % MEDIAN_WINDOW;
+  if (historyCount < MEDIAN_WINDOW)
+    historyCount++;
+}
+
+// The queue is drained after every beat, so it only overflows if the
+// caller stops reading; the oldest interval is dropped then.
+void RrCleaner::emit(uint32_t endMs, uint32_t rr, uint8_t flags)
+{
+  if (outputCount == OUTPUT_CAPACITY)
+  {
+    outputHead = (outputHead + 1) % OUTPUT_CAPACITY;
+    outputCount--;
+  }
+  RrInterval &slot = output[(outputHead + outputCount) % OUTPUT_CAPACITY];
+  slot.endMs = endMs;
+  slot.rrMs = (uint16_t)rr;
+  slot.flags = restart ? (uint8_t)(flags | RESTART) : flags;
+  restart = false;
+  outputCount++;
+}
+
+int cleanPeakTimes(const uint32_t *peakTimes, int count, RrInterval *out, int cap)
+{
+  RrCleaner cleaner;
+  int n = 0;
+  RrInterval rr;
+  for (int i = 0; i <= count; i++)
+  {
+    if (i < count)
+      cleaner.addBeat(peakTimes[i]);
+    else
+      cleaner.flush();
+    while (cleaner.next(rr))
+    {
+      if (n < cap)
+        out[n++] = rr;
+    }
+  }
+  return n;
+}
+
+RrCorrections countCorrections(const RrInterval *rr, int from, int count)
+{
+  RrCorrections c = {0, 0, 0, 0};
+  for (int i = from; i < count; i++)
+  {
+    if (rr[i].flags & RrCleaner::MISSED)
+      c.missed++;
+    if (rr[i].flags & RrCleaner::EXTRA)
+      c.extra++;
+    if (rr[i].flags & RrCleaner::ECTOPIC)
+      c.ectopic++;
+    if (rr[i].flags & RrCleaner::ARTIFACT)
+      c.artifact++;
+  }
+  return c;
+}
+
+bool computeHrv(const RrInterval *rr, int from, int count, HrvStats &out)
+{
+  HrvAccumulator acc;
+  for (int i = from; i < count; i++)
+  {
+    if (rr[i].flags & RrCleaner::RESTART)
+      acc.gap();
+    acc.add(rr[i].rrMs);
+  }
+  return acc.finish(out);
+}
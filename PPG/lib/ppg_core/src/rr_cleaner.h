@@ -0,0 +1,91 @@
+#ifndef PPG_RR_CLEANER_H
+#define PPG_RR_CLEANER_H
+
+#include <stdint.h>
+
+#include "ppg_pipeline.h"
+
+// One beat-to-beat interval after cleaning. flags is 0 for an interval
+// taken as measured, otherwise the correction that produced it (plus
+// RESTART on the first interval after a gap).
+struct RrInterval
+{
+  uint32_t endMs; // time of the beat that closes the interval
+  uint16_t rrMs;
+  uint8_t flags;
+};
+
+struct RrCorrections
+{
+  int missed, extra, ectopic, artifact;
+};
+
+// Streaming RR artifact correction. Each interval is compared with the
+// median of the preceding MEDIAN_WINDOW intervals; when it deviates by
+// more than TOLERANCE of that median it is classified with percentage
+// rules and replaced:
+//   missed beat   ~k x median (k = 2, 3): split into k equal intervals
+//   extra beat    short, and short + next ~ median: merged with the next
+//   ectopic beat  short then long, summing to ~2 x median: both set to
+//                 half their sum (the compensatory pause is preserved)
+//   artifact      anything else: replaced by the median
+// Deciding "extra" and "ectopic" needs the following interval, so output
+// lags input by one beat; flush() releases the last one at the end of a
+// session. The median follows the input, so gradual rate changes (warm-up,
+// exercise) pass through uncorrected, and after a sudden step only the
+// first few intervals are.
+class RrCleaner
+{
+public:
+  // Flags
+  static const uint8_t MISSED = 1;
+  static const uint8_t EXTRA = 2;
+  static const uint8_t ECTOPIC = 4;
+  static const uint8_t ARTIFACT = 8;
+  static const uint8_t RESTART = 16; // not a correction: the series resumes after a gap
+
+  static const int MEDIAN_WINDOW = 9;
+  static const int WARMUP = 5;            // intervals before corrections start
+  static const uint32_t MIN_RR_MS = 250;  // 240 bpm
+  static const uint32_t MAX_RR_MS = 2000; // 30 bpm; longer is a gap, not a beat
+  static const int TOLERANCE_PCT = 20;
+  static const int OUTPUT_CAPACITY = 8;
+
+  RrCleaner() { reset(); }
+
+  void reset();
+  void addBeat(uint32_t timeMs);
+  void flush();
+  // Pops the next cleaned interval, oldest first.
+  bool next(RrInterval &out);
+
+private:
+  void decide(uint32_t endMs, uint32_t rr, bool haveNext, uint32_t nextEndMs, uint32_t nextRr);
+  uint32_t median() const;
+  void remember(uint32_t rr);
+  void emit(uint32_t endMs, uint32_t rr, uint8_t flags);
+  static bool near(uint32_t value, uint32_t target, uint32_t reference);
+
+  uint32_t lastBeatMs;
+  bool haveBeat;
+  bool pending;
+  bool restart; // next emitted interval does not follow the previous one
+  uint32_t pendingEndMs, pendingRr;
+  uint16_t history[MEDIAN_WINDOW];
+  int historyCount, historyNext;
+  RrInterval output[OUTPUT_CAPACITY];
+  int outputHead, outputCount;
+};
+
+// Runs a whole peak series through an RrCleaner; returns how many
+// intervals were written to out (at most cap).
+int cleanPeakTimes(const uint32_t *peakTimes, int count, RrInterval *out, int cap);
+
+RrCorrections countCorrections(const RrInterval *rr, int from, int count);
+
+// SDNN and RMSSD over cleaned intervals rr[from..count). Corrected
+// intervals count like measured ones; only RESTART breaks the successive
+// differences.
+bool computeHrv(const RrInterval *rr, int from, int count, HrvStats &out);
+
+#endif
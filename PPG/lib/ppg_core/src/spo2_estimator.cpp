@@ -0,0 +1,83 @@
+#include "spo2_estimator.h"
+
+#include <math.h>
+
+namespace
+{
+  float score(float value, float floor, float good)
+  {
+    if (value <= floor)
+      return 0;
+    return value >= good ? 1 : (value - floor) / (good - floor);
+  }
+
+  float evaluate(const Spo2Calibration &curve, float r)
+  {
+    return (curve.a * r + curve.b) * r + curve.c;
+  }
+}
+
+bool estimateSpo2(const uint32_t *ir, const uint32_t *red, int count, Spo2Estimate &out,
+                  const Spo2Calibration &curve)
+{
+  out.valid = false;
+  out.spo2 = 0;
+  out.ratio = 0;
+  out.perfusion = 0;
+  out.confidence = 0;
+  if (count < 2)
+    return false;
+  // One pass for the means and the IR range, one for the second moments
+  uint64_t irSum = 0, redSum = 0;
+  uint32_t irMin = ir[0], irMax = ir[0];
+  for (int i = 0; i < count; i++)
+  {
+    irSum += ir[i];
+    redSum += red[i];
+    if (ir[i] < irMin)
+      irMin = ir[i];
+    if (ir[i] > irMax)
+      irMax = ir[i];
+  }
+  float irDc = (float)irSum / count, redDc = (float)redSum / count;
+  float sxx = 0, syy = 0, sxy = 0;
+  for (int i = 0; i < count; i++)
+  {
+    float x = ir[i] - irDc, y = red[i] - redDc;
+    sxx += x * x;
+    syy += y * y;
+    sxy += x * y;
+  }
+  float irAc = sqrtf(sxx / count), redAc = sqrtf(syy / count);
+  if (irDc < SPO2_MIN_DC || redDc <= 0 || irAc <= 0)
+    return false;
+  out.perfusion = 100.0f * (irMax - irMin) / irDc;
+  float r = (redAc / redDc) / (irAc / irDc);
+  out.ratio = r;
+  // Outside this range the curve is meaningless (motion, ambient light)
+  if (r < 0.2f || r > 1.8f)
+    return false;
+  float spo2 = evaluate(curve, r);
+  if (!(spo2 >= SPO2_MIN_VALID))
+    return false;
+  out.spo2 = spo2 > 100 ? 100 : spo2;
+  out.valid = true;
+  float perfusionScore = out.perfusion <= SPO2_PI_HIGH ? score(out.perfusion, SPO2_PI_FLOOR, SPO2_PI_GOOD)
+                                                      : 1 - score(out.perfusion, SPO2_PI_HIGH, SPO2_PI_CEIL);
+  out.confidence = perfusionScore *
+                   score(syy > 0 ? sxy / sqrtf(sxx * syy) : 0, SPO2_CORR_FLOOR, SPO2_CORR_GOOD);
+  return true;
+}
+
+bool spo2CalibrationValid(const Spo2Calibration &curve)
+{
+  float prev = INFINITY;
+  for (float r = 0.4f; r <= 1.2001f; r += 0.1f)
+  {
+    float spo2 = evaluate(curve, r);
+    if (!(spo2 >= 50 && spo2 <= 105) || spo2 >= prev)
+      return false;
+    prev = spo2;
+  }
+  return true;
+}
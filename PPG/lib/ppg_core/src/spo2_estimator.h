@@ -0,0 +1,57 @@
+#ifndef PPG_SPO2_ESTIMATOR_H
+#define PPG_SPO2_ESTIMATOR_H
+
+#include <stdint.h>
+
+// Ratio-of-ratios SpO2 over one window of filtered IR/red samples (the
+// 100-sample buffers the firmware collects). AC is the RMS about the
+// window mean and DC the mean, so R does not depend on the pulse shape.
+// R is mapped with a quadratic calibration curve
+//   SpO2 = a R^2 + b R + c
+// which defaults to the standard one and can be refitted for a sensor
+// placement from reference recordings (src/spo2_calibrate.py).
+struct Spo2Calibration
+{
+  float a, b, c;
+};
+
+const Spo2Calibration SPO2_STANDARD_CURVE = {-45.060f, 30.354f, 94.845f};
+
+struct Spo2Estimate
+{
+  bool valid;
+  float spo2;
+  float ratio;
+  float perfusion;  // perfusion index: IR peak-to-peak over DC, %
+  float confidence; // 0..1, see estimateSpo2()
+};
+
+const int32_t SPO2_MIN_DC = 50000; // below this there is no finger on the sensor
+// A window the curve puts below this is not a saturation a conscious
+// athlete can have but a bad R (motion, ambient light), and is invalid
+const float SPO2_MIN_VALID = 50.0f;
+
+// Confidence is the product of two scores. Perfusion scores 1 between
+// SPO2_PI_GOOD and SPO2_PI_HIGH, falling to 0 at SPO2_PI_FLOOR and
+// SPO2_PI_CEIL: a weak pulse leaves R at the mercy of noise, and a
+// "pulse" far stronger than perfusion allows is motion, which moves both
+// channels alike and drags R towards 1. The red/IR correlation of the AC parts scores 0 at
+// SPO2_CORR_FLOOR and 1 from SPO2_CORR_GOOD; ambient light and noise
+// decorrelate the channels, a clean pulse moves both together.
+// Confidence is 0 whenever valid is false.
+const float SPO2_PI_FLOOR = 0.5f;
+const float SPO2_PI_GOOD = 1.5f;
+const float SPO2_PI_HIGH = 4.0f;
+const float SPO2_PI_CEIL = 8.0f;
+const float SPO2_CORR_FLOOR = 0.5f;
+const float SPO2_CORR_GOOD = 0.9f;
+
+bool estimateSpo2(const uint32_t *ir, const uint32_t *red, int count, Spo2Estimate &out,
+                  const Spo2Calibration &curve = SPO2_STANDARD_CURVE);
+
+// A usable curve falls monotonically across R 0.4..1.2 and stays within
+// 50..105 % there; anything else (a failed fit, corrupt storage) is
+// rejected.
+bool spo2CalibrationValid(const Spo2Calibration &curve);
+
+#endif
@@ -0,0 +1,78 @@
+#include "stage_stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void StageStats::reset()
+{
+  memset(histogram, 0, sizeof(histogram));
+  samples = 0;
+  lowest = UINT32_MAX;
+  highest = 0;
+  total = 0;
+}
+
+void StageStats::add(uint32_t cycles)
+{
+  histogram[bucketOf(cycles)]++;
+  samples++;
+  total += cycles;
+  if (cycles < lowest)
+    lowest = cycles;
+  if (cycles > highest)
+    highest = cycles;
+}
+
+// Values below 2 * SUB_BUCKETS get a bucket each; above that the octave
+// picks a group of SUB_BUCKETS and the next two bits the bucket within it.
+int StageStats::bucketOf(uint32_t cycles)
+{
+  if (cycles < 2 * SUB_BUCKETS)
+    return (int)cycles;
+  int msb = 31 - __builtin_clz(cycles);
+  int sub = (int)((cycles >> (msb - 2)) & (SUB_BUCKETS - 1));
+  int bucket = (msb - 1) * SUB_BUCKETS + sub;
+  return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+uint32_t StageStats::bucketUpper(int bucket)
+{
+  if (bucket < 2 * SUB_BUCKETS)
+    return (uint32_t)bucket;
+  int msb = bucket / SUB_BUCKETS + 1;
+  int sub = bucket % SUB_BUCKETS;
+  uint64_t upper = ((uint64_t)(SUB_BUCKETS + sub + 1) << (msb - 2)) - 1;
+  return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+}
+
+uint32_t StageStats::percentile(int pct) const
+{
+  if (samples == 0)
+    return 0;
+  uint64_t rank = ((uint64_t)samples * pct + 99) / 100;
+  uint64_t seen = 0;
+  for (int b = 0; b < BUCKETS; b++)
+  {
+    seen += histogram[b];
+    if (seen >= rank)
+    {
+      uint32_t upper = bucketUpper(b);
+      return upper < highest ? upper : highest;
+    }
+  }
+  return highest;
+}
+
+size_t formatStageStats(const char *stage, const StageStats &stats, uint32_t cyclesPerUs,
+                        char *out, size_t cap)
+{
+  if (cyclesPerUs == 0)
+    cyclesPerUs = 1;
+  float scale = 1.0f / cyclesPerUs;
+  int n = snprintf(out, cap,
+                   "{\"type\":\"prof\",\"stage\":\"%s\",\"n\":%u,\"minUs\":%.2f,\"meanUs\":%.2f,"
+                   "\"p99Us\":%.2f,\"maxUs\":%.2f}",
+                   stage, (unsigned)stats.count(), stats.min() * scale, stats.mean() * scale,
+                   stats.percentile(99) * scale, stats.max() * scale);
+  return n > 0 && (size_t)n < cap ? (size_t)n : 0;
+}
@@ -0,0 +1,44 @@
+#ifndef PPG_STAGE_STATS_H
+#define PPG_STAGE_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Duration statistics for one instrumented stage, in CPU cycles. Samples
+// go into a fixed log-linear histogram (4 buckets per power of two, so
+// percentiles are within 25% of the true value) next to exact min, max
+// and mean; adding one never allocates.
+class StageStats
+{
+public:
+  static const int SUB_BUCKETS = 4;
+  static const int BUCKETS = 32 * SUB_BUCKETS;
+
+  StageStats() { reset(); }
+
+  void reset();
+  void add(uint32_t cycles);
+
+  uint32_t count() const { return samples; }
+  uint32_t min() const { return samples ? lowest : 0; }
+  uint32_t max() const { return highest; }
+  uint32_t mean() const { return samples ? (uint32_t)(total / samples) : 0; }
+  // Upper edge of the bucket holding the pct-th percentile, capped at max().
+  uint32_t percentile(int pct) const;
+
+  static int bucketOf(uint32_t cycles);
+  static uint32_t bucketUpper(int bucket);
+
+private:
+  uint32_t histogram[BUCKETS];
+  uint32_t samples;
+  uint32_t lowest, highest;
+  uint64_t total;
+};
+
+// {"type":"prof","stage":"...","n":..,"minUs":..,"meanUs":..,"p99Us":..,"maxUs":..}
+// Returns the length written, or 0 if it did not fit.
+size_t formatStageStats(const char *stage, const StageStats &stats, uint32_t cyclesPerUs,
+                        char *out, size_t cap);
+
+#endif
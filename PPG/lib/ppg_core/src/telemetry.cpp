@@ -0,0 +1,208 @@
+#include "telemetry.h"
+
+#include <string.h>
+
+#include "waveform_codec.h"
+
+namespace
+{
+  struct StreamName
+  {
+    const char *name;
+    uint8_t flag;
+  };
+
+  const StreamName STREAM_NAMES[] = {
+      {"summary", STREAM_SUMMARY},
+      {"raw", STREAM_RAW},
+      {"hrv", STREAM_HRV},
+      {"diag", STREAM_DIAG},
+      {"rawz", STREAM_RAW_Z},
+  };
+
+  void putU24(uint8_t *p, uint32_t v)
+  {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+  }
+
+  uint32_t getU24(const uint8_t *p)
+  {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+  }
+
+  // The version 3 header, shared by compressed frames
+  void putRawHeader(const RawFrame &frame, uint8_t magic, uint8_t version, uint8_t *out)
+  {
+    out[0] = magic;
+    out[1] = version;
+    out[2] = frame.seq & 0xFF;
+    out[3] = frame.seq >> 8;
+    out[4] = frame.firstSample & 0xFF;
+    out[5] = (frame.firstSample >> 8) & 0xFF;
+    out[6] = (frame.firstSample >> 16) & 0xFF;
+    out[7] = (frame.firstSample >> 24) & 0xFF;
+    out[8] = frame.count;
+    out[9] = 0;
+    for (int i = 0; i < 8; i++)
+      out[10 + i] = ((uint64_t)frame.timestampMs >> (8 * i)) & 0xFF;
+    for (int i = 0; i < 4; i++)
+      out[18 + i] = (frame.samplePeriodNs >> (8 * i)) & 0xFF;
+  }
+
+  // Fields a shorter header of an older version lacks are left 0
+  void getRawHeader(const uint8_t *in, size_t headerSize, RawFrame &frame)
+  {
+    frame.seq = (uint16_t)(in[2] | (in[3] << 8));
+    frame.firstSample = (uint32_t)in[4] | ((uint32_t)in[5] << 8) | ((uint32_t)in[6] << 16) | ((uint32_t)in[7] << 24);
+    frame.count = in[8];
+    uint64_t ts = 0;
+    if (headerSize >= RAW_FRAME_V2_HEADER_SIZE)
+    {
+      for (int i = 0; i < 8; i++)
+        ts |= (uint64_t)in[10 + i] << (8 * i);
+    }
+    frame.timestampMs = (int64_t)ts;
+    frame.samplePeriodNs = 0;
+    if (headerSize >= RAW_FRAME_HEADER_SIZE)
+    {
+      for (int i = 0; i < 4; i++)
+        frame.samplePeriodNs |= (uint32_t)in[18 + i] << (8 * i);
+    }
+  }
+
+  bool decodeCompressedRawFrame(const uint8_t *in, size_t len, RawFrame &frame)
+  {
+    if (len < RAW_FRAME_V2_HEADER_SIZE)
+      return false;
+    size_t headerSize = in[1] == RAW_Z_FRAME_VERSION ? RAW_FRAME_HEADER_SIZE
+                        : in[1] == 1                 ? RAW_FRAME_V2_HEADER_SIZE
+                                                     : 0;
+    if (headerSize == 0 || len < headerSize)
+      return false;
+    uint8_t count = in[8];
+    if (count == 0 || count > RAW_Z_SAMPLES_PER_FRAME)
+      return false;
+    getRawHeader(in, headerSize, frame);
+    const uint8_t *p = in + headerSize;
+    size_t left = len - headerSize;
+    size_t used = decodeWaveBlock(p, left, count, frame.ir);
+    if (used == 0)
+      return false;
+    size_t usedRed = decodeWaveBlock(p + used, left - used, count, frame.red);
+    return usedRed != 0 && used + usedRed == left;
+  }
+}
+
+uint8_t parseStreamList(const char *list)
+{
+  uint8_t mask = 0;
+  const char *p = list;
+  while (*p)
+  {
+    while (*p == ',' || *p == ' ')
+      p++;
+    const char *start = p;
+    while (*p && *p != ',' && *p != ' ')
+      p++;
+    size_t len = p - start;
+    if (len == 0)
+      continue;
+    if (len == 3 && strncmp(start, "all", 3) == 0)
+    {
+      mask |= STREAM_ALL;
+      continue;
+    }
+    for (const StreamName &s : STREAM_NAMES)
+    {
+      if (strlen(s.name) == len && strncmp(start, s.name, len) == 0)
+        mask |= s.flag;
+    }
+  }
+  return mask;
+}
+
+size_t formatStreamList(uint8_t mask, char *out, size_t cap)
+{
+  if (cap == 0)
+    return 0;
+  size_t n = 0;
+  out[0] = '\0';
+  for (const StreamName &s : STREAM_NAMES)
+  {
+    if (!(mask & s.flag))
+      continue;
+    size_t len = strlen(s.name) + (n > 0 ? 1 : 0);
+    if (n + len >= cap)
+      break;
+    if (n > 0)
+      out[n++] = ',';
+    memcpy(out + n, s.name, strlen(s.name));
+    n += strlen(s.name);
+    out[n] = '\0';
+  }
+  return n;
+}
+
+size_t encodeRawFrame(const RawFrame &frame, uint8_t *out, size_t cap)
+{
+  if (frame.count > RAW_SAMPLES_PER_FRAME)
+    return 0;
+  size_t size = RAW_FRAME_HEADER_SIZE + frame.count * RAW_SAMPLE_SIZE;
+  if (size > cap)
+    return 0;
+  putRawHeader(frame, RAW_FRAME_MAGIC, RAW_FRAME_VERSION, out);
+  uint8_t *p = out + RAW_FRAME_HEADER_SIZE;
+  for (uint8_t i = 0; i < frame.count; i++)
+  {
+    // The MAX30105 ADC is 18 bits, so 3 bytes per channel is lossless.
+    putU24(p, frame.ir[i]);
+    putU24(p + 3, frame.red[i]);
+    p += RAW_SAMPLE_SIZE;
+  }
+  return size;
+}
+
+size_t encodeCompressedRawFrame(const RawFrame &frame, uint8_t *out, size_t cap)
+{
+  if (frame.count == 0 || frame.count > RAW_Z_SAMPLES_PER_FRAME || cap < RAW_FRAME_HEADER_SIZE)
+    return 0;
+  putRawHeader(frame, RAW_Z_FRAME_MAGIC, RAW_Z_FRAME_VERSION, out);
+  size_t size = RAW_FRAME_HEADER_SIZE;
+  size_t ir = encodeWaveBlock(frame.ir, frame.count, out + size, cap - size);
+  if (ir == 0)
+    return 0;
+  size += ir;
+  size_t red = encodeWaveBlock(frame.red, frame.count, out + size, cap - size);
+  return red == 0 ? 0 : size + red;
+}
+
+bool decodeRawFrame(const uint8_t *in, size_t len, RawFrame &frame)
+{
+  if (len > 0 && in[0] == RAW_Z_FRAME_MAGIC)
+    return decodeCompressedRawFrame(in, len, frame);
+  if (len < RAW_FRAME_V1_HEADER_SIZE || in[0] != RAW_FRAME_MAGIC)
+    return false;
+  size_t headerSize;
+  if (in[1] == RAW_FRAME_VERSION)
+    headerSize = RAW_FRAME_HEADER_SIZE;
+  else if (in[1] == 2)
+    headerSize = RAW_FRAME_V2_HEADER_SIZE;
+  else if (in[1] == 1)
+    headerSize = RAW_FRAME_V1_HEADER_SIZE;
+  else
+    return false;
+  uint8_t count = in[8];
+  if (count > RAW_SAMPLES_PER_FRAME || len != headerSize + count * RAW_SAMPLE_SIZE)
+    return false;
+  getRawHeader(in, headerSize, frame);
+  const uint8_t *p = in + headerSize;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    frame.ir[i] = getU24(p);
+    frame.red[i] = getU24(p + 3);
+    p += RAW_SAMPLE_SIZE;
+  }
+  return true;
+}
@@ -0,0 +1,83 @@
+#ifndef PPG_TELEMETRY_H
+#define PPG_TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streams a BLE client can subscribe to with "SUB <name>[,<name>...]".
+// Values are bit flags so a connection's subscriptions fit in one byte.
+enum TelemetryStream : uint8_t
+{
+  STREAM_SUMMARY = 0x01, // 1 Hz JSON reading (heartRate, sbp, dbp, oxygen, respRate, ...)
+  STREAM_RAW = 0x02,     // binary frames of raw IR/red samples
+  STREAM_HRV = 0x04,     // JSON HRV statistics per window
+  STREAM_DIAG = 0x08,    // JSON diagnostics, e.g. per-stage timings (PPG_PROFILE)
+  STREAM_RAW_Z = 0x10,   // the raw samples in compressed frames
+};
+
+// "all" means every data stream; diagnostics and rawz (the raw samples
+// again) must be asked for by name.
+const uint8_t STREAM_ALL = STREAM_SUMMARY | STREAM_RAW | STREAM_HRV;
+
+// MAX30105 default setup(): 400 Hz with 4-sample averaging.
+const uint16_t SAMPLE_RATE_HZ = 100;
+
+// Parses a comma/space separated list of stream names into a bit mask.
+// Unknown names are ignored; "all" selects every stream.
+uint8_t parseStreamList(const char *list);
+
+// Writes the names of the streams in mask as a comma separated list.
+size_t formatStreamList(uint8_t mask, char *out, size_t cap);
+
+// Raw stream frame, little endian:
+//   magic(1) version(1) seq(2) firstSample(4) count(1) reserved(1)
+//   timestampMs(8) samplePeriodNs(4)
+//   count x { ir(3) red(3) }
+// The magic byte cannot start a JSON payload, so clients can tell raw
+// frames apart from summary/HRV messages on the same characteristic.
+// Trend read frames (trend_store.h) start with 0xA7 for the same reason.
+// timestampMs is the host epoch time of firstSample once the device clock
+// has been synchronised (see clock_sync.h), or 0 before that.
+// samplePeriodNs is the sample period the device measured against its own
+// clock, or 0 if unknown; the sensor's oscillator is only accurate to a
+// few percent. Version 1 frames (no timestamp or period) and version 2
+// frames (no period) are still accepted by the decoder.
+const uint8_t RAW_FRAME_MAGIC = 0xA5;
+const uint8_t RAW_FRAME_VERSION = 3;
+const size_t RAW_FRAME_HEADER_SIZE = 22;
+const size_t RAW_FRAME_V2_HEADER_SIZE = 18;
+const size_t RAW_FRAME_V1_HEADER_SIZE = 10;
+const size_t RAW_SAMPLE_SIZE = 6;
+const uint8_t RAW_SAMPLES_PER_FRAME = 8;
+const size_t RAW_FRAME_MAX_SIZE = RAW_FRAME_HEADER_SIZE + RAW_SAMPLES_PER_FRAME * RAW_SAMPLE_SIZE;
+
+// Compressed raw frame ("rawz" stream): the version 3 header with its own
+// magic, then the IR and the red samples as one waveform_codec.h block
+// each. Typically 3-4x smaller per sample than a raw frame; at worst (the
+// codec falls back to verbatim) it still fits a 185 byte MTU. Version 1
+// has the version 2 header, without the period.
+const uint8_t RAW_Z_FRAME_MAGIC = 0xA6;
+const uint8_t RAW_Z_FRAME_VERSION = 2;
+const uint8_t RAW_Z_SAMPLES_PER_FRAME = 24;
+const size_t RAW_Z_FRAME_MAX_SIZE = RAW_FRAME_HEADER_SIZE + 2 * (1 + 3 * RAW_Z_SAMPLES_PER_FRAME);
+
+struct RawFrame
+{
+  uint16_t seq;
+  uint32_t firstSample;
+  uint8_t count;
+  int64_t timestampMs;
+  uint32_t samplePeriodNs;
+  uint32_t ir[RAW_Z_SAMPLES_PER_FRAME];
+  uint32_t red[RAW_Z_SAMPLES_PER_FRAME];
+};
+
+// Returns the encoded size, or 0 if the frame does not fit in cap.
+size_t encodeRawFrame(const RawFrame &frame, uint8_t *out, size_t cap);
+size_t encodeCompressedRawFrame(const RawFrame &frame, uint8_t *out, size_t cap);
+
+// Returns false if the buffer is not a well formed raw frame of either
+// kind.
+bool decodeRawFrame(const uint8_t *in, size_t len, RawFrame &frame);
+
+#endif
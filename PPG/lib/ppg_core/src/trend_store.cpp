@@ -0,0 +1,410 @@
+#include "trend_store.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "crc16.h"
+
+namespace
+{
+  const char *TIER_NAMES[TREND_TIER_COUNT] = {"minute", "session", "day"};
+  const uint32_t SECONDS_PER_DAY = 86400;
+  // Session records looked back through for a day roll-up
+  const int DAY_LOOKBACK = 64;
+
+  void put16(uint8_t *p, uint16_t v)
+  {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+  }
+
+  void put32(uint8_t *p, uint32_t v)
+  {
+    put16(p, v & 0xFFFF);
+    put16(p + 2, v >> 16);
+  }
+
+  uint16_t get16(const uint8_t *p)
+  {
+    return (uint16_t)(p[0] | (p[1] << 8));
+  }
+
+  uint32_t get32(const uint8_t *p)
+  {
+    return get16(p) | ((uint32_t)get16(p + 2) << 16);
+  }
+
+  uint16_t packTenths(float v)
+  {
+    if (isnan(v) || v < 0)
+      return 0xFFFF;
+    float t = v * 10 + 0.5f;
+    return t >= 0xFFFE ? 0xFFFE : (uint16_t)t;
+  }
+
+  float unpackTenths(uint16_t v)
+  {
+    return v == 0xFFFF ? NAN : v / 10.0f;
+  }
+
+  uint8_t packMmHg(float v)
+  {
+    if (isnan(v) || v < 0)
+      return 0xFF;
+    float t = v + 0.5f;
+    return t >= 0xFE ? 0xFE : (uint8_t)t;
+  }
+
+  float unpackMmHg(uint8_t v)
+  {
+    return v == 0xFF ? NAN : (float)v;
+  }
+
+  int8_t packZ(float z)
+  {
+    if (isnan(z))
+      return -128;
+    float t = roundf(z * 10);
+    return t > 127 ? 127 : t < -127 ? -127 : (int8_t)t;
+  }
+
+  float unpackZ(int8_t v)
+  {
+    return v == -128 ? NAN : v / 10.0f;
+  }
+
+  bool blank(const uint8_t *data, size_t len)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      if (data[i] != 0xFF)
+        return false;
+    }
+    return true;
+  }
+
+  // A record with only the identifying fields set
+  TrendRecord emptyRecord()
+  {
+    TrendRecord r;
+    r.seq = 0;
+    r.startS = 0;
+    r.session = 0;
+    r.minutes = 0;
+    r.heartRate = r.rmssd = r.sdnn = r.spo2 = r.sbp = r.dbp = r.stress = NAN;
+    return r;
+  }
+}
+
+const char *trendTierName(TrendTier tier)
+{
+  return tier < TREND_TIER_COUNT ? TIER_NAMES[tier] : "?";
+}
+
+bool parseTrendTier(const char *name, TrendTier &tier)
+{
+  for (int t = 0; t < TREND_TIER_COUNT; t++)
+  {
+    if (strcmp(name, TIER_NAMES[t]) == 0)
+    {
+      tier = (TrendTier)t;
+      return true;
+    }
+  }
+  return false;
+}
+
+void encodeTrendRecord(const TrendRecord &r, uint8_t *out)
+{
+  put32(out, r.seq);
+  put32(out + 4, r.startS);
+  put16(out + 8, r.session);
+  put16(out + 10, r.minutes);
+  put16(out + 12, packTenths(r.heartRate));
+  put16(out + 14, packTenths(r.rmssd));
+  put16(out + 16, packTenths(r.sdnn));
+  put16(out + 18, packTenths(r.spo2));
+  out[20] = packMmHg(r.sbp);
+  out[21] = packMmHg(r.dbp);
+  out[22] = (uint8_t)packZ(r.stress);
+  out[23] = 0;
+  put16(out + 24, crc16Ccitt(out, TREND_RECORD_SIZE - 2));
+}
+
+bool decodeTrendRecord(const uint8_t *in, TrendRecord &r)
+{
+  if (crc16Ccitt(in, TREND_RECORD_SIZE - 2) != get16(in + 24))
+    return false;
+  r.seq = get32(in);
+  r.startS = get32(in + 4);
+  r.session = get16(in + 8);
+  r.minutes = get16(in + 10);
+  r.heartRate = unpackTenths(get16(in + 12));
+  r.rmssd = unpackTenths(get16(in + 14));
+  r.sdnn = unpackTenths(get16(in + 16));
+  r.spo2 = unpackTenths(get16(in + 18));
+  r.sbp = unpackMmHg(in[20]);
+  r.dbp = unpackMmHg(in[21]);
+  r.stress = unpackZ((int8_t)in[22]);
+  return true;
+}
+
+void TrendAccumulator::reset()
+{
+  for (int i = 0; i < FIELDS; i++)
+    sums[i] = weights[i] = 0;
+}
+
+void TrendAccumulator::addField(int field, float value, float weight)
+{
+  if (isnan(value) || weight <= 0)
+    return;
+  sums[field] += value * weight;
+  weights[field] += weight;
+}
+
+void TrendAccumulator::add(const TrendRecord &r, float weight)
+{
+  addField(0, r.heartRate, weight);
+  addField(1, r.rmssd, weight);
+  addField(2, r.sdnn, weight);
+  addField(3, r.spo2, weight);
+  addField(4, r.sbp, weight);
+  addField(5, r.dbp, weight);
+  addField(6, r.stress, weight);
+}
+
+// The pipeline reports 0 until it has something to say
+void TrendAccumulator::addHeart(float heartRate, float spo2, float sbp, float dbp)
+{
+  addField(0, heartRate > 0 ? heartRate : NAN, 1);
+  addField(3, spo2 > 0 ? spo2 : NAN, 1);
+  addField(4, sbp > 0 ? sbp : NAN, 1);
+  addField(5, dbp > 0 ? dbp : NAN, 1);
+}
+
+void TrendAccumulator::addHrv(float rmssd, float sdnn, float stress)
+{
+  addField(1, rmssd, 1);
+  addField(2, sdnn, 1);
+  addField(6, stress, 1);
+}
+
+bool TrendAccumulator::empty() const
+{
+  for (int i = 0; i < FIELDS; i++)
+  {
+    if (weights[i] > 0)
+      return false;
+  }
+  return true;
+}
+
+void TrendAccumulator::result(TrendRecord &r) const
+{
+  float *fields[FIELDS] = {&r.heartRate, &r.rmssd, &r.sdnn, &r.spo2, &r.sbp, &r.dbp, &r.stress};
+  for (int i = 0; i < FIELDS; i++)
+    *fields[i] = weights[i] > 0 ? sums[i] / weights[i] : NAN;
+}
+
+bool TrendStore::begin()
+{
+  ready = false;
+  uint32_t sectors = flash.size() / PpgFlash::SECTOR_SIZE;
+  uint32_t rollup = sectors / 12 > 2 ? sectors / 12 : 2;
+  if (sectors < 2 * rollup + 2)
+    return false;
+  uint32_t shares[TREND_TIER_COUNT] = {sectors - 2 * rollup, rollup, rollup};
+  uint32_t first = 0;
+  sessionCounter = 0;
+  for (int t = 0; t < TREND_TIER_COUNT; t++)
+  {
+    Tier &tier = tiers[t];
+    tier.firstSector = first;
+    tier.sectors = shares[t];
+    tier.slots = shares[t] * RECORDS_PER_SECTOR;
+    first += shares[t];
+    scan(tier);
+  }
+  ready = true;
+  return true;
+}
+
+uint32_t TrendStore::slotOffset(const Tier &t, uint32_t seq) const
+{
+  uint32_t slot = seq % t.slots;
+  return (t.firstSector + slot / RECORDS_PER_SECTOR) * PpgFlash::SECTOR_SIZE +
+         (slot % RECORDS_PER_SECTOR) * TREND_RECORD_SIZE;
+}
+
+// The head is one past the highest sequence number found in its own slot.
+void TrendStore::scan(Tier &t)
+{
+  t.next = 0;
+  bool found = false;
+  uint8_t buffer[TREND_RECORD_SIZE];
+  for (uint32_t slot = 0; slot < t.slots; slot++)
+  {
+    TrendRecord r;
+    if (!flash.read(slotOffset(t, slot), buffer, sizeof(buffer)) || !decodeTrendRecord(buffer, r))
+      continue;
+    if (r.seq % t.slots != slot)
+      continue;
+    if (!found || r.seq >= t.next)
+      t.next = r.seq + 1;
+    found = true;
+    if (r.session >= sessionCounter)
+      sessionCounter = r.session + 1;
+  }
+}
+
+uint32_t TrendStore::firstSeq(TrendTier tier) const
+{
+  const Tier &t = tiers[tier];
+  if (t.next <= t.slots)
+    return 0;
+  // Writing the first record of a sector erased the rest of it
+  uint32_t held = t.slots - RECORDS_PER_SECTOR + (t.next - 1) % RECORDS_PER_SECTOR + 1;
+  return t.next - held;
+}
+
+bool TrendStore::append(TrendTier tier, TrendRecord &r)
+{
+  if (!ready)
+    return false;
+  Tier &t = tiers[tier];
+  uint8_t buffer[TREND_RECORD_SIZE];
+  while (true)
+  {
+    uint32_t offset = slotOffset(t, t.next);
+    if (t.next % RECORDS_PER_SECTOR == 0)
+    {
+      if (!flash.eraseSector(offset))
+        return false;
+      break;
+    }
+    // A write torn by a reset leaves a programmed slot behind the head;
+    // skip it rather than write over it.
+    if (!flash.read(offset, buffer, sizeof(buffer)))
+      return false;
+    if (blank(buffer, sizeof(buffer)))
+      break;
+    t.next++;
+  }
+  r.seq = t.next;
+  encodeTrendRecord(r, buffer);
+  if (!flash.write(slotOffset(t, t.next), buffer, sizeof(buffer)))
+    return false;
+  t.next++;
+  if (r.session >= sessionCounter)
+    sessionCounter = r.session + 1;
+  return true;
+}
+
+bool TrendStore::read(TrendTier tier, uint32_t seq, TrendRecord &r)
+{
+  const Tier &t = tiers[tier];
+  if (!ready || seq >= t.next || seq < firstSeq(tier))
+    return false;
+  uint8_t buffer[TREND_RECORD_SIZE];
+  return flash.read(slotOffset(t, seq), buffer, sizeof(buffer)) && decodeTrendRecord(buffer, r) && r.seq == seq;
+}
+
+void TrendRecorder::start(uint32_t epochS)
+{
+  active = true;
+  session = store.nextSession();
+  sessionStartS = epochS;
+  seconds = 0;
+  minutes = 0;
+  elapsedS = 0;
+  minute.reset();
+  total.reset();
+}
+
+void TrendRecorder::addSecond(uint32_t epochS, float heartRate, float spo2, float sbp, float dbp)
+{
+  if (!active)
+    return;
+  elapsedS++;
+  if (sessionStartS == 0 && epochS != 0)
+    sessionStartS = epochS - elapsedS;
+  minute.addHeart(heartRate, spo2, sbp, dbp);
+  total.addHeart(heartRate, spo2, sbp, dbp);
+  if (++seconds >= 60)
+    writeMinute(epochS);
+}
+
+void TrendRecorder::addHrvWindow(float rmssd, float sdnn, float stress)
+{
+  if (!active)
+    return;
+  minute.addHrv(rmssd, sdnn, stress);
+  total.addHrv(rmssd, sdnn, stress);
+}
+
+void TrendRecorder::writeMinute(uint32_t epochS)
+{
+  if (!minute.empty())
+  {
+    TrendRecord r = emptyRecord();
+    r.startS = epochS ? epochS - seconds : 0;
+    r.session = session;
+    r.minutes = 1;
+    minute.result(r);
+    store.append(TREND_MINUTE, r);
+  }
+  minutes++;
+  seconds = 0;
+  minute.reset();
+}
+
+void TrendRecorder::finish(uint32_t epochS)
+{
+  if (!active)
+    return;
+  active = false;
+  if (sessionStartS == 0 && epochS != 0)
+    sessionStartS = epochS - elapsedS;
+  if (seconds >= 30)
+    writeMinute(epochS);
+  if (total.empty() || elapsedS < 30)
+    return;
+  TrendRecord r = emptyRecord();
+  r.startS = sessionStartS;
+  r.session = session;
+  r.minutes = (uint16_t)((elapsedS + 30) / 60);
+  total.result(r);
+  if (store.append(TREND_SESSION, r))
+    writeDay(r);
+}
+
+// Sessions without a synchronised clock cannot be placed in a day and
+// stay out of the day tier.
+void TrendRecorder::writeDay(const TrendRecord &latest)
+{
+  if (latest.startS == 0)
+    return;
+  uint32_t day = latest.startS / SECONDS_PER_DAY;
+  TrendAccumulator sum;
+  uint32_t dayMinutes = 0;
+  uint32_t first = store.firstSeq(TREND_SESSION);
+  uint32_t seq = latest.seq + 1;
+  for (int looked = 0; seq > first && looked < DAY_LOOKBACK; looked++)
+  {
+    TrendRecord r;
+    if (!store.read(TREND_SESSION, --seq, r) || r.startS == 0)
+      continue;
+    if (r.startS / SECONDS_PER_DAY != day)
+      break;
+    float weight = r.minutes > 0 ? r.minutes : 1;
+    sum.add(r, weight);
+    dayMinutes += r.minutes;
+  }
+  TrendRecord r = emptyRecord();
+  r.startS = day * SECONDS_PER_DAY;
+  r.session = latest.session;
+  r.minutes = dayMinutes > 0xFFFF ? 0xFFFF : (uint16_t)dayMinutes;
+  sum.result(r);
+  store.append(TREND_DAY, r);
+}
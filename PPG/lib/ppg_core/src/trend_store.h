@@ -0,0 +1,166 @@
+#ifndef PPG_TREND_STORE_H
+#define PPG_TREND_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ppg_hal.h"
+
+// Long-term trends kept on the sensor across sessions, for looking back
+// over the weeks before a competition. Three tiers of the same record:
+//   minute   one per recorded minute
+//   session  one per session, rolled up from its minutes
+//   day      one per UTC day, rolled up from that day's sessions; a day
+//            with several sessions gets a newer record after each, and
+//            readers keep the newest per day
+// Each tier is a ring of records in its own share of a flash region
+// (PpgFlash). Minutes wrap first (a 384 KB region keeps about 200 hours
+// of recording); sessions and days keep over a thousand entries each, so
+// the rolled-up history outlives the minutes it came from.
+//
+// Records carry a per-tier sequence number, which also fixes their slot,
+// and a CRC, so the heads are found again by scanning after a reboot and
+// a record torn by power loss is skipped.
+enum TrendTier : uint8_t
+{
+  TREND_MINUTE,
+  TREND_SESSION,
+  TREND_DAY,
+  TREND_TIER_COUNT
+};
+
+const char *trendTierName(TrendTier tier);
+bool parseTrendTier(const char *name, TrendTier &tier);
+
+// Means over the record's span. NAN where nothing was measured (no valid
+// SpO2 window, no HRV window, no baseline yet for the stress z).
+struct TrendRecord
+{
+  uint32_t seq;
+  uint32_t startS;  // host epoch seconds, 0 if the clock was never synchronised
+  uint16_t session; // session number, counting up across reboots
+  uint16_t minutes; // recorded minutes behind the record
+  float heartRate, rmssd, sdnn, spo2, sbp, dbp;
+  float stress; // baseline stress z, mean of hrZ and -rmssdZ (athlete_baseline.h)
+};
+
+// Stored and sent little endian:
+//   seq(4) startS(4) session(2) minutes(2) hr(2) rmssd(2) sdnn(2) spo2(2)
+//   sbp(1) dbp(1) stress(1) reserved(1) crc16(2)
+// hr, rmssd, sdnn and spo2 in tenths (0xFFFF for NAN), sbp/dbp in mmHg
+// (0xFF for NAN), stress in tenths of a z (-128 for NAN). The CRC is
+// CRC-16/CCITT over the preceding bytes.
+const size_t TREND_RECORD_SIZE = 26;
+
+void encodeTrendRecord(const TrendRecord &r, uint8_t *out);
+// Returns false on a CRC mismatch, which includes erased flash.
+bool decodeTrendRecord(const uint8_t *in, TrendRecord &r);
+
+// Bulk read frame:
+//   magic(1) version(1) tier(1) count(1)  count x record
+// Like raw frames, the magic byte cannot start a JSON payload.
+const uint8_t TREND_FRAME_MAGIC = 0xA7;
+const uint8_t TREND_FRAME_VERSION = 1;
+const size_t TREND_FRAME_HEADER_SIZE = 4;
+
+// Weighted running means of the record fields, skipping NANs.
+class TrendAccumulator
+{
+public:
+  TrendAccumulator() { reset(); }
+
+  void reset();
+  void add(const TrendRecord &r, float weight);
+  void addHeart(float heartRate, float spo2, float sbp, float dbp);
+  void addHrv(float rmssd, float sdnn, float stress);
+  bool empty() const;
+  // Fills the measured fields of r
+  void result(TrendRecord &r) const;
+
+private:
+  static const int FIELDS = 7;
+  void addField(int field, float value, float weight);
+
+  float sums[FIELDS];
+  float weights[FIELDS];
+};
+
+class TrendStore
+{
+public:
+  explicit TrendStore(PpgFlash &flash) : flash(flash), ready(false) {}
+
+  // Splits the region between the tiers and finds each tier's head.
+  // Fails if the region is too small for two sectors per tier.
+  bool begin();
+  bool isReady() const { return ready; }
+
+  // Assigns r.seq and writes r to the tier, erasing the oldest sector when
+  // the ring is full.
+  bool append(TrendTier tier, TrendRecord &r);
+
+  // Sequence numbers held: [firstSeq, nextSeq). Slots in the range may
+  // still fail to read (a torn write).
+  uint32_t firstSeq(TrendTier tier) const;
+  uint32_t nextSeq(TrendTier tier) const { return tiers[tier].next; }
+  bool read(TrendTier tier, uint32_t seq, TrendRecord &r);
+
+  // One past the highest session number stored
+  uint16_t nextSession() const { return sessionCounter; }
+
+private:
+  struct Tier
+  {
+    uint32_t firstSector;
+    uint32_t sectors;
+    uint32_t slots;
+    uint32_t next;
+  };
+
+  static const uint32_t RECORDS_PER_SECTOR = PpgFlash::SECTOR_SIZE / TREND_RECORD_SIZE;
+
+  uint32_t slotOffset(const Tier &t, uint32_t seq) const;
+  void scan(Tier &t);
+
+  PpgFlash &flash;
+  bool ready;
+  Tier tiers[TREND_TIER_COUNT];
+  uint16_t sessionCounter;
+};
+
+// Turns the 1 Hz summary values and the HRV windows of a session into
+// minute records, and at the end of the session into its session and day
+// roll-ups.
+class TrendRecorder
+{
+public:
+  explicit TrendRecorder(TrendStore &store) : store(store), active(false) {}
+
+  // epochS is 0 while the host clock is unknown; it is picked up later
+  // from whichever call first supplies one.
+  void start(uint32_t epochS);
+  // Once per second of recording. Writes a minute record every 60 calls.
+  void addSecond(uint32_t epochS, float heartRate, float spo2, float sbp, float dbp);
+  void addHrvWindow(float rmssd, float sdnn, float stress);
+  // Writes the last partial minute (if at least half recorded), the
+  // session record and the day record.
+  void finish(uint32_t epochS);
+
+  bool recording() const { return active; }
+
+private:
+  void writeMinute(uint32_t epochS);
+  void writeDay(const TrendRecord &session);
+
+  TrendStore &store;
+  bool active;
+  uint16_t session;
+  uint32_t sessionStartS;
+  uint32_t elapsedS;
+  uint16_t seconds; // into the current minute
+  uint16_t minutes; // closed this session
+  TrendAccumulator minute;
+  TrendAccumulator total;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include "upload_batch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+  const char PUSH_CHARS[] = "-0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
+}
+
+void UploadQueue::push(const UploadRecord &record)
+{
+  if (count == capacity)
+  {
+    head = (head + 1) % capacity;
+    count--;
+    droppedCount++;
+  }
+  records[(head + count) % capacity] = record;
+  count++;
+}
+
+size_t UploadQueue::peek(UploadRecord *out, size_t max) const
+{
+  size_t n = count < max ? count : max;
+  for (size_t i = 0; i < n; i++)
+    out[i] = records[(head + i) % capacity];
+  return n;
+}
+
+void UploadQueue::pop(size_t n)
+{
+  if (n > count)
+    n = count;
+  head = (head + n) % capacity;
+  count -= n;
+}
+
+void makeRecordKey(int64_t timestampMs, uint32_t deviceId, uint32_t seq, char out[21])
+{
+  uint64_t ts = (uint64_t)timestampMs;
+  for (int i = 7; i >= 0; i--)
+  {
+    out[i] = PUSH_CHARS[ts % 64];
+    ts /= 64;
+  }
+  uint64_t tail = ((uint64_t)deviceId << 32) | seq;
+  for (int i = 19; i >= 8; i--)
+  {
+    out[i] = PUSH_CHARS[tail % 64];
+    tail /= 64;
+  }
+  out[20] = '\0';
+}
+
+size_t buildPatchBody(const UploadRecord *records, size_t n, uint32_t deviceId, char *out, size_t cap)
+{
+  size_t len = 0;
+  if (cap < 3)
+    return 0;
+  out[len++] = '{';
+  for (size_t i = 0; i < n; i++)
+  {
+    const UploadRecord &r = records[i];
+    char key[21];
+    makeRecordKey(r.timestampMs, deviceId, r.seq, key);
+    int written;
+    if (r.oxygen >= 0)
+      written = snprintf(out + len, cap - len,
+                         "%s\"%s\":{\"heartRate\":%.1f,\"avgHeartRate\":%.1f,\"oxygen\":%d,\"timestamp\":%lld}",
+                         i > 0 ? "," : "", key, r.heartRate, r.avgHeartRate, r.oxygen, (long long)(r.timestampMs / 1000));
+    else
+      written = snprintf(out + len, cap - len,
+                         "%s\"%s\":{\"heartRate\":%.1f,\"avgHeartRate\":%.1f,\"timestamp\":%lld}",
+                         i > 0 ? "," : "", key, r.heartRate, r.avgHeartRate, (long long)(r.timestampMs / 1000));
+    if (written < 0 || (size_t)written >= cap - len)
+      return 0;
+    len += written;
+  }
+  if (len + 2 > cap)
+    return 0;
+  out[len++] = '}';
+  out[len] = '\0';
+  return len;
+}
+
+uint32_t Backoff::next(uint32_t rand)
+{
+  uint32_t shift = attempts < 16 ? attempts : 16;
+  attempts++;
+  uint64_t delay = (uint64_t)baseMs << shift;
+  if (delay > maxMs)
+    delay = maxMs;
+  // Full jitter on the upper half keeps several devices from retrying in
+  // lockstep after a shared outage.
+  uint32_t half = (uint32_t)(delay / 2);
+  return half + (half > 0 ? rand % (half + 1) : 0);
+}
@@ -0,0 +1,73 @@
+#ifndef PPG_UPLOAD_BATCH_H
+#define PPG_UPLOAD_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One per-second reading as uploaded to /users/<uid>/sessions/<sid>/readings.
+struct UploadRecord
+{
+  int64_t timestampMs; // epoch ms
+  uint32_t seq;        // per-device counter, makes keys unique and retries idempotent
+  float heartRate;
+  float avgHeartRate;
+  int16_t oxygen; // < 0 when there is no valid SpO2
+};
+
+// Bounded FIFO that keeps readings while the network is down. When full the
+// oldest record is dropped, so a long outage loses the start of the gap
+// rather than the most recent data.
+class UploadQueue
+{
+public:
+  UploadQueue(UploadRecord *storage, size_t capacity) : records(storage), capacity(capacity) {}
+
+  void push(const UploadRecord &record);
+  // Copies up to max of the oldest records without removing them.
+  size_t peek(UploadRecord *out, size_t max) const;
+  // Removes the n oldest records once they have been acknowledged.
+  void pop(size_t n);
+  void clear() { head = count = 0; }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  uint32_t dropped() const { return droppedCount; }
+
+private:
+  UploadRecord *records;
+  size_t capacity;
+  size_t head = 0;
+  size_t count = 0;
+  uint32_t droppedCount = 0;
+};
+
+// Builds a Firebase push-id compatible key: 8 chars of timestamp followed by
+// 12 chars derived from deviceId/seq instead of random bits. Keys sort by
+// time like the app's push() keys, and re-sending a batch after a timeout
+// overwrites the same children instead of duplicating them.
+void makeRecordKey(int64_t timestampMs, uint32_t deviceId, uint32_t seq, char out[21]);
+
+// Serialises records as one multi-location update body for
+//   PATCH <db>/users/<uid>/sessions/<sid>/readings.json
+// i.e. {"<key>":{"heartRate":..,...},...}. Returns the body length, or 0
+// if it does not fit in cap.
+size_t buildPatchBody(const UploadRecord *records, size_t n, uint32_t deviceId, char *out, size_t cap);
+
+// Exponential backoff with jitter for failed uploads.
+class Backoff
+{
+public:
+  Backoff(uint32_t baseMs, uint32_t maxMs) : baseMs(baseMs), maxMs(maxMs) {}
+
+  // Delay before the next attempt; rand is any 32-bit random value.
+  uint32_t next(uint32_t rand);
+  void reset() { attempts = 0; }
+  uint32_t failures() const { return attempts; }
+
+private:
+  uint32_t baseMs;
+  uint32_t maxMs;
+  uint32_t attempts = 0;
+};
+
+#endif
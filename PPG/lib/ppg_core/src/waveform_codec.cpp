@@ -0,0 +1,278 @@
+#include "waveform_codec.h"
+
+namespace
+{
+  const uint8_t VERBATIM = 0xE0;
+  const int MAX_ORDER = 3;
+  const int MAX_K = 23;
+  const int ESCAPE_BITS = 28; // zigzagged order 3 residuals of 24-bit samples
+
+  // Bits are packed MSB first; at most 24 per call, so the accumulator
+  // never holds more than 31.
+  struct BitWriter
+  {
+    uint8_t *out;
+    size_t pos;
+    uint32_t acc;
+    int bits;
+
+    void put(uint32_t value, int n)
+    {
+      acc = (acc << n) | (value & ((1u << n) - 1));
+      bits += n;
+      while (bits >= 8)
+      {
+        bits -= 8;
+        out[pos++] = (uint8_t)(acc >> bits);
+      }
+      acc &= (1u << bits) - 1;
+    }
+
+    void putOnes(uint32_t n)
+    {
+      for (; n >= 24; n -= 24)
+        put(0xFFFFFF, 24);
+      put((1u << n) - 1, n);
+    }
+
+    void flush()
+    {
+      if (bits > 0)
+        put(0, 8 - bits);
+    }
+  };
+
+  struct BitReader
+  {
+    const uint8_t *in;
+    size_t len;
+    size_t pos;
+    uint32_t acc;
+    int bits;
+
+    bool get(int n, uint32_t &value)
+    {
+      while (bits < n)
+      {
+        if (pos >= len)
+          return false;
+        acc = (acc << 8) | in[pos++];
+        bits += 8;
+      }
+      bits -= n;
+      value = (acc >> bits) & ((1u << n) - 1);
+      acc &= (1u << bits) - 1;
+      return true;
+    }
+
+    // Counts ones up to limit, consuming the closing zero if one comes first
+    bool unary(uint32_t limit, uint32_t &count)
+    {
+      count = 0;
+      uint32_t bit;
+      while (count < limit)
+      {
+        if (!get(1, bit))
+          return false;
+        if (bit == 0)
+          return true;
+        count++;
+      }
+      return true;
+    }
+  };
+
+  int32_t predict(const uint32_t *x, int i, int order)
+  {
+    int o = i < order ? i : order;
+    switch (o)
+    {
+    case 0:
+      return 0;
+    case 1:
+      return (int32_t)x[i - 1];
+    case 2:
+      return 2 * (int32_t)x[i - 1] - (int32_t)x[i - 2];
+    default:
+      return 3 * ((int32_t)x[i - 1] - (int32_t)x[i - 2]) + (int32_t)x[i - 3];
+    }
+  }
+
+  uint32_t zigzag(int32_t r)
+  {
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+  }
+
+  int32_t unzigzag(uint32_t u)
+  {
+    return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+  }
+
+  uint32_t absDiff(int32_t v)
+  {
+    return v < 0 ? (uint32_t)-v : (uint32_t)v;
+  }
+
+  uint32_t riceBits(const uint32_t *u, int n, int k)
+  {
+    uint32_t total = 0;
+    for (int i = 0; i < n; i++)
+    {
+      uint32_t q = u[i] >> k;
+      total += q < WAVE_RICE_ESCAPE ? q + 1 + k : WAVE_RICE_ESCAPE + ESCAPE_BITS;
+    }
+    return total;
+  }
+
+  // The order whose residuals over samples 3.. have the smallest sum
+  int chooseOrder(const uint32_t *x, int count)
+  {
+    if (count <= MAX_ORDER)
+      return count > 1 ? 1 : 0;
+    uint64_t sums[MAX_ORDER + 1] = {0, 0, 0, 0};
+    for (int i = MAX_ORDER; i < count; i++)
+    {
+      int32_t e0 = (int32_t)x[i];
+      int32_t e1 = e0 - (int32_t)x[i - 1];
+      int32_t d1 = (int32_t)x[i - 1] - (int32_t)x[i - 2];
+      int32_t e2 = e1 - d1;
+      int32_t e3 = e2 - (d1 - ((int32_t)x[i - 2] - (int32_t)x[i - 3]));
+      sums[0] += (uint32_t)e0;
+      sums[1] += absDiff(e1);
+      sums[2] += absDiff(e2);
+      sums[3] += absDiff(e3);
+    }
+    int best = 0;
+    for (int o = 1; o <= MAX_ORDER; o++)
+    {
+      if (sums[o] < sums[best])
+        best = o;
+    }
+    return best;
+  }
+}
+
+size_t encodeWaveBlock(const uint32_t *samples, int count, uint8_t *out, size_t cap)
+{
+  if (count < 1 || count > WAVE_BLOCK_MAX_SAMPLES)
+    return 0;
+  for (int i = 0; i < count; i++)
+  {
+    if (samples[i] > WAVE_SAMPLE_MAX)
+      return 0;
+  }
+
+  int order = chooseOrder(samples, count);
+  uint32_t u[WAVE_BLOCK_MAX_SAMPLES];
+  uint32_t sum = 0;
+  int n = count - 1;
+  for (int i = 1; i < count; i++)
+  {
+    u[i - 1] = zigzag((int32_t)samples[i] - predict(samples, i, order));
+    // Saturating: only the order of magnitude matters for k
+    sum = sum + u[i - 1] < sum ? UINT32_MAX : sum + u[i - 1];
+  }
+
+  // Start from k ~ log2(mean) and try its neighbours
+  int k = 0;
+  uint32_t mean = n > 0 ? sum / n : 0;
+  while (k < MAX_K && (mean >> (k + 1)) > 0)
+    k++;
+  uint32_t bestBits = UINT32_MAX;
+  int bestK = k;
+  for (int candidate = k > 0 ? k - 1 : 0; candidate <= k + 1 && candidate <= MAX_K; candidate++)
+  {
+    uint32_t bits = riceBits(u, n, candidate);
+    if (bits < bestBits)
+    {
+      bestBits = bits;
+      bestK = candidate;
+    }
+  }
+
+  size_t coded = 4 + (bestBits + 7) / 8;
+  if (coded >= waveBlockMaxSize(count))
+  {
+    if (cap < waveBlockMaxSize(count))
+      return 0;
+    out[0] = VERBATIM;
+    for (int i = 0; i < count; i++)
+    {
+      out[1 + 3 * i] = samples[i] & 0xFF;
+      out[2 + 3 * i] = (samples[i] >> 8) & 0xFF;
+      out[3 + 3 * i] = (samples[i] >> 16) & 0xFF;
+    }
+    return waveBlockMaxSize(count);
+  }
+  if (cap < coded)
+    return 0;
+
+  out[0] = (uint8_t)(order << 5 | bestK);
+  out[1] = samples[0] & 0xFF;
+  out[2] = (samples[0] >> 8) & 0xFF;
+  out[3] = (samples[0] >> 16) & 0xFF;
+  BitWriter w = {out + 4, 0, 0, 0};
+  for (int i = 0; i < n; i++)
+  {
+    uint32_t q = u[i] >> bestK;
+    if (q < WAVE_RICE_ESCAPE)
+    {
+      w.putOnes(q);
+      w.put(0, 1);
+      w.put(u[i], bestK);
+    }
+    else
+    {
+      w.putOnes(WAVE_RICE_ESCAPE);
+      w.put(u[i] >> 14, ESCAPE_BITS - 14);
+      w.put(u[i], 14);
+    }
+  }
+  w.flush();
+  return 4 + w.pos;
+}
+
+size_t decodeWaveBlock(const uint8_t *in, size_t len, int count, uint32_t *samples)
+{
+  if (count < 1 || count > WAVE_BLOCK_MAX_SAMPLES || len < 1)
+    return 0;
+  if (in[0] == VERBATIM)
+  {
+    if (len < waveBlockMaxSize(count))
+      return 0;
+    for (int i = 0; i < count; i++)
+      samples[i] = in[1 + 3 * i] | (uint32_t)in[2 + 3 * i] << 8 | (uint32_t)in[3 + 3 * i] << 16;
+    return waveBlockMaxSize(count);
+  }
+  int order = in[0] >> 5;
+  int k = in[0] & 0x1F;
+  if (order > MAX_ORDER || k > MAX_K || len < 4)
+    return 0;
+  samples[0] = in[1] | (uint32_t)in[2] << 8 | (uint32_t)in[3] << 16;
+  BitReader r = {in + 4, len - 4, 0, 0, 0};
+  for (int i = 1; i < count; i++)
+  {
+    uint32_t q, u;
+    if (!r.unary(WAVE_RICE_ESCAPE, q))
+      return 0;
+    if (q < WAVE_RICE_ESCAPE)
+    {
+      uint32_t low;
+      if (!r.get(k, low))
+        return 0;
+      u = q << k | low;
+    }
+    else
+    {
+      uint32_t high, low;
+      if (!r.get(ESCAPE_BITS - 14, high) || !r.get(14, low))
+        return 0;
+      u = high << 14 | low;
+    }
+    int32_t x = predict(samples, i, order) + unzigzag(u);
+    if (x < 0 || (uint32_t)x > WAVE_SAMPLE_MAX)
+      return 0;
+    samples[i] = (uint32_t)x;
+  }
+  return 4 + r.pos;
+}
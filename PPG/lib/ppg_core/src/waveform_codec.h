@@ -0,0 +1,37 @@
+#ifndef PPG_WAVEFORM_CODEC_H
+#define PPG_WAVEFORM_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Lossless compression of one channel of raw samples (the MAX30105's 18
+// bits, anything up to 24), in independently decodable blocks so a lost
+// notification costs only its own samples.
+//
+// Each block picks the fixed polynomial predictor (order 0-3, as in
+// Shorten/FLAC) with the smallest residuals and Rice codes them:
+//   header(1)   order << 5 | k; 0xE0 marks a verbatim block
+//   first(3)    the first sample, little endian
+//   residuals   samples 1..count-1, MSB first, zero padded to a byte.
+//               Sample i is predicted with order min(i, order). Each
+//               residual is zigzag mapped to u and sent as u >> k in
+//               unary (ones closed by a zero) and the low k bits; a
+//               quotient of WAVE_RICE_ESCAPE or more is sent as that many
+//               ones followed by u in 28 bits.
+// Verbatim blocks are count x 3 bytes and are used whenever coding would
+// not be smaller, which bounds a block at waveBlockMaxSize(count).
+// The block does not record its sample count; the container does.
+const int WAVE_BLOCK_MAX_SAMPLES = 64;
+const uint32_t WAVE_SAMPLE_MAX = 0xFFFFFF;
+const uint32_t WAVE_RICE_ESCAPE = 24;
+
+inline size_t waveBlockMaxSize(int count) { return 1 + 3 * (size_t)count; }
+
+// Returns the encoded size, or 0 if count is out of range, a sample is
+// over WAVE_SAMPLE_MAX or the block does not fit in cap.
+size_t encodeWaveBlock(const uint32_t *samples, int count, uint8_t *out, size_t cap);
+
+// Returns the bytes consumed, or 0 if the block is malformed or truncated.
+size_t decodeWaveBlock(const uint8_t *in, size_t len, int count, uint32_t *samples);
+
+#endif
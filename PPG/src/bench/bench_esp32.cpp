@@ -0,0 +1,95 @@
+// On-target cycle counts for the per-sample path (env esp32dev_bench):
+// runs the fixed-point PpgPipeline and the float reference over the same
+// trace and prints CPU cycles per sample for each, then repeats. Also
+// times compressing the trace as the rawz stream does (waveform_codec.h).
+
+#include <Arduino.h>
+#include "bench_trace.h"
+#include "reference_pipeline.h"
+#include "ppg_pipeline.h"
+#include "telemetry.h"
+#include "waveform_codec.h"
+
+namespace
+{
+  const int TRACE_SAMPLES = 3000; // 30 s at 100 Hz
+  int32_t traceIr[TRACE_SAMPLES], traceRed[TRACE_SAMPLES];
+  uint32_t rawIr[TRACE_SAMPLES], rawRed[TRACE_SAMPLES];
+  uint32_t traceTime[TRACE_SAMPLES];
+  PpgPipeline fixedPipeline;
+  ReferencePipeline floatPipeline;
+  volatile float sink;
+
+  uint32_t cyclesFixed()
+  {
+    fixedPipeline.reset();
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < TRACE_SAMPLES; i++)
+      fixedPipeline.addSample(traceIr[i], traceRed[i], traceTime[i]);
+    HrvStats hrv;
+    computeHrv(fixedPipeline.peakTimes(), 0, fixedPipeline.peakCount(), hrv);
+    uint32_t cycles = ESP.getCycleCount() - start;
+    sink = hrv.sdnn + fixedPipeline.systolic().toFloat();
+    return cycles;
+  }
+
+  uint32_t cyclesFloat()
+  {
+    floatPipeline.reset();
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < TRACE_SAMPLES; i++)
+      floatPipeline.addSample(traceIr[i], traceRed[i], traceTime[i]);
+    float sdnn, rmssd;
+    referenceHrv(floatPipeline.peakTimes, floatPipeline.peakCount, sdnn, rmssd);
+    uint32_t cycles = ESP.getCycleCount() - start;
+    sink = sdnn + floatPipeline.estimatedSBP;
+    return cycles;
+  }
+
+  // Both channels in rawz frame blocks; bytes gets the encoded size
+  uint32_t cyclesCodec(size_t &bytes)
+  {
+    static uint8_t block[2 * (1 + 3 * RAW_Z_SAMPLES_PER_FRAME)];
+    bytes = 0;
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i + RAW_Z_SAMPLES_PER_FRAME <= TRACE_SAMPLES; i += RAW_Z_SAMPLES_PER_FRAME)
+    {
+      size_t n = encodeWaveBlock(rawIr + i, RAW_Z_SAMPLES_PER_FRAME, block, sizeof(block));
+      bytes += n + encodeWaveBlock(rawRed + i, RAW_Z_SAMPLES_PER_FRAME, block + n, sizeof(block) - n);
+    }
+    return ESP.getCycleCount() - start;
+  }
+}
+
+void setup()
+{
+  Serial.begin(230400);
+  delay(1000);
+  BenchTrace trace = {traceIr, traceRed, traceTime, TRACE_SAMPLES};
+  fillBenchTrace(trace, 75, 12345u);
+  for (int i = 0; i < TRACE_SAMPLES; i++)
+  {
+    rawIr[i] = (uint32_t)traceIr[i];
+    rawRed[i] = (uint32_t)traceRed[i];
+  }
+  Serial.printf("per-sample path, %d samples, CPU %u MHz\n", TRACE_SAMPLES, ESP.getCpuFreqMHz());
+}
+
+void loop()
+{
+  // Both runs with interrupts enabled; take the best of a few passes.
+  uint32_t bestFloat = UINT32_MAX, bestFixed = UINT32_MAX, bestCodec = UINT32_MAX;
+  size_t codecBytes = 0;
+  for (int r = 0; r < 5; r++)
+  {
+    bestFloat = min(bestFloat, cyclesFloat());
+    bestFixed = min(bestFixed, cyclesFixed());
+    bestCodec = min(bestCodec, cyclesCodec(codecBytes));
+  }
+  Serial.printf("float %.1f cycles/sample, fixed %.1f cycles/sample, speedup %.2fx\n",
+                (float)bestFloat / TRACE_SAMPLES, (float)bestFixed / TRACE_SAMPLES,
+                (float)bestFloat / bestFixed);
+  Serial.printf("rawz encode %.1f cycles/sample, %.2f bits/sample per channel\n", (float)bestCodec / TRACE_SAMPLES,
+                8.0f * codecBytes / (2 * TRACE_SAMPLES));
+  delay(5000);
+}
@@ -0,0 +1,52 @@
+#ifndef PPG_BENCH_TRACE_H
+#define PPG_BENCH_TRACE_H
+
+// Deterministic PPG traces for the benchmarks, drawn from PpgSynth at its
+// sample rate (100 Hz by default) with timestamps starting at 1 s. The
+// synth's beat annotations become the ground-truth peak times.
+
+#include <stdint.h>
+
+#include "ppg_synth.h"
+
+struct BenchTrace
+{
+  int32_t *ir;
+  int32_t *red;
+  uint32_t *timeMs;
+  int samples;
+  // Optional ground truth: systolic peak times (ms), capacity maxBeats.
+  // Left zero by a four-member initializer.
+  uint32_t *beatMs;
+  int maxBeats;
+  int beats;
+  uint8_t *flags; // optional, PpgSynthSample flags per sample
+};
+
+inline void fillBenchTrace(BenchTrace &t, const PpgSynthConfig &config)
+{
+  PpgSynth synth(config);
+  t.beats = 0;
+  for (int i = 0; i < t.samples; i++)
+  {
+    uint32_t at = 1000 + (uint32_t)(synth.timeUs() / 1000);
+    PpgSynthSample s = synth.next();
+    t.ir[i] = (int32_t)s.ir;
+    t.red[i] = (int32_t)s.red;
+    t.timeMs[i] = at;
+    if (t.flags)
+      t.flags[i] = s.flags;
+    if ((s.flags & PpgSynthSample::BEAT) && t.beatMs && t.beats < t.maxBeats)
+      t.beatMs[t.beats++] = 1000 + (uint32_t)((s.beatUs + 500) / 1000);
+  }
+}
+
+inline void fillBenchTrace(BenchTrace &t, float heartRate, uint32_t seed)
+{
+  PpgSynthConfig config;
+  config.heartRate = heartRate;
+  config.seed = seed;
+  fillBenchTrace(t, config);
+}
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef PPG_BENCH_REFERENCE_PIPELINE_H
+#define PPG_BENCH_REFERENCE_PIPELINE_H
+
+// Float implementation of the per-sample path as it ran before the
+// fixed-point port. Kept only for the benchmarks: it is the speed baseline
+// and the numeric reference the fixed-point PpgPipeline is checked against,
+// so beat detection and the outlier reset follow PpgPipeline's.
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+class ReferencePipeline
+{
+public:
+  static const int RATE_SIZE = 15;
+  static const int MAX_PEAKS = 500;
+
+  ReferencePipeline() { reset(); }
+
+  void reset()
+  {
+    irFiltered = redFiltered = 0;
+    prev1 = prev2 = 0;
+    prevFiltered = 0;
+    lastPeakTime = 0;
+    beatAmplitude = 0;
+    riseLow = risePrevLow = 0x7FFFFFFF;
+    riseBlockTime = 0;
+    refractory = 250;
+    intervalCount = intervalNext = 0;
+    outliers = 0;
+    peakCount = 0;
+    beatsPerMinute = 0;
+    filteredBPM = 0;
+    beatAvg = 0;
+    for (int i = 0; i < RATE_SIZE; i++)
+      rates[i] = 75;
+    rateSpot = 0;
+    wasRising = false;
+    pulseMin = 0;
+    pulseMinTime = 0;
+    pulseAmplitude = 0;
+    pulseWidth = 0;
+    updateBloodPressure();
+  }
+
+  void addSample(long irValue, long redValue, unsigned long now)
+  {
+    addFiltered(filterValue(irValue, irFiltered), filterValue(redValue, redFiltered), now);
+  }
+
+  // Everything after the filter, so the later stages can be checked on
+  // exactly the same input as the fixed-point version.
+  void addFiltered(long irValue, long redValue, unsigned long now)
+  {
+    irFiltered = irValue;
+    redFiltered = redValue;
+
+    if (prev2 < prev1 && prev1 > irFiltered && prev1 > 50000 && isBeat(now))
+    {
+      if (peakCount < MAX_PEAKS)
+        peakTimes[peakCount++] = now;
+      if (lastPeakTime > 0)
+        updateHeartRate(now - lastPeakTime);
+      acceptBeat(now, prev1 - std::min(riseLow, risePrevLow));
+    }
+    prev2 = prev1;
+    prev1 = irFiltered;
+    if (now - riseBlockTime > 150)
+    {
+      risePrevLow = riseLow;
+      riseLow = irFiltered;
+      riseBlockTime = now;
+    }
+    else if (irFiltered < riseLow)
+      riseLow = irFiltered;
+
+    if (!wasRising && prevFiltered != 0 && irFiltered > prevFiltered)
+    {
+      pulseMin = prevFiltered;
+      pulseMinTime = now;
+      wasRising = true;
+    }
+    else if (wasRising && irFiltered < prevFiltered)
+    {
+      pulseAmplitude = prevFiltered - pulseMin;
+      pulseWidth = now - pulseMinTime;
+      wasRising = false;
+      updateBloodPressure();
+    }
+    prevFiltered = irFiltered;
+  }
+
+  long irFiltered, redFiltered;
+  float filteredBPM, beatAvg;
+  float estimatedSBP, estimatedDBP;
+  uint32_t peakTimes[MAX_PEAKS];
+  int peakCount;
+
+private:
+  static long filterValue(long newValue, long prevValue)
+  {
+    const float alpha = 0.7;
+    if (prevValue == 0)
+      return newValue;
+    return (long)(alpha * newValue + (1 - alpha) * prevValue);
+  }
+
+  bool isBeat(unsigned long now) const
+  {
+    unsigned long elapsed = now - lastPeakTime;
+    if (elapsed <= refractory)
+      return false;
+    if (beatAmplitude == 0 || elapsed > 2000)
+      return true;
+    return (prev1 - std::min(riseLow, risePrevLow)) * 100 >= beatAmplitude * 50;
+  }
+
+  void acceptBeat(unsigned long now, long rise)
+  {
+    unsigned long elapsed = now - lastPeakTime;
+    if (beatAmplitude == 0 || elapsed > 2000)
+      beatAmplitude = rise;
+    else
+      beatAmplitude += (rise - beatAmplitude) / 4;
+    if (lastPeakTime > 0 && elapsed <= 2000)
+    {
+      intervals[intervalNext] = elapsed;
+      intervalNext = (intervalNext + 1) % 5;
+      if (intervalCount < 5)
+        intervalCount++;
+      unsigned long sorted[5];
+      for (int i = 0; i < intervalCount; i++)
+      {
+        int j = i;
+        for (; j > 0 && sorted[j - 1] > intervals[i]; j--)
+          sorted[j] = sorted[j - 1];
+        sorted[j] = intervals[i];
+      }
+      refractory = std::max(250UL, sorted[intervalCount / 2] * 55 / 100);
+    }
+    lastPeakTime = now;
+  }
+
+  void updateHeartRate(long delta)
+  {
+    const float bpmAlpha = 0.3;
+    beatsPerMinute = 60.0 / (delta / 1000.0);
+    if (beatsPerMinute >= 255 || beatsPerMinute <= 20)
+      return;
+    if (beatAvg > 0 && (beatsPerMinute < 0.7 * beatAvg || beatsPerMinute > 1.3 * beatAvg))
+    {
+      if (++outliers < 4)
+        return;
+      for (int x = 0; x < RATE_SIZE; x++)
+        rates[x] = beatsPerMinute;
+      filteredBPM = 0;
+    }
+    outliers = 0;
+    if (filteredBPM == 0)
+      filteredBPM = beatsPerMinute;
+    else
+      filteredBPM = bpmAlpha * beatsPerMinute + (1 - bpmAlpha) * filteredBPM;
+    rates[rateSpot++] = filteredBPM;
+    rateSpot %= RATE_SIZE;
+    beatAvg = 0;
+    for (int x = 0; x < RATE_SIZE; x++)
+      beatAvg += rates[x];
+    beatAvg /= RATE_SIZE;
+  }
+
+  void updateBloodPressure()
+  {
+    estimatedSBP = 115 + (pulseAmplitude * 0.004) - (pulseWidth * 0.04) + (filteredBPM * 0.15);
+    estimatedDBP = 75 + (pulseAmplitude * 0.0015) - (pulseWidth * 0.015) + (filteredBPM * 0.08);
+  }
+
+  long prev1, prev2;
+  long beatAmplitude;
+  long riseLow, risePrevLow;
+  unsigned long riseBlockTime;
+  unsigned long refractory;
+  unsigned long intervals[5];
+  int intervalCount, intervalNext;
+  int outliers;
+  float prevFiltered;
+  unsigned long lastPeakTime;
+  float beatsPerMinute;
+  float rates[RATE_SIZE];
+  int rateSpot;
+  bool wasRising;
+  float pulseMin;
+  unsigned long pulseMinTime;
+  float pulseAmplitude, pulseWidth;
+};
+
+// Session SDNN and RMSSD as calculateSessionHRV()/calculateWindowHRV() did
+// them, with pow() and sqrt() on float accumulators.
+inline bool referenceHrv(const uint32_t *peakTimes, int count, float &sdnn, float &rmssd)
+{
+  long rr[ReferencePipeline::MAX_PEAKS];
+  bool follows[ReferencePipeline::MAX_PEAKS]; // previous interval was accepted
+  int n = 0;
+  bool accepted = false;
+  for (int i = 1; i < count; i++)
+  {
+    long d = peakTimes[i] - peakTimes[i - 1];
+    if (d > 500 && d < 1200)
+    {
+      follows[n] = accepted;
+      rr[n++] = d;
+      accepted = true;
+    }
+    else
+    {
+      accepted = false;
+    }
+  }
+  if (n < 2)
+    return false;
+  long sum = 0;
+  for (int i = 0; i < n; i++)
+    sum += rr[i];
+  float mean = (float)sum / n;
+  float variance = 0, sumDiffSq = 0;
+  int diffs = 0;
+  for (int i = 0; i < n; i++)
+  {
+    variance += pow(rr[i] - mean, 2);
+    if (follows[i])
+    {
+      sumDiffSq += pow(rr[i] - rr[i - 1], 2);
+      diffs++;
+    }
+  }
+  sdnn = sqrt(variance / n);
+  rmssd = diffs > 0 ? sqrt(sumDiffSq / diffs) : 0;
+  return true;
+}
+
+#endif
@@ -0,0 +1,96 @@
+import asyncio
+import itertools
+import json
+import socket
+import struct
+import sys
+import time
+import zlib
+
+from bleak import BleakClient, BleakScanner
+
+# Forwards notifications from every nearby ESP32-PPG sensor to the gateway
+# daemon as UDP envelopes (see src/host/gateway/envelope.h).
+
+DEVICE_NAME = "ESP32-PPG"
+RX_CHAR_UUID = "6e400002-b5a3-f393-e0a9-e50e24dcca9e"  # Write (App -> ESP)
+TX_CHAR_UUID = "6e400003-b5a3-f393-e0a9-e50e24dcca9e"  # Notify (ESP -> App)
+STREAMS = "summary,rawz,hrv"  # rawz: the raw samples compressed, about a third of the airtime
+SYNC_BURST = 8
+SYNC_INTERVAL_S = 30
+# Notifications are not fragmented; the largest, a rawz frame, needs this
+# ATT MTU. BlueZ, WinRT and CoreBluetooth negotiate one on connect.
+MIN_MTU = 167
+
+gateway_addr = (sys.argv[1] if len(sys.argv) > 1 else "127.0.0.1", 9750)
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+connected = set()
+sync_seq = itertools.count()
+
+
+def device_id(address):
+    # BLE addresses are UUIDs on macOS, so hash rather than parse them.
+    return zlib.crc32(address.encode()) & 0xFFFFFFFF
+
+
+def forward(dev_id, data):
+    header = b"PG" + struct.pack("<BBIQ", 1, 0, dev_id, time.time_ns())
+    sock.sendto(header + bytes(data), gateway_addr)
+
+
+def now_ms():
+    return time.time_ns() / 1e6
+
+
+async def send_sync(client):
+    # Host side of the clock-sync exchange in lib/ppg_core/src/clock_sync.h
+    await client.write_gatt_char(RX_CHAR_UUID, f"SYNC {next(sync_seq)} {now_ms():.3f}".encode(), response=True)
+
+
+def on_notify(client, dev_id, data):
+    if data[:15] == b'{"type":"sync",':
+        t4 = now_ms()
+        reply = json.loads(data)
+        asyncio.create_task(
+            client.write_gatt_char(RX_CHAR_UUID, f"SYNCFIN {reply['seq']} {t4:.3f}".encode(), response=True))
+    forward(dev_id, data)
+
+
+async def follow(device):
+    dev_id = device_id(device.address)
+    try:
+        async with BleakClient(device) as client:
+            print(f"Connected to {device.address} as {dev_id:08x}")
+            if client.mtu_size < MIN_MTU:
+                print(f"{device.address}: MTU {client.mtu_size}, raw frames and summaries over it will be dropped")
+            await client.start_notify(TX_CHAR_UUID, lambda _, data: on_notify(client, dev_id, data))
+            await client.write_gatt_char(RX_CHAR_UUID, f"SUB {STREAMS}".encode(), response=True)
+            for _ in range(SYNC_BURST):
+                await send_sync(client)
+                await asyncio.sleep(0.25)
+            last_sync = time.monotonic()
+            while client.is_connected:
+                await asyncio.sleep(1)
+                if time.monotonic() - last_sync >= SYNC_INTERVAL_S:
+                    await send_sync(client)
+                    last_sync = time.monotonic()
+    except Exception as e:
+        print(f"{device.address}: {e}")
+    finally:
+        connected.discard(device.address)
+        print(f"Lost {device.address}")
+
+
+async def main():
+    print(f"Forwarding {DEVICE_NAME} notifications to {gateway_addr[0]}:{gateway_addr[1]}")
+    while True:
+        for device in await BleakScanner.discover(timeout=5.0):
+            if device.name == DEVICE_NAME and device.address not in connected:
+                connected.add(device.address)
+                asyncio.create_task(follow(device))
+
+
+try:
+    asyncio.run(main())
+except KeyboardInterrupt:
+    print("\nExiting...")
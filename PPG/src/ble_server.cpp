@@ -0,0 +1,267 @@
+#include "ble_server.h"
+
+#include <BLEDevice.h>
+#include <BLEUtils.h>
+#include <BLEServer.h>
+#include <BLE2902.h>
+
+namespace
+{
+  struct BleConnection
+  {
+    bool active;
+    uint16_t connId;
+    uint16_t mtu;
+    uint8_t streams;
+    uint32_t oversized; // notifications dropped for not fitting the MTU
+  };
+
+  // Connection callbacks run on the Bluedroid task while bleSend() runs
+  // from loop(), so the table is only touched inside connectionsMux.
+  BleConnection connections[BLE_MAX_CONNECTIONS];
+  portMUX_TYPE connectionsMux = portMUX_INITIALIZER_UNLOCKED;
+  volatile uint8_t subscribedMask = 0;
+  volatile uint8_t connectionCount = 0;
+
+  BLEServer *server = nullptr;
+  BLECharacteristic *txCharacteristic = nullptr;
+  BLECharacteristic *rxCharacteristic = nullptr;
+  BleCommandHandler commandHandler = nullptr;
+  BleDisconnectHandler disconnectHandler = nullptr;
+
+  // Must be called with connectionsMux held.
+  void refreshMaskLocked()
+  {
+    uint8_t mask = 0, count = 0;
+    for (const BleConnection &c : connections)
+    {
+      if (!c.active)
+        continue;
+      mask |= c.streams;
+      count++;
+    }
+    subscribedMask = mask;
+    connectionCount = count;
+  }
+
+  BleConnection *findLocked(uint16_t connId)
+  {
+    for (BleConnection &c : connections)
+    {
+      if (c.active && c.connId == connId)
+        return &c;
+    }
+    return nullptr;
+  }
+
+  void startAdvertisingIfFree()
+  {
+    if (connectionCount < BLE_MAX_CONNECTIONS)
+      BLEDevice::startAdvertising();
+  }
+
+  class ServerCallbacks : public BLEServerCallbacks
+  {
+    void onConnect(BLEServer *pServer, esp_ble_gatts_cb_param_t *param)
+    {
+      uint16_t connId = param->connect.conn_id;
+      portENTER_CRITICAL(&connectionsMux);
+      for (BleConnection &c : connections)
+      {
+        if (!c.active)
+        {
+          // New clients get the summary stream so the app keeps working
+          // without having to send SUB first.
+          c = {true, connId, 23, STREAM_SUMMARY, 0};
+          break;
+        }
+      }
+      refreshMaskLocked();
+      portEXIT_CRITICAL(&connectionsMux);
+      Serial.printf("BLE client %u connected (%u active)\n", connId, connectionCount);
+      // The controller stops advertising once a central connects; restart it
+      // so a second device (e.g. a coach tablet) can join the session.
+      startAdvertisingIfFree();
+    }
+
+    void onDisconnect(BLEServer *pServer, esp_ble_gatts_cb_param_t *param)
+    {
+      uint16_t connId = param->disconnect.conn_id;
+      uint32_t oversized = 0;
+      portENTER_CRITICAL(&connectionsMux);
+      BleConnection *c = findLocked(connId);
+      if (c)
+      {
+        c->active = false;
+        oversized = c->oversized;
+      }
+      refreshMaskLocked();
+      portEXIT_CRITICAL(&connectionsMux);
+      Serial.printf("BLE client %u disconnected (%u active)\n", connId, connectionCount);
+      if (oversized > 0)
+        Serial.printf("BLE client %u: %lu notifications over its MTU dropped\n", connId, (unsigned long)oversized);
+      if (disconnectHandler)
+        disconnectHandler(connId);
+      startAdvertisingIfFree();
+    }
+
+    void onMtuChanged(BLEServer *pServer, esp_ble_gatts_cb_param_t *param)
+    {
+      portENTER_CRITICAL(&connectionsMux);
+      BleConnection *c = findLocked(param->mtu.conn_id);
+      if (c)
+        c->mtu = param->mtu.mtu;
+      portEXIT_CRITICAL(&connectionsMux);
+    }
+  };
+
+  // SUB/UNSUB change the subscriptions of the writing connection only.
+  bool handleSubscription(const String &command, uint16_t connId)
+  {
+    bool subscribe = command.startsWith("SUB");
+    bool unsubscribe = command.startsWith("UNSUB");
+    if (!subscribe && !unsubscribe)
+      return false;
+    uint8_t streams = parseStreamList(command.c_str() + (subscribe ? 3 : 5));
+    uint8_t current = 0;
+    portENTER_CRITICAL(&connectionsMux);
+    BleConnection *c = findLocked(connId);
+    if (c)
+    {
+      if (subscribe)
+        c->streams |= streams;
+      else
+        c->streams &= ~streams;
+      current = c->streams;
+    }
+    refreshMaskLocked();
+    portEXIT_CRITICAL(&connectionsMux);
+
+    char list[32];
+    formatStreamList(current, list, sizeof(list));
+    bleSendTo(connId, String("{\"subscribed\":\"") + list + "\"}");
+    return true;
+  }
+
+  class CommandCallbacks : public BLECharacteristicCallbacks
+  {
+    void onWrite(BLECharacteristic *pCharacteristic, esp_ble_gatts_cb_param_t *param)
+    {
+      std::string value = pCharacteristic->getValue();
+      if (value.length() == 0)
+        return;
+      String command = String(value.c_str());
+      command.trim();
+      uint16_t connId = param->write.conn_id;
+      if (handleSubscription(command, connId))
+        return;
+      if (commandHandler)
+        commandHandler(command, connId);
+    }
+  };
+
+  // Notifications are not fragmented: a payload over the connection's MTU
+  // is dropped and counted, and the first drop is logged. The app and the
+  // gateway request a large MTU after connecting (the default 23 bytes
+  // fits no summary).
+  bool sendToConnection(uint16_t connId, uint16_t mtu, const uint8_t *data, size_t len)
+  {
+    if (len > (size_t)(mtu - 3))
+    {
+      uint32_t oversized = 0;
+      portENTER_CRITICAL(&connectionsMux);
+      BleConnection *c = findLocked(connId);
+      if (c)
+        oversized = ++c->oversized;
+      portEXIT_CRITICAL(&connectionsMux);
+      if (oversized == 1)
+        Serial.printf("BLE client %u: %u byte notification over MTU %u dropped\n", connId, (unsigned)len, mtu);
+      return false;
+    }
+    esp_err_t rc = esp_ble_gatts_send_indicate(server->getGattsIf(), connId, txCharacteristic->getHandle(),
+                                               len, (uint8_t *)data, false);
+    return rc == ESP_OK;
+  }
+}
+
+void bleSetup(const char *deviceName, BleCommandHandler handler, BleDisconnectHandler disconnected)
+{
+  commandHandler = handler;
+  disconnectHandler = disconnected;
+
+  BLEDevice::init(deviceName);
+  // Largest ATT MTU the stack accepts when a client asks for more
+  BLEDevice::setMTU(BLE_PREFERRED_MTU);
+  server = BLEDevice::createServer();
+  server->setCallbacks(new ServerCallbacks());
+  BLEService *pService = server->createService(SERVICE_UUID);
+
+  rxCharacteristic = pService->createCharacteristic(
+      RX_CHAR_UUID,
+      BLECharacteristic::PROPERTY_WRITE);
+  rxCharacteristic->setCallbacks(new CommandCallbacks());
+
+  txCharacteristic = pService->createCharacteristic(
+      TX_CHAR_UUID,
+      BLECharacteristic::PROPERTY_NOTIFY);
+  txCharacteristic->addDescriptor(new BLE2902());
+
+  pService->start();
+  BLEAdvertising *pAdvertising = BLEDevice::getAdvertising();
+  pAdvertising->setScanResponse(true);
+  pAdvertising->setMinPreferred(0x06);
+  pAdvertising->setMinPreferred(0x12);
+  pAdvertising->start();
+}
+
+uint8_t bleSubscribedStreams()
+{
+  return subscribedMask;
+}
+
+uint8_t bleConnectionCount()
+{
+  return connectionCount;
+}
+
+int bleSend(uint8_t stream, const uint8_t *data, size_t len)
+{
+  if (!(subscribedMask & stream))
+    return 0;
+
+  BleConnection targets[BLE_MAX_CONNECTIONS];
+  portENTER_CRITICAL(&connectionsMux);
+  memcpy(targets, connections, sizeof(targets));
+  portEXIT_CRITICAL(&connectionsMux);
+
+  int sent = 0;
+  for (const BleConnection &c : targets)
+  {
+    if (c.active && (c.streams & stream) && sendToConnection(c.connId, c.mtu, data, len))
+      sent++;
+  }
+  return sent;
+}
+
+int bleSend(uint8_t stream, const String &text)
+{
+  return bleSend(stream, (const uint8_t *)text.c_str(), text.length());
+}
+
+bool bleSendTo(uint16_t connId, const uint8_t *data, size_t len)
+{
+  uint16_t mtu = 0;
+  portENTER_CRITICAL(&connectionsMux);
+  BleConnection *c = findLocked(connId);
+  if (c)
+    mtu = c->mtu;
+  portEXIT_CRITICAL(&connectionsMux);
+  if (mtu == 0)
+    return false;
+  return sendToConnection(connId, mtu, data, len);
+}
+
+bool bleSendTo(uint16_t connId, const String &text)
+{
+  return bleSendTo(connId, (const uint8_t *)text.c_str(), text.length());
+}
@@ -0,0 +1,38 @@
+#ifndef PPG_BLE_SERVER_H
+#define PPG_BLE_SERVER_H
+
+#include <Arduino.h>
+#include "telemetry.h"
+
+#define SERVICE_UUID "6e400001-b5a3-f393-e0a9-e50e24dcca9e"
+#define RX_CHAR_UUID "6e400002-b5a3-f393-e0a9-e50e24dcca9e" // Write (App -> ESP)
+#define TX_CHAR_UUID "6e400003-b5a3-f393-e0a9-e50e24dcca9e" // Notify (ESP -> App)
+
+// Bluedroid's default CONFIG_BT_ACL_CONNECTIONS is 4; keep one slot spare.
+const uint8_t BLE_MAX_CONNECTIONS = 3;
+// Clients should request this ATT MTU after connecting: summaries and raw
+// frames do not fit the default 23 bytes and are not fragmented.
+const uint16_t BLE_PREFERRED_MTU = 517;
+
+// Called for every RX write that is not a subscription command.
+typedef void (*BleCommandHandler)(const String &command, uint16_t connId);
+// Called from the Bluedroid task once a connection has closed.
+typedef void (*BleDisconnectHandler)(uint16_t connId);
+
+void bleSetup(const char *deviceName, BleCommandHandler handler, BleDisconnectHandler disconnected);
+
+// Streams at least one connected client is subscribed to. Cheap enough to
+// call per sample, so callers can skip building payloads nobody will read.
+uint8_t bleSubscribedStreams();
+inline bool bleHasSubscribers(uint8_t stream) { return (bleSubscribedStreams() & stream) != 0; }
+
+// Notifies every connection subscribed to stream and returns how many were
+// reached. Connections whose MTU is too small for the payload are skipped.
+int bleSend(uint8_t stream, const uint8_t *data, size_t len);
+int bleSend(uint8_t stream, const String &text);
+bool bleSendTo(uint16_t connId, const uint8_t *data, size_t len);
+bool bleSendTo(uint16_t connId, const String &text);
+
+uint8_t bleConnectionCount();
+
+#endif
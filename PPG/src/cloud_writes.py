@@ -0,0 +1,177 @@
+import argparse
+import ctypes
+import glob
+import json
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import urllib.error
+import urllib.request
+
+# Measures the app's cloud writes of live readings against
+# src/mock_firebase.py: either one push() per reading, as the app used to
+# do, or through the write-behind buffer in the shared core
+# (lib/ppg_analytics/src/write_behind.h), loaded from libppg_core.so.
+#
+#   python3 src/mock_firebase.py --fail-rate 0.1 &
+#   python3 src/cloud_writes.py --athletes 4 --seconds 1800 --restart-at 900
+#   python3 src/cloud_writes.py --direct --athletes 4 --seconds 1800
+#
+# Time is simulated, so a long session runs in seconds. --restart-at
+# closes the buffer with readings still pending and reopens it from its
+# journal, as after an app restart. At the end every athlete's readings
+# are read back and checked for loss and duplicates.
+
+LIB = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "lib")
+ANALYTICS_SRC = os.path.join(LIB, "ppg_analytics", "src")
+CORE_SRC = os.path.join(LIB, "ppg_core", "src")
+CORE_SOURCES = ["crc16.cpp", "trend_store.cpp", "upload_batch.cpp"]
+
+
+def load_core(path):
+    if path is None:
+        # Same sources as the app's Linux build, compiled for this machine
+        path = os.path.join(tempfile.mkdtemp(), "libppg_core.so")
+        sources = sorted(glob.glob(os.path.join(ANALYTICS_SRC, "*.cpp")))
+        sources += [os.path.join(CORE_SRC, name) for name in CORE_SOURCES]
+        subprocess.run(["c++", "-std=gnu++17", "-O2", "-shared", "-fPIC", "-I", ANALYTICS_SRC, "-I", CORE_SRC, "-o", path]
+                       + sources, check=True)
+    lib = ctypes.CDLL(path)
+    p, u32, i32, i64 = ctypes.c_void_p, ctypes.c_uint32, ctypes.c_int32, ctypes.c_int64
+    signatures = {
+        "ppg_wb_open": (p, [ctypes.c_char_p, u32, u32, u32]),
+        "ppg_wb_close": (None, [p]),
+        "ppg_wb_append": (i32, [p, ctypes.c_char_p, ctypes.c_char_p, i64]),
+        "ppg_wb_flush_soon": (None, [p]),
+        "ppg_wb_due": (i32, [p, i64]),
+        "ppg_wb_take_batch": (u32, [p]),
+        "ppg_wb_batch_body": (ctypes.c_char_p, [p]),
+        "ppg_wb_batch_path": (ctypes.c_char_p, [p]),
+        "ppg_wb_ack": (None, [p, i32, i64]),
+        "ppg_wb_pending": (u32, [p]),
+        "ppg_wb_stat": (ctypes.c_uint64, [p, i32]),
+    }
+    for name, (restype, argtypes) in signatures.items():
+        fn = getattr(lib, name)
+        fn.restype, fn.argtypes = restype, argtypes
+    return lib
+
+
+class Endpoint:
+    def __init__(self, url):
+        self.url = url.rstrip("/")
+        self.requests = self.failed = self.bytes = 0
+
+    def send(self, method, path, body):
+        data = body.encode()
+        self.requests += 1
+        self.bytes += len(data)
+        request = urllib.request.Request(f"{self.url}/{path}.json", data=data, method=method)
+        try:
+            with urllib.request.urlopen(request, timeout=10) as reply:
+                reply.read()
+            return True
+        except (urllib.error.URLError, OSError):
+            self.failed += 1
+            return False
+
+    def get(self, path):
+        with urllib.request.urlopen(f"{self.url}/{path}.json", timeout=10) as reply:
+            return json.loads(reply.read())
+
+
+def reading(rng, t):
+    # A summary notification as the sensor sends it (ppg_app.cpp)
+    hr = 60 + 8 * rng.random()
+    return json.dumps({
+        "heartRate": round(hr, 1), "avgHeartRate": round(hr, 1), "sbp": round(118 + 4 * rng.random(), 1),
+        "dbp": round(76 + 3 * rng.random(), 1), "oxygen": 97.0, "spo2Valid": 1, "spo2Conf": 0.9,
+        "perfusion": 1.2, "respRate": 14.0, "timestamp": t * 1000,
+    }, separators=(",", ":"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure cloud writes of live readings against mock_firebase.py")
+    parser.add_argument("--url", default="http://127.0.0.1:8080")
+    parser.add_argument("--lib", help="libppg_core.so to load (default: build one from lib/ppg_analytics)")
+    parser.add_argument("--direct", action="store_true", help="one push() per reading instead of the buffer")
+    parser.add_argument("--athletes", type=int, default=1)
+    parser.add_argument("--seconds", type=int, default=600)
+    parser.add_argument("--interval", type=int, default=10, help="flush interval, seconds")
+    parser.add_argument("--max-bytes", type=int, default=16384, help="largest update body")
+    parser.add_argument("--restart-at", type=int, help="reopen the buffer from its journal at this second")
+    parser.add_argument("--journal", help="journal file (default: a temporary one)")
+    args = parser.parse_args()
+
+    endpoint = Endpoint(args.url)
+    rng = random.Random(1)
+    run = f"run{random.randrange(1 << 30)}"
+    paths = [f"users/athlete{a}/sessions/{run}/readings" for a in range(args.athletes)]
+    start_ms = 1_700_000_000_000
+    payload_bytes = 0
+
+    if args.direct:
+        for t in range(args.seconds):
+            for path in paths:
+                body = reading(rng, t)
+                payload_bytes += len(body)
+                # The app never retried a failed push()
+                endpoint.send("POST", path, body)
+    else:
+        core = load_core(args.lib)
+        journal = (args.journal or os.path.join(tempfile.mkdtemp(), "readings.journal")).encode()
+        open_buffer = lambda: core.ppg_wb_open(journal, 0x5EED, args.interval * 1000, args.max_bytes)
+        wb = open_buffer()
+        if not wb:
+            sys.exit("cannot open the journal")
+        now = start_ms
+
+        def pump():
+            while core.ppg_wb_due(wb, now):
+                core.ppg_wb_take_batch(wb)
+                body = core.ppg_wb_batch_body(wb).decode()
+                ok = endpoint.send("PATCH", core.ppg_wb_batch_path(wb).decode(), body)
+                core.ppg_wb_ack(wb, 1 if ok else 0, now)
+
+        for t in range(args.seconds):
+            now = start_ms + t * 1000
+            if t == args.restart_at:
+                pending = core.ppg_wb_pending(wb)
+                core.ppg_wb_close(wb)
+                wb = open_buffer()
+                print(f"restart at {t} s: {pending} readings pending, {core.ppg_wb_pending(wb)} replayed")
+            for path in paths:
+                body = reading(rng, t)
+                payload_bytes += len(body)
+                if not core.ppg_wb_append(wb, path.encode(), body.encode(), now):
+                    sys.exit("append failed")
+            pump()
+        core.ppg_wb_flush_soon(wb)
+        # Session end: drain, waiting out any backoff
+        for _ in range(1000):
+            if core.ppg_wb_pending(wb) == 0:
+                break
+            now += 1000
+            pump()
+        stats = [core.ppg_wb_stat(wb, i) for i in range(5)]
+        print(f"buffer: appended={stats[0]} sent={stats[1]} batches={stats[2]} failures={stats[3]} "
+              f"bodyBytes={stats[4]} pending={core.ppg_wb_pending(wb)}")
+        core.ppg_wb_close(wb)
+
+    readings = args.seconds * args.athletes
+    stored = 0
+    for path in paths:
+        node = endpoint.get(path) or {}
+        stored += len(node)
+    print(f"{'direct' if args.direct else 'write-behind'}: {readings} readings, {stored} stored, "
+          f"{endpoint.requests} requests ({endpoint.failed} failed), {endpoint.bytes} body bytes")
+    print(f"  requests/reading={endpoint.requests / readings:.3f} "
+          f"bytes/reading={endpoint.bytes / readings:.1f} (payload {payload_bytes / readings:.1f})")
+    if stored != readings:
+        sys.exit(f"{readings - stored} readings missing")
+
+
+if __name__ == "__main__":
+    main()
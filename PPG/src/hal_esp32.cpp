@@ -0,0 +1,147 @@
+#include "hal_esp32.h"
+
+#include <Preferences.h>
+#include <esp_timer.h>
+#include "ble_server.h"
+#include "profiler.h"
+
+namespace
+{
+  portMUX_TYPE platformMux = portMUX_INITIALIZER_UNLOCKED;
+  const char *SETTINGS_NAMESPACE = "ppg";
+  const char *TREND_PARTITION = "trends";
+  TransportCommandHandler transportHandler = nullptr;
+  TransportDisconnectHandler transportDisconnected = nullptr;
+
+  void onBleCommand(const String &command, uint16_t connId)
+  {
+    if (transportHandler)
+      transportHandler(command.c_str(), connId);
+  }
+
+  void onBleDisconnect(uint16_t connId)
+  {
+    if (transportDisconnected)
+      transportDisconnected(connId);
+  }
+}
+
+uint64_t Esp32Platform::micros()
+{
+  return (uint64_t)esp_timer_get_time();
+}
+
+uint32_t Esp32Platform::millis()
+{
+  return ::millis();
+}
+
+void Esp32Platform::sleepMs(uint32_t ms)
+{
+  delay(ms);
+}
+
+void Esp32Platform::log(const char *line)
+{
+  Serial.println(line);
+}
+
+void Esp32Platform::lock()
+{
+  portENTER_CRITICAL(&platformMux);
+}
+
+void Esp32Platform::unlock()
+{
+  portEXIT_CRITICAL(&platformMux);
+}
+
+bool Esp32Platform::loadSetting(const char *key, void *data, size_t len)
+{
+  Preferences prefs;
+  if (!prefs.begin(SETTINGS_NAMESPACE, true))
+    return false;
+  bool ok = prefs.getBytesLength(key) == len && prefs.getBytes(key, data, len) == len;
+  prefs.end();
+  return ok;
+}
+
+bool Esp32Platform::saveSetting(const char *key, const void *data, size_t len)
+{
+  Preferences prefs;
+  if (!prefs.begin(SETTINGS_NAMESPACE, false))
+    return false;
+  bool ok = prefs.putBytes(key, data, len) == len;
+  prefs.end();
+  return ok;
+}
+
+const esp_partition_t *Esp32Flash::find()
+{
+  if (!searched)
+  {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, TREND_PARTITION);
+    searched = true;
+  }
+  return partition;
+}
+
+uint32_t Esp32Flash::size()
+{
+  const esp_partition_t *p = find();
+  return p ? p->size - p->size % SECTOR_SIZE : 0;
+}
+
+bool Esp32Flash::read(uint32_t offset, void *data, size_t len)
+{
+  const esp_partition_t *p = find();
+  return p && esp_partition_read(p, offset, data, len) == ESP_OK;
+}
+
+bool Esp32Flash::write(uint32_t offset, const void *data, size_t len)
+{
+  const esp_partition_t *p = find();
+  return p && esp_partition_write(p, offset, data, len) == ESP_OK;
+}
+
+bool Esp32Flash::eraseSector(uint32_t offset)
+{
+  const esp_partition_t *p = find();
+  return p && esp_partition_erase_range(p, offset, SECTOR_SIZE) == ESP_OK;
+}
+
+bool BleTransport::begin(const char *deviceName, TransportCommandHandler handler,
+                         TransportDisconnectHandler disconnected)
+{
+  transportHandler = handler;
+  transportDisconnected = disconnected;
+  bleSetup(deviceName, onBleCommand, onBleDisconnect);
+  return true;
+}
+
+uint8_t BleTransport::subscribedStreams()
+{
+  return bleSubscribedStreams();
+}
+
+int BleTransport::send(uint8_t stream, const uint8_t *data, size_t len)
+{
+  return bleSend(stream, data, len);
+}
+
+bool BleTransport::sendTo(uint16_t connId, const uint8_t *data, size_t len)
+{
+  return bleSendTo(connId, data, len);
+}
+
+#ifdef PPG_PROFILE
+uint32_t profileCycles()
+{
+  return ESP.getCycleCount();
+}
+
+uint32_t profileCyclesPerUs()
+{
+  return ESP.getCpuFreqMHz();
+}
+#endif
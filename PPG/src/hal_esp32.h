@@ -0,0 +1,97 @@
+#ifndef PPG_HAL_ESP32_H
+#define PPG_HAL_ESP32_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#undef I2C_BUFFER_LENGTH // Fix redefinition warning
+#include <MAX30105.h>
+#include <esp_partition.h>
+#include "ppg_hal.h"
+
+class Esp32Platform : public PpgPlatform
+{
+public:
+  uint64_t micros();
+  uint32_t millis();
+  void sleepMs(uint32_t ms);
+  void log(const char *line);
+  void lock();
+  void unlock();
+  bool loadSetting(const char *key, void *data, size_t len);
+  bool saveSetting(const char *key, const void *data, size_t len);
+};
+
+// The "trends" data partition (partitions.csv). Looked up on first use;
+// without it size() is 0 and the app records no trends.
+class Esp32Flash : public PpgFlash
+{
+public:
+  Esp32Flash() : partition(nullptr), searched(false) {}
+
+  uint32_t size();
+  bool read(uint32_t offset, void *data, size_t len);
+  bool write(uint32_t offset, const void *data, size_t len);
+  bool eraseSector(uint32_t offset);
+
+private:
+  const esp_partition_t *find();
+
+  const esp_partition_t *partition;
+  bool searched;
+};
+
+// MAX30105 on I2C pins 21/22. Templated on the driver so the simulated
+// part (ppg_synth.h) can stand in for the SparkFun one.
+template <typename Driver>
+class Max30105Sensor : public PpgSensor
+{
+public:
+  explicit Max30105Sensor(Driver &driver) : driver(driver) {}
+
+  bool begin()
+  {
+    Wire.begin(21, 22);
+    if (!driver.begin(Wire, I2C_SPEED_FAST))
+      return false;
+    driver.setup();
+    driver.setPulseAmplitudeRed(0x3F);
+    driver.setPulseAmplitudeGreen(0);
+    return true;
+  }
+
+  // Both channels of the oldest sample in the FIFO, waiting up to 250 ms
+  // for one. getIR() and getRed() would each wait for a sample of their
+  // own and drop every other one.
+  void read(uint32_t &ir, uint32_t &red)
+  {
+    uint32_t start = millis();
+    while (driver.available() == 0)
+    {
+      if (driver.check() == 0 && millis() - start > 250)
+      {
+        ir = red = 0;
+        return;
+      }
+    }
+    ir = driver.getFIFOIR();
+    red = driver.getFIFORed();
+    driver.nextSample();
+  }
+
+private:
+  Driver &driver;
+};
+
+// The Nordic UART style service in ble_server.h
+class BleTransport : public PpgTransport
+{
+public:
+  bool begin(const char *deviceName, TransportCommandHandler handler, TransportDisconnectHandler disconnected);
+  uint8_t subscribedStreams();
+  int send(uint8_t stream, const uint8_t *data, size_t len);
+  bool sendTo(uint16_t connId, const uint8_t *data, size_t len);
+  using PpgTransport::send;
+  using PpgTransport::sendTo;
+};
+
+#endif
@@ -0,0 +1,410 @@
+// Session archive: keeps the index over a directory of session files (see
+// session_index.h) and answers time-range and threshold queries from it.
+//
+//   program index squad_store/sessions
+//   program query squad_store/sessions --metric rmssd --below 42 --from 2026-03-01 --to 2026-03-08
+//   program days squad_store/sessions --metric rmssd --device 00001003 --from 2026-02-01
+//   program bench /tmp/archive --athletes 4 --years 3
+//
+// bench writes a synthetic multi-year archive to an empty directory, with
+// a competition every six weeks per athlete and RMSSD falling in the week
+// before it, then asks, for every competition, for the sessions of the 7
+// days before it with RMSSD below the athlete's baseline (the mean of the
+// four weeks before that), once through the index and once by scanning
+// every file, and compares the answers and the time taken.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "session_file.h"
+#include "session_index.h"
+
+namespace
+{
+  const int32_t BENCH_FIRST_DAY = 19358; // 2023-01-01
+  const int COMPETITION_EVERY_DAYS = 42;
+  const int BASELINE_DAYS = 28;
+  const int LEAD_UP_DAYS = 7;
+
+  struct Options
+  {
+    std::string command;
+    std::string archive;
+    int metric = METRIC_HEART_RATE;
+    int64_t fromMs = INT64_MIN;
+    int64_t toMs = INT64_MAX;
+    double above = -INFINITY;
+    double below = INFINITY;
+    bool anyDevice = true;
+    uint32_t device = 0;
+    int athletes = 4;
+    int years = 3;
+    unsigned seed = 1;
+  };
+
+  // YYYY-MM-DD as epoch ms, UTC
+  bool parseDate(const char *s, int64_t &ms)
+  {
+    tm t = {};
+    if (sscanf(s, "%d-%d-%d", &t.tm_year, &t.tm_mon, &t.tm_mday) != 3)
+      return false;
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    ms = (int64_t)timegm(&t) * 1000;
+    return true;
+  }
+
+  std::string formatDay(int32_t day)
+  {
+    time_t s = (time_t)day * 86400;
+    tm t;
+    gmtime_r(&s, &t);
+    char buf[16];
+    strftime(buf, sizeof(buf), "%Y-%m-%d", &t);
+    return buf;
+  }
+
+  bool parseArgs(int argc, char **argv, Options &opts)
+  {
+    if (argc < 3)
+      return false;
+    opts.command = argv[1];
+    opts.archive = argv[2];
+    for (int i = 3; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (i + 1 >= argc)
+        return false;
+      const char *v = argv[++i];
+      if (arg == "--metric")
+        opts.metric = sessionMetric(v);
+      else if (arg == "--from")
+      {
+        if (!parseDate(v, opts.fromMs))
+          return false;
+      }
+      else if (arg == "--to")
+      {
+        if (!parseDate(v, opts.toMs))
+          return false;
+      }
+      else if (arg == "--above")
+        opts.above = atof(v);
+      else if (arg == "--below")
+        opts.below = atof(v);
+      else if (arg == "--device")
+      {
+        opts.anyDevice = false;
+        opts.device = strtoul(v, nullptr, 16);
+      }
+      else if (arg == "--athletes")
+        opts.athletes = std::max(1, atoi(v));
+      else if (arg == "--years")
+        opts.years = std::max(1, atoi(v));
+      else if (arg == "--seed")
+        opts.seed = atoi(v);
+      else
+        return false;
+    }
+    return opts.metric >= 0;
+  }
+
+  double monotonicS()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+  bool openIndex(const std::string &archive, SessionIndex &index, bool quiet)
+  {
+    std::string error;
+    if (!index.open(archive, error))
+    {
+      fprintf(stderr, "%s\n", error.c_str());
+      return false;
+    }
+    double start = monotonicS();
+    size_t before = index.sessionCount();
+    size_t added = index.update(error);
+    if (!error.empty())
+      fprintf(stderr, "skipped %s\n", error.c_str());
+    bool changed = added > 0 || index.sessionCount() != before;
+    if (changed && !index.save(error))
+    {
+      fprintf(stderr, "%s\n", error.c_str());
+      return false;
+    }
+    if (!quiet || changed)
+      printf("index: %zu sessions, %zu added in %.3f s\n", index.sessionCount(), added, monotonicS() - start);
+    return true;
+  }
+
+  int runQuery(const Options &opts)
+  {
+    SessionIndex index;
+    if (!openIndex(opts.archive, index, true))
+      return 1;
+    SessionQuery q;
+    q.metric = opts.metric;
+    q.fromMs = opts.fromMs;
+    q.toMs = opts.toMs;
+    q.above = opts.above;
+    q.below = opts.below;
+    q.anySource = opts.anyDevice;
+    q.source = opts.device;
+    std::vector<SessionHit> hits;
+    QueryStats stats;
+    std::string error;
+    double start = monotonicS();
+    if (!index.query(q, hits, stats, error))
+    {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+    double elapsed = monotonicS() - start;
+    for (const SessionHit &h : hits)
+    {
+      const SessionIndex::Session &s = index.session(h.session);
+      printf("%s device=%08x %s rows=%llu min=%.2f max=%.2f\n", s.path.c_str(), s.source,
+             formatDay(utcDay(h.firstMs)).c_str(), (unsigned long long)h.rows, h.min, h.max);
+    }
+    printf("%zu sessions matched of %zu in range; %llu of %llu blocks read from %zu files in %.3f ms\n",
+           hits.size(), stats.sessions, (unsigned long long)stats.blocksRead, (unsigned long long)stats.blocks,
+           stats.filesOpened, elapsed * 1e3);
+    return 0;
+  }
+
+  int runDays(const Options &opts)
+  {
+    if (opts.anyDevice)
+    {
+      fprintf(stderr, "days needs --device\n");
+      return 2;
+    }
+    SessionIndex index;
+    if (!openIndex(opts.archive, index, true))
+      return 1;
+    int32_t from = opts.fromMs == INT64_MIN ? 0 : utcDay(opts.fromMs);
+    int32_t to = opts.toMs == INT64_MAX ? INT32_MAX >> 4 : utcDay(opts.toMs - 1);
+    std::vector<std::pair<int32_t, DayStats>> daily;
+    index.dailyRollups(opts.device, opts.metric, from, to, daily);
+    for (const auto &d : daily)
+      printf("%s n=%u mean=%.2f min=%.2f max=%.2f\n", formatDay(d.first).c_str(), d.second.count, d.second.mean(),
+             d.second.min, d.second.max);
+    return 0;
+  }
+
+  // One session a day per athlete, 30 minutes of 1 Hz readings and 30 s
+  // HRV windows
+  bool synthesise(const Options &opts)
+  {
+    std::mt19937 rng(opts.seed);
+    std::normal_distribution<double> noise(0, 1);
+    const int64_t readings = 1800;
+    const int64_t windowMs = 30000;
+    SessionFileWriter w;
+    int tMs = w.addColumn("t_ms", PSF_I64);
+    int hr = w.addColumn("heart_rate", PSF_F32);
+    int sbp = w.addColumn("sbp", PSF_F32);
+    int dbp = w.addColumn("dbp", PSF_F32);
+    int oxygen = w.addColumn("oxygen", PSF_F32);
+    int hrvT = w.addColumn("hrv_t_ms", PSF_I64);
+    int sdnn = w.addColumn("sdnn", PSF_F32);
+    int rmssd = w.addColumn("rmssd", PSF_F32);
+    for (int a = 0; a < opts.athletes; a++)
+    {
+      uint32_t device = 0x1000 + a;
+      double baseline = 45 + 30 * (rng() % 1000) / 1000.0;
+      double restingHr = 50 + rng() % 15;
+      int offset = a * 9;
+      for (int day = 0; day < opts.years * 365; day++)
+      {
+        // 1 on competition day, rising over the week before it
+        int untilComp = COMPETITION_EVERY_DAYS - 1 - (day + offset) % COMPETITION_EVERY_DAYS;
+        double strain = untilComp < LEAD_UP_DAYS ? 1 - untilComp / (double)LEAD_UP_DAYS : 0;
+        double dayRmssd = baseline * (1 - 0.25 * strain) + 4 * noise(rng);
+        double dayHr = restingHr * (1 + 0.15 * strain) + 2 * noise(rng);
+        int64_t start = (int64_t)(BENCH_FIRST_DAY + day) * MS_PER_DAY + (6 * 3600 + rng() % 7200) * 1000LL;
+        w.clear();
+        for (int64_t i = 0; i < readings; i++)
+        {
+          double h = dayHr + 8 * sin(i / 120.0) + noise(rng);
+          w.putI64(tMs, start + i * 1000);
+          w.putF32(hr, (float)h);
+          w.putF32(sbp, (float)(112 + 0.3 * h + noise(rng)));
+          w.putF32(dbp, (float)(70 + 0.1 * h + noise(rng)));
+          w.putF32(oxygen, (float)(97.5 + 0.5 * noise(rng)));
+        }
+        for (int64_t t = windowMs; t <= readings * 1000; t += windowMs)
+        {
+          double r = std::max(5.0, dayRmssd + 6 * noise(rng));
+          w.putI64(hrvT, start + t);
+          w.putF32(rmssd, (float)r);
+          w.putF32(sdnn, (float)(r * 1.2 + 3 * noise(rng)));
+        }
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%08x-%lld.psf", opts.archive.c_str(), device, (long long)start);
+        std::string error;
+        if (!w.write(path, device, start, error))
+        {
+          fprintf(stderr, "%s\n", error.c_str());
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // The same query without the index: every file, every row
+  void scanAll(const std::vector<std::string> &files, const SessionQuery &q, uint64_t &rows, size_t &sessions)
+  {
+    for (const std::string &path : files)
+    {
+      SessionFile file;
+      std::string error;
+      if (!file.open(path.c_str(), error) || (!q.anySource && file.source() != q.source))
+        continue;
+      const SessionFile::Column *c = file.find(metricColumn(q.metric));
+      const SessionFile::Column *t = file.find(metricTimeColumn(q.metric));
+      const float *v = c ? SessionFile::f32(*c) : nullptr;
+      const int64_t *times = t ? SessionFile::i64(*t) : nullptr;
+      if (!v || !times)
+        continue;
+      uint64_t matched = 0;
+      for (uint64_t i = 0; i < c->rows; i++)
+        matched += times[i] >= q.fromMs && times[i] < q.toMs && v[i] > q.above && v[i] < q.below;
+      rows += matched;
+      sessions += matched > 0;
+    }
+  }
+
+  int runBench(Options opts)
+  {
+    mkdir(opts.archive.c_str(), 0755);
+    std::vector<std::string> files;
+    listSessionFiles(opts.archive, files);
+    if (files.empty())
+    {
+      double start = monotonicS();
+      if (!synthesise(opts))
+        return 1;
+      listSessionFiles(opts.archive, files);
+      printf("wrote %zu sessions (%d athletes, %d years) in %.1f s\n", files.size(), opts.athletes, opts.years,
+             monotonicS() - start);
+    }
+    uint64_t bytes = 0;
+    for (const std::string &f : files)
+    {
+      struct stat st;
+      if (stat(f.c_str(), &st) == 0)
+        bytes += st.st_size;
+    }
+
+    SessionIndex index;
+    if (!openIndex(opts.archive, index, false))
+      return 1;
+    struct stat st;
+    stat((opts.archive + "/index.psi").c_str(), &st);
+    printf("archive %.1f MB, index %.1f MB\n", bytes / 1e6, st.st_size / 1e6);
+
+    // Competitions as synthesise() placed them
+    std::vector<SessionQuery> queries;
+    for (int a = 0; a < opts.athletes; a++)
+    {
+      for (int day = 0; day < opts.years * 365; day++)
+      {
+        if ((day + a * 9) % COMPETITION_EVERY_DAYS != COMPETITION_EVERY_DAYS - 1 || day < LEAD_UP_DAYS + BASELINE_DAYS)
+          continue;
+        SessionQuery q;
+        q.metric = METRIC_RMSSD;
+        q.anySource = false;
+        q.source = 0x1000 + a;
+        q.toMs = (int64_t)(BENCH_FIRST_DAY + day) * MS_PER_DAY;
+        q.fromMs = q.toMs - LEAD_UP_DAYS * MS_PER_DAY;
+        queries.push_back(q);
+      }
+    }
+
+    uint64_t indexedRows = 0, blocks = 0, blocksRead = 0;
+    size_t indexedSessions = 0, opened = 0;
+    double start = monotonicS();
+    for (SessionQuery &q : queries)
+    {
+      int32_t firstDay = utcDay(q.fromMs);
+      q.below = index.rollup(q.source, q.metric, firstDay - BASELINE_DAYS, firstDay - 1).mean();
+      std::vector<SessionHit> hits;
+      QueryStats stats;
+      std::string error;
+      if (!index.query(q, hits, stats, error))
+      {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+      }
+      for (const SessionHit &h : hits)
+        indexedRows += h.rows;
+      indexedSessions += hits.size();
+      blocks += stats.blocks;
+      blocksRead += stats.blocksRead;
+      opened += stats.filesOpened;
+    }
+    double indexedS = monotonicS() - start;
+
+    uint64_t scannedRows = 0;
+    size_t scannedSessions = 0;
+    start = monotonicS();
+    for (const SessionQuery &q : queries)
+      scanAll(files, q, scannedRows, scannedSessions);
+    double scanS = monotonicS() - start;
+
+    printf("%zu queries: RMSSD below the 28-day baseline in the 7 days before each competition\n", queries.size());
+    printf("  indexed  %8.3f ms/query  %zu sessions, %llu rows; %llu of %llu blocks read, %zu files opened\n",
+           indexedS * 1e3 / queries.size(), indexedSessions, (unsigned long long)indexedRows,
+           (unsigned long long)blocksRead, (unsigned long long)blocks, opened);
+    printf("  full scan %7.3f ms/query  %zu sessions, %llu rows; %zu files opened per query\n",
+           scanS * 1e3 / queries.size(), scannedSessions, (unsigned long long)scannedRows, files.size());
+    if (indexedRows != scannedRows || indexedSessions != scannedSessions)
+    {
+      printf("MISMATCH between the indexed and the full scan\n");
+      return 1;
+    }
+    printf("  %.0fx faster, same answers\n", scanS / std::max(indexedS, 1e-9));
+    return 0;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options opts;
+  if (!parseArgs(argc, argv, opts) ||
+      (opts.command != "index" && opts.command != "query" && opts.command != "days" && opts.command != "bench"))
+  {
+    fprintf(stderr,
+            "usage: %s index DIR\n"
+            "       %s query DIR [--metric NAME] [--from DATE] [--to DATE] [--above X] [--below X] [--device HEX]\n"
+            "       %s days DIR --device HEX [--metric NAME] [--from DATE] [--to DATE]\n"
+            "       %s bench DIR [--athletes N] [--years N] [--seed N]\n"
+            "dates are YYYY-MM-DD, UTC; --to is exclusive\n",
+            argv[0], argv[0], argv[0], argv[0]);
+    return 2;
+  }
+  if (opts.command == "index")
+  {
+    SessionIndex index;
+    return openIndex(opts.archive, index, false) ? 0 : 1;
+  }
+  if (opts.command == "query")
+    return runQuery(opts);
+  if (opts.command == "days")
+    return runDays(opts);
+  return runBench(opts);
+}
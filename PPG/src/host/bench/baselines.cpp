@@ -0,0 +1,122 @@
+#include "baselines.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace
+{
+  bool endsWith(const std::string &s, const char *suffix)
+  {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+  }
+
+  double errorTolerance(const std::string &key, const GateTolerance &t)
+  {
+    if (endsWith(key, "hr_mae_bpm"))
+      return t.heartRateBpm;
+    if (endsWith(key, "rr_error_ms"))
+      return t.rrMs;
+    if (endsWith(key, "_beats_pct"))
+      return t.beatsPct;
+    if (endsWith(key, "spo2_bias_pct"))
+      return t.spo2Pct;
+    if (endsWith(key, "resp_mae_bpm"))
+      return t.respBpm;
+    if (endsWith(key, "resp_withheld_pct"))
+      return t.respWithheldPct;
+    if (endsWith(key, "spo2_low_conf_pct"))
+      return t.spo2LowConfPct;
+    if (endsWith(key, "sdnn_error_ms"))
+      return t.sdnnMs;
+    if (endsWith(key, "codec_bits_per_sample"))
+      return t.codecBits;
+    return 0;
+  }
+}
+
+bool loadBaselines(const std::string &path, Baselines &out)
+{
+  FILE *f = fopen(path.c_str(), "r");
+  if (!f)
+    return false;
+  char line[256];
+  while (fgets(line, sizeof(line), f))
+  {
+    char key[200];
+    double value;
+    if (line[0] == '#')
+      continue;
+    if (sscanf(line, "%199s %lf", key, &value) == 2)
+      out[key] = value;
+  }
+  fclose(f);
+  return true;
+}
+
+bool saveBaselines(const std::string &path, const std::vector<BenchMetric> &metrics)
+{
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f)
+    return false;
+  fprintf(f, "# Written by the bench env with --update. ns/sample values are machine\n"
+             "# specific and gated relative to all/reference_ns; error values come from\n"
+             "# the golden traces.\n");
+  for (const BenchMetric &m : metrics)
+    fprintf(f, "%s %.4f\n", m.key.c_str(), m.value);
+  return fclose(f) == 0;
+}
+
+int checkBaselines(const Baselines &baselines, const std::vector<BenchMetric> &metrics,
+                   const GateTolerance &tolerance)
+{
+  // Speed is compared relative to the reference loop of the same run; a
+  // baseline file without one can only be advisory on speed
+  double scale = NAN;
+  Baselines::const_iterator reference = baselines.find(REFERENCE_KEY);
+  for (const BenchMetric &m : metrics)
+  {
+    if (m.key == REFERENCE_KEY && reference != baselines.end() && reference->second > 0)
+      scale = m.value / reference->second;
+  }
+  if (isnan(scale))
+    printf("  advisory: no %s baseline, speed is not gated\n", REFERENCE_KEY);
+  else
+    printf("  reference loop %.2fx its baseline time; speed limits scaled by that\n", scale);
+
+  int failures = 0;
+  for (const BenchMetric &m : metrics)
+  {
+    Baselines::const_iterator it = baselines.find(m.key);
+    if (it == baselines.end())
+    {
+      printf("  new      %-36s %10.4f (no baseline)\n", m.key.c_str(), m.value);
+      continue;
+    }
+    double base = it->second;
+    bool regressed;
+    double limit;
+    if (m.kind == BenchMetric::SPEED)
+    {
+      if (m.key == REFERENCE_KEY || isnan(scale))
+        continue;
+      base *= scale;
+      limit = std::max(base * (1 + tolerance.speed), base + tolerance.speedFloorNs);
+      regressed = m.value > limit;
+    }
+    else
+    {
+      limit = fabs(base) + errorTolerance(m.key, tolerance);
+      regressed = fabs(m.value) > limit;
+    }
+    if (regressed)
+    {
+      printf("  REGRESS  %-36s %10.4f > %.4f (baseline %.4f)\n", m.key.c_str(), m.value, limit, base);
+      failures++;
+    }
+  }
+  return failures;
+}
@@ -0,0 +1,39 @@
+#ifndef PPG_BENCH_BASELINES_H
+#define PPG_BENCH_BASELINES_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "suite.h"
+
+// Stored reference values, one "<key> <value>" per line, '#' comments.
+// ns/sample figures depend on the machine, so each is gated after scaling
+// by how this run's reference loop (REFERENCE_KEY) compares to its own.
+typedef std::map<std::string, double> Baselines;
+
+bool loadBaselines(const std::string &path, Baselines &out);
+bool saveBaselines(const std::string &path, const std::vector<BenchMetric> &metrics);
+
+struct GateTolerance
+{
+  double speed = 0.50;       // scaled ns/sample may grow by 50%...
+  double speedFloorNs = 0.5; // ...and by at least this much, to ignore timer noise
+  double heartRateBpm = 0.5; // hr_mae_bpm
+  double rrMs = 3;           // rr_error_ms
+  double beatsPct = 2;       // missed/extra_beats_pct
+  double spo2Pct = 0.5;      // |spo2_bias_pct|
+  double respBpm = 0.5;      // resp_mae_bpm
+  double respWithheldPct = 5; // resp_withheld_pct
+  double spo2LowConfPct = 5; // spo2_low_conf_pct
+  double sdnnMs = 2;         // sdnn_error_ms, rr_clean_sdnn_error_ms
+  double codecBits = 0.25;   // codec_bits_per_sample; codec_mismatches must stay 0
+};
+
+// Prints one line per regression and returns how many there were. Metrics
+// without a baseline are reported but never fail, and speed is not gated
+// when the baselines have no reference loop time.
+int checkBaselines(const Baselines &baselines, const std::vector<BenchMetric> &metrics,
+                   const GateTolerance &tolerance);
+
+#endif
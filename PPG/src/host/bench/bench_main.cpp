@@ -0,0 +1,163 @@
+// Native benchmark suite for the per-sample path.
+//
+// 1. The fixed-point pipeline against the float code it replaced
+//    (float_check.cpp), with hard error bounds.
+// 2. Every stage and the full path over the golden synthetic traces and
+//    any recorded traces in --traces, reporting ns/sample and samples/s,
+//    and accuracy against each trace's ground truth (suite.cpp), and the
+//    raw waveform codec's size and losslessness on the same traces.
+// 3. A regression gate against --baselines: exits non-zero when speed or
+//    accuracy got worse by more than the tolerance (baselines.h).
+// 4. The app's session cache and write-behind journal through reopens
+//    and damaged files (storage_check.cpp), pass or fail.
+// 5. The competition trends against a batch recomputation over a
+//    synthetic season (trends_check.cpp), pass or fail.
+// 6. The batch stress scorer against --stress-fixture, a small model and
+//    its probabilities from src/mlmodel_fixture.py, and its session export
+//    on missing readings (scorer_check.cpp).
+// 7. The SpO2 estimator at the edges of the R range and its floor
+//    (spo2_check.cpp), pass or fail.
+// 8. The app's live chart series, its window statistics and decimation
+//    down to one point (series_check.cpp), pass or fail.
+//
+// Run from PPG/: pio run -e bench && .pio/build/bench/program
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "baselines.h"
+#include "float_check.h"
+#include "scorer_check.h"
+#include "series_check.h"
+#include "spo2_check.h"
+#include "storage_check.h"
+#include "trends_check.h"
+#include "suite.h"
+#include "trace_set.h"
+
+namespace
+{
+  struct Options
+  {
+    int seconds = 300;
+    int reps = 30;
+    std::string traces = "bench/traces";
+    std::string baselines = "bench/baselines.txt";
+    std::string stressFixture = "bench/stress_fixture";
+    bool update = false;
+    bool speedGate = true;
+    GateTolerance tolerance;
+  };
+
+  void usage(const char *argv0)
+  {
+    fprintf(stderr,
+            "usage: %s [--seconds N] [--reps N] [--traces DIR] [--baselines FILE]\n"
+            "          [--stress-fixture PATH] [--update] [--no-speed-gate] [--speed-tolerance FRACTION]\n",
+            argv0);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  for (int i = 1; i < argc; i++)
+  {
+    const char *a = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(a, "--seconds") && hasValue)
+      opt.seconds = atoi(argv[++i]);
+    else if (!strcmp(a, "--reps") && hasValue)
+      opt.reps = atoi(argv[++i]);
+    else if (!strcmp(a, "--traces") && hasValue)
+      opt.traces = argv[++i];
+    else if (!strcmp(a, "--baselines") && hasValue)
+      opt.baselines = argv[++i];
+    else if (!strcmp(a, "--stress-fixture") && hasValue)
+      opt.stressFixture = argv[++i];
+    else if (!strcmp(a, "--speed-tolerance") && hasValue)
+      opt.tolerance.speed = atof(argv[++i]);
+    else if (!strcmp(a, "--update"))
+      opt.update = true;
+    else if (!strcmp(a, "--no-speed-gate"))
+      opt.speedGate = false;
+    else
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  printf("== fixed point vs float reference\n");
+  bool ok = runFloatCheck(opt.seconds, opt.reps);
+
+  printf("\n== app storage (session cache, write-behind journal)\n");
+  ok = runStorageCheck() && ok;
+
+  printf("\n== competition trends against a batch recomputation\n");
+  ok = runTrendsCheck() && ok;
+
+  printf("\n== batch stress scorer against %s\n", opt.stressFixture.c_str());
+  ok = runScorerCheck(opt.stressFixture) && ok;
+
+  printf("\n== SpO2 estimator at the edges of its range\n");
+  ok = runSpo2Check() && ok;
+
+  printf("\n== live chart series\n");
+  ok = runSeriesCheck() && ok;
+
+  std::vector<BenchCase> cases = syntheticCases(opt.seconds);
+  std::vector<BenchCase> recorded = loadTraceDir(opt.traces);
+  cases.insert(cases.end(), recorded.begin(), recorded.end());
+  size_t samples = 0;
+  for (const BenchCase &c : cases)
+    samples += c.samples();
+  printf("\n== stages over %zu traces (%zu synthetic, %zu recorded), %zu samples\n", cases.size(),
+         cases.size() - recorded.size(), recorded.size(), samples);
+
+  std::vector<BenchMetric> metrics;
+  timeStages(cases, opt.reps, metrics);
+  for (const BenchMetric &m : metrics)
+    printf("  %-22s %9.2f ns/sample %14.0f samples/s\n", m.key.c_str(), m.value, 1e9 / m.value);
+
+  printf("\n== accuracy against ground truth\n");
+  size_t firstError = metrics.size();
+  scoreAccuracy(cases, metrics);
+  for (size_t i = firstError; i < metrics.size(); i++)
+    printf("  %-36s %9.3f\n", metrics[i].key.c_str(), metrics[i].value);
+
+  printf("\n== raw waveform codec (bits per sample and channel; 32 stored as uint32_t)\n");
+  size_t firstCodec = metrics.size();
+  scoreCodec(cases, metrics);
+  for (size_t i = firstCodec; i < metrics.size(); i++)
+    printf("  %-36s %9.3f\n", metrics[i].key.c_str(), metrics[i].value);
+
+  if (opt.update)
+  {
+    if (!saveBaselines(opt.baselines, metrics))
+    {
+      fprintf(stderr, "cannot write %s\n", opt.baselines.c_str());
+      return 2;
+    }
+    printf("\nbaselines written to %s\n", opt.baselines.c_str());
+    return ok ? 0 : 1;
+  }
+
+  Baselines baselines;
+  if (!loadBaselines(opt.baselines, baselines))
+  {
+    printf("\nno baselines at %s; run with --update to create them\n", opt.baselines.c_str());
+    return ok ? 0 : 1;
+  }
+  if (!opt.speedGate)
+    opt.tolerance.speed = INFINITY;
+  printf("\n== regression gate (%s)\n", opt.baselines.c_str());
+  int regressions = checkBaselines(baselines, metrics, opt.tolerance);
+  printf("  %d regression%s\n", regressions, regressions == 1 ? "" : "s");
+  return ok && regressions == 0 ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+#include "float_check.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../../bench/bench_trace.h"
+#include "../../bench/reference_pipeline.h"
+#include "ppg_pipeline.h"
+
+namespace
+{
+  struct Bounds
+  {
+    double filteredCounts = 1;
+    double heartRateBpm = 0.05;
+    double pressureMmHg = 0.1;
+    double hrvMs = 0.05;
+  };
+
+  struct Errors
+  {
+    double filtered = 0;
+    double heartRate = 0;
+    double pressure = 0;
+    double hrv = 0;
+    int peakMismatches = 0;
+  };
+
+  struct Trace
+  {
+    std::vector<int32_t> ir, red;
+    std::vector<uint32_t> timeMs;
+    BenchTrace view;
+
+    Trace(int samples, float heartRate, uint32_t seed)
+        : ir(samples), red(samples), timeMs(samples)
+    {
+      view.ir = ir.data();
+      view.red = red.data();
+      view.timeMs = timeMs.data();
+      view.samples = samples;
+      view.beatMs = nullptr;
+      view.maxBeats = 0;
+      view.beats = 0;
+      view.flags = nullptr;
+      fillBenchTrace(view, heartRate, seed);
+    }
+  };
+
+  double nowNs()
+  {
+    using namespace std::chrono;
+    return (double)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  void track(double &worst, double diff)
+  {
+    diff = fabs(diff);
+    if (diff > worst)
+      worst = diff;
+  }
+
+  // The filter is compared end to end. Peak detection picks local maxima,
+  // so a one-count filter difference can legitimately move a peak; the
+  // later stages are therefore fed the fixed-point filter output on both
+  // sides and must then find identical peaks.
+  Errors compare(const Trace &t)
+  {
+    static PpgPipeline fixed;
+    static ReferencePipeline filterRef, ref;
+    fixed.reset();
+    filterRef.reset();
+    ref.reset();
+    Errors e;
+    for (int i = 0; i < t.view.samples; i++)
+    {
+      fixed.addSample(t.ir[i], t.red[i], t.timeMs[i]);
+      filterRef.addSample(t.ir[i], t.red[i], t.timeMs[i]);
+      track(e.filtered, fixed.irFiltered() - filterRef.irFiltered);
+      track(e.filtered, fixed.redFiltered() - filterRef.redFiltered);
+      ref.addFiltered(fixed.irFiltered(), fixed.redFiltered(), t.timeMs[i]);
+      track(e.heartRate, fixed.heartRate().toFloat() - ref.filteredBPM);
+      track(e.heartRate, fixed.averageHeartRate().toFloat() - ref.beatAvg);
+      track(e.pressure, fixed.systolic().toFloat() - ref.estimatedSBP);
+      track(e.pressure, fixed.diastolic().toFloat() - ref.estimatedDBP);
+    }
+    int peaks = fixed.peakCount() < ref.peakCount ? fixed.peakCount() : ref.peakCount;
+    e.peakMismatches = abs(fixed.peakCount() - ref.peakCount);
+    for (int i = 0; i < peaks; i++)
+      if (fixed.peakTimes()[i] != ref.peakTimes[i])
+        e.peakMismatches++;
+
+    HrvStats hrv;
+    float sdnn, rmssd;
+    bool haveFixed = computeHrv(fixed.peakTimes(), 0, fixed.peakCount(), hrv);
+    bool haveRef = referenceHrv(ref.peakTimes, ref.peakCount, sdnn, rmssd);
+    if (haveFixed != haveRef)
+      e.hrv = INFINITY;
+    else if (haveFixed)
+    {
+      track(e.hrv, hrv.sdnn - sdnn);
+      track(e.hrv, hrv.rmssd - rmssd);
+    }
+    return e;
+  }
+
+  // Best of several passes, so scheduling noise does not count against either side.
+  template <typename Pipeline, typename Fn>
+  double timePipeline(Pipeline &p, const Trace &t, int reps, Fn sessionEnd)
+  {
+    double best = INFINITY;
+    for (int r = 0; r < reps; r++)
+    {
+      p.reset();
+      double start = nowNs();
+      for (int i = 0; i < t.view.samples; i++)
+        p.addSample(t.ir[i], t.red[i], t.timeMs[i]);
+      sessionEnd(p);
+      double ns = (nowNs() - start) / t.view.samples;
+      if (ns < best)
+        best = ns;
+    }
+    return best;
+  }
+
+  volatile float sink;
+}
+
+bool runFloatCheck(int seconds, int reps)
+{
+  const Bounds bounds;
+  const float rates[] = {55, 75, 100};
+  static PpgPipeline fixed;
+  static ReferencePipeline ref;
+  bool ok = true;
+
+  printf("%-6s %12s %12s %8s | %9s %9s %9s %9s %5s\n", "bpm", "float ns/s", "fixed ns/s", "speedup",
+         "filt cnt", "hr bpm", "bp mmHg", "hrv ms", "peaks");
+  for (float rate : rates)
+  {
+    Trace t(seconds * 100, rate, 12345u + (uint32_t)rate);
+    double floatNs = timePipeline(ref, t, reps, [](ReferencePipeline &p)
+                                  {
+                                    float sdnn, rmssd;
+                                    referenceHrv(p.peakTimes, p.peakCount, sdnn, rmssd);
+                                    sink = sdnn + rmssd + p.estimatedSBP;
+                                  });
+    double fixedNs = timePipeline(fixed, t, reps, [](PpgPipeline &p)
+                                  {
+                                    HrvStats hrv;
+                                    computeHrv(p.peakTimes(), 0, p.peakCount(), hrv);
+                                    sink = hrv.sdnn + hrv.rmssd + p.systolic().toFloat();
+                                  });
+    Errors e = compare(t);
+    bool pass = e.filtered <= bounds.filteredCounts && e.heartRate <= bounds.heartRateBpm &&
+                e.pressure <= bounds.pressureMmHg && e.hrv <= bounds.hrvMs && e.peakMismatches == 0;
+    ok = ok && pass;
+    printf("%-6.0f %12.2f %12.2f %7.2fx | %9.0f %9.4f %9.4f %9.4f %5d %s\n", rate, floatNs, fixedNs,
+           floatNs / fixedNs, e.filtered, e.heartRate, e.pressure, e.hrv, e.peakMismatches,
+           pass ? "" : "FAIL");
+  }
+  printf("bounds: filtered <= %.0f counts, heart rate <= %.2f bpm, pressure <= %.2f mmHg, "
+         "hrv <= %.2f ms, identical peaks\n",
+         bounds.filteredCounts, bounds.heartRateBpm, bounds.pressureMmHg, bounds.hrvMs);
+  return ok;
+}
@@ -0,0 +1,10 @@
+#ifndef PPG_BENCH_FLOAT_CHECK_H
+#define PPG_BENCH_FLOAT_CHECK_H
+
+// The fixed-point PpgPipeline against the float code it replaced
+// (src/bench/reference_pipeline.h): prints ns/sample for both and the
+// largest output differences. Returns false if a difference exceeds its
+// bound.
+bool runFloatCheck(int seconds, int reps);
+
+#endif
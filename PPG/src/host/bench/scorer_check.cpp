@@ -0,0 +1,267 @@
+#include "scorer_check.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "session_file.h"
+#include "stress_model.h"
+#include "window_export.h"
+
+namespace
+{
+  const double TOLERANCE = 1e-4;
+  const char *const INPUTS[StressModel::INPUT_COUNT] = {"hrv", "heart_rate", "sbp", "dbp", "oxygen", "resp_rate"};
+
+  int failures = 0;
+
+  void check(bool pass, const char *what)
+  {
+    printf("  %-4s %s\n", pass ? "ok" : "FAIL", what);
+    if (!pass)
+      failures++;
+  }
+
+  void split(const char *line, std::vector<std::string> &fields)
+  {
+    fields.clear();
+    std::string field;
+    for (const char *p = line; *p && *p != '\n' && *p != '\r'; p++)
+    {
+      if (*p == ',')
+      {
+        fields.push_back(field);
+        field.clear();
+      }
+      else
+        field += *p;
+    }
+    fields.push_back(field);
+  }
+
+  // Columns of the fixture's CSV by its header
+  bool readCsv(const std::string &path, std::vector<std::string> &names, std::vector<std::vector<float>> &columns)
+  {
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f)
+      return false;
+    char line[1024];
+    std::vector<std::string> fields;
+    bool ok = fgets(line, sizeof(line), f) != nullptr;
+    if (ok)
+    {
+      split(line, names);
+      columns.assign(names.size(), std::vector<float>());
+    }
+    while (ok && fgets(line, sizeof(line), f))
+    {
+      split(line, fields);
+      ok = fields.size() == names.size();
+      for (size_t k = 0; k < fields.size() && ok; k++)
+        columns[k].push_back(strtof(fields[k].c_str(), nullptr));
+    }
+    fclose(f);
+    return ok && !columns.empty() && !columns[0].empty();
+  }
+
+  int find(const std::vector<std::string> &names, const std::string &name)
+  {
+    for (size_t k = 0; k < names.size(); k++)
+    {
+      if (names[k] == name)
+        return (int)k;
+    }
+    return -1;
+  }
+
+  void compare(const char *name, const std::vector<float> &expected, const float *scored)
+  {
+    double error = 0;
+    size_t flips = 0, nans = 0;
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+      if (isnan(expected[i]) || isnan(scored[i]))
+      {
+        nans += isnan(expected[i]) != isnan(scored[i]);
+        continue;
+      }
+      error = fmax(error, fabs(scored[i] - expected[i]));
+      flips += (scored[i] > 0.5f) != (expected[i] > 0.5f);
+    }
+    bool pass = error <= TOLERANCE && flips == 0 && nans == 0;
+    printf("  %-4s scorer: %-12s max error %.2g, %zu label flips, %zu NAN mismatches\n", pass ? "ok" : "FAIL", name,
+           error, flips, nans);
+    if (!pass)
+      failures++;
+  }
+
+  // A copy of the model cut short, which load() must refuse
+  bool refusesTruncated(const std::string &source)
+  {
+    FILE *in = fopen(source.c_str(), "rb");
+    if (!in)
+      return false;
+    std::vector<char> bytes(1 << 16);
+    size_t size = fread(bytes.data(), 1, bytes.size(), in);
+    fclose(in);
+    char path[] = "/tmp/ppg_scorer_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+      return false;
+    FILE *out = fdopen(fd, "wb");
+    fwrite(bytes.data(), 1, size / 2, out);
+    fclose(out);
+    StressModel model;
+    std::string error;
+    bool refused = !model.load(path, error);
+    remove(path);
+    return refused;
+  }
+
+  // A session as the gateway writes it, with the zeros it writes for
+  // readings the device did not have: the exporter must turn them into
+  // NAN, and the scorer must score those windows NAN
+  void checkSessionExport(const StressModel &model)
+  {
+    static const char *const COLUMNS[] = {"sdnn", "heart_rate", "sbp", "dbp", "oxygen", "resp_rate"};
+    static const float READINGS[3][StressModel::INPUT_COUNT] = {
+        {0, 70, 120, 80, 97, 15}, // all measured; HRV comes from the windows
+        {0, 72, 118, 79, 96, 0},  // no respiration estimate yet
+        {0, 75, 121, 81, 0, 16},  // SpO2 not valid
+    };
+    static const float SDNN[] = {50, 48, 52, 0, 47};
+    SessionFileWriter writer;
+    int t = writer.addColumn("t_ms", PSF_I64);
+    int hrvT = writer.addColumn("hrv_t_ms", PSF_I64);
+    int columns[StressModel::INPUT_COUNT];
+    for (int k = 0; k < StressModel::INPUT_COUNT; k++)
+      columns[k] = writer.addColumn(COLUMNS[k], PSF_F32);
+    for (int r = 0; r < 3; r++)
+    {
+      writer.putI64(t, 1000 * (r + 1));
+      for (int k = 1; k < StressModel::INPUT_COUNT; k++)
+        writer.putF32(columns[k], READINGS[r][k]);
+    }
+    // The first window comes before any reading and is left out; the
+    // fourth has no SDNN
+    for (int w = 0; w < 5; w++)
+    {
+      writer.putI64(hrvT, 500 + 1000 * w);
+      writer.putF32(columns[StressModel::HRV], SDNN[w]);
+    }
+
+    char path[] = "/tmp/ppg_session_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+      check(false, "scorer: a scratch session file");
+      return;
+    }
+    close(fd);
+    std::string error;
+    SessionFile file;
+    WindowColumns windows;
+    bool exported = writer.write(path, 1, 0, error) && file.open(path, error) &&
+                    addSessionWindows(file, windows, error);
+    file.close();
+    remove(path);
+    if (!exported || windows.rows() != 4)
+    {
+      check(false, "scorer: session export gives one window per HRV window after the first reading");
+      return;
+    }
+
+    bool nans = true;
+    for (int k = 0; k < StressModel::INPUT_COUNT; k++)
+    {
+      for (size_t w = 0; w < windows.rows(); w++)
+      {
+        bool missing = (k == StressModel::RESP_RATE && w == 1) || (k == StressModel::SPO2 && w >= 2) ||
+                       (k == StressModel::HRV && w == 2);
+        nans = nans && isnan(windows.inputs[k][w]) == missing;
+      }
+    }
+    check(nans, "scorer: session export turns readings of 0 into NAN");
+
+    StressModel::Columns input;
+    input.rows = windows.rows();
+    for (int k = 0; k < StressModel::INPUT_COUNT; k++)
+      input.inputs[k] = windows.inputs[k].data();
+    std::vector<float> scores(input.rows);
+    StressModel::Scratch scratch;
+    model.score(input, 0, input.rows, scores.data(), nullptr, scratch);
+    check(!isnan(scores[0]) && isnan(scores[1]) && isnan(scores[2]) && isnan(scores[3]),
+          "scorer: windows with a missing reading score NAN");
+  }
+}
+
+bool runScorerCheck(const std::string &fixture)
+{
+  failures = 0;
+  StressModel model;
+  std::string error;
+  std::vector<std::string> names;
+  std::vector<std::vector<float>> columns;
+  if (!model.load((fixture + ".psm").c_str(), error) || !readCsv(fixture + ".csv", names, columns))
+  {
+    printf("  FAIL cannot read %s.psm/.csv %s\n", fixture.c_str(), error.c_str());
+    return false;
+  }
+
+  StressModel::Columns input;
+  input.rows = columns[0].size();
+  for (int k = 0; k < StressModel::INPUT_COUNT; k++)
+  {
+    int column = find(names, INPUTS[k]);
+    if (column < 0)
+    {
+      printf("  FAIL %s.csv has no %s column\n", fixture.c_str(), INPUTS[k]);
+      return false;
+    }
+    input.inputs[k] = columns[column].data();
+  }
+
+  size_t rows = input.rows;
+  std::vector<float> scores(rows);
+  std::vector<std::vector<float>> members(model.memberCount(), std::vector<float>(rows));
+  std::vector<float *> memberOut;
+  for (std::vector<float> &m : members)
+    memberOut.push_back(m.data());
+  StressModel::Scratch scratch;
+  model.score(input, 0, rows, scores.data(), memberOut.data(), scratch);
+
+  int stress = find(names, "stress");
+  if (stress >= 0)
+    compare("ensemble", columns[stress], scores.data());
+  else
+    check(false, "scorer: the fixture has a stress column");
+  for (size_t m = 0; m < model.memberCount(); m++)
+  {
+    std::string name = "stress_" + model.memberName(m);
+    int column = find(names, name);
+    if (column >= 0)
+      compare(model.memberName(m).c_str(), columns[column], members[m].data());
+    else
+      check(false, ("scorer: the fixture has a " + name + " column").c_str());
+  }
+
+  // Ranges that start and end mid-block, as a caller other than the
+  // scorer's threads could give
+  std::vector<float> pieces(rows);
+  size_t cuts[] = {0, 3, 131, 260, rows};
+  for (size_t c = 0; c + 1 < sizeof(cuts) / sizeof(cuts[0]); c++)
+  {
+    size_t begin = std::min(cuts[c], rows), end = std::min(cuts[c + 1], rows);
+    model.score(input, begin, end, pieces.data(), nullptr, scratch);
+  }
+  check(memcmp(pieces.data(), scores.data(), rows * sizeof(float)) == 0,
+        "scorer: the same scores in uneven ranges");
+  check(refusesTruncated(fixture + ".psm"), "scorer: a truncated model is refused");
+  checkSessionExport(model);
+  return failures == 0;
+}
@@ -0,0 +1,16 @@
+#ifndef PPG_BENCH_SCORER_CHECK_H
+#define PPG_BENCH_SCORER_CHECK_H
+
+#include <string>
+
+// The batch stress scorer (src/host/scorer/stress_model.h) against the
+// fixture written by src/mlmodel_fixture.py: fixture.psm, a small model
+// with every member kind, and fixture.csv, windows with the probabilities
+// of the ensemble and each member computed in double precision. Also
+// scores the windows in uneven ranges, loads a truncated copy of the
+// model, and exports a small session file with missing readings
+// (window_export.h). Returns false on a difference above 1e-4, a label
+// flip or a mismatched NAN.
+bool runScorerCheck(const std::string &fixture);
+
+#endif
@@ -0,0 +1,78 @@
+#include "series_check.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "ppg_analytics.h"
+
+namespace
+{
+  const uint32_t CAPACITY = 64;
+
+  int failures = 0;
+
+  void check(bool pass, const char *what)
+  {
+    printf("  %-4s %s\n", pass ? "ok" : "FAIL", what);
+    if (!pass)
+      failures++;
+  }
+
+  // Points in x order, none outside the window, the window's extremes
+  // among them
+  bool decimatedWindow(const float *points, uint32_t n, uint32_t firstX, uint32_t lastX, float lo, float hi)
+  {
+    bool sawLo = false, sawHi = false;
+    for (uint32_t i = 0; i < n; i++)
+    {
+      float x = points[2 * i], y = points[2 * i + 1];
+      if (x < firstX || x > lastX || (i > 0 && x <= points[2 * i - 2]))
+        return false;
+      sawLo = sawLo || y == lo;
+      sawHi = sawHi || y == hi;
+    }
+    return sawLo && sawHi;
+  }
+}
+
+bool runSeriesCheck()
+{
+  failures = 0;
+  PpgSeries *series = ppg_series_new(CAPACITY, 0.5f);
+  if (!series)
+  {
+    printf("  FAIL cannot create a series\n");
+    return false;
+  }
+  // Three windows' worth of a slow triangle wave, so the window has
+  // wrapped and its min and max came and went
+  const uint32_t pushed = 3 * CAPACITY;
+  for (uint32_t x = 0; x < pushed; x++)
+    ppg_series_push(series, x, (float)(x % 40 < 20 ? x % 40 : 40 - x % 40));
+  ppg_series_push(series, pushed, NAN);
+  float sum = 0, lo = INFINITY, hi = -INFINITY;
+  for (uint32_t x = pushed - CAPACITY; x < pushed; x++)
+  {
+    float v = (float)(x % 40 < 20 ? x % 40 : 40 - x % 40);
+    sum += v;
+    lo = fminf(lo, v);
+    hi = fmaxf(hi, v);
+  }
+  check(ppg_series_size(series) == CAPACITY && fabsf(ppg_series_stat(series, PPG_STAT_MEAN) - sum / CAPACITY) < 1e-4f &&
+            ppg_series_stat(series, PPG_STAT_MIN) == lo && ppg_series_stat(series, PPG_STAT_MAX) == hi,
+        "series: window statistics after wrapping, NAN dropped");
+
+  const float *points = ppg_series_points(series);
+  uint32_t n = ppg_series_decimate(series, 16);
+  check(n <= 16 && decimatedWindow(points, n, pushed - CAPACITY, pushed - 1, lo, hi),
+        "series: decimated in order, keeping the window's min and max");
+  n = ppg_series_decimate(series, 2);
+  check(n == 2 && decimatedWindow(points, n, pushed - CAPACITY, pushed - 1, lo, hi),
+        "series: two points are the window's min and max");
+  n = ppg_series_decimate(series, 1);
+  float last = ppg_series_stat(series, PPG_STAT_LAST);
+  check(n == 1 && points[0] == (float)(pushed - 1) && points[1] == last, "series: one point is the newest");
+  check(ppg_series_decimate(series, 0) == 0, "series: no room gives no points");
+  ppg_series_free(series);
+  return failures == 0;
+}
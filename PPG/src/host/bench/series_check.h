@@ -0,0 +1,10 @@
+#ifndef PPG_BENCH_SERIES_CHECK_H
+#define PPG_BENCH_SERIES_CHECK_H
+
+// The app's live chart series through its C API (ppg_analytics.h,
+// rolling_series.h): window statistics after the window has wrapped, and
+// decimation to fewer points than the window holds, down to one and
+// none. Prints one line per check and returns false if any failed.
+bool runSeriesCheck();
+
+#endif
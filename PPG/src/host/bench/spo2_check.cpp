@@ -0,0 +1,63 @@
+#include "spo2_check.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "spo2_estimator.h"
+
+namespace
+{
+  const int WINDOW = 100;
+  const float IR_DC = 110000, RED_DC = 88000;
+  const float IR_MODULATION = 0.01f; // AC amplitude over DC
+
+  int failures = 0;
+
+  void check(bool pass, const char *what)
+  {
+    printf("  %-4s %s\n", pass ? "ok" : "FAIL", what);
+    if (!pass)
+      failures++;
+  }
+
+  // Two beats of a sine on both channels, red modulated ratio times as
+  // deeply as IR
+  Spo2Estimate estimate(float ratio)
+  {
+    uint32_t ir[WINDOW], red[WINDOW];
+    for (int i = 0; i < WINDOW; i++)
+    {
+      float pulse = sinf(2 * (float)M_PI * i / (WINDOW / 2));
+      ir[i] = (uint32_t)(IR_DC * (1 + IR_MODULATION * pulse) + 0.5f);
+      red[i] = (uint32_t)(RED_DC * (1 + ratio * IR_MODULATION * pulse) + 0.5f);
+    }
+    Spo2Estimate e;
+    estimateSpo2(ir, red, WINDOW, e);
+    return e;
+  }
+
+  float standardCurve(float r)
+  {
+    return (SPO2_STANDARD_CURVE.a * r + SPO2_STANDARD_CURVE.b) * r + SPO2_STANDARD_CURVE.c;
+  }
+}
+
+bool runSpo2Check()
+{
+  failures = 0;
+  Spo2Estimate mid = estimate(1.0f);
+  check(mid.valid && fabsf(mid.ratio - 1.0f) < 0.01f && fabsf(mid.spo2 - standardCurve(1.0f)) < 0.5f,
+        "spo2: R of 1 maps through the standard curve");
+  Spo2Estimate high = estimate(0.25f);
+  check(high.valid && high.spo2 > 99 && high.spo2 <= 100, "spo2: a low R near the bottom of the range is valid");
+  check(!estimate(0.1f).valid, "spo2: R below 0.2 is invalid");
+
+  // The standard curve crosses SPO2_MIN_VALID at R of about 1.39
+  Spo2Estimate above = estimate(1.37f);
+  check(above.valid && above.spo2 >= SPO2_MIN_VALID, "spo2: just above the floor is valid");
+  Spo2Estimate below = estimate(1.42f);
+  check(!below.valid && below.spo2 == 0 && below.confidence == 0, "spo2: just below the floor is invalid");
+  Spo2Estimate top = estimate(1.8f);
+  check(!top.valid && top.spo2 == 0, "spo2: R of 1.8, about 3.5 % on the curve, is invalid");
+  return failures == 0;
+}
@@ -0,0 +1,10 @@
+#ifndef PPG_BENCH_SPO2_CHECK_H
+#define PPG_BENCH_SPO2_CHECK_H
+
+// The ratio-of-ratios SpO2 estimator (spo2_estimator.h) on synthetic
+// windows with a known R, at the edges of what it accepts: the ends of
+// the R range and the SPO2_MIN_VALID floor. Prints one line per check and
+// returns false if any failed.
+bool runSpo2Check();
+
+#endif
@@ -0,0 +1,221 @@
+#include "storage_check.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "session_cache.h"
+#include "write_behind.h"
+
+namespace
+{
+  int failures = 0;
+
+  void check(bool pass, const char *what)
+  {
+    printf("  %-4s %s\n", pass ? "ok" : "FAIL", what);
+    if (!pass)
+      failures++;
+  }
+
+  long fileSize(const std::string &path)
+  {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? (long)st.st_size : -1;
+  }
+
+  void flipByte(const std::string &path, long offset)
+  {
+    FILE *f = fopen(path.c_str(), "r+b");
+    if (!f)
+      return;
+    fseek(f, offset, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, offset, SEEK_SET);
+    fputc(c ^ 0x5A, f);
+    fclose(f);
+  }
+
+  SessionCache::Reading reading(float heartRate, float spo2, float sbp, float dbp)
+  {
+    SessionCache::Reading r = {heartRate, spo2, sbp, dbp};
+    return r;
+  }
+
+  void checkSessionCache(const std::string &dir)
+  {
+    const std::string index = dir + "/sessions.idx";
+    const long header = 16;
+    {
+      SessionCache cache;
+      check(cache.open(dir.c_str()) && cache.size() == 0 && fileSize(index) == header,
+            "cache: a new index is just its header");
+      // Out of order, so the index is rewritten sorted
+      cache.upsert("s0003", 3000);
+      cache.upsert("s0001", 1000);
+      int i = cache.upsert("s0002", 2000);
+      cache.addReading(i, "k1", reading(60, 97, 120, 80));
+      cache.addReading(i, "k2", reading(70, 0, 125, 82));
+      cache.addReading(i, "k3", reading(80, 98, 0, 0));
+      cache.setSession(i, 42.5f, 3.25f, true);
+      cache.setWatermark(5000);
+      check(cache.commit() && fileSize(index) == header + 3 * (long)SessionCache::SUMMARY_SIZE,
+            "cache: one 128-byte summary per session");
+      // Written to the readings file but not committed, as at a crash
+      cache.addReading(i, "k4", reading(200, 99, 200, 100));
+    }
+    {
+      SessionCache cache;
+      cache.open(dir.c_str());
+      int i = cache.find("s0002");
+      bool sorted = cache.size() == 3 && !strcmp(cache.summary(0).sessionId, "s0001") &&
+                    !strcmp(cache.summary(2).sessionId, "s0003");
+      check(sorted && cache.watermark() == 5000 && i == 1, "cache: reopens sorted with its watermark");
+      const SessionCache::Summary &s = cache.summary(i);
+      check(s.readings == 3 && !strcmp(s.lastKey, "k3") && (s.flags & SessionCache::ENDED) &&
+                fabsf(cache.stat(i, SessionCache::MEAN_HEART_RATE) - 70) < 1e-4f &&
+                fabsf(cache.stat(i, SessionCache::MEAN_SPO2) - 97.5f) < 1e-4f &&
+                cache.stat(i, SessionCache::MIN_HEART_RATE) == 60 &&
+                cache.stat(i, SessionCache::MAX_HEART_RATE) == 80 && cache.stat(i, SessionCache::HRV) == 42.5f,
+            "cache: summary stats survive the reopen");
+      std::vector<SessionCache::Reading> readings;
+      check(cache.readReadings(i, readings) && readings.size() == 3 && readings[2].heartRate == 80,
+            "cache: the uncommitted reading is not counted");
+      check(!cache.addReading(i, "k3", reading(90, 0, 0, 0)), "cache: a repeated key is skipped");
+      cache.addReading(i, "k4", reading(90, 96, 0, 0));
+      cache.commit();
+      check(cache.readReadings(i, readings) && readings.size() == 4 && readings[3].heartRate == 90,
+            "cache: the next sync overwrites it");
+    }
+    // A damaged second summary ends the index there
+    flipByte(index, header + (long)SessionCache::SUMMARY_SIZE + 30);
+    {
+      SessionCache cache;
+      cache.open(dir.c_str());
+      check(cache.size() == 1 && cache.find("s0001") == 0 && cache.watermark() == 0,
+            "cache: sessions from a bad summary on are dropped for a full sync");
+      cache.upsert("s0003", 3000);
+      cache.commit();
+    }
+    {
+      SessionCache cache;
+      cache.open(dir.c_str());
+      check(cache.size() == 2 && cache.find("s0003") == 1 &&
+                fileSize(index) == header + 2 * (long)SessionCache::SUMMARY_SIZE,
+            "cache: the next commit rewrites the index without them");
+    }
+  }
+
+  void appendReadings(WriteBehind &wb, const char *path, int count, int64_t &nowMs)
+  {
+    char json[64];
+    for (int k = 0; k < count; k++)
+    {
+      snprintf(json, sizeof(json), "{\"heartRate\":%d}", 60 + k);
+      wb.append(path, json, nowMs);
+      nowMs += 1000;
+    }
+  }
+
+  void checkWriteBehind(const std::string &dir)
+  {
+    const std::string journal = dir + "/readings.wb";
+    const char *pathA = "users/u/sessions/a/readings";
+    const char *pathB = "users/u/sessions/b/readings";
+    int64_t nowMs = 1000;
+    std::string sent;
+    {
+      WriteBehind wb;
+      wb.open(journal.c_str(), 7, 1000, 4096);
+      appendReadings(wb, pathA, 5, nowMs);
+      wb.takeBatch(nowMs);
+      wb.ack(true, nowMs);
+      check(wb.pending() == 0 && fileSize(journal) == 8, "journal: drained to its header");
+      appendReadings(wb, pathA, 4, nowMs);
+      sent = wb.takeBatch(nowMs);
+      wb.ack(false, nowMs);
+    }
+    // Tear the last entry, as a kill mid-write would
+    if (truncate(journal.c_str(), fileSize(journal) - 5) != 0)
+      check(false, "journal: truncate");
+    {
+      WriteBehind wb;
+      wb.open(journal.c_str(), 99, 1000, 4096);
+      check(wb.pending() == 3, "journal: a torn tail entry ends the replay");
+      const std::string &again = wb.takeBatch(nowMs);
+      // Same writer id and keys, so the resend overwrites the same children
+      bool sameKeys = again.size() > 2 && sent.compare(0, again.size() - 1, again, 0, again.size() - 1) == 0 &&
+                      sent[again.size() - 1] == ',';
+      check(sameKeys, "journal: replayed readings keep their keys");
+      wb.ack(true, nowMs);
+      appendReadings(wb, pathA, 3, nowMs);
+      appendReadings(wb, pathB, 2, nowMs);
+      wb.takeBatch(nowMs);
+      wb.ack(true, nowMs);
+      check(wb.pending() == 2, "journal: only the batch's path is acknowledged");
+    }
+    {
+      WriteBehind wb;
+      wb.open(journal.c_str(), 7, 1000, 4096);
+      wb.takeBatch(nowMs);
+      check(wb.pending() == 2 && wb.batchPath() == pathB, "journal: acknowledgements replay");
+      wb.ack(false, nowMs);
+    }
+    // A bad CRC in the first entry's body: nothing after it is trusted
+    flipByte(journal, 8 + 3 + 14);
+    {
+      WriteBehind wb;
+      wb.open(journal.c_str(), 7, 1000, 4096);
+      check(wb.pending() == 0 && fileSize(journal) == 8, "journal: a corrupt entry ends the replay");
+    }
+    // A node that keeps refusing writes, as the previous user's does after
+    // a sign-out, backs off alone
+    {
+      WriteBehind wb;
+      wb.open(journal.c_str(), 7, 1000, 4096);
+      appendReadings(wb, pathA, 2, nowMs);
+      appendReadings(wb, pathB, 2, nowMs);
+      wb.takeBatch(nowMs);
+      wb.ack(false, nowMs);
+      wb.flushSoon();
+      bool next = wb.due(nowMs) && !wb.takeBatch(nowMs).empty() && wb.batchPath() == pathB;
+      wb.ack(true, nowMs);
+      check(next && wb.pending() == 2 && !wb.due(nowMs),
+            "journal: a failing path does not hold up the others");
+      nowMs += WriteBehind::RETRY_MAX_MS;
+      check(wb.due(nowMs) && !wb.takeBatch(nowMs).empty() && wb.batchPath() == pathA,
+            "journal: the failing path is retried after its backoff");
+      wb.ack(true, nowMs);
+    }
+  }
+
+  void removeTree(const std::string &dir)
+  {
+    const char *names[] = {"sessions.idx", "s0001.rd", "s0002.rd", "s0003.rd", "readings.wb"};
+    for (const char *name : names)
+      remove((dir + "/" + name).c_str());
+    rmdir(dir.c_str());
+  }
+}
+
+bool runStorageCheck()
+{
+  char pattern[] = "/tmp/ppg_storage_XXXXXX";
+  if (!mkdtemp(pattern))
+  {
+    printf("  FAIL cannot create a scratch directory\n");
+    return false;
+  }
+  std::string dir = pattern;
+  failures = 0;
+  checkSessionCache(dir);
+  checkWriteBehind(dir);
+  removeTree(dir);
+  return failures == 0;
+}
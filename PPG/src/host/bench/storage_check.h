@@ -0,0 +1,10 @@
+#ifndef PPG_BENCH_STORAGE_CHECK_H
+#define PPG_BENCH_STORAGE_CHECK_H
+
+// The app's on-disk stores in a scratch directory: the session cache
+// (session_cache.h) across commits, reopens and a damaged index, and the
+// write-behind journal (write_behind.h) replayed after a torn or corrupt
+// entry, and its per-path backoff. Prints one line per check and returns false if any failed.
+bool runStorageCheck();
+
+#endif
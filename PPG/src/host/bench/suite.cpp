@@ -0,0 +1,508 @@
+#include "suite.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+#include "../../bench/reference_pipeline.h"
+#include "ppg_pipeline.h"
+#include "respiration_estimator.h"
+#include "rr_cleaner.h"
+#include "spo2_estimator.h"
+#include "telemetry.h"
+#include "waveform_codec.h"
+
+namespace
+{
+  const int SPO2_WINDOW = 100;         // samples, as the firmware buffers them
+  const int HRV_WINDOW = 3000;         // samples between HRV windows (30 s)
+  const uint32_t WARMUP_MS = 15000;    // filter and BPM smoothing settle
+  const uint32_t MATCH_WINDOW_MS = 150; // detected peak to reference beat
+  const uint32_t TRUTH_SPAN_MS = 5000;  // reference HR averages this long
+  // Beat errors injected into the reference beats for the RR cleaner
+  const int INJECT_MISSED_EVERY = 37;
+  const int INJECT_EXTRA_EVERY = 53;
+  const int INJECT_ECTOPIC_EVERY = 71;
+  const int CODEC_BLOCK = RAW_Z_SAMPLES_PER_FRAME;
+
+  volatile float sink;
+
+  double nowNs()
+  {
+    using namespace std::chrono;
+    return (double)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
+  struct TimedStage
+  {
+    const char *key;
+    std::function<void(const BenchCase &)> run;
+    double best;
+  };
+
+  // Passes of different stages are interleaved, so a slow stretch of the
+  // host (frequency scaling, a noisy neighbour) costs every stage one pass
+  // rather than all passes of one stage.
+  void timeInterleaved(const std::vector<BenchCase> &cases, int reps, std::vector<TimedStage> &stages)
+  {
+    size_t samples = 0;
+    for (const BenchCase &c : cases)
+      samples += c.samples();
+    for (TimedStage &stage : stages)
+      stage.best = INFINITY;
+    for (int r = 0; r < reps; r++)
+    {
+      for (TimedStage &stage : stages)
+      {
+        double start = nowNs();
+        for (const BenchCase &c : cases)
+          stage.run(c);
+        double ns = (nowNs() - start) / samples;
+        if (ns < stage.best)
+          stage.best = ns;
+      }
+    }
+  }
+
+  // Everything loop() does per sample that is not I/O.
+  struct FullPath
+  {
+    PpgPipeline pipeline;
+    RespirationEstimator respiration;
+    RrCleaner cleaner;
+    RrInterval rr[PpgPipeline::MAX_PEAKS];
+    int rrCount = 0;
+    uint32_t irBuf[SPO2_WINDOW], redBuf[SPO2_WINDOW];
+    int buffered = 0;
+    int sinceHrv = 0;
+    int hrvFrom = 0;
+    Spo2Estimate spo2 = {};
+    bool spo2Updated = false;
+
+    void reset()
+    {
+      pipeline.reset();
+      respiration.reset();
+      cleaner.reset();
+      rrCount = buffered = sinceHrv = hrvFrom = 0;
+      spo2 = {};
+    }
+
+    uint8_t add(int32_t ir, int32_t red, uint32_t t)
+    {
+      uint8_t events = pipeline.addSample(ir, red, t);
+      if (events & PpgPipeline::PEAK)
+      {
+        respiration.addBeat(t, pipeline.beatPeak(), pipeline.beatTrough());
+        cleaner.addBeat(t);
+        drain();
+      }
+      irBuf[buffered] = pipeline.irFiltered();
+      redBuf[buffered] = pipeline.redFiltered();
+      spo2Updated = false;
+      if (++buffered == SPO2_WINDOW)
+      {
+        estimateSpo2(irBuf, redBuf, SPO2_WINDOW, spo2);
+        spo2Updated = true;
+        buffered = 0;
+      }
+      if (++sinceHrv == HRV_WINDOW)
+      {
+        HrvStats hrv;
+        computeHrv(rr, hrvFrom, rrCount, hrv);
+        sink = hrv.sdnn;
+        hrvFrom = rrCount;
+        sinceHrv = 0;
+      }
+      return events;
+    }
+
+    void drain()
+    {
+      RrInterval next;
+      while (cleaner.next(next))
+        if (rrCount < PpgPipeline::MAX_PEAKS)
+          rr[rrCount++] = next;
+    }
+
+    void finish()
+    {
+      cleaner.flush();
+      drain();
+    }
+  };
+
+  FullPath fullPath;
+
+  // Both channels of a case in codec blocks; returns the encoded bytes
+  size_t encodeChannels(const std::vector<uint32_t> &ir, const std::vector<uint32_t> &red,
+                        std::vector<uint8_t> &out)
+  {
+    out.resize((ir.size() / CODEC_BLOCK + 1) * 2 * waveBlockMaxSize(CODEC_BLOCK));
+    size_t n = 0;
+    for (size_t i = 0; i + CODEC_BLOCK <= ir.size(); i += CODEC_BLOCK)
+    {
+      n += encodeWaveBlock(ir.data() + i, CODEC_BLOCK, out.data() + n, out.size() - n);
+      n += encodeWaveBlock(red.data() + i, CODEC_BLOCK, out.data() + n, out.size() - n);
+    }
+    return n;
+  }
+
+  // Returns the samples that failed to decode to their original value
+  size_t decodeChannels(const std::vector<uint8_t> &in, size_t len, const std::vector<uint32_t> &ir,
+                        const std::vector<uint32_t> &red)
+  {
+    uint32_t block[CODEC_BLOCK];
+    size_t pos = 0, wrong = 0;
+    for (size_t i = 0; i + CODEC_BLOCK <= ir.size(); i += CODEC_BLOCK)
+    {
+      for (const std::vector<uint32_t> *channel : {&ir, &red})
+      {
+        size_t used = decodeWaveBlock(in.data() + pos, len - pos, CODEC_BLOCK, block);
+        if (used == 0)
+          return wrong + 2 * (ir.size() - i);
+        pos += used;
+        for (int k = 0; k < CODEC_BLOCK; k++)
+          wrong += block[k] != (*channel)[i + k];
+      }
+    }
+    return wrong;
+  }
+
+  // 60000 / mean reference RR over the TRUTH_SPAN_MS before t, or 0.
+  double referenceHeartRate(const std::vector<uint32_t> &beats, uint32_t t)
+  {
+    int last = -1;
+    for (int i = 0; i < (int)beats.size() && beats[i] <= t; i++)
+      last = i;
+    int first = last;
+    while (first > 0 && t - beats[first - 1] <= TRUTH_SPAN_MS)
+      first--;
+    if (last - first < 1)
+      return 0;
+    return 60000.0 * (last - first) / (beats[last] - beats[first]);
+  }
+
+  void add(std::vector<BenchMetric> &out, const std::string &key, double value, BenchMetric::Kind kind)
+  {
+    out.push_back({key, value, kind});
+  }
+
+  // Reference beats from `from` on with beats periodically dropped,
+  // doubled and moved early, as a detector on a poor signal would report
+  // them.
+  std::vector<uint32_t> injectBeatErrors(const std::vector<uint32_t> &beats, uint32_t from)
+  {
+    std::vector<uint32_t> out;
+    int n = 0;
+    for (size_t i = 0; i < beats.size(); i++)
+    {
+      if (beats[i] < from)
+        continue;
+      if (out.empty())
+      {
+        out.push_back(beats[i]);
+        continue;
+      }
+      uint32_t rr = beats[i] - beats[i - 1];
+      n++;
+      if (n % INJECT_MISSED_EVERY == 0)
+        continue;
+      if (n % INJECT_EXTRA_EVERY == 0)
+        out.push_back(beats[i - 1] + rr * 2 / 5);
+      if (n % INJECT_ECTOPIC_EVERY == 0)
+        out.push_back(beats[i] - rr * 3 / 10);
+      else
+        out.push_back(beats[i]);
+    }
+    return out;
+  }
+
+  double cleanedSdnn(const std::vector<uint32_t> &beats)
+  {
+    std::vector<RrInterval> rr(beats.size() * 2 + 1);
+    int n = cleanPeakTimes(beats.data(), (int)beats.size(), rr.data(), (int)rr.size());
+    HrvStats hrv;
+    return computeHrv(rr.data(), 0, n, hrv) ? hrv.sdnn : 0;
+  }
+}
+
+const char *const REFERENCE_KEY = "all/reference_ns";
+
+void timeStages(const std::vector<BenchCase> &cases, int reps, std::vector<BenchMetric> &out)
+{
+  static PpgPipeline pipeline;
+  std::vector<std::vector<uint32_t>> irU(cases.size()), redU(cases.size()), peaks(cases.size());
+  std::vector<std::vector<int32_t>> peakValues(cases.size()), troughValues(cases.size());
+  for (size_t i = 0; i < cases.size(); i++)
+  {
+    const BenchCase &c = cases[i];
+    irU[i].assign(c.ir.begin(), c.ir.end());
+    redU[i].assign(c.red.begin(), c.red.end());
+    // HRV is timed on the peaks the pipeline finds
+    pipeline.reset();
+    for (size_t k = 0; k < c.samples(); k++)
+      if (pipeline.addSample(c.ir[k], c.red[k], c.timeMs[k]) & PpgPipeline::PEAK)
+      {
+        peaks[i].push_back(c.timeMs[k]);
+        peakValues[i].push_back(pipeline.beatPeak());
+        troughValues[i].push_back(pipeline.beatTrough());
+      }
+  }
+  const Q15 alpha = Q15::fromFloat(0.7);
+  auto index = [&](const BenchCase &c) { return (size_t)(&c - &cases[0]); };
+
+  std::vector<TimedStage> stages;
+  stages.push_back({REFERENCE_KEY, [&](const BenchCase &c)
+                    {
+                      static ReferencePipeline reference;
+                      reference.reset();
+                      for (size_t i = 0; i < c.samples(); i++)
+                        reference.addSample(c.ir[i], c.red[i], c.timeMs[i]);
+                      sink = reference.filteredBPM;
+                    },
+                    0});
+  stages.push_back({"all/filter_ns", [&](const BenchCase &c)
+                    {
+                      int32_t ir = 0, red = 0;
+                      for (size_t i = 0; i < c.samples(); i++)
+                      {
+                        ir = emaFilter(c.ir[i], ir, alpha);
+                        red = emaFilter(c.red[i], red, alpha);
+                      }
+                      sink = ir + red;
+                    },
+                    0});
+  stages.push_back({"all/pipeline_ns", [&](const BenchCase &c)
+                    {
+                      pipeline.reset();
+                      for (size_t i = 0; i < c.samples(); i++)
+                        pipeline.addSample(c.ir[i], c.red[i], c.timeMs[i]);
+                      sink = pipeline.heartRate().toFloat();
+                    },
+                    0});
+  stages.push_back({"all/spo2_ns", [&](const BenchCase &c)
+                    {
+                      const uint32_t *ir = irU[index(c)].data(), *red = redU[index(c)].data();
+                      Spo2Estimate e = {};
+                      for (size_t i = 0; i + SPO2_WINDOW <= c.samples(); i += SPO2_WINDOW)
+                        estimateSpo2(ir + i, red + i, SPO2_WINDOW, e);
+                      sink = e.spo2;
+                    },
+                    0});
+  stages.push_back({"all/hrv_ns", [&](const BenchCase &c)
+                    {
+                      static RrCleaner cleaner;
+                      static RrInterval rr[PpgPipeline::MAX_PEAKS];
+                      const std::vector<uint32_t> &p = peaks[index(c)];
+                      HrvStats hrv = {};
+                      int from = 0, count = 0;
+                      size_t k = 0;
+                      cleaner.reset();
+                      for (size_t end = HRV_WINDOW; end <= c.samples(); end += HRV_WINDOW)
+                      {
+                        for (; k < p.size() && p[k] < c.timeMs[end - 1]; k++)
+                        {
+                          RrInterval next;
+                          cleaner.addBeat(p[k]);
+                          while (cleaner.next(next))
+                            if (count < PpgPipeline::MAX_PEAKS)
+                              rr[count++] = next;
+                        }
+                        computeHrv(rr, from, count, hrv);
+                        from = count;
+                      }
+                      sink = hrv.sdnn;
+                    },
+                    0});
+  stages.push_back({"all/resp_ns", [&](const BenchCase &c)
+                    {
+                      static RespirationEstimator respiration;
+                      size_t i = index(c);
+                      respiration.reset();
+                      for (size_t k = 0; k < peaks[i].size(); k++)
+                        respiration.addBeat(peaks[i][k], peakValues[i][k], troughValues[i][k]);
+                      sink = respiration.rate();
+                    },
+                    0});
+  std::vector<std::vector<uint8_t>> encoded(cases.size());
+  std::vector<size_t> encodedLen(cases.size());
+  stages.push_back({"all/codec_encode_ns", [&](const BenchCase &c)
+                    {
+                      size_t i = index(c);
+                      encodedLen[i] = encodeChannels(irU[i], redU[i], encoded[i]);
+                    },
+                    0});
+  stages.push_back({"all/codec_decode_ns", [&](const BenchCase &c)
+                    {
+                      size_t i = index(c);
+                      sink = decodeChannels(encoded[i], encodedLen[i], irU[i], redU[i]);
+                    },
+                    0});
+  stages.push_back({"all/full_ns", [&](const BenchCase &c)
+                    {
+                      fullPath.reset();
+                      for (size_t i = 0; i < c.samples(); i++)
+                        fullPath.add(c.ir[i], c.red[i], c.timeMs[i]);
+                      sink = fullPath.spo2.spo2;
+                    },
+                    0});
+
+  timeInterleaved(cases, reps, stages);
+  for (const TimedStage &stage : stages)
+    add(out, stage.key, stage.best, BenchMetric::SPEED);
+}
+
+void scoreAccuracy(const std::vector<BenchCase> &cases, std::vector<BenchMetric> &out)
+{
+  for (const BenchCase &c : cases)
+  {
+    fullPath.reset();
+    std::vector<uint32_t> detected;
+    double hrErr = 0, spo2Err = 0, respErr = 0;
+    int hrN = 0, spo2N = 0, respN = 0, respWithheld = 0, spo2Windows = 0, spo2LowConf = 0;
+    for (size_t i = 0; i < c.samples(); i++)
+    {
+      uint32_t t = c.timeMs[i];
+      uint8_t events = fullPath.add(c.ir[i], c.red[i], t);
+      if (events & PpgPipeline::PEAK)
+        detected.push_back(t);
+      bool settled = t - c.timeMs[0] >= WARMUP_MS;
+      if (!settled)
+        continue;
+      if (c.hasBeats() && i % 100 == 0)
+      {
+        double truth = referenceHeartRate(c.beatMs, t);
+        double hr = fullPath.pipeline.heartRate().toFloat();
+        if (truth > 0 && hr > 0)
+        {
+          hrErr += fabs(hr - truth);
+          hrN++;
+        }
+      }
+      if (c.hasRespiration() && i % 100 == 0)
+      {
+        if (fullPath.respiration.valid())
+        {
+          respErr += fabs(fullPath.respiration.rate() - c.respirationRate);
+          respN++;
+        }
+        else
+          respWithheld++;
+      }
+      if (fullPath.spo2Updated && fullPath.spo2.valid)
+      {
+        spo2Windows++;
+        if (fullPath.spo2.confidence < 0.5f)
+          spo2LowConf++;
+      }
+      if (c.hasSpo2() && fullPath.spo2Updated && fullPath.spo2.valid && !isnan(c.spo2[i]))
+      {
+        spo2Err += fullPath.spo2.spo2 - c.spo2[i];
+        spo2N++;
+      }
+    }
+    if (hrN > 0)
+      add(out, c.name + "/hr_mae_bpm", hrErr / hrN, BenchMetric::ERROR);
+    if (c.hasRespiration())
+    {
+      // A case that never produces an estimate scores a 60 breaths/min error
+      add(out, c.name + "/resp_mae_bpm", respN > 0 ? respErr / respN : 60, BenchMetric::ERROR);
+      add(out, c.name + "/resp_withheld_pct", 100.0 * respWithheld / std::max(1, respN + respWithheld),
+          BenchMetric::ERROR);
+    }
+    if (c.hasSpo2())
+      add(out, c.name + "/spo2_bias_pct", spo2N > 0 ? spo2Err / spo2N : 100, BenchMetric::ERROR);
+    add(out, c.name + "/spo2_low_conf_pct", 100.0 * spo2LowConf / std::max(1, spo2Windows), BenchMetric::ERROR);
+    if (!c.hasBeats())
+      continue;
+
+    // SDNN of the cleaned detected beats, and of the cleaned reference
+    // beats with injected errors, against the reference SDNN
+    uint32_t from = c.timeMs[0] + WARMUP_MS;
+    fullPath.finish();
+    std::vector<uint32_t> truthBeats;
+    for (uint32_t beat : c.beatMs)
+      if (beat >= from)
+        truthBeats.push_back(beat);
+    HrvStats truth, detectedHrv;
+    int firstRR = 0;
+    while (firstRR < fullPath.rrCount && fullPath.rr[firstRR].endMs < from)
+      firstRR++;
+    if (computeHrv(truthBeats.data(), 0, (int)truthBeats.size(), truth, 0, UINT32_MAX))
+    {
+      bool ok = computeHrv(fullPath.rr, firstRR, fullPath.rrCount, detectedHrv);
+      add(out, c.name + "/sdnn_error_ms", ok ? fabs(detectedHrv.sdnn - truth.sdnn) : 1000, BenchMetric::ERROR);
+      add(out, c.name + "/rr_clean_sdnn_error_ms", fabs(cleanedSdnn(injectBeatErrors(c.beatMs, from)) - truth.sdnn),
+          BenchMetric::ERROR);
+    }
+
+    // Pair each reference beat after warm-up with the nearest detected peak
+    std::vector<int> match;
+    size_t d = 0;
+    int reference = 0, matched = 0;
+    for (uint32_t beat : c.beatMs)
+    {
+      if (beat < from)
+        continue;
+      reference++;
+      while (d + 1 < detected.size() && detected[d + 1] <= beat)
+        d++;
+      int best = -1;
+      uint32_t bestDist = MATCH_WINDOW_MS + 1;
+      for (size_t k = d; k < detected.size() && k <= d + 1; k++)
+      {
+        uint32_t dist = detected[k] > beat ? detected[k] - beat : beat - detected[k];
+        if (dist < bestDist)
+        {
+          bestDist = dist;
+          best = (int)k;
+        }
+      }
+      match.push_back(best);
+      if (best >= 0)
+        matched++;
+    }
+    double rrErr = 0;
+    int rrN = 0;
+    int b = 0;
+    for (size_t i = 0; i < c.beatMs.size(); i++)
+    {
+      if (c.beatMs[i] < from)
+        continue;
+      if (b > 0 && match[b] >= 0 && match[b - 1] >= 0 && match[b] != match[b - 1])
+      {
+        double trueRR = (double)c.beatMs[i] - c.beatMs[i - 1];
+        double detRR = (double)detected[match[b]] - detected[match[b - 1]];
+        rrErr += fabs(detRR - trueRR);
+        rrN++;
+      }
+      b++;
+    }
+    int detectedAfter = 0;
+    for (uint32_t t : detected)
+      if (t + MATCH_WINDOW_MS >= from)
+        detectedAfter++;
+    add(out, c.name + "/rr_error_ms", rrN > 0 ? rrErr / rrN : 1000, BenchMetric::ERROR);
+    add(out, c.name + "/missed_beats_pct", reference > 0 ? 100.0 * (reference - matched) / reference : 0,
+        BenchMetric::ERROR);
+    add(out, c.name + "/extra_beats_pct",
+        detectedAfter > 0 ? 100.0 * std::max(0, detectedAfter - matched) / detectedAfter : 0, BenchMetric::ERROR);
+  }
+}
+
+void scoreCodec(const std::vector<BenchCase> &cases, std::vector<BenchMetric> &out)
+{
+  for (const BenchCase &c : cases)
+  {
+    std::vector<uint32_t> ir(c.ir.begin(), c.ir.end()), red(c.red.begin(), c.red.end());
+    std::vector<uint8_t> encoded;
+    size_t len = encodeChannels(ir, red, encoded);
+    size_t samples = c.samples() / CODEC_BLOCK * CODEC_BLOCK * 2;
+    add(out, c.name + "/codec_bits_per_sample", samples > 0 ? 8.0 * len / samples : 0, BenchMetric::ERROR);
+    add(out, c.name + "/codec_mismatches", (double)decodeChannels(encoded, len, ir, red), BenchMetric::ERROR);
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef PPG_BENCH_SUITE_H
+#define PPG_BENCH_SUITE_H
+
+#include <string>
+#include <vector>
+
+#include "trace_set.h"
+
+// A named measurement. Speed metrics are ns/sample and may grow by a
+// relative tolerance; error metrics may grow by an absolute one.
+struct BenchMetric
+{
+  enum Kind
+  {
+    SPEED,
+    ERROR
+  };
+  std::string key; // "<case>/<metric>"
+  double value;
+  Kind kind;
+};
+
+// Key of the reference loop timed in the same passes as the stages: the
+// float pipeline the fixed-point one replaced (src/bench/reference_pipeline.h),
+// code that no longer changes. The gate compares each stage's time relative
+// to it, so a slower or busier host does not read as a regression.
+extern const char *const REFERENCE_KEY;
+
+// Times each pipeline stage, and the whole per-sample path as loop() runs
+// it, over all cases, plus encoding and decoding the raw samples and the
+// reference loop. Best of reps passes.
+void timeStages(const std::vector<BenchCase> &cases, int reps, std::vector<BenchMetric> &out);
+
+// Runs the full path over each case once and scores it against the ground
+// truth the case has: heart rate MAE, RR interval timing error, missed and
+// extra beats, SDNN error after RR cleaning, SpO2 bias and the share of
+// SpO2 windows with low confidence.
+void scoreAccuracy(const std::vector<BenchCase> &cases, std::vector<BenchMetric> &out);
+
+// Compresses each case's raw IR and red samples in rawz frame blocks
+// (waveform_codec.h) and reports bits per sample and any sample that did
+// not decode back exactly.
+void scoreCodec(const std::vector<BenchCase> &cases, std::vector<BenchMetric> &out);
+
+#endif
@@ -0,0 +1,250 @@
+#include "trace_set.h"
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "../../bench/bench_trace.h"
+
+namespace
+{
+  BenchCase synthesize(const char *name, const PpgSynthConfig &config, int seconds)
+  {
+    BenchCase c;
+    c.name = name;
+    int samples = seconds * config.sampleRateHz;
+    int maxBeats = seconds * 4;
+    c.ir.resize(samples);
+    c.red.resize(samples);
+    c.timeMs.resize(samples);
+    c.beatMs.resize(maxBeats);
+    std::vector<uint8_t> flags(samples);
+    BenchTrace t = {c.ir.data(), c.red.data(), c.timeMs.data(), samples, c.beatMs.data(), maxBeats, 0, flags.data()};
+    fillBenchTrace(t, config);
+    c.beatMs.resize(t.beats);
+    c.respirationRate = config.respirationRate;
+    // No SpO2 reference while the optical path is disturbed
+    c.spo2.assign(samples, config.spo2);
+    for (int i = 0; i < samples; i++)
+      if (flags[i] & (PpgSynthSample::MOTION | PpgSynthSample::DROPOUT))
+        c.spo2[i] = NAN;
+    return c;
+  }
+
+  std::vector<std::string> splitCsv(const char *line)
+  {
+    std::vector<std::string> fields;
+    std::string field;
+    for (const char *p = line; *p && *p != '\n' && *p != '\r'; p++)
+    {
+      if (*p == ',')
+      {
+        fields.push_back(field);
+        field.clear();
+      }
+      else if (*p != ' ')
+        field += *p;
+    }
+    fields.push_back(field);
+    return fields;
+  }
+}
+
+std::vector<BenchCase> syntheticCases(int seconds)
+{
+  std::vector<BenchCase> cases;
+  PpgSynthConfig rest;
+  rest.heartRate = 55;
+  rest.spo2 = 98;
+  rest.respirationRate = 12;
+  rest.seed = 101;
+  cases.push_back(synthesize("synth_rest", rest, seconds));
+
+  PpgSynthConfig normal;
+  normal.heartRate = 75;
+  normal.seed = 202;
+  cases.push_back(synthesize("synth_normal", normal, seconds));
+
+  PpgSynthConfig exercise;
+  exercise.heartRate = 105;
+  exercise.spo2 = 94;
+  exercise.respirationRate = 24;
+  exercise.hfAmplitudeMs = 8;
+  exercise.seed = 303;
+  cases.push_back(synthesize("synth_exercise", exercise, seconds));
+
+  // Above the 120 bpm a fixed 500 ms refractory period allowed
+  PpgSynthConfig sprint;
+  sprint.heartRate = 150;
+  sprint.spo2 = 95;
+  sprint.respirationRate = 32;
+  sprint.hfAmplitudeMs = 5;
+  sprint.lfAmplitudeMs = 8;
+  sprint.seed = 313;
+  cases.push_back(synthesize("synth_sprint", sprint, seconds));
+
+  PpgSynthConfig maximal;
+  maximal.heartRate = 185;
+  maximal.spo2 = 93;
+  maximal.respirationRate = 40;
+  maximal.hfAmplitudeMs = 3;
+  maximal.lfAmplitudeMs = 5;
+  maximal.rrJitterMs = 4;
+  maximal.seed = 323;
+  cases.push_back(synthesize("synth_max_effort", maximal, seconds));
+
+  PpgSynthConfig lowPerfusion;
+  lowPerfusion.heartRate = 68;
+  lowPerfusion.perfusion = 0.006f;
+  lowPerfusion.seed = 404;
+  cases.push_back(synthesize("synth_low_perfusion", lowPerfusion, seconds));
+
+  PpgSynthConfig noisy;
+  noisy.heartRate = 82;
+  noisy.spo2 = 96;
+  noisy.noise = 45;
+  noisy.seed = 505;
+  cases.push_back(synthesize("synth_noisy", noisy, seconds));
+
+  PpgSynthConfig hrv;
+  hrv.heartRate = 62;
+  hrv.lfAmplitudeMs = 45;
+  hrv.hfAmplitudeMs = 60;
+  hrv.rrJitterMs = 20;
+  hrv.seed = 606;
+  cases.push_back(synthesize("synth_hrv", hrv, seconds));
+
+  PpgSynthConfig motion;
+  motion.heartRate = 78;
+  motion.motionPerMinute = 4;
+  motion.seed = 707;
+  cases.push_back(synthesize("synth_motion", motion, seconds));
+
+  PpgSynthConfig dropout;
+  dropout.heartRate = 72;
+  dropout.dropoutPerMinute = 1;
+  dropout.seed = 808;
+  cases.push_back(synthesize("synth_dropout", dropout, seconds));
+
+  // Strong signal driven into the top of the ADC range
+  PpgSynthConfig clipped;
+  clipped.heartRate = 70;
+  clipped.irDc = 250000;
+  clipped.perfusion = 0.03f;
+  clipped.seed = 909;
+  cases.push_back(synthesize("synth_clipped", clipped, seconds));
+  return cases;
+}
+
+bool loadTraceCsv(const std::string &path, BenchCase &out, std::string &error)
+{
+  FILE *f = fopen(path.c_str(), "r");
+  if (!f)
+  {
+    error = "cannot open " + path;
+    return false;
+  }
+  char line[512];
+  if (!fgets(line, sizeof(line), f))
+  {
+    fclose(f);
+    error = path + ": empty file";
+    return false;
+  }
+  std::vector<std::string> header = splitCsv(line);
+  int colTime = -1, colIr = -1, colRed = -1, colBeat = -1, colSpo2 = -1;
+  for (size_t i = 0; i < header.size(); i++)
+  {
+    const std::string &h = header[i];
+    if (h == "time_ms")
+      colTime = (int)i;
+    else if (h == "ir")
+      colIr = (int)i;
+    else if (h == "red")
+      colRed = (int)i;
+    else if (h == "beat")
+      colBeat = (int)i;
+    else if (h == "spo2")
+      colSpo2 = (int)i;
+  }
+  if (colTime < 0 || colIr < 0 || colRed < 0)
+  {
+    fclose(f);
+    error = path + ": header needs time_ms, ir and red columns";
+    return false;
+  }
+
+  size_t slash = path.find_last_of('/');
+  out = BenchCase();
+  out.name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+  bool anySpo2 = false;
+  int lineNo = 1;
+  while (fgets(line, sizeof(line), f))
+  {
+    lineNo++;
+    std::vector<std::string> fields = splitCsv(line);
+    if (fields.size() == 1 && fields[0].empty())
+      continue;
+    if ((int)fields.size() <= std::max(colTime, std::max(colIr, colRed)))
+    {
+      fclose(f);
+      error = path + ": short row at line " + std::to_string(lineNo);
+      return false;
+    }
+    uint32_t t = (uint32_t)strtoul(fields[colTime].c_str(), nullptr, 10);
+    out.timeMs.push_back(t);
+    out.ir.push_back((int32_t)strtol(fields[colIr].c_str(), nullptr, 10));
+    out.red.push_back((int32_t)strtol(fields[colRed].c_str(), nullptr, 10));
+    if (colBeat >= 0 && colBeat < (int)fields.size() && atoi(fields[colBeat].c_str()) == 1)
+      out.beatMs.push_back(t);
+    float spo2 = NAN;
+    if (colSpo2 >= 0 && colSpo2 < (int)fields.size() && !fields[colSpo2].empty())
+    {
+      spo2 = strtof(fields[colSpo2].c_str(), nullptr);
+      if (spo2 <= 0)
+        spo2 = NAN;
+    }
+    anySpo2 = anySpo2 || !isnan(spo2);
+    out.spo2.push_back(spo2);
+  }
+  fclose(f);
+  if (!anySpo2)
+    out.spo2.clear();
+  if (out.ir.empty())
+  {
+    error = path + ": no samples";
+    return false;
+  }
+  return true;
+}
+
+std::vector<BenchCase> loadTraceDir(const std::string &dir)
+{
+  std::vector<BenchCase> cases;
+  DIR *d = opendir(dir.c_str());
+  if (!d)
+    return cases;
+  std::vector<std::string> files;
+  while (dirent *e = readdir(d))
+  {
+    size_t len = strlen(e->d_name);
+    if (len > 4 && strcmp(e->d_name + len - 4, ".csv") == 0)
+      files.push_back(dir + "/" + e->d_name);
+  }
+  closedir(d);
+  std::sort(files.begin(), files.end());
+  for (const std::string &path : files)
+  {
+    BenchCase c;
+    std::string error;
+    if (loadTraceCsv(path, c, error))
+      cases.push_back(c);
+    else
+      fprintf(stderr, "skipping trace: %s\n", error.c_str());
+  }
+  return cases;
+}
@@ -0,0 +1,40 @@
+#ifndef PPG_BENCH_TRACE_SET_H
+#define PPG_BENCH_TRACE_SET_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// One benchmark input: 100 Hz IR/red samples plus whatever ground truth is
+// known for it. Synthetic cases always have beat times, SpO2 and the
+// breathing rate; recorded ones only if their CSV carries the annotation
+// columns.
+struct BenchCase
+{
+  std::string name;
+  std::vector<int32_t> ir, red;
+  std::vector<uint32_t> timeMs;
+  std::vector<uint32_t> beatMs; // reference systolic peak times
+  std::vector<float> spo2;      // reference SpO2 per sample, NAN where unknown
+  float respirationRate = NAN;  // reference breaths/min, NAN where unknown
+
+  size_t samples() const { return ir.size(); }
+  bool hasBeats() const { return !beatMs.empty(); }
+  bool hasSpo2() const { return !spo2.empty(); }
+  bool hasRespiration() const { return !isnan(respirationRate); }
+};
+
+// The golden synthetic set: fixed seeds, so every run sees the same data.
+std::vector<BenchCase> syntheticCases(int seconds);
+
+// Recorded traces, one CSV per trace with a header row naming the columns:
+//   time_ms,ir,red[,beat][,spo2]
+// beat is 1 on the sample nearest an annotated systolic peak, spo2 a
+// reference oximeter reading (empty or 0 when missing). Every *.csv in dir
+// is loaded; a missing directory is not an error.
+bool loadTraceCsv(const std::string &path, BenchCase &out, std::string &error);
+std::vector<BenchCase> loadTraceDir(const std::string &dir);
+
+#endif
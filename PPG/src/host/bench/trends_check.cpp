@@ -0,0 +1,295 @@
+#include "trends_check.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "competition_trends.h"
+
+namespace
+{
+  typedef CompetitionTrends CT;
+
+  const int HISTORY_DAYS = 120;
+  const int32_t FIRST_DAY = 19000;
+  const int HRV_DROP_DAY = 80; // HRV steps down by 15 ms from here
+  const double TOLERANCE = 1e-3;
+
+  uint32_t rng = 2463534242u;
+
+  double uniform()
+  {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (rng >> 8) / 16777216.0;
+  }
+
+  double gaussian()
+  {
+    double u = uniform() + 1e-12, v = uniform();
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+  }
+
+  // A season of sessions: HRV follows sleep quality and drops part way
+  // through, some metrics and answers are missing, and the days before
+  // competition count down every two weeks.
+  std::vector<CT::Session> history()
+  {
+    std::vector<CT::Session> sessions;
+    for (int d = 0; d < HISTORY_DAYS; d++)
+    {
+      if (uniform() < 0.15)
+        continue;
+      int count = uniform() < 0.3 ? 2 : 1;
+      for (int k = 0; k < count; k++)
+      {
+        CT::Session s;
+        s.day = FIRST_DAY + d;
+        float sleep = (float)(1 + (int)(uniform() * 10));
+        s.answers[CT::SLEEP_QUALITY] = sleep;
+        s.answers[CT::HAD_COFFEE] = uniform() < 0.5 ? 1.0f : 0.0f;
+        s.answers[CT::STRESS_LEVEL] = uniform() < 0.2 ? NAN : (float)(1 + (int)(uniform() * 10));
+        int daysBefore = 10 - d % 14;
+        s.answers[CT::DAYS_PRE_COMPETITION] = daysBefore >= 1 ? (float)daysBefore : NAN;
+        s.metrics[CT::HRV] = (float)(60 + 2 * (sleep - 5) + 3 * gaussian() - (d >= HRV_DROP_DAY ? 15 : 0));
+        s.metrics[CT::HEART_RATE] = uniform() < 0.1 ? 0 : (float)(65 - 0.5 * (sleep - 5) + 3 * gaussian());
+        s.metrics[CT::SBP] = (float)(120 + 4 * gaussian());
+        s.metrics[CT::DBP] = uniform() < 0.1 ? NAN : (float)(80 + 3 * gaussian());
+        sessions.push_back(s);
+      }
+    }
+    return sessions;
+  }
+
+  bool measured(float v) { return v > 0 && !isinf(v); }
+
+  struct DayMean
+  {
+    int32_t day;
+    float mean[CT::METRIC_COUNT]; // NAN if not measured that day
+  };
+
+  std::vector<DayMean> dailyMeans(const std::vector<CT::Session> &sessions)
+  {
+    std::vector<DayMean> days;
+    size_t i = 0;
+    while (i < sessions.size())
+    {
+      DayMean d;
+      d.day = sessions[i].day;
+      double sum[CT::METRIC_COUNT] = {0};
+      int count[CT::METRIC_COUNT] = {0};
+      for (; i < sessions.size() && sessions[i].day == d.day; i++)
+      {
+        for (int m = 0; m < CT::METRIC_COUNT; m++)
+        {
+          if (measured(sessions[i].metrics[m]))
+          {
+            sum[m] += sessions[i].metrics[m];
+            count[m]++;
+          }
+        }
+      }
+      for (int m = 0; m < CT::METRIC_COUNT; m++)
+        d.mean[m] = count[m] > 0 ? (float)(sum[m] / count[m]) : NAN;
+      days.push_back(d);
+    }
+    return days;
+  }
+
+  // Mean and SD (floored) of metric m over the closed days within
+  // BASELINE_DAYS before day, recomputed from scratch
+  bool baselineAt(const std::vector<DayMean> &closed, int m, int32_t day, double &mean, double &sd)
+  {
+    static const double SD_FLOOR[CT::METRIC_COUNT] = {3.0, 2.0, 3.0, 2.0};
+    std::vector<double> values;
+    for (const DayMean &d : closed)
+    {
+      if (d.day >= day - CT::BASELINE_DAYS && d.day < day && !isnan(d.mean[m]))
+        values.push_back(d.mean[m]);
+    }
+    if ((int)values.size() < CT::MIN_BASELINE_DAYS)
+      return false;
+    mean = 0;
+    for (double v : values)
+      mean += v;
+    mean /= values.size();
+    double ss = 0;
+    for (double v : values)
+      ss += (v - mean) * (v - mean);
+    sd = fmax(sqrt(ss / (values.size() - 1)), SD_FLOOR[m]);
+    return true;
+  }
+
+  int failures = 0;
+
+  void check(bool pass, const char *what)
+  {
+    printf("  %-4s %s\n", pass ? "ok" : "FAIL", what);
+    if (!pass)
+      failures++;
+  }
+
+  void checkError(bool known, double error, const char *what)
+  {
+    bool pass = known && error < TOLERANCE;
+    printf("  %-4s %-38s max error %.2g\n", pass ? "ok" : "FAIL", what, error);
+    if (!pass)
+      failures++;
+  }
+
+  void checkAgainstReference(const std::vector<CT::Session> &sessions, const CT &trends)
+  {
+    std::vector<DayMean> days = dailyMeans(sessions);
+    std::vector<DayMean> closed(days.begin(), days.end() - 1);
+    int32_t openDay = days.back().day;
+
+    // Baselines of the open day
+    double baselineError = 0;
+    bool baselinesMatch = true;
+    for (int m = 0; m < CT::METRIC_COUNT; m++)
+    {
+      double mean, sd;
+      CT::Trend t = trends.trend((CT::Metric)m);
+      if (!baselineAt(closed, m, openDay, mean, sd))
+      {
+        baselinesMatch = baselinesMatch && isnan(t.baseline);
+        continue;
+      }
+      baselineError = fmax(baselineError, fmax(fabs(t.baseline - mean), fabs(t.sd - sd)));
+    }
+    checkError(baselinesMatch, baselineError, "trends: baseline mean and SD");
+
+    // CUSUM over every closed day's z against the baseline before it
+    bool changesMatch = true;
+    bool hrvDrop = false;
+    for (int m = 0; m < CT::METRIC_COUNT; m++)
+    {
+      double high = 0, low = 0;
+      int32_t changeDay = CT::NO_DAY;
+      int direction = 0;
+      for (const DayMean &d : closed)
+      {
+        double mean, sd;
+        if (isnan(d.mean[m]) || !baselineAt(closed, m, d.day, mean, sd))
+          continue;
+        double z = (d.mean[m] - mean) / sd;
+        high = fmax(0, high + z - CT::CUSUM_K);
+        low = fmax(0, low - z - CT::CUSUM_K);
+        if (high > CT::CUSUM_H || low > CT::CUSUM_H)
+        {
+          changeDay = d.day;
+          direction = high > CT::CUSUM_H ? 1 : -1;
+          high = low = 0;
+        }
+      }
+      CT::Trend t = trends.trend((CT::Metric)m);
+      changesMatch = changesMatch && t.changeDay == changeDay && t.changeDirection == direction;
+      if (m == CT::HRV)
+        hrvDrop = direction == -1 && changeDay >= FIRST_DAY + HRV_DROP_DAY;
+    }
+    check(changesMatch, "trends: CUSUM changepoint days and directions");
+    check(hrvDrop, "trends: CUSUM finds the HRV drop");
+
+    // Pearson r over every session measuring both, two passes
+    double rError = 0;
+    bool rKnown = true;
+    for (int m = 0; m < CT::METRIC_COUNT; m++)
+    {
+      for (int a = 0; a < CT::ANSWER_COUNT; a++)
+      {
+        std::vector<double> xs, ys;
+        for (const CT::Session &s : sessions)
+        {
+          if (measured(s.metrics[m]) && !isnan(s.answers[a]))
+          {
+            xs.push_back(s.metrics[m]);
+            ys.push_back(s.answers[a]);
+          }
+        }
+        double mx = 0, my = 0;
+        for (size_t i = 0; i < xs.size(); i++)
+        {
+          mx += xs[i];
+          my += ys[i];
+        }
+        mx /= xs.size();
+        my /= ys.size();
+        double sxx = 0, syy = 0, sxy = 0;
+        for (size_t i = 0; i < xs.size(); i++)
+        {
+          sxx += (xs[i] - mx) * (xs[i] - mx);
+          syy += (ys[i] - my) * (ys[i] - my);
+          sxy += (xs[i] - mx) * (ys[i] - my);
+        }
+        float r = trends.correlation((CT::Metric)m, (CT::Answer)a);
+        if (xs.size() < 3 || sxx <= 0 || syy <= 0)
+        {
+          rKnown = rKnown && isnan(r);
+          continue;
+        }
+        rError = fmax(rError, fabs(r - sxy / sqrt(sxx * syy)));
+      }
+    }
+    checkError(rKnown, rError, "trends: correlation with each answer");
+
+    // Lead-up: % deviation from the baseline of the session's day
+    double leadError = 0;
+    bool leadKnown = true;
+    for (int m = 0; m < CT::METRIC_COUNT; m++)
+    {
+      double sum[CT::LEAD_UP_DAYS] = {0};
+      int count[CT::LEAD_UP_DAYS] = {0};
+      for (const CT::Session &s : sessions)
+      {
+        float daysBefore = s.answers[CT::DAYS_PRE_COMPETITION];
+        double mean, sd;
+        if (!measured(s.metrics[m]) || isnan(daysBefore) || !baselineAt(closed, m, s.day, mean, sd))
+          continue;
+        int i = (int)(daysBefore + 0.5f) - 1;
+        sum[i] += 100.0 * (s.metrics[m] - mean) / mean;
+        count[i]++;
+      }
+      for (int i = 0; i < CT::LEAD_UP_DAYS; i++)
+      {
+        float v = trends.leadUp((CT::Metric)m, i + 1);
+        if (count[i] == 0)
+          leadKnown = leadKnown && isnan(v);
+        else
+          leadError = fmax(leadError, fabs(v - sum[i] / count[i]));
+      }
+    }
+    checkError(leadKnown, leadError, "trends: lead-up deviation");
+  }
+}
+
+bool runTrendsCheck()
+{
+  failures = 0;
+  std::vector<CT::Session> sessions = history();
+  CT seeded;
+  for (const CT::Session &s : sessions)
+    seeded.addSession(s);
+  checkAgainstReference(sessions, seeded);
+
+  // A live session before the history was ever replayed: the older
+  // sessions are refused, so the app starts over from the whole history
+  CT live;
+  live.addSession(sessions.back());
+  int older = 0, refused = 0;
+  for (size_t i = 0; i + 1 < sessions.size() && sessions[i].day < sessions.back().day; i++, older++)
+    refused += !live.addSession(sessions[i]);
+  live.reset();
+  for (const CT::Session &s : sessions)
+    live.addSession(s);
+  std::string expected, rebuilt;
+  seeded.toJson(expected);
+  live.toJson(rebuilt);
+  check(older > 0 && refused == older, "trends: history older than a live session is refused");
+  check(rebuilt == expected && live.sessions() == sessions.size(),
+        "trends: rebuilt from the history, same as seeded first");
+  return failures == 0;
+}
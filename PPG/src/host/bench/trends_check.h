@@ -0,0 +1,11 @@
+#ifndef PPG_BENCH_TRENDS_CHECK_H
+#define PPG_BENCH_TRENDS_CHECK_H
+
+// CompetitionTrends (competition_trends.h), updated per session, against
+// a batch recomputation over the whole synthetic history: baselines,
+// CUSUM changepoints, correlations and lead-up deviations. Also checks
+// that rebuilding from the history after a live session gives the same
+// trends as seeding first. Returns false on any mismatch.
+bool runTrendsCheck();
+
+#endif
@@ -0,0 +1,403 @@
+#include "session_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "crc16.h"
+#include "waveform_codec.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "session files map columns straight into memory and need a little-endian host"
+#endif
+
+namespace
+{
+  const char MAGIC[4] = {'P', 'S', 'F', '1'};
+
+  size_t valueSize(SessionColumnType type)
+  {
+    switch (type)
+    {
+    case PSF_U32:
+    case PSF_F32:
+      return 4;
+    case PSF_I64:
+      return 8;
+    default:
+      return 0;
+    }
+  }
+
+  uint64_t waveBlocks(uint64_t rows)
+  {
+    return rows / WAVE_BLOCK_MAX_SAMPLES + (rows % WAVE_BLOCK_MAX_SAMPLES != 0);
+  }
+
+  void put16(uint8_t *p, uint16_t v)
+  {
+    p[0] = v;
+    p[1] = v >> 8;
+  }
+
+  void put32(uint8_t *p, uint32_t v)
+  {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+  }
+
+  void put64(uint8_t *p, uint64_t v)
+  {
+    put32(p, (uint32_t)v);
+    put32(p + 4, (uint32_t)(v >> 32));
+  }
+
+  uint16_t get16(const uint8_t *p) { return (uint16_t)(p[0] | p[1] << 8); }
+
+  uint32_t get32(const uint8_t *p) { return get16(p) | (uint32_t)get16(p + 2) << 16; }
+
+  uint64_t get64(const uint8_t *p) { return get32(p) | (uint64_t)get32(p + 4) << 32; }
+
+  double getDouble(const uint8_t *p)
+  {
+    uint64_t bits = get64(p);
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+  }
+
+  size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+  bool writeAll(FILE *f, const void *data, size_t size) { return size == 0 || fwrite(data, 1, size, f) == size; }
+
+  bool pad(FILE *f, size_t &at, size_t to)
+  {
+    static const uint8_t zeros[8] = {0};
+    bool ok = writeAll(f, zeros, to - at);
+    at = to;
+    return ok;
+  }
+}
+
+SessionFileWriter::SessionFileWriter(uint32_t blockRows)
+    : blockRows(std::max<uint32_t>(WAVE_BLOCK_MAX_SAMPLES, blockRows / WAVE_BLOCK_MAX_SAMPLES * WAVE_BLOCK_MAX_SAMPLES))
+{
+}
+
+int SessionFileWriter::addColumn(const char *name, SessionColumnType type)
+{
+  size_t len = strlen(name);
+  if (len == 0 || len >= PSF_NAME_CAPACITY)
+    return -1;
+  Column c;
+  c.name = name;
+  c.type = type;
+  columns.push_back(c);
+  return (int)columns.size() - 1;
+}
+
+void SessionFileWriter::put(Column &c, const void *v, size_t size, double value)
+{
+  const uint8_t *p = (const uint8_t *)v;
+  c.bytes.insert(c.bytes.end(), p, p + size);
+  if (c.rows % blockRows == 0)
+  {
+    c.stats.push_back(value);
+    c.stats.push_back(value);
+  }
+  else
+  {
+    double &lo = c.stats[c.stats.size() - 2];
+    double &hi = c.stats.back();
+    lo = std::min(lo, value);
+    hi = std::max(hi, value);
+  }
+  c.rows++;
+}
+
+void SessionFileWriter::putU32(int column, uint32_t v)
+{
+  put(columns[column], &v, sizeof(v), v);
+}
+
+void SessionFileWriter::putI64(int column, int64_t v)
+{
+  put(columns[column], &v, sizeof(v), (double)v);
+}
+
+void SessionFileWriter::putF32(int column, float v)
+{
+  put(columns[column], &v, sizeof(v), v);
+}
+
+void SessionFileWriter::putSample(int column, uint32_t sample)
+{
+  Column &c = columns[column];
+  sample = std::min(sample, WAVE_SAMPLE_MAX);
+  c.pending.push_back(sample);
+  // The stats, without the value bytes
+  put(c, nullptr, 0, sample);
+  if (c.pending.size() == (size_t)WAVE_BLOCK_MAX_SAMPLES)
+    compress(c);
+}
+
+void SessionFileWriter::compress(Column &c)
+{
+  uint8_t block[waveBlockMaxSize(WAVE_BLOCK_MAX_SAMPLES)];
+  size_t size = encodeWaveBlock(c.pending.data(), (int)c.pending.size(), block, sizeof(block));
+  c.blockOffsets.push_back(c.bytes.size());
+  c.bytes.insert(c.bytes.end(), block, block + size);
+  c.pending.clear();
+}
+
+void SessionFileWriter::clear()
+{
+  for (Column &c : columns)
+  {
+    c.rows = 0;
+    c.bytes.clear();
+    c.stats.clear();
+    c.blockOffsets.clear();
+    c.pending.clear();
+  }
+}
+
+bool SessionFileWriter::write(const char *path, uint32_t source, int64_t startMs, std::string &error)
+{
+  // A WAVE column's partial last block is compressed here, at its end
+  for (Column &c : columns)
+  {
+    if (c.type == PSF_WAVE && !c.pending.empty())
+      compress(c);
+  }
+
+  size_t at = PSF_HEADER_SIZE + columns.size() * PSF_COLUMN_ENTRY_SIZE;
+  std::vector<uint8_t> head(at, 0);
+  memcpy(head.data(), MAGIC, sizeof(MAGIC));
+  put16(&head[4], PSF_VERSION);
+  put16(&head[6], (uint16_t)columns.size());
+  put32(&head[8], blockRows);
+  put32(&head[12], source);
+  put64(&head[16], (uint64_t)startMs);
+  std::vector<size_t> dataAt(columns.size());
+  for (size_t i = 0; i < columns.size(); i++)
+  {
+    const Column &c = columns[i];
+    size_t size = c.bytes.size();
+    if (c.type == PSF_WAVE)
+      size += (c.blockOffsets.size() + 1) * 8;
+    dataAt[i] = align8(at);
+    size_t statsAt = align8(dataAt[i] + size);
+    at = statsAt + c.stats.size() * 8;
+    uint8_t *entry = &head[PSF_HEADER_SIZE + i * PSF_COLUMN_ENTRY_SIZE];
+    memcpy(entry, c.name.data(), c.name.size());
+    entry[24] = c.type;
+    put64(entry + 32, c.rows);
+    put64(entry + 40, dataAt[i]);
+    put64(entry + 48, size);
+    put64(entry + 56, statsAt);
+  }
+  uint16_t crc = crc16Ccitt(head.data(), head.size());
+  put16(&head[PSF_HEADER_SIZE - 2], crc);
+
+  std::string tmp = std::string(path) + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (!f)
+  {
+    error = tmp + ": " + strerror(errno);
+    return false;
+  }
+  bool ok = writeAll(f, head.data(), head.size());
+  at = head.size();
+  for (size_t i = 0; i < columns.size() && ok; i++)
+  {
+    const Column &c = columns[i];
+    ok = pad(f, at, dataAt[i]);
+    if (c.type == PSF_WAVE)
+    {
+      std::vector<uint8_t> table((c.blockOffsets.size() + 1) * 8);
+      for (size_t b = 0; b < c.blockOffsets.size(); b++)
+        put64(&table[b * 8], c.blockOffsets[b]);
+      put64(&table[c.blockOffsets.size() * 8], c.bytes.size());
+      ok = ok && writeAll(f, table.data(), table.size());
+      at += table.size();
+    }
+    ok = ok && writeAll(f, c.bytes.data(), c.bytes.size());
+    at += c.bytes.size();
+    ok = ok && pad(f, at, align8(at));
+    for (double v : c.stats)
+    {
+      uint8_t b[8];
+      uint64_t bits;
+      memcpy(&bits, &v, sizeof(bits));
+      put64(b, bits);
+      ok = ok && writeAll(f, b, sizeof(b));
+    }
+    at += c.stats.size() * 8;
+  }
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path) != 0)
+  {
+    error = std::string(path) + ": " + strerror(errno);
+    remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool SessionFile::open(const char *path, std::string &error)
+{
+  close();
+  fd = ::open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0)
+  {
+    error = strerror(errno);
+    close();
+    return false;
+  }
+  mapSize = st.st_size;
+  if (mapSize < PSF_HEADER_SIZE)
+  {
+    error = "too short for a session file";
+    close();
+    return false;
+  }
+  void *m = mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+  if (m == MAP_FAILED)
+  {
+    error = strerror(errno);
+    map = nullptr;
+    close();
+    return false;
+  }
+  map = (const uint8_t *)m;
+  madvise(m, mapSize, MADV_SEQUENTIAL);
+
+  uint16_t version = get16(map + 4);
+  size_t count = get16(map + 6);
+  size_t headSize = PSF_HEADER_SIZE + count * PSF_COLUMN_ENTRY_SIZE;
+  if (memcmp(map, MAGIC, sizeof(MAGIC)) != 0)
+    error = "not a session file";
+  else if (version != PSF_VERSION)
+    error = "session file version " + std::to_string(version) + ", this reader knows " + std::to_string(PSF_VERSION);
+  else if (headSize > mapSize)
+    error = "truncated directory";
+  else
+  {
+    // The CRC is computed with its own field zeroed
+    std::vector<uint8_t> head(map, map + headSize);
+    put16(&head[PSF_HEADER_SIZE - 2], 0);
+    if (crc16Ccitt(head.data(), head.size()) != get16(map + PSF_HEADER_SIZE - 2))
+      error = "bad directory CRC";
+  }
+  rowsPerBlock = get32(map + 8);
+  if (error.empty() && (rowsPerBlock == 0 || rowsPerBlock % WAVE_BLOCK_MAX_SAMPLES != 0))
+    error = "bad block size";
+  if (!error.empty())
+  {
+    close();
+    return false;
+  }
+  sourceId = get32(map + 12);
+  start = (int64_t)get64(map + 16);
+
+  for (size_t i = 0; i < count; i++)
+  {
+    const uint8_t *entry = map + PSF_HEADER_SIZE + i * PSF_COLUMN_ENTRY_SIZE;
+    Column c;
+    c.name.assign((const char *)entry, strnlen((const char *)entry, PSF_NAME_CAPACITY));
+    c.type = (SessionColumnType)entry[24];
+    c.rows = get64(entry + 32);
+    uint64_t offset = get64(entry + 40);
+    c.size = get64(entry + 48);
+    uint64_t statsOffset = get64(entry + 56);
+    if (c.type != PSF_WAVE && valueSize(c.type) == 0)
+    {
+      error = "column " + c.name + " of unknown type";
+      close();
+      return false;
+    }
+    // Divided rather than multiplied, so a corrupt row count cannot wrap
+    c.blocks = c.rows / rowsPerBlock + (c.rows % rowsPerBlock != 0);
+    bool fits = offset % 8 == 0 && statsOffset % 8 == 0 && offset <= mapSize && c.size <= mapSize - offset &&
+                statsOffset <= mapSize && c.blocks <= (mapSize - statsOffset) / 16;
+    if (fits && c.type == PSF_WAVE)
+      fits = waveBlocks(c.rows) < c.size / 8;
+    else if (fits)
+      fits = c.rows <= (mapSize - offset) / valueSize(c.type) && c.size == c.rows * valueSize(c.type);
+    if (!fits)
+    {
+      error = "column " + c.name + " out of bounds";
+      close();
+      return false;
+    }
+    c.data = map + offset;
+    c.stats = map + statsOffset;
+    columns.push_back(c);
+  }
+  return true;
+}
+
+void SessionFile::close()
+{
+  if (map)
+    munmap((void *)map, mapSize);
+  if (fd >= 0)
+    ::close(fd);
+  fd = -1;
+  map = nullptr;
+  mapSize = 0;
+  columns.clear();
+}
+
+const SessionFile::Column *SessionFile::find(const char *name) const
+{
+  for (const Column &c : columns)
+  {
+    if (c.name == name)
+      return &c;
+  }
+  return nullptr;
+}
+
+double SessionFile::blockMin(const Column &c, uint64_t block)
+{
+  return getDouble(c.stats + block * 16);
+}
+
+double SessionFile::blockMax(const Column &c, uint64_t block)
+{
+  return getDouble(c.stats + block * 16 + 8);
+}
+
+bool SessionFile::readWave(const Column &c, uint64_t first, size_t count, uint32_t *out)
+{
+  if (c.type != PSF_WAVE || first > c.rows || count > c.rows - first)
+    return false;
+  uint64_t blocks = waveBlocks(c.rows);
+  const uint8_t *payload = c.data + (blocks + 1) * 8;
+  uint64_t payloadSize = c.size - (blocks + 1) * 8;
+  uint32_t samples[WAVE_BLOCK_MAX_SAMPLES];
+  while (count > 0)
+  {
+    uint64_t block = first / WAVE_BLOCK_MAX_SAMPLES;
+    uint64_t from = get64(c.data + block * 8), to = get64(c.data + block * 8 + 8);
+    int n = (int)std::min<uint64_t>(WAVE_BLOCK_MAX_SAMPLES, c.rows - block * WAVE_BLOCK_MAX_SAMPLES);
+    if (from > to || to > payloadSize || decodeWaveBlock(payload + from, to - from, n, samples) == 0)
+      return false;
+    size_t skip = first % WAVE_BLOCK_MAX_SAMPLES;
+    size_t take = std::min(count, (size_t)n - skip);
+    memcpy(out, samples + skip, take * sizeof(uint32_t));
+    out += take;
+    first += take;
+    count -= take;
+  }
+  return true;
+}
@@ -0,0 +1,143 @@
+#ifndef PPG_HOST_SESSION_FILE_H
+#define PPG_HOST_SESSION_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// One recorded session as a columnar binary file (.psf), written by the
+// gateway when a device's session ends and read by the analytics tools
+// through mmap, without parsing or copying.
+//
+// Each column is typed and fixed width, stored contiguously and 8-byte
+// aligned, so a reader gets a pointer to its values in the mapping. Every
+// blockRows rows of a column have a min/max entry, letting a scan skip
+// blocks its predicate rules out. A WAVE column holds raw samples
+// compressed with waveform_codec.h in 64-sample blocks, with an offset
+// table so any range decodes without the rest. Columns have their own row
+// counts: readings, HRV windows and raw samples come at different rates.
+//
+// Little endian:
+//   header     "PSF1" version(2) columns(2) blockRows(4) source(4)
+//              startMs(8) reserved(38) crc16(2), 64 bytes; the CRC covers
+//              the header before it and the directory
+//   directory  per column, 64 bytes: name[24] (NUL padded) type(1)
+//              reserved(7) rows(8) offset(8) size(8) statsOffset(8)
+//   data       U32/F32 4 bytes a row, I64 8; WAVE: ceil(rows / 64) + 1
+//              byte offsets(8) into the blocks that follow them
+//   stats      per block of blockRows rows: min(8) max(8), doubles
+// The version changes with the layout or a new column type; a file with a
+// column of a type the reader does not know is rejected.
+//
+// The zero-copy accessors return host pointers into the file, so the
+// reader needs a little-endian host (x86, ARM Linux).
+enum SessionColumnType : uint8_t
+{
+  PSF_U32,
+  PSF_I64,
+  PSF_F32,
+  PSF_WAVE,
+};
+
+const uint16_t PSF_VERSION = 1;
+const size_t PSF_HEADER_SIZE = 64;
+const size_t PSF_COLUMN_ENTRY_SIZE = 64;
+const size_t PSF_NAME_CAPACITY = 24; // NUL included
+
+// Collects a session's columns in memory, WAVE columns already
+// compressed, and writes them out as one file.
+class SessionFileWriter
+{
+public:
+  // blockRows must be a multiple of 64, the WAVE block size
+  explicit SessionFileWriter(uint32_t blockRows = 4096);
+
+  // Returns the column's index, or -1 for a name that is empty or too long
+  int addColumn(const char *name, SessionColumnType type);
+
+  void putU32(int column, uint32_t v);
+  void putI64(int column, int64_t v);
+  void putF32(int column, float v);
+  // Samples above WAVE_SAMPLE_MAX are clamped
+  void putSample(int column, uint32_t sample);
+
+  uint64_t rows(int column) const { return columns[column].rows; }
+  // Drops the rows, keeps the columns
+  void clear();
+  // Writes path.tmp and renames it over path. This closes the WAVE
+  // columns' last blocks, so clear() before adding rows again.
+  bool write(const char *path, uint32_t source, int64_t startMs, std::string &error);
+
+private:
+  struct Column
+  {
+    std::string name;
+    SessionColumnType type;
+    uint64_t rows = 0;
+    std::vector<uint8_t> bytes; // values, or compressed WAVE blocks
+    std::vector<double> stats;  // min, max per block
+    std::vector<uint64_t> blockOffsets;
+    std::vector<uint32_t> pending; // WAVE samples not yet compressed
+  };
+
+  void put(Column &c, const void *v, size_t size, double value);
+  void compress(Column &c);
+
+  uint32_t blockRows;
+  std::vector<Column> columns;
+};
+
+class SessionFile
+{
+public:
+  struct Column
+  {
+    std::string name;
+    SessionColumnType type;
+    uint64_t rows;
+    const uint8_t *data;
+    uint64_t size;
+    const uint8_t *stats;
+    uint64_t blocks;
+  };
+
+  SessionFile() = default;
+  SessionFile(const SessionFile &) = delete;
+  SessionFile &operator=(const SessionFile &) = delete;
+  ~SessionFile() { close(); }
+
+  bool open(const char *path, std::string &error);
+  void close();
+
+  uint32_t source() const { return sourceId; }
+  int64_t startMs() const { return start; }
+  uint32_t blockRows() const { return rowsPerBlock; }
+  size_t mappedBytes() const { return mapSize; }
+  size_t columnCount() const { return columns.size(); }
+  const Column &column(size_t i) const { return columns[i]; }
+  // NULL if absent
+  const Column *find(const char *name) const;
+
+  // The values in the mapping; NULL for another type
+  static const uint32_t *u32(const Column &c) { return c.type == PSF_U32 ? (const uint32_t *)c.data : nullptr; }
+  static const int64_t *i64(const Column &c) { return c.type == PSF_I64 ? (const int64_t *)c.data : nullptr; }
+  static const float *f32(const Column &c) { return c.type == PSF_F32 ? (const float *)c.data : nullptr; }
+  static double blockMin(const Column &c, uint64_t block);
+  static double blockMax(const Column &c, uint64_t block);
+
+  // Decodes samples [first, first + count) of a WAVE column
+  static bool readWave(const Column &c, uint64_t first, size_t count, uint32_t *out);
+
+private:
+  int fd = -1;
+  const uint8_t *map = nullptr;
+  size_t mapSize = 0;
+  uint32_t sourceId = 0;
+  int64_t start = 0;
+  uint32_t rowsPerBlock = 0;
+  std::vector<Column> columns;
+};
+
+#endif
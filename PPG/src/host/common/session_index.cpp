@@ -0,0 +1,491 @@
+#include "session_index.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <set>
+
+#include "session_file.h"
+
+namespace
+{
+  const uint16_t INDEX_VERSION = 1;
+  const char INDEX_MAGIC[4] = {'P', 'S', 'I', '1'};
+
+  const char *const METRIC_COLUMNS[METRIC_COUNT] = {"heart_rate", "avg_heart_rate", "sbp", "dbp",
+                                                    "oxygen",     "resp_rate",      "sdnn", "rmssd"};
+
+  uint64_t dayKey(uint32_t source, int32_t day, int metric)
+  {
+    return (uint64_t)source << 32 | (uint64_t)(uint32_t)day << 4 | (uint64_t)metric;
+  }
+
+  template <typename T>
+  void matchRows(const T *values, const int64_t *times, uint64_t begin, uint64_t end, const SessionQuery &q,
+                 SessionHit &hit)
+  {
+    for (uint64_t i = begin; i < end; i++)
+    {
+      double v = values[i];
+      int64_t t = times[i];
+      if (t < q.fromMs || t >= q.toMs || !(v > q.above && v < q.below))
+        continue;
+      if (hit.rows++ == 0)
+        hit.firstMs = t;
+      hit.lastMs = std::max(hit.lastMs, t);
+      hit.min = std::min(hit.min, v);
+      hit.max = std::max(hit.max, v);
+    }
+  }
+
+  class Out
+  {
+  public:
+    template <typename T> void put(T v)
+    {
+      const uint8_t *p = (const uint8_t *)&v;
+      bytes.insert(bytes.end(), p, p + sizeof(v));
+    }
+    void put(const std::string &s)
+    {
+      put((uint16_t)s.size());
+      bytes.insert(bytes.end(), s.begin(), s.end());
+    }
+
+    std::vector<uint8_t> bytes;
+  };
+
+  class In
+  {
+  public:
+    In(const uint8_t *p, size_t size) : p(p), end(p + size) {}
+
+    template <typename T> T get()
+    {
+      T v = T();
+      if ((size_t)(end - p) < sizeof(v))
+      {
+        ok = false;
+        return v;
+      }
+      memcpy(&v, p, sizeof(v));
+      p += sizeof(v);
+      return v;
+    }
+    std::string str()
+    {
+      size_t n = get<uint16_t>();
+      if ((size_t)(end - p) < n)
+      {
+        ok = false;
+        return std::string();
+      }
+      std::string s((const char *)p, n);
+      p += n;
+      return s;
+    }
+
+    bool ok = true;
+
+  private:
+    const uint8_t *p, *end;
+  };
+
+  bool readFile(const std::string &path, std::vector<uint8_t> &out)
+  {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+      return false;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+      out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return true;
+  }
+}
+
+const char *metricColumn(int metric)
+{
+  return metric >= 0 && metric < METRIC_COUNT ? METRIC_COLUMNS[metric] : nullptr;
+}
+
+const char *metricTimeColumn(int metric)
+{
+  return metric == METRIC_SDNN || metric == METRIC_RMSSD ? "hrv_t_ms" : "t_ms";
+}
+
+int sessionMetric(const char *name)
+{
+  for (int m = 0; m < METRIC_COUNT; m++)
+  {
+    if (strcmp(name, METRIC_COLUMNS[m]) == 0)
+      return m;
+  }
+  return -1;
+}
+
+void DayStats::add(double v)
+{
+  count++;
+  sum += v;
+  min = std::min(min, v);
+  max = std::max(max, v);
+}
+
+void DayStats::merge(const DayStats &o)
+{
+  count += o.count;
+  sum += o.sum;
+  min = std::min(min, o.min);
+  max = std::max(max, o.max);
+}
+
+void listSessionFiles(const std::string &path, std::vector<std::string> &files)
+{
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return;
+  if (!S_ISDIR(st.st_mode))
+  {
+    files.push_back(path);
+    return;
+  }
+  DIR *d = opendir(path.c_str());
+  if (!d)
+    return;
+  std::vector<std::string> dirs;
+  while (dirent *e = readdir(d))
+  {
+    size_t len = strlen(e->d_name);
+    if (e->d_name[0] == '.')
+      continue;
+    std::string child = path + "/" + e->d_name;
+    if (len > 4 && strcmp(e->d_name + len - 4, ".psf") == 0)
+      files.push_back(child);
+    else if (stat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+      dirs.push_back(child);
+  }
+  closedir(d);
+  for (const std::string &dir : dirs)
+    listSessionFiles(dir, files);
+  std::sort(files.begin(), files.end());
+}
+
+bool SessionIndex::open(const std::string &archive, std::string &error)
+{
+  root = archive;
+  sessions.clear();
+  std::vector<uint8_t> bytes;
+  std::string path = root + "/index.psi";
+  if (!readFile(path, bytes))
+  {
+    if (errno == ENOENT)
+    {
+      rebuild();
+      return true;
+    }
+    error = path + ": " + strerror(errno);
+    return false;
+  }
+
+  In in(bytes.data(), bytes.size());
+  char magic[4];
+  for (char &c : magic)
+    c = in.get<char>();
+  bool current = memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0 && in.get<uint16_t>() == INDEX_VERSION &&
+                 in.get<uint16_t>() == METRIC_COUNT;
+  uint32_t count = current ? in.get<uint32_t>() : 0;
+  for (uint32_t i = 0; i < count && in.ok; i++)
+  {
+    Session s;
+    s.path = in.str();
+    s.source = in.get<uint32_t>();
+    s.startMs = in.get<int64_t>();
+    s.endMs = in.get<int64_t>();
+    s.blockRows = in.get<uint32_t>();
+    for (int m = 0; m < METRIC_COUNT && in.ok; m++)
+    {
+      s.rows[m] = in.get<uint64_t>();
+      uint32_t blocks = in.get<uint32_t>();
+      for (uint32_t b = 0; b < blocks && in.ok; b++)
+      {
+        Block block;
+        block.min = in.get<double>();
+        block.max = in.get<double>();
+        block.fromMs = in.get<int64_t>();
+        block.toMs = in.get<int64_t>();
+        s.blocks[m].push_back(block);
+      }
+    }
+    uint16_t days = in.get<uint16_t>();
+    for (uint16_t d = 0; d < days && in.ok; d++)
+    {
+      Day day;
+      day.day = in.get<int32_t>();
+      day.metric = in.get<uint8_t>();
+      day.stats.count = in.get<uint32_t>();
+      day.stats.sum = in.get<double>();
+      day.stats.min = in.get<double>();
+      day.stats.max = in.get<double>();
+      s.days.push_back(day);
+    }
+    sessions.push_back(s);
+  }
+  if (!current || !in.ok)
+    sessions.clear();
+  rebuild();
+  return true;
+}
+
+bool SessionIndex::indexFile(const std::string &path, Session &s, std::string &error) const
+{
+  SessionFile file;
+  if (!file.open(path.c_str(), error))
+    return false;
+  s.source = file.source();
+  s.blockRows = file.blockRows();
+  s.startMs = INT64_MAX;
+  s.endMs = INT64_MIN;
+  for (size_t i = 0; i < file.columnCount(); i++)
+  {
+    const SessionFile::Column &c = file.column(i);
+    if (c.type != PSF_I64 || c.rows == 0 || c.name.size() < 4 || c.name.compare(c.name.size() - 4, 4, "t_ms") != 0)
+      continue;
+    for (uint64_t b = 0; b < c.blocks; b++)
+    {
+      s.startMs = std::min(s.startMs, (int64_t)SessionFile::blockMin(c, b));
+      s.endMs = std::max(s.endMs, (int64_t)SessionFile::blockMax(c, b));
+    }
+  }
+  if (s.startMs > s.endMs)
+    s.startMs = s.endMs = file.startMs();
+
+  std::map<std::pair<int32_t, int>, DayStats> days;
+  for (int m = 0; m < METRIC_COUNT; m++)
+  {
+    s.rows[m] = 0;
+    s.blocks[m].clear();
+    const SessionFile::Column *c = file.find(metricColumn(m));
+    const SessionFile::Column *t = file.find(metricTimeColumn(m));
+    const int64_t *times = t ? SessionFile::i64(*t) : nullptr;
+    if (!c || !times || t->rows != c->rows || !(c->type == PSF_F32 || c->type == PSF_U32))
+      continue;
+    s.rows[m] = c->rows;
+    for (uint64_t b = 0; b < c->blocks; b++)
+    {
+      Block block = {SessionFile::blockMin(*c, b), SessionFile::blockMax(*c, b),
+                     (int64_t)SessionFile::blockMin(*t, b), (int64_t)SessionFile::blockMax(*t, b)};
+      s.blocks[m].push_back(block);
+    }
+    const float *f = SessionFile::f32(*c);
+    const uint32_t *u = SessionFile::u32(*c);
+    for (uint64_t i = 0; i < c->rows; i++)
+    {
+      double v = f ? f[i] : u[i];
+      if (v > 0)
+        days[std::make_pair(utcDay(times[i]), m)].add(v);
+    }
+  }
+  s.days.clear();
+  for (const auto &d : days)
+  {
+    Day day = {d.first.first, (uint8_t)d.first.second, d.second};
+    s.days.push_back(day);
+  }
+  return true;
+}
+
+size_t SessionIndex::update(std::string &error)
+{
+  std::vector<std::string> files;
+  listSessionFiles(root, files);
+  std::set<std::string> present;
+  for (const std::string &f : files)
+    present.insert(f.substr(root.size() + 1));
+
+  std::set<std::string> known;
+  std::vector<Session> kept;
+  for (Session &s : sessions)
+  {
+    if (present.count(s.path))
+    {
+      known.insert(s.path);
+      kept.push_back(std::move(s));
+    }
+  }
+  sessions.swap(kept);
+
+  size_t added = 0;
+  for (const std::string &path : present)
+  {
+    if (known.count(path))
+      continue;
+    Session s;
+    s.path = path;
+    std::string why;
+    if (!indexFile(root + "/" + path, s, why))
+    {
+      error = path + ": " + why;
+      continue;
+    }
+    sessions.push_back(std::move(s));
+    added++;
+  }
+  rebuild();
+  return added;
+}
+
+void SessionIndex::rebuild()
+{
+  std::sort(sessions.begin(), sessions.end(),
+            [](const Session &a, const Session &b) { return a.startMs < b.startMs; });
+  longestMs = 0;
+  days.clear();
+  for (const Session &s : sessions)
+  {
+    longestMs = std::max(longestMs, s.endMs - s.startMs);
+    for (const Day &d : s.days)
+      days[dayKey(s.source, d.day, d.metric)].merge(d.stats);
+  }
+}
+
+bool SessionIndex::save(std::string &error) const
+{
+  Out out;
+  for (char c : INDEX_MAGIC)
+    out.put(c);
+  out.put(INDEX_VERSION);
+  out.put((uint16_t)METRIC_COUNT);
+  out.put((uint32_t)sessions.size());
+  for (const Session &s : sessions)
+  {
+    out.put(s.path);
+    out.put(s.source);
+    out.put(s.startMs);
+    out.put(s.endMs);
+    out.put(s.blockRows);
+    for (int m = 0; m < METRIC_COUNT; m++)
+    {
+      out.put(s.rows[m]);
+      out.put((uint32_t)s.blocks[m].size());
+      for (const Block &b : s.blocks[m])
+      {
+        out.put(b.min);
+        out.put(b.max);
+        out.put(b.fromMs);
+        out.put(b.toMs);
+      }
+    }
+    out.put((uint16_t)s.days.size());
+    for (const Day &d : s.days)
+    {
+      out.put(d.day);
+      out.put(d.metric);
+      out.put(d.stats.count);
+      out.put(d.stats.sum);
+      out.put(d.stats.min);
+      out.put(d.stats.max);
+    }
+  }
+
+  std::string path = root + "/index.psi";
+  std::string tmp = path + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  bool ok = f && fwrite(out.bytes.data(), 1, out.bytes.size(), f) == out.bytes.size();
+  ok = f && fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+  {
+    error = path + ": " + strerror(errno);
+    remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool SessionIndex::query(const SessionQuery &q, std::vector<SessionHit> &hits, QueryStats &stats,
+                         std::string &error) const
+{
+  const char *column = metricColumn(q.metric);
+  if (!column)
+  {
+    error = "unknown metric";
+    return false;
+  }
+  // No session that started before this reaches the range
+  int64_t earliest = q.fromMs > INT64_MIN + longestMs ? q.fromMs - longestMs : INT64_MIN;
+  auto first = std::lower_bound(sessions.begin(), sessions.end(), earliest,
+                                [](const Session &s, int64_t t) { return s.startMs < t; });
+  for (auto it = first; it != sessions.end() && it->startMs < q.toMs; ++it)
+  {
+    const Session &s = *it;
+    if (s.endMs < q.fromMs || (!q.anySource && s.source != q.source))
+      continue;
+    stats.sessions++;
+    stats.blocks += s.blocks[q.metric].size();
+
+    SessionFile file;
+    const SessionFile::Column *c = nullptr;
+    const int64_t *times = nullptr;
+    SessionHit hit = {(size_t)(it - sessions.begin()), 0, 0, INT64_MIN, INFINITY, -INFINITY};
+    for (size_t b = 0; b < s.blocks[q.metric].size(); b++)
+    {
+      const Block &block = s.blocks[q.metric][b];
+      if (block.toMs < q.fromMs || block.fromMs >= q.toMs || block.max <= q.above || block.min >= q.below)
+        continue;
+      if (!c)
+      {
+        std::string path = root + "/" + s.path;
+        if (!file.open(path.c_str(), error))
+        {
+          error = path + ": " + error;
+          return false;
+        }
+        stats.filesOpened++;
+        c = file.find(column);
+        const SessionFile::Column *t = file.find(metricTimeColumn(q.metric));
+        times = t ? SessionFile::i64(*t) : nullptr;
+        if (!c || !times || c->rows != s.rows[q.metric])
+        {
+          error = path + ": changed since it was indexed";
+          return false;
+        }
+      }
+      uint64_t begin = b * s.blockRows, end = std::min<uint64_t>(c->rows, begin + s.blockRows);
+      if (const float *v = SessionFile::f32(*c))
+        matchRows(v, times, begin, end, q, hit);
+      else if (const uint32_t *v = SessionFile::u32(*c))
+        matchRows(v, times, begin, end, q, hit);
+      stats.blocksRead++;
+      stats.rowsRead += end - begin;
+    }
+    if (hit.rows > 0)
+      hits.push_back(hit);
+  }
+  return true;
+}
+
+DayStats SessionIndex::rollup(uint32_t source, int metric, int32_t fromDay, int32_t toDay) const
+{
+  DayStats total;
+  std::vector<std::pair<int32_t, DayStats>> daily;
+  dailyRollups(source, metric, fromDay, toDay, daily);
+  for (const auto &d : daily)
+    total.merge(d.second);
+  return total;
+}
+
+void SessionIndex::dailyRollups(uint32_t source, int metric, int32_t fromDay, int32_t toDay,
+                                std::vector<std::pair<int32_t, DayStats>> &out) const
+{
+  auto end = days.upper_bound(dayKey(source, toDay, METRIC_COUNT));
+  for (auto it = days.lower_bound(dayKey(source, fromDay, 0)); it != end; ++it)
+  {
+    if ((int)(it->first & 0xF) == metric)
+      out.push_back(std::make_pair((int32_t)(it->first >> 4 & 0xFFFFFFF), it->second));
+  }
+}
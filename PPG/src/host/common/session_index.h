@@ -0,0 +1,156 @@
+#ifndef PPG_HOST_SESSION_INDEX_H
+#define PPG_HOST_SESSION_INDEX_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Index over an archive of session files (session_file.h), kept in
+// <archive>/index.psi, so range and threshold queries over years of
+// sessions read only the blocks that can match.
+//
+// Per session it holds the time bounds and, for each metric, every block's
+// min/max and time bounds, copied from the file's block statistics. Per
+// device and UTC day it holds rollups (count, sum, min, max) of each
+// metric, which answer baseline questions without opening a file. Values
+// of 0 or less are left out of the rollups: the gateway writes 0 for a
+// reading the device did not have.
+//
+// Session files are written once and never change, so update() only adds
+// the files it has not seen and drops the ones that are gone.
+//
+// Index file, little endian:
+//   "PSI1" version(2) metrics(2) sessions(4), per session:
+//     pathLen(2) path source(4) startMs(8) endMs(8) blockRows(4)
+//     per metric: rows(8) blocks(4), per block: min(8) max(8) fromMs(8) toMs(8)
+//     days(2), per day: day(4) metric(1) count(4) sum(8) min(8) max(8)
+enum SessionMetric
+{
+  METRIC_HEART_RATE,
+  METRIC_AVG_HEART_RATE,
+  METRIC_SBP,
+  METRIC_DBP,
+  METRIC_OXYGEN,
+  METRIC_RESP_RATE,
+  METRIC_SDNN,
+  METRIC_RMSSD,
+  METRIC_COUNT
+};
+
+// The metric's session file column, and the column with its timestamps
+const char *metricColumn(int metric);
+const char *metricTimeColumn(int metric);
+// -1 if unknown
+int sessionMetric(const char *name);
+
+const int64_t MS_PER_DAY = 86400000;
+
+// Days since 1970-01-01 UTC; session times are epoch ms, never negative
+inline int32_t utcDay(int64_t ms) { return (int32_t)(ms / MS_PER_DAY); }
+
+struct DayStats
+{
+  uint32_t count = 0;
+  double sum = 0;
+  double min = INFINITY;
+  double max = -INFINITY;
+
+  void add(double v);
+  void merge(const DayStats &o);
+  double mean() const { return count > 0 ? sum / count : NAN; }
+};
+
+struct SessionQuery
+{
+  int metric = METRIC_HEART_RATE;
+  int64_t fromMs = INT64_MIN;
+  int64_t toMs = INT64_MAX; // exclusive
+  // Rows with above < value < below match
+  double above = -INFINITY;
+  double below = INFINITY;
+  bool anySource = true;
+  uint32_t source = 0;
+};
+
+struct SessionHit
+{
+  size_t session;
+  uint64_t rows;
+  int64_t firstMs, lastMs;
+  double min, max;
+};
+
+struct QueryStats
+{
+  size_t sessions = 0;    // in the time range
+  size_t filesOpened = 0;
+  uint64_t blocks = 0;    // of those sessions
+  uint64_t blocksRead = 0;
+  uint64_t rowsRead = 0;
+};
+
+class SessionIndex
+{
+public:
+  struct Block
+  {
+    double min, max;
+    int64_t fromMs, toMs;
+  };
+
+  struct Day
+  {
+    int32_t day;
+    uint8_t metric;
+    DayStats stats;
+  };
+
+  struct Session
+  {
+    std::string path; // relative to the archive
+    uint32_t source;
+    int64_t startMs, endMs;
+    uint32_t blockRows;
+    uint64_t rows[METRIC_COUNT];
+    std::vector<Block> blocks[METRIC_COUNT];
+    std::vector<Day> days;
+  };
+
+  // Loads <archive>/index.psi if there is one. An index of another version,
+  // or a damaged one, is dropped: update() rebuilds it.
+  bool open(const std::string &archive, std::string &error);
+  // Indexes new session files and forgets deleted ones. Returns the number
+  // added; files that cannot be read are skipped, the last reason in error.
+  size_t update(std::string &error);
+  bool save(std::string &error) const;
+
+  size_t sessionCount() const { return sessions.size(); }
+  const Session &session(size_t i) const { return sessions[i]; }
+  std::string sessionPath(size_t i) const { return root + "/" + sessions[i].path; }
+
+  // Sessions with matching rows, by start time
+  bool query(const SessionQuery &q, std::vector<SessionHit> &hits, QueryStats &stats, std::string &error) const;
+  // The metric over [fromDay, toDay], from the rollups alone
+  DayStats rollup(uint32_t source, int metric, int32_t fromDay, int32_t toDay) const;
+  void dailyRollups(uint32_t source, int metric, int32_t fromDay, int32_t toDay,
+                    std::vector<std::pair<int32_t, DayStats>> &out) const;
+
+private:
+  bool indexFile(const std::string &path, Session &s, std::string &error) const;
+  void rebuild();
+
+  std::string root;
+  std::vector<Session> sessions; // by start time
+  int64_t longestMs = 0;
+  // source << 32 | day << 4 | metric
+  std::map<uint64_t, DayStats> days;
+};
+
+// Session files (.psf) under path, recursively, sorted
+void listSessionFiles(const std::string &path, std::vector<std::string> &files);
+
+#endif
@@ -0,0 +1,113 @@
+#include "column_store.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+namespace
+{
+  const char *typeName(ColumnType type)
+  {
+    switch (type)
+    {
+    case COL_U32:
+      return "u32";
+    case COL_I64:
+      return "i64";
+    case COL_F32:
+      return "f32";
+    }
+    return "?";
+  }
+
+  bool makeDirs(const std::string &path)
+  {
+    for (size_t i = 1; i <= path.size(); i++)
+    {
+      if (i < path.size() && path[i] != '/')
+        continue;
+      std::string part = path.substr(0, i);
+      if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST)
+        return false;
+    }
+    return true;
+  }
+}
+
+size_t columnTypeSize(ColumnType type)
+{
+  return type == COL_I64 ? 8 : 4;
+}
+
+ColumnTable::ColumnTable(const std::string &dir, const std::vector<ColumnSpec> &columns)
+    : dir(dir), columns(columns), files(columns.size(), nullptr), staged(columns.size())
+{
+}
+
+ColumnTable::~ColumnTable()
+{
+  flush();
+  for (FILE *f : files)
+  {
+    if (f)
+      fclose(f);
+  }
+}
+
+bool ColumnTable::open()
+{
+  if (!makeDirs(dir))
+  {
+    fprintf(stderr, "Cannot create %s: %s\n", dir.c_str(), strerror(errno));
+    return false;
+  }
+  FILE *schema = fopen((dir + "/schema").c_str(), "w");
+  if (!schema)
+    return false;
+  for (const ColumnSpec &c : columns)
+    fprintf(schema, "%s %s\n", c.name, typeName(c.type));
+  fclose(schema);
+
+  for (size_t i = 0; i < columns.size(); i++)
+  {
+    std::string path = dir + "/" + columns[i].name + ".col";
+    files[i] = fopen(path.c_str(), "ab");
+    if (!files[i])
+    {
+      fprintf(stderr, "Cannot open %s: %s\n", path.c_str(), strerror(errno));
+      return false;
+    }
+    staged[i].reserve(64 * 1024);
+  }
+  return true;
+}
+
+void ColumnTable::put(const void *v, size_t size)
+{
+  std::vector<uint8_t> &col = staged[nextColumn++];
+  const uint8_t *p = (const uint8_t *)v;
+  col.insert(col.end(), p, p + size);
+}
+
+void ColumnTable::endRow()
+{
+  nextColumn = 0;
+  stagedRows++;
+}
+
+void ColumnTable::flush()
+{
+  if (stagedRows == 0)
+    return;
+  for (size_t i = 0; i < columns.size(); i++)
+  {
+    if (files[i])
+    {
+      fwrite(staged[i].data(), 1, staged[i].size(), files[i]);
+      fflush(files[i]);
+    }
+    staged[i].clear();
+  }
+  rowsWritten += stagedRows;
+  stagedRows = 0;
+}
@@ -0,0 +1,57 @@
+#ifndef PPG_GATEWAY_COLUMN_STORE_H
+#define PPG_GATEWAY_COLUMN_STORE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+enum ColumnType : uint8_t
+{
+  COL_U32,
+  COL_I64,
+  COL_F32,
+};
+
+struct ColumnSpec
+{
+  const char *name;
+  ColumnType type;
+};
+
+// Append-only table stored as one little-endian file per column plus a
+// plain-text schema, so the output can be loaded with numpy.fromfile().
+// Rows are staged in memory and written a column at a time on flush().
+class ColumnTable
+{
+public:
+  ColumnTable(const std::string &dir, const std::vector<ColumnSpec> &columns);
+  ~ColumnTable();
+
+  bool open();
+  void flush();
+
+  // Values must be appended column by column, in schema order, once per row.
+  void putU32(uint32_t v) { put(&v, sizeof(v)); }
+  void putI64(int64_t v) { put(&v, sizeof(v)); }
+  void putF32(float v) { put(&v, sizeof(v)); }
+  void endRow();
+
+  uint64_t rows() const { return rowsWritten + stagedRows; }
+  size_t pendingRows() const { return stagedRows; }
+
+private:
+  void put(const void *v, size_t size);
+
+  std::string dir;
+  std::vector<ColumnSpec> columns;
+  std::vector<FILE *> files;
+  std::vector<std::vector<uint8_t>> staged;
+  size_t nextColumn = 0;
+  size_t stagedRows = 0;
+  uint64_t rowsWritten = 0;
+};
+
+size_t columnTypeSize(ColumnType type);
+
+#endif
@@ -0,0 +1,277 @@
+#include "device_decoder.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "telemetry.h"
+
+namespace
+{
+  // For frames that do not carry the period the device measured
+  const double NOMINAL_PERIOD_MS = 1000.0 / SAMPLE_RATE_HZ;
+
+  // Session file columns, in this order. Raw samples go in the WAVE
+  // columns; a frame row records where each frame's samples start.
+  enum SessionColumn
+  {
+    S_T_MS,
+    S_DEVICE_MS,
+    S_HEART_RATE,
+    S_AVG_HEART_RATE,
+    S_SBP,
+    S_DBP,
+    S_OXYGEN,
+    S_RESP_RATE,
+    S_HRV_T_MS,
+    S_SDNN,
+    S_RMSSD,
+    S_BEATS,
+    S_FRAME_T_MS,
+    S_FRAME_SAMPLE,
+    S_FRAME_ROW,
+    S_IR,
+    S_RED,
+  };
+
+  const struct
+  {
+    const char *name;
+    SessionColumnType type;
+  } SESSION_COLUMNS[] = {
+      {"t_ms", PSF_I64},       {"device_ms", PSF_U32},    {"heart_rate", PSF_F32}, {"avg_heart_rate", PSF_F32},
+      {"sbp", PSF_F32},        {"dbp", PSF_F32},          {"oxygen", PSF_F32},     {"resp_rate", PSF_F32},
+      {"hrv_t_ms", PSF_I64},   {"sdnn", PSF_F32},         {"rmssd", PSF_F32},      {"beats", PSF_U32},
+      {"frame_t_ms", PSF_I64}, {"frame_sample", PSF_U32}, {"frame_row", PSF_U32},  {"ir", PSF_WAVE},
+      {"red", PSF_WAVE},
+  };
+}
+
+GatewayStore::GatewayStore(const std::string &dir)
+    : sessionDir(dir + "/sessions"),
+      summary(dir + "/summary", {{"device", COL_U32},
+                                 {"t_ms", COL_I64},
+                                 {"device_ms", COL_U32},
+                                 {"heart_rate", COL_F32},
+                                 {"avg_heart_rate", COL_F32},
+                                 {"sbp", COL_F32},
+                                 {"dbp", COL_F32},
+                                 {"oxygen", COL_F32}}),
+      hrv(dir + "/hrv", {{"device", COL_U32},
+                         {"t_ms", COL_I64},
+                         {"sdnn", COL_F32},
+                         {"rmssd", COL_F32},
+                         {"beats", COL_U32}}),
+      raw(dir + "/raw", {{"device", COL_U32},
+                         {"t_ms", COL_I64},
+                         {"sample", COL_U32},
+                         {"ir", COL_U32},
+                         {"red", COL_U32}})
+{
+}
+
+bool GatewayStore::open()
+{
+  if (!summary.open() || !hrv.open() || !raw.open())
+    return false;
+  if (mkdir(sessionDir.c_str(), 0755) != 0 && errno != EEXIST)
+  {
+    fprintf(stderr, "Cannot create %s: %s\n", sessionDir.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void GatewayStore::flush()
+{
+  summary.flush();
+  hrv.flush();
+  raw.flush();
+}
+
+void OffsetTracker::observe(int64_t gatewayMs, int64_t deviceMs)
+{
+  window[next] = gatewayMs - deviceMs;
+  next = (next + 1) % OFFSET_WINDOW;
+  if (count < OFFSET_WINDOW)
+    count++;
+  offset = window[0];
+  for (int i = 1; i < count; i++)
+  {
+    if (window[i] < offset)
+      offset = window[i];
+  }
+}
+
+bool jsonNumber(const char *json, size_t len, const char *key, double &out)
+{
+  size_t keyLen = strlen(key);
+  const char *end = json + len;
+  for (const char *p = json; p + keyLen + 3 <= end; p++)
+  {
+    if (p[0] != '"' || memcmp(p + 1, key, keyLen) != 0 || p[keyLen + 1] != '"' || p[keyLen + 2] != ':')
+      continue;
+    const char *v = p + keyLen + 3;
+    char buf[32];
+    size_t n = 0;
+    while (v < end && n < sizeof(buf) - 1 && *v && (strchr("+-.eE", *v) || (*v >= '0' && *v <= '9')))
+      buf[n++] = *v++;
+    if (n == 0)
+      return false;
+    buf[n] = '\0';
+    out = strtod(buf, nullptr);
+    return true;
+  }
+  return false;
+}
+
+DeviceDecoder::DeviceDecoder(uint32_t deviceId) : deviceId(deviceId)
+{
+  for (const auto &c : SESSION_COLUMNS)
+    session.addColumn(c.name, c.type);
+}
+
+void DeviceDecoder::startSession(int64_t t)
+{
+  if (sessionStart < 0)
+    sessionStart = t;
+}
+
+void DeviceDecoder::endSession(const GatewayStore &store, IngestStats &stats)
+{
+  if (sessionStart < 0)
+    return;
+  char name[48];
+  snprintf(name, sizeof(name), "/%08x-%lld.psf", deviceId, (long long)sessionStart);
+  std::string error;
+  if (session.write((store.sessionDir + name).c_str(), deviceId, sessionStart, error))
+    stats.sessionFiles++;
+  else
+    fprintf(stderr, "Cannot write session: %s\n", error.c_str());
+  session.clear();
+  sessionStart = -1;
+}
+
+void DeviceDecoder::handle(const uint8_t *payload, size_t len, int64_t recvMs, GatewayStore &store, IngestStats &stats)
+{
+  lastSeen = recvMs;
+  if (len > 0 && (payload[0] == RAW_FRAME_MAGIC || payload[0] == RAW_Z_FRAME_MAGIC))
+    handleRaw(payload, len, recvMs, store, stats);
+  else if (len > 0 && payload[0] == '{')
+    handleJson((const char *)payload, len, recvMs, store, stats);
+  else
+    stats.decodeErrors++;
+}
+
+void DeviceDecoder::handleJson(const char *json, size_t len, int64_t recvMs, GatewayStore &store, IngestStats &stats)
+{
+  double deviceMs;
+  if (!jsonNumber(json, len, "timestamp", deviceMs))
+  {
+    // Session summaries and subscription acks carry no readings; a
+    // summary is sent at STOP and ends the session.
+    double hrv;
+    if (jsonNumber(json, len, "hrv", hrv))
+      endSession(store, stats);
+    return;
+  }
+  millisClock.observe(recvMs, (int64_t)deviceMs);
+  // Devices synchronised by a host (see clock_sync.h) report host epoch
+  // time directly; otherwise fall back to the gateway's own estimate.
+  double ts;
+  int64_t t = jsonNumber(json, len, "ts", ts) ? (int64_t)ts : millisClock.toGateway((int64_t)deviceMs);
+
+  double sdnn, rmssd, beats;
+  if (jsonNumber(json, len, "sdnn", sdnn) && jsonNumber(json, len, "rmssd", rmssd) &&
+      jsonNumber(json, len, "beats", beats))
+  {
+    store.hrv.putU32(deviceId);
+    store.hrv.putI64(t);
+    store.hrv.putF32((float)sdnn);
+    store.hrv.putF32((float)rmssd);
+    store.hrv.putU32((uint32_t)beats);
+    store.hrv.endRow();
+    startSession(t);
+    session.putI64(S_HRV_T_MS, t);
+    session.putF32(S_SDNN, (float)sdnn);
+    session.putF32(S_RMSSD, (float)rmssd);
+    session.putU32(S_BEATS, (uint32_t)beats);
+    stats.hrvWindows++;
+    return;
+  }
+
+  double hr = 0, avgHr = 0, sbp = 0, dbp = 0, oxygen = 0, respRate = 0;
+  if (!jsonNumber(json, len, "heartRate", hr))
+  {
+    stats.decodeErrors++;
+    return;
+  }
+  jsonNumber(json, len, "avgHeartRate", avgHr);
+  jsonNumber(json, len, "sbp", sbp);
+  jsonNumber(json, len, "dbp", dbp);
+  jsonNumber(json, len, "oxygen", oxygen);
+  jsonNumber(json, len, "respRate", respRate);
+  store.summary.putU32(deviceId);
+  store.summary.putI64(t);
+  store.summary.putU32((uint32_t)deviceMs);
+  store.summary.putF32((float)hr);
+  store.summary.putF32((float)avgHr);
+  store.summary.putF32((float)sbp);
+  store.summary.putF32((float)dbp);
+  store.summary.putF32((float)oxygen);
+  store.summary.endRow();
+  startSession(t);
+  session.putI64(S_T_MS, t);
+  session.putU32(S_DEVICE_MS, (uint32_t)deviceMs);
+  session.putF32(S_HEART_RATE, (float)hr);
+  session.putF32(S_AVG_HEART_RATE, (float)avgHr);
+  session.putF32(S_SBP, (float)sbp);
+  session.putF32(S_DBP, (float)dbp);
+  session.putF32(S_OXYGEN, (float)oxygen);
+  session.putF32(S_RESP_RATE, (float)respRate);
+  stats.summaries++;
+}
+
+void DeviceDecoder::handleRaw(const uint8_t *payload, size_t len, int64_t recvMs, GatewayStore &store, IngestStats &stats)
+{
+  RawFrame frame;
+  if (!decodeRawFrame(payload, len, frame))
+  {
+    stats.decodeErrors++;
+    return;
+  }
+  FrameSeq &seq = payload[0] == RAW_Z_FRAME_MAGIC ? rawZSeq : rawSeq;
+  if (seq.have && frame.seq != (uint16_t)(seq.last + 1))
+    stats.frameGaps++;
+  seq.have = true;
+  seq.last = frame.seq;
+
+  // The last sample of the frame was taken just before it was sent.
+  double periodMs = frame.samplePeriodNs != 0 ? frame.samplePeriodNs / 1e6 : NOMINAL_PERIOD_MS;
+  int64_t lastSampleMs = llround((frame.firstSample + frame.count - 1) * periodMs);
+  sampleClock.observe(recvMs, lastSampleMs);
+  int64_t firstMs =
+      frame.timestampMs != 0 ? frame.timestampMs : sampleClock.toGateway(llround(frame.firstSample * periodMs));
+  startSession(firstMs);
+  session.putI64(S_FRAME_T_MS, firstMs);
+  session.putU32(S_FRAME_SAMPLE, frame.firstSample);
+  session.putU32(S_FRAME_ROW, (uint32_t)session.rows(S_IR));
+  for (uint8_t i = 0; i < frame.count; i++)
+  {
+    uint32_t sample = frame.firstSample + i;
+    store.raw.putU32(deviceId);
+    int64_t t = firstMs + llround(i * periodMs);
+    store.raw.putI64(t);
+    store.raw.putU32(sample);
+    store.raw.putU32(frame.ir[i]);
+    store.raw.putU32(frame.red[i]);
+    store.raw.endRow();
+    session.putSample(S_IR, frame.ir[i]);
+    session.putSample(S_RED, frame.red[i]);
+  }
+  stats.rawFrames++;
+  stats.rawSamples += frame.count;
+}
@@ -0,0 +1,91 @@
+#ifndef PPG_GATEWAY_DEVICE_DECODER_H
+#define PPG_GATEWAY_DEVICE_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "column_store.h"
+#include "session_file.h"
+
+struct IngestStats
+{
+  uint64_t datagrams = 0;
+  uint64_t summaries = 0;
+  uint64_t hrvWindows = 0;
+  uint64_t rawFrames = 0;
+  uint64_t rawSamples = 0;
+  uint64_t frameGaps = 0;
+  uint64_t decodeErrors = 0;
+  uint64_t sessionFiles = 0;
+};
+
+// Output tables shared by all devices. Every row carries the device id and
+// a gateway-clock timestamp so sessions from different sensors line up.
+struct GatewayStore
+{
+  explicit GatewayStore(const std::string &dir);
+  bool open();
+  void flush();
+
+  std::string sessionDir;
+  ColumnTable summary;
+  ColumnTable hrv;
+  ColumnTable raw;
+};
+
+// Maps a device clock onto the gateway clock. The offset is the minimum of
+// (gateway - device) over the last OFFSET_WINDOW observations: the datagram
+// with the least transport delay is the best estimate of the true offset.
+class OffsetTracker
+{
+public:
+  void observe(int64_t gatewayMs, int64_t deviceMs);
+  bool valid() const { return count > 0; }
+  int64_t toGateway(int64_t deviceMs) const { return deviceMs + offset; }
+
+private:
+  static const int OFFSET_WINDOW = 64;
+  int64_t window[OFFSET_WINDOW];
+  int next = 0;
+  int count = 0;
+  int64_t offset = 0;
+};
+
+// Besides the shared tables, each device's session is kept in memory and
+// written to <store>/sessions/<device>-<start ms>.psf when the device sends
+// its STOP summary, goes idle or the gateway shuts down.
+class DeviceDecoder
+{
+public:
+  explicit DeviceDecoder(uint32_t deviceId);
+
+  void handle(const uint8_t *payload, size_t len, int64_t recvMs, GatewayStore &store, IngestStats &stats);
+  int64_t lastSeenMs() const { return lastSeen; }
+  // Writes the session file, if there is a session, and starts afresh
+  void endSession(const GatewayStore &store, IngestStats &stats);
+
+private:
+  void handleJson(const char *json, size_t len, int64_t recvMs, GatewayStore &store, IngestStats &stats);
+  void handleRaw(const uint8_t *payload, size_t len, int64_t recvMs, GatewayStore &store, IngestStats &stats);
+
+  void startSession(int64_t t);
+
+  uint32_t deviceId;
+  int64_t lastSeen = 0;
+  SessionFileWriter session;
+  int64_t sessionStart = -1;
+  OffsetTracker millisClock;
+  OffsetTracker sampleClock;
+  // Raw and rawz frames are numbered separately on the device
+  struct FrameSeq
+  {
+    bool have = false;
+    uint16_t last = 0;
+  };
+  FrameSeq rawSeq, rawZSeq;
+};
+
+// Extracts a numeric field from a flat JSON object without allocating.
+bool jsonNumber(const char *json, size_t len, const char *key, double &out);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef PPG_GATEWAY_ENVELOPE_H
+#define PPG_GATEWAY_ENVELOPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Every BLE notification forwarded to the gateway (by the BLE bridge or the
+// load generator) is wrapped in one UDP datagram:
+//   magic "PG"(2) version(1) reserved(1) deviceId(4) sentNs(8) payload...
+// sentNs is CLOCK_REALTIME at the sender, used for ingest latency stats.
+const uint8_t ENVELOPE_VERSION = 1;
+const size_t ENVELOPE_HEADER_SIZE = 16;
+const size_t ENVELOPE_MAX_SIZE = 1024;
+
+struct Envelope
+{
+  uint32_t deviceId;
+  uint64_t sentNs;
+  const uint8_t *payload;
+  size_t payloadLen;
+};
+
+inline size_t encodeEnvelope(uint32_t deviceId, uint64_t sentNs, const uint8_t *payload, size_t len,
+                             uint8_t *out, size_t cap)
+{
+  if (ENVELOPE_HEADER_SIZE + len > cap)
+    return 0;
+  out[0] = 'P';
+  out[1] = 'G';
+  out[2] = ENVELOPE_VERSION;
+  out[3] = 0;
+  for (int i = 0; i < 4; i++)
+    out[4 + i] = (deviceId >> (8 * i)) & 0xFF;
+  for (int i = 0; i < 8; i++)
+    out[8 + i] = (sentNs >> (8 * i)) & 0xFF;
+  memcpy(out + ENVELOPE_HEADER_SIZE, payload, len);
+  return ENVELOPE_HEADER_SIZE + len;
+}
+
+inline bool decodeEnvelope(const uint8_t *in, size_t len, Envelope &env)
+{
+  if (len < ENVELOPE_HEADER_SIZE || in[0] != 'P' || in[1] != 'G' || in[2] != ENVELOPE_VERSION)
+    return false;
+  env.deviceId = 0;
+  for (int i = 0; i < 4; i++)
+    env.deviceId |= (uint32_t)in[4 + i] << (8 * i);
+  env.sentNs = 0;
+  for (int i = 0; i < 8; i++)
+    env.sentNs |= (uint64_t)in[8 + i] << (8 * i);
+  env.payload = in + ENVELOPE_HEADER_SIZE;
+  env.payloadLen = len - ENVELOPE_HEADER_SIZE;
+  return true;
+}
+
+#endif
@@ -0,0 +1,291 @@
+// Gateway daemon: ingests telemetry from many PPG sensors at once.
+//
+// BLE notifications reach the gateway as UDP datagrams (see envelope.h),
+// either from ble_gateway_bridge.py talking to real devices or from the
+// gateway_loadgen simulator. A single epoll loop decodes them per device, maps
+// device clocks onto the gateway clock and appends rows to a column store,
+// and writes each device's session to a session file when it ends.
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "device_decoder.h"
+#include "envelope.h"
+
+namespace
+{
+  const int RECV_BATCH = 64;
+  const int64_t DEVICE_IDLE_MS = 10000;
+
+  struct Options
+  {
+    int port = 9750;
+    std::string storeDir = "gateway_store";
+    int statsIntervalS = 5;
+  };
+
+  int64_t realtimeNs()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+
+  void usage(const char *argv0)
+  {
+    fprintf(stderr, "usage: %s [--port N] [--store DIR] [--stats SECONDS]\n", argv0);
+  }
+
+  bool parseArgs(int argc, char **argv, Options &opts)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (i + 1 >= argc)
+        return false;
+      if (arg == "--port")
+        opts.port = atoi(argv[++i]);
+      else if (arg == "--store")
+        opts.storeDir = argv[++i];
+      else if (arg == "--stats")
+        opts.statsIntervalS = std::max(1, atoi(argv[++i]));
+      else
+        return false;
+    }
+    return true;
+  }
+
+  int openSocket(int port)
+  {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+      return -1;
+    // 30 devices streaming raw frames is ~400 datagrams/s; a deep kernel
+    // buffer absorbs store flushes without drops.
+    int rcvbuf = 8 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  class Gateway
+  {
+  public:
+    explicit Gateway(const Options &opts) : opts(opts), store(opts.storeDir) {}
+
+    int run();
+
+  private:
+    void drainSocket();
+    void report(int64_t nowNs);
+    void endIdleSessions(int64_t nowMs);
+
+    Options opts;
+    GatewayStore store;
+    int sock = -1;
+    std::unordered_map<uint32_t, DeviceDecoder> devices;
+    IngestStats stats;
+    IngestStats lastStats;
+    int64_t lastReportNs = 0;
+    std::vector<uint32_t> latenciesUs;
+  };
+
+  void Gateway::drainSocket()
+  {
+    static uint8_t buffers[RECV_BATCH][ENVELOPE_MAX_SIZE];
+    mmsghdr msgs[RECV_BATCH];
+    iovec iovs[RECV_BATCH];
+    for (int i = 0; i < RECV_BATCH; i++)
+    {
+      iovs[i] = {buffers[i], ENVELOPE_MAX_SIZE};
+      msgs[i] = {};
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    for (;;)
+    {
+      int n = recvmmsg(sock, msgs, RECV_BATCH, MSG_DONTWAIT, nullptr);
+      if (n <= 0)
+        return;
+      int64_t nowNs = realtimeNs();
+      int64_t nowMs = nowNs / 1000000;
+      for (int i = 0; i < n; i++)
+      {
+        stats.datagrams++;
+        Envelope env;
+        if (!decodeEnvelope(buffers[i], msgs[i].msg_len, env))
+        {
+          stats.decodeErrors++;
+          continue;
+        }
+        if (nowNs > (int64_t)env.sentNs)
+          latenciesUs.push_back((uint32_t)std::min<int64_t>((nowNs - env.sentNs) / 1000, UINT32_MAX));
+        auto it = devices.find(env.deviceId);
+        if (it == devices.end())
+        {
+          it = devices.emplace(env.deviceId, DeviceDecoder(env.deviceId)).first;
+          printf("Device %08x joined (%zu active)\n", env.deviceId, devices.size());
+        }
+        it->second.handle(env.payload, env.payloadLen, nowMs, store, stats);
+      }
+    }
+  }
+
+  void Gateway::endIdleSessions(int64_t nowMs)
+  {
+    for (auto &d : devices)
+    {
+      if (nowMs - d.second.lastSeenMs() >= DEVICE_IDLE_MS)
+        d.second.endSession(store, stats);
+    }
+  }
+
+  uint32_t percentile(std::vector<uint32_t> &v, double p)
+  {
+    if (v.empty())
+      return 0;
+    size_t k = std::min(v.size() - 1, (size_t)(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+  }
+
+  void Gateway::report(int64_t nowNs)
+  {
+    double seconds = (nowNs - lastReportNs) / 1e9;
+    lastReportNs = nowNs;
+    int64_t nowMs = nowNs / 1000000;
+    size_t active = 0;
+    for (const auto &d : devices)
+    {
+      if (nowMs - d.second.lastSeenMs() < DEVICE_IDLE_MS)
+        active++;
+    }
+    uint32_t maxUs = latenciesUs.empty() ? 0 : *std::max_element(latenciesUs.begin(), latenciesUs.end());
+    printf("devices=%zu msgs/s=%.0f summaries/s=%.1f samples/s=%.0f latency_us p50=%u p99=%u max=%u "
+           "gaps=%llu errors=%llu rows=%llu sessions=%llu\n",
+           active,
+           (stats.datagrams - lastStats.datagrams) / seconds,
+           (stats.summaries - lastStats.summaries) / seconds,
+           (stats.rawSamples - lastStats.rawSamples) / seconds,
+           percentile(latenciesUs, 0.5), percentile(latenciesUs, 0.99), maxUs,
+           (unsigned long long)stats.frameGaps, (unsigned long long)stats.decodeErrors,
+           (unsigned long long)(store.summary.rows() + store.hrv.rows() + store.raw.rows()),
+           (unsigned long long)stats.sessionFiles);
+    fflush(stdout);
+    latenciesUs.clear();
+    lastStats = stats;
+  }
+
+  int Gateway::run()
+  {
+    if (!store.open())
+      return 1;
+    sock = openSocket(opts.port);
+    if (sock < 0)
+    {
+      fprintf(stderr, "Cannot bind UDP port %d: %s\n", opts.port, strerror(errno));
+      return 1;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    int sigFd = signalfd(-1, &mask, SFD_NONBLOCK);
+
+    // Store flushes and stats share one 1 s tick.
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    itimerspec tick = {{1, 0}, {1, 0}};
+    timerfd_settime(timerFd, 0, &tick, nullptr);
+
+    int ep = epoll_create1(0);
+    for (int fd : {sock, sigFd, timerFd})
+    {
+      epoll_event ev = {};
+      ev.events = EPOLLIN;
+      ev.data.fd = fd;
+      epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    }
+    printf("Gateway listening on UDP %d, writing to %s\n", opts.port, opts.storeDir.c_str());
+    fflush(stdout);
+
+    lastReportNs = realtimeNs();
+    int ticks = 0;
+    bool running = true;
+    while (running)
+    {
+      epoll_event events[4];
+      int n = epoll_wait(ep, events, 4, -1);
+      for (int i = 0; i < n; i++)
+      {
+        int fd = events[i].data.fd;
+        if (fd == sock)
+        {
+          drainSocket();
+        }
+        else if (fd == timerFd)
+        {
+          uint64_t expirations;
+          if (read(timerFd, &expirations, sizeof(expirations)) < 0)
+            continue;
+          store.flush();
+          endIdleSessions(realtimeNs() / 1000000);
+          if (++ticks % opts.statsIntervalS == 0)
+            report(realtimeNs());
+        }
+        else if (fd == sigFd)
+        {
+          running = false;
+        }
+      }
+    }
+
+    drainSocket();
+    store.flush();
+    for (auto &d : devices)
+      d.second.endSession(store, stats);
+    report(realtimeNs());
+    close(ep);
+    close(timerFd);
+    close(sigFd);
+    close(sock);
+    return 0;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options opts;
+  if (!parseArgs(argc, argv, opts))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+  Gateway gateway(opts);
+  return gateway.run();
+}
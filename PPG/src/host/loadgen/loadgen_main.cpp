@@ -0,0 +1,225 @@
+// Load generator for the gateway: simulates many PPG sensors streaming the
+// same summary JSON and raw frames the firmware sends over BLE, wrapped in
+// gateway envelopes, so ingest throughput and latency can be measured
+// without radios.
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "../gateway/envelope.h"
+#include "telemetry.h"
+
+namespace
+{
+  struct Options
+  {
+    std::string host = "127.0.0.1";
+    int port = 9750;
+    int devices = 25;
+    int seconds = 30;
+    double speed = 1.0; // simulated seconds per wall-clock second
+    bool raw = true;
+    bool compressed = false; // rawz frames, as the bridge subscribes to
+  };
+
+  struct SimDevice
+  {
+    uint32_t id;
+    double heartRate;
+    double phase;
+    uint32_t sample;
+    uint16_t seq;
+    RawFrame frame;
+  };
+
+  int64_t realtimeNs()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+
+  bool parseArgs(int argc, char **argv, Options &opts)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "--no-raw")
+      {
+        opts.raw = false;
+        continue;
+      }
+      if (arg == "--rawz")
+      {
+        opts.compressed = true;
+        continue;
+      }
+      if (i + 1 >= argc)
+        return false;
+      if (arg == "--host")
+        opts.host = argv[++i];
+      else if (arg == "--port")
+        opts.port = atoi(argv[++i]);
+      else if (arg == "--devices")
+        opts.devices = atoi(argv[++i]);
+      else if (arg == "--seconds")
+        opts.seconds = atoi(argv[++i]);
+      else if (arg == "--speed")
+        opts.speed = atof(argv[++i]);
+      else
+        return false;
+    }
+    return opts.devices > 0 && opts.speed > 0;
+  }
+
+  // Crude PPG shape: a systolic peak plus a smaller dicrotic wave on an
+  // 18-bit DC level, enough for the gateway to store realistic magnitudes.
+  uint32_t ppgValue(double phase, double dc, double ac)
+  {
+    double x = phase - floor(phase);
+    double pulse = exp(-pow((x - 0.2) / 0.07, 2)) + 0.35 * exp(-pow((x - 0.45) / 0.1, 2));
+    return (uint32_t)(dc + ac * pulse);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options opts;
+  if (!parseArgs(argc, argv, opts))
+  {
+    fprintf(stderr, "usage: %s [--host IP] [--port N] [--devices N] [--seconds N] [--speed X] [--no-raw] [--rawz]\n", argv[0]);
+    return 2;
+  }
+
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(opts.port);
+  if (sock < 0 || inet_pton(AF_INET, opts.host.c_str(), &addr.sin_addr) != 1)
+  {
+    fprintf(stderr, "Invalid gateway address %s\n", opts.host.c_str());
+    return 1;
+  }
+  int sndbuf = 4 * 1024 * 1024;
+  setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+  std::vector<SimDevice> devices(opts.devices);
+  srand(42);
+  for (int i = 0; i < opts.devices; i++)
+  {
+    devices[i] = {};
+    devices[i].id = 0x1000 + i;
+    devices[i].heartRate = 55 + rand() % 60;
+    devices[i].phase = (double)rand() / RAND_MAX;
+    devices[i].frame.samplePeriodNs = 1000000000u / SAMPLE_RATE_HZ;
+  }
+
+  // One datagram slot per device per tick is enough: a tick is one sample,
+  // and a device emits at most one raw frame or summary per sample.
+  std::vector<std::vector<uint8_t>> buffers(opts.devices * 2, std::vector<uint8_t>(ENVELOPE_MAX_SIZE));
+  std::vector<mmsghdr> msgs(opts.devices * 2);
+  std::vector<iovec> iovs(opts.devices * 2);
+
+  const uint32_t samplesPerSummary = SAMPLE_RATE_HZ;
+  const uint64_t totalTicks = (uint64_t)opts.seconds * SAMPLE_RATE_HZ;
+  const int64_t tickNs = (int64_t)(1e9 / SAMPLE_RATE_HZ / opts.speed);
+  uint64_t sent = 0, bytes = 0, failed = 0;
+
+  timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  int64_t startNs = realtimeNs();
+  for (uint64_t tick = 0; tick < totalTicks; tick++)
+  {
+    int batch = 0;
+    for (SimDevice &d : devices)
+    {
+      d.phase += d.heartRate / 60.0 / SAMPLE_RATE_HZ;
+      uint32_t ir = ppgValue(d.phase, 120000, 3000);
+      uint32_t red = ppgValue(d.phase, 90000, 1500);
+      uint32_t deviceMs = d.sample * (1000 / SAMPLE_RATE_HZ);
+
+      uint8_t payload[256];
+      size_t len = 0;
+      if (opts.raw)
+      {
+        if (d.frame.count == 0)
+          d.frame.firstSample = d.sample;
+        d.frame.ir[d.frame.count] = ir;
+        d.frame.red[d.frame.count] = red;
+        if (++d.frame.count == (opts.compressed ? RAW_Z_SAMPLES_PER_FRAME : RAW_SAMPLES_PER_FRAME))
+        {
+          d.frame.seq = d.seq++;
+          len = opts.compressed ? encodeCompressedRawFrame(d.frame, payload, sizeof(payload))
+                                : encodeRawFrame(d.frame, payload, sizeof(payload));
+          d.frame.count = 0;
+        }
+      }
+      if (len > 0)
+      {
+        size_t n = encodeEnvelope(d.id, realtimeNs(), payload, len, buffers[batch].data(), ENVELOPE_MAX_SIZE);
+        iovs[batch] = {buffers[batch].data(), n};
+        batch++;
+      }
+      if (d.sample % samplesPerSummary == 0)
+      {
+        double hr = d.heartRate + 2 * sin(d.sample / 1000.0);
+        len = snprintf((char *)payload, sizeof(payload),
+                       "{\"heartRate\":%.1f,\"avgHeartRate\":%.1f,\"sbp\":%.1f,\"dbp\":%.1f,"
+                       "\"oxygen\":%d,\"timestamp\":%u}",
+                       hr, d.heartRate, 118.0 + hr * 0.15, 76.0 + hr * 0.08, 97, deviceMs);
+        size_t n = encodeEnvelope(d.id, realtimeNs(), payload, len, buffers[batch].data(), ENVELOPE_MAX_SIZE);
+        iovs[batch] = {buffers[batch].data(), n};
+        batch++;
+      }
+      d.sample++;
+    }
+
+    for (int i = 0; i < batch; i++)
+    {
+      msgs[i] = {};
+      msgs[i].msg_hdr.msg_name = &addr;
+      msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int done = 0;
+    while (done < batch)
+    {
+      int n = sendmmsg(sock, msgs.data() + done, batch - done, 0);
+      if (n <= 0)
+      {
+        failed += batch - done;
+        break;
+      }
+      for (int i = done; i < done + n; i++)
+        bytes += msgs[i].msg_len;
+      done += n;
+    }
+    sent += done;
+
+    next.tv_nsec += tickNs;
+    while (next.tv_nsec >= 1000000000L)
+    {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+  }
+
+  double elapsed = (realtimeNs() - startNs) / 1e9;
+  printf("devices=%d simulated_s=%d wall_s=%.2f datagrams=%llu (%.0f/s) bytes=%llu (%.1f KB/s) failed=%llu\n",
+         opts.devices, opts.seconds, elapsed, (unsigned long long)sent, sent / elapsed,
+         (unsigned long long)bytes, bytes / elapsed / 1024, (unsigned long long)failed);
+  close(sock);
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+// Session scan: reads a season of session files (see session_file.h) and
+// summarises one column across all of them, to size up the data or pull
+// the sessions where a value crossed a threshold.
+//
+// Files are mapped rather than read, so a fixed-width column is scanned in
+// place; blocks whose min/max rule out the --above/--below predicate are
+// skipped without touching their rows. A WAVE column (ir, red) is decoded
+// a block at a time. Directories are searched for .psf files recursively.
+//
+//   .pio/build/session_scan/program gateway_store/sessions --column heart_rate --above 180
+//   .pio/build/session_scan/program season/ --column ir --list
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "session_file.h"
+#include "session_index.h"
+
+namespace
+{
+  const size_t WAVE_CHUNK = 4096;
+
+  struct Options
+  {
+    std::vector<std::string> paths;
+    std::string column = "heart_rate";
+    double above = -INFINITY;
+    double below = INFINITY;
+    bool list = false;
+  };
+
+  struct Totals
+  {
+    size_t files = 0;
+    size_t bad = 0;
+    uint64_t bytes = 0;
+    uint64_t rows = 0;
+    uint64_t scanned = 0;
+    uint64_t blocks = 0;
+    uint64_t skipped = 0;
+    uint64_t matches = 0;
+    double sum = 0;
+    double min = INFINITY;
+    double max = -INFINITY;
+  };
+
+  bool parseArgs(int argc, char **argv, Options &opts)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "--list")
+      {
+        opts.list = true;
+        continue;
+      }
+      if (arg.compare(0, 2, "--") != 0)
+      {
+        opts.paths.push_back(arg);
+        continue;
+      }
+      if (i + 1 >= argc)
+        return false;
+      if (arg == "--column")
+        opts.column = argv[++i];
+      else if (arg == "--above")
+        opts.above = atof(argv[++i]);
+      else if (arg == "--below")
+        opts.below = atof(argv[++i]);
+      else
+        return false;
+    }
+    return !opts.paths.empty();
+  }
+
+  double monotonicS()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+  template <typename T> void scanValues(const T *values, uint64_t begin, uint64_t end, const Options &opts, Totals &t)
+  {
+    uint64_t matches = 0;
+    double sum = 0, lo = t.min, hi = t.max;
+    for (uint64_t i = begin; i < end; i++)
+    {
+      double v = values[i];
+      bool match = v > opts.above && v < opts.below;
+      matches += match;
+      sum += match ? v : 0;
+      lo = match ? std::min(lo, v) : lo;
+      hi = match ? std::max(hi, v) : hi;
+    }
+    t.matches += matches;
+    t.sum += sum;
+    t.min = lo;
+    t.max = hi;
+    t.scanned += end - begin;
+  }
+
+  // Returns the matching rows
+  uint64_t scanColumn(const SessionFile::Column &c, uint32_t blockRows, const Options &opts, Totals &t)
+  {
+    uint64_t before = t.matches;
+    std::vector<uint32_t> samples;
+    for (uint64_t b = 0; b < c.blocks; b++)
+    {
+      uint64_t begin = b * blockRows, end = std::min(c.rows, begin + blockRows);
+      t.blocks++;
+      if (SessionFile::blockMax(c, b) <= opts.above || SessionFile::blockMin(c, b) >= opts.below)
+      {
+        t.skipped++;
+        continue;
+      }
+      if (const float *v = SessionFile::f32(c))
+        scanValues(v, begin, end, opts, t);
+      else if (const uint32_t *v = SessionFile::u32(c))
+        scanValues(v, begin, end, opts, t);
+      else if (const int64_t *v = SessionFile::i64(c))
+        scanValues(v, begin, end, opts, t);
+      for (uint64_t at = begin; c.type == PSF_WAVE && at < end; at += WAVE_CHUNK)
+      {
+        size_t n = (size_t)std::min<uint64_t>(WAVE_CHUNK, end - at);
+        samples.resize(n);
+        if (!SessionFile::readWave(c, at, n, samples.data()))
+        {
+          t.bad++;
+          break;
+        }
+        scanValues(samples.data(), 0, n, opts, t);
+      }
+    }
+    return t.matches - before;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options opts;
+  if (!parseArgs(argc, argv, opts))
+  {
+    fprintf(stderr, "usage: %s PATH... [--column NAME] [--above X] [--below X] [--list]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<std::string> files;
+  for (const std::string &p : opts.paths)
+    listSessionFiles(p, files);
+
+  Totals t;
+  double start = monotonicS();
+  for (const std::string &path : files)
+  {
+    SessionFile file;
+    std::string error;
+    if (!file.open(path.c_str(), error))
+    {
+      fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+      t.bad++;
+      continue;
+    }
+    t.files++;
+    t.bytes += file.mappedBytes();
+    const SessionFile::Column *c = file.find(opts.column.c_str());
+    if (!c)
+      continue;
+    t.rows += c->rows;
+    uint64_t matches = scanColumn(*c, file.blockRows(), opts, t);
+    if (opts.list && matches > 0)
+      printf("%s device=%08x start_ms=%lld rows=%llu matches=%llu\n", path.c_str(), file.source(),
+             (long long)file.startMs(), (unsigned long long)c->rows, (unsigned long long)matches);
+  }
+  double elapsed = std::max(monotonicS() - start, 1e-9);
+
+  printf("%zu files (%zu unreadable), %.1f MB mapped in %.3f s: %.0f MB/s\n", t.files, t.bad, t.bytes / 1e6,
+         elapsed, t.bytes / 1e6 / elapsed);
+  printf("%s: %llu rows, %llu scanned (%.0f rows/s), %llu of %llu blocks skipped\n", opts.column.c_str(),
+         (unsigned long long)t.rows, (unsigned long long)t.scanned, t.scanned / elapsed,
+         (unsigned long long)t.skipped, (unsigned long long)t.blocks);
+  if (t.matches > 0)
+    printf("  matches=%llu mean=%.3f min=%.3f max=%.3f\n", (unsigned long long)t.matches, t.sum / t.matches, t.min,
+           t.max);
+  else
+    printf("  matches=0\n");
+  return t.bad > 0 ? 1 : 0;
+}
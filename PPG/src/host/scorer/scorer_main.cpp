@@ -0,0 +1,263 @@
+// Batch stress scorer: re-scores a whole history of windows with the model
+// exported by src/mlmodel_export.py, across threads (see stress_model.h).
+//
+// Windows are read from a directory of little-endian float columns, one
+// .col file each: hrv (ms), heart_rate, sbp, dbp, oxygen and resp_rate.
+// --sessions builds that directory first from the gateway's session files
+// (a .psf file, or a directory searched recursively), one window per HRV
+// window (window_export.h); without --model it only exports. The scores
+// go to stress.col, and with --members each member's to stress_<name>.col,
+// with a schema file, in --out (default: <windows>/scores).
+// --synthetic N scores N generated windows instead, to measure throughput.
+//
+//   .pio/build/scorer/program --sessions gateway_store/sessions --windows history --model stress.psm
+//   .pio/build/scorer/program --model stress.psm --windows history
+//   .pio/build/scorer/program --model stress.psm --synthetic 2000000 --threads 8
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "session_index.h"
+#include "stress_model.h"
+#include "window_export.h"
+
+namespace
+{
+  struct Options
+  {
+    std::string model;
+    std::string windows;
+    std::string sessions;
+    std::string out;
+    size_t synthetic = 0;
+    unsigned threads = 0;
+    bool members = false;
+    unsigned seed = 1;
+  };
+
+  bool parseArgs(int argc, char **argv, Options &opts)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "--members")
+      {
+        opts.members = true;
+        continue;
+      }
+      if (i + 1 >= argc)
+        return false;
+      if (arg == "--model")
+        opts.model = argv[++i];
+      else if (arg == "--windows")
+        opts.windows = argv[++i];
+      else if (arg == "--sessions")
+        opts.sessions = argv[++i];
+      else if (arg == "--out")
+        opts.out = argv[++i];
+      else if (arg == "--synthetic")
+        opts.synthetic = strtoull(argv[++i], nullptr, 10);
+      else if (arg == "--threads")
+        opts.threads = atoi(argv[++i]);
+      else if (arg == "--seed")
+        opts.seed = atoi(argv[++i]);
+      else
+        return false;
+    }
+    if (!opts.sessions.empty())
+      return opts.synthetic == 0 && !opts.windows.empty();
+    return !opts.model.empty() && (opts.synthetic > 0) != !opts.windows.empty();
+  }
+
+  double monotonicS()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+  bool readColumn(const std::string &path, std::vector<float> &out)
+  {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+      return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    out.resize(size / sizeof(float));
+    bool ok = fread(out.data(), sizeof(float), out.size(), f) == out.size();
+    fclose(f);
+    return ok;
+  }
+
+  bool writeColumn(const std::string &path, const std::vector<float> &values)
+  {
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+      return false;
+    bool ok = fwrite(values.data(), sizeof(float), values.size(), f) == values.size();
+    return fclose(f) == 0 && ok;
+  }
+
+  // Spread over the ranges the training data covers
+  void synthesise(size_t rows, unsigned seed, std::vector<float> *inputs)
+  {
+    static const float LOW[StressModel::INPUT_COUNT] = {15, 50, 100, 60, 92, 10};
+    static const float HIGH[StressModel::INPUT_COUNT] = {110, 130, 160, 100, 100, 26};
+    std::mt19937 rng(seed);
+    for (int k = 0; k < StressModel::INPUT_COUNT; k++)
+    {
+      std::uniform_real_distribution<float> value(LOW[k], HIGH[k]);
+      inputs[k].resize(rows);
+      for (size_t i = 0; i < rows; i++)
+        inputs[k][i] = value(rng);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options opts;
+  if (!parseArgs(argc, argv, opts))
+  {
+    fprintf(stderr,
+            "usage: %s --model FILE (--windows DIR | --synthetic N) [--out DIR] [--members]\n"
+            "          [--threads N] [--seed N]\n"
+            "       %s --sessions PATH --windows DIR [--model FILE ...]\n",
+            argv[0], argv[0]);
+    return 2;
+  }
+
+  std::string error;
+  if (!opts.sessions.empty())
+  {
+    std::vector<std::string> files;
+    listSessionFiles(opts.sessions, files);
+    WindowColumns windows;
+    size_t skipped = 0;
+    for (const std::string &path : files)
+    {
+      SessionFile file;
+      if (!file.open(path.c_str(), error) || !addSessionWindows(file, windows, error))
+      {
+        fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+        skipped++;
+      }
+    }
+    if (!writeWindows(opts.windows, windows, error))
+    {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+    printf("exported %zu windows from %zu session files (%zu skipped) to %s\n", windows.rows(),
+           files.size() - skipped, skipped, opts.windows.c_str());
+    if (opts.model.empty())
+      return 0;
+  }
+
+  StressModel model;
+  if (!model.load(opts.model.c_str(), error))
+  {
+    fprintf(stderr, "%s: %s\n", opts.model.c_str(), error.c_str());
+    return 1;
+  }
+
+  std::vector<float> inputs[StressModel::INPUT_COUNT];
+  if (opts.synthetic > 0)
+    synthesise(opts.synthetic, opts.seed, inputs);
+  for (int k = 0; k < StressModel::INPUT_COUNT && opts.synthetic == 0; k++)
+  {
+    std::string path = opts.windows + "/" + WINDOW_INPUT_NAMES[k] + ".col";
+    if (!readColumn(path, inputs[k]) || inputs[k].size() != inputs[0].size())
+    {
+      fprintf(stderr, "Cannot read %s, or its length differs from hrv.col\n", path.c_str());
+      return 1;
+    }
+  }
+  StressModel::Columns columns;
+  for (int k = 0; k < StressModel::INPUT_COUNT; k++)
+    columns.inputs[k] = inputs[k].data();
+  columns.rows = inputs[0].size();
+
+  std::vector<float> scores(columns.rows);
+  std::vector<std::vector<float>> memberScores(opts.members ? model.memberCount() : 0,
+                                               std::vector<float>(columns.rows));
+  std::vector<float *> memberOut;
+  for (std::vector<float> &m : memberScores)
+    memberOut.push_back(m.data());
+
+  // Contiguous ranges of whole blocks, one per thread
+  unsigned threads = opts.threads > 0 ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+  size_t blocks = (columns.rows + StressModel::BLOCK - 1) / StressModel::BLOCK;
+  threads = (unsigned)std::max<size_t>(1, std::min<size_t>(threads, blocks));
+  size_t perThread = (blocks + threads - 1) / threads * StressModel::BLOCK;
+  double start = monotonicS();
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++)
+  {
+    size_t begin = std::min(columns.rows, t * perThread);
+    size_t end = std::min(columns.rows, begin + perThread);
+    workers.emplace_back([&, begin, end]() {
+      StressModel::Scratch scratch;
+      model.score(columns, begin, end, scores.data(), memberOut.empty() ? nullptr : memberOut.data(), scratch);
+    });
+  }
+  for (std::thread &w : workers)
+    w.join();
+  double elapsed = monotonicS() - start;
+
+  size_t stressed = 0, invalid = 0;
+  double sum = 0;
+  for (float p : scores)
+  {
+    if (isnan(p))
+    {
+      invalid++;
+      continue;
+    }
+    sum += p;
+    stressed += p > 0.5f;
+  }
+  size_t valid = columns.rows - invalid;
+  printf("scored %zu windows in %.3f s on %u threads: %.0f windows/s (%zu features, %zu members)\n", columns.rows,
+         elapsed, threads, columns.rows / std::max(elapsed, 1e-9), model.featureCount(), model.memberCount());
+  printf("  mean P(stressed)=%.4f stressed=%zu invalid=%zu\n", valid ? sum / valid : 0.0, stressed, invalid);
+
+  if (opts.synthetic > 0 && opts.out.empty())
+    return 0;
+  std::string outDir = !opts.out.empty() ? opts.out : opts.windows + "/scores";
+  if (mkdir(outDir.c_str(), 0755) != 0 && errno != EEXIST)
+  {
+    fprintf(stderr, "Cannot create %s: %s\n", outDir.c_str(), strerror(errno));
+    return 1;
+  }
+  FILE *schema = fopen((outDir + "/schema").c_str(), "w");
+  bool ok = schema && writeColumn(outDir + "/stress.col", scores);
+  if (schema)
+    fprintf(schema, "stress f32\n");
+  for (size_t m = 0; m < memberScores.size() && ok; m++)
+  {
+    std::string name = "stress_" + model.memberName(m);
+    ok = writeColumn(outDir + "/" + name + ".col", memberScores[m]);
+    fprintf(schema, "%s f32\n", name.c_str());
+  }
+  if (schema)
+    fclose(schema);
+  if (!ok)
+  {
+    fprintf(stderr, "Cannot write the scores to %s\n", outDir.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,752 @@
+#include "stress_model.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace
+{
+  // The engineered features of src/mlmodel.py, by the column names the
+  // export lists
+  enum Feature
+  {
+    F_HRV,
+    F_HEART_RATE,
+    F_SBP,
+    F_DBP,
+    F_SPO2,
+    F_RESP_RATE,
+    F_HR_HRV_RATIO,
+    F_PULSE_PRESSURE,
+    F_MAP,
+    F_RPP,
+    F_MAX_HR,
+    F_HR_RESERVE,
+    F_HRV_COMPLEXITY,
+    F_HRV_SQUARED,
+    F_HRV_CUBED,
+    F_LOG_HRV,
+    F_HR_SQUARED,
+    F_HR_CUBED,
+    F_LOG_HR,
+    F_RATIO_SQUARED,
+    F_RATIO_CUBED,
+    F_LOG_RATIO,
+    F_HR_SBP,
+    F_HR_SPO2,
+    F_HRV_SPO2,
+    F_HRV_DBP,
+    F_SPO2_MAP,
+    F_HR_MAP,
+    F_HR_RESP,
+    FEATURE_COUNT
+  };
+
+  const char *const FEATURE_NAMES[FEATURE_COUNT] = {
+      "HRV (ms)",
+      "Heart Rate (BPM)",
+      "Systolic",
+      "Diastolic",
+      "Oxygen Saturation (%)",
+      "Respiration Rate (BPM)",
+      "HR_HRV_Ratio",
+      "Pulse_Pressure",
+      "MAP",
+      "RPP",
+      "Max_HR_Estimated",
+      "HR_Reserve_Used",
+      "HRV_Complexity",
+      "HRV (ms)_squared",
+      "HRV (ms)_cubed",
+      "log_HRV (ms)",
+      "Heart Rate (BPM)_squared",
+      "Heart Rate (BPM)_cubed",
+      "log_Heart Rate (BPM)",
+      "HR_HRV_Ratio_squared",
+      "HR_HRV_Ratio_cubed",
+      "log_HR_HRV_Ratio",
+      "HR_Systolic_Interaction",
+      "HR_Oxygen_Interaction",
+      "HRV_Oxygen_Interaction",
+      "HRV_Diastolic",
+      "Oxygen_BP_Ratio",
+      "HR_BP_Product",
+      "HR_Resp_Ratio",
+  };
+
+  // 220 - 25, the age mlmodel.py assumes
+  const double MAX_HR_ESTIMATED = 195;
+
+  enum Activation
+  {
+    IDENTITY,
+    LOGISTIC,
+    TANH,
+    RELU
+  };
+
+  enum Kernel
+  {
+    LINEAR,
+    RBF
+  };
+
+  struct Reader
+  {
+    const uint8_t *p, *end;
+    bool ok;
+
+    Reader(const std::vector<uint8_t> &data) : p(data.data()), end(data.data() + data.size()), ok(true) {}
+
+    bool take(size_t n)
+    {
+      if (!ok || (size_t)(end - p) < n)
+        ok = false;
+      return ok;
+    }
+
+    uint8_t u8()
+    {
+      if (!take(1))
+        return 0;
+      return *p++;
+    }
+
+    uint32_t u32()
+    {
+      if (!take(4))
+        return 0;
+      uint32_t v = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+      p += 4;
+      return v;
+    }
+
+    double f64()
+    {
+      uint64_t bits = u32();
+      bits |= (uint64_t)u32() << 32;
+      double v;
+      memcpy(&v, &bits, sizeof(v));
+      return v;
+    }
+
+    std::string str(size_t n)
+    {
+      if (!take(n))
+        return std::string();
+      std::string s((const char *)p, n);
+      p += n;
+      return s;
+    }
+  };
+
+  // A float x satisfies x <= t exactly when it satisfies x <= the largest
+  // float not above t, so the trees compare in float as scikit-learn's
+  // float32 features against float64 thresholds do
+  float floatThreshold(double t)
+  {
+    float f = (float)t;
+    if ((double)f > t)
+      f = nextafterf(f, -INFINITY);
+    return f;
+  }
+
+  // Appends the trees' nodes as threshold (a leaf's value) and link:
+  // feature(8) | right child's offset from the node(24), and each tree's
+  // depth. scikit-learn numbers nodes depth first, so a left child is the
+  // next node.
+  bool readTrees(Reader &r, size_t featureCount, std::vector<uint32_t> &roots, std::vector<uint32_t> &depths,
+                 std::vector<float> &thresholds, std::vector<uint32_t> &links)
+  {
+    uint32_t trees = r.u32();
+    for (uint32_t t = 0; t < trees && r.ok; t++)
+    {
+      uint32_t nodes = r.u32();
+      if (nodes == 0 || !r.take((size_t)nodes * 28))
+        return false;
+      roots.push_back(thresholds.size());
+      // A parent comes before its children
+      std::vector<uint32_t> depth(nodes, 0);
+      uint32_t deepest = 0;
+      for (uint32_t k = 0; k < nodes; k++)
+      {
+        int32_t feature = (int32_t)r.u32();
+        double threshold = r.f64();
+        int32_t left = (int32_t)r.u32();
+        int32_t right = (int32_t)r.u32();
+        double value = r.f64();
+        if (feature < 0)
+        {
+          thresholds.push_back((float)value);
+          links.push_back(StressModel::LEAF);
+          continue;
+        }
+        if ((size_t)feature >= featureCount || left != (int32_t)k + 1 || right <= left || right >= (int32_t)nodes ||
+            right - (int32_t)k >= (1 << 24))
+          return false;
+        thresholds.push_back(floatThreshold(threshold));
+        links.push_back((uint32_t)feature | (uint32_t)(right - k) << 8);
+        depth[left] = depth[right] = depth[k] + 1;
+        deepest = std::max(deepest, depth[k] + 1);
+      }
+      depths.push_back(deepest);
+    }
+    return r.ok;
+  }
+
+  // expf for x <= 0 in plain arithmetic, so loops calling it vectorise:
+  // 2^k from the exponent bits times Cephes' polynomial for e^r, within
+  // 2 ulp
+  inline float expNegative(float x)
+  {
+    x = x > -87.0f ? x : -87.0f;
+    int32_t k = (int32_t)(x * 1.44269504f - 0.5f);
+    float r = x - k * 0.693359375f + k * 2.12194440e-4f;
+    float p = 1.9875691500e-4f;
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    p = p * r * r + r + 1.0f;
+    int32_t bits = (k + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+  }
+
+  void activate(uint8_t activation, float *v, size_t n)
+  {
+    switch (activation)
+    {
+    case LOGISTIC:
+      for (size_t i = 0; i < n; i++)
+        v[i] = 1.0f / (1.0f + expf(-v[i]));
+      break;
+    case TANH:
+      for (size_t i = 0; i < n; i++)
+        v[i] = tanhf(v[i]);
+      break;
+    case RELU:
+      for (size_t i = 0; i < n; i++)
+        v[i] = v[i] > 0 ? v[i] : 0;
+      break;
+    }
+  }
+}
+
+const size_t StressModel::BLOCK;
+const size_t StressModel::LANES;
+const uint32_t StressModel::LEAF;
+
+bool StressModel::load(const char *path, std::string &error)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f)
+  {
+    error = std::string("cannot open ") + path;
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t chunk[65536];
+  size_t got;
+  while ((got = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    data.insert(data.end(), chunk, chunk + got);
+  fclose(f);
+
+  Reader r(data);
+  if (r.str(4) != "PSM1")
+  {
+    error = "not a stress model (PSM1)";
+    return false;
+  }
+  features.clear();
+  members.clear();
+  uint32_t featureCount = r.u32();
+  if (featureCount >= LEAF)
+  {
+    error = "too many features";
+    return false;
+  }
+  for (uint32_t i = 0; i < featureCount && r.ok; i++)
+  {
+    std::string name = r.str(r.u8());
+    int id = -1;
+    for (int k = 0; k < FEATURE_COUNT; k++)
+    {
+      if (name == FEATURE_NAMES[k])
+        id = k;
+    }
+    if (id < 0 && r.ok)
+    {
+      error = "unknown feature " + name;
+      return false;
+    }
+    features.push_back(id);
+  }
+  means.resize(featureCount);
+  scales.resize(featureCount);
+  for (uint32_t i = 0; i < featureCount; i++)
+    means[i] = r.f64();
+  for (uint32_t i = 0; i < featureCount; i++)
+    scales[i] = r.f64();
+
+  uint32_t memberCount = r.u32();
+  double weights = 0;
+  for (uint32_t m = 0; m < memberCount && r.ok; m++)
+  {
+    Member member;
+    member.kind = (Kind)r.u8();
+    member.name = r.str(r.u8());
+    member.weight = r.f64();
+    member.init = member.learningRate = 0;
+    member.activation = IDENTITY;
+    member.kernel = LINEAR;
+    member.gamma = 0;
+    member.intercept = member.probA = member.probB = 0;
+    weights += member.weight;
+    bool valid = r.ok;
+    switch (member.kind)
+    {
+    case BOOSTING:
+      member.init = r.f64();
+      member.learningRate = r.f64();
+      // fall through
+    case FOREST:
+    {
+      std::vector<float> thresholds;
+      std::vector<uint32_t> links;
+      valid = readTrees(r, featureCount, member.roots, member.depths, thresholds, links) && !member.roots.empty();
+      member.nodes.resize(links.size());
+      for (size_t k = 0; k < links.size(); k++)
+      {
+        member.nodes[k].threshold = thresholds[k];
+        member.nodes[k].link = links[k];
+      }
+      break;
+    }
+    case MLP:
+    {
+      member.activation = r.u8();
+      uint32_t layers = r.u32();
+      uint32_t width = featureCount;
+      for (uint32_t l = 0; l < layers && r.ok; l++)
+      {
+        Layer layer;
+        layer.in = r.u32();
+        layer.out = r.u32();
+        if (layer.in != width || layer.out == 0 || !r.take((size_t)layer.in * layer.out * 8 + layer.out * 8))
+        {
+          valid = false;
+          break;
+        }
+        layer.weights.resize((size_t)layer.in * layer.out);
+        for (size_t k = 0; k < layer.weights.size(); k++)
+          layer.weights[k] = (float)r.f64();
+        layer.bias.resize(layer.out);
+        for (size_t k = 0; k < layer.bias.size(); k++)
+          layer.bias[k] = (float)r.f64();
+        width = layer.out;
+        member.layers.push_back(layer);
+      }
+      valid = valid && r.ok && !member.layers.empty() && width == 1 && member.activation <= RELU;
+      break;
+    }
+    case SVM:
+    {
+      member.kernel = r.u8();
+      member.gamma = (float)r.f64();
+      member.intercept = r.f64();
+      member.probA = r.f64();
+      member.probB = r.f64();
+      uint32_t vectors = r.u32();
+      if (member.kernel > RBF || vectors == 0 || !r.take((size_t)vectors * (featureCount + 1) * 8))
+      {
+        valid = false;
+        break;
+      }
+      member.coefs.resize(vectors);
+      member.vectors.resize((size_t)vectors * featureCount);
+      for (uint32_t v = 0; v < vectors; v++)
+      {
+        member.coefs[v] = (float)r.f64();
+        for (uint32_t k = 0; k < featureCount; k++)
+          member.vectors[(size_t)v * featureCount + k] = (float)r.f64();
+      }
+      break;
+    }
+    default:
+      valid = false;
+    }
+    if (!valid)
+    {
+      error = "bad member " + member.name;
+      return false;
+    }
+    members.push_back(member);
+  }
+  if (!r.ok || members.empty() || !(weights > 0))
+  {
+    error = "truncated model";
+    return false;
+  }
+  for (size_t m = 0; m < members.size(); m++)
+    members[m].weight /= weights;
+  return true;
+}
+
+void StressModel::computeFeatures(const Columns &c, size_t begin, size_t n, Scratch &s) const
+{
+  double *in = s.inputs.data();
+  for (int k = 0; k < INPUT_COUNT; k++)
+  {
+    const float *src = c.inputs[k] + begin;
+    double *dst = in + k * BLOCK;
+    for (size_t i = 0; i < n; i++)
+      dst[i] = src[i];
+  }
+  const double *hrv = in + HRV * BLOCK;
+  const double *hr = in + HEART_RATE * BLOCK;
+  const double *sbp = in + SBP * BLOCK;
+  const double *dbp = in + DBP * BLOCK;
+  const double *spo2 = in + SPO2 * BLOCK;
+  const double *resp = in + RESP_RATE * BLOCK;
+  double *o = s.feature.data();
+  uint8_t *bad = s.bad.data();
+  memset(bad, 0, n);
+
+  // Same operations in the same order as the pandas code, in double
+  for (size_t f = 0; f < features.size(); f++)
+  {
+    switch (features[f])
+    {
+    case F_HRV:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hrv[i];
+      break;
+    case F_HEART_RATE:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hr[i];
+      break;
+    case F_SBP:
+      for (size_t i = 0; i < n; i++)
+        o[i] = sbp[i];
+      break;
+    case F_DBP:
+      for (size_t i = 0; i < n; i++)
+        o[i] = dbp[i];
+      break;
+    case F_SPO2:
+      for (size_t i = 0; i < n; i++)
+        o[i] = spo2[i];
+      break;
+    case F_RESP_RATE:
+      for (size_t i = 0; i < n; i++)
+        o[i] = resp[i];
+      break;
+    case F_HR_HRV_RATIO:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hr[i] / hrv[i];
+      break;
+    case F_PULSE_PRESSURE:
+      for (size_t i = 0; i < n; i++)
+        o[i] = sbp[i] - dbp[i];
+      break;
+    case F_MAP:
+      for (size_t i = 0; i < n; i++)
+        o[i] = dbp[i] + (sbp[i] - dbp[i]) / 3;
+      break;
+    case F_RPP:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hr[i] * sbp[i] / 100;
+      break;
+    case F_MAX_HR:
+      for (size_t i = 0; i < n; i++)
+        o[i] = MAX_HR_ESTIMATED;
+      break;
+    case F_HR_RESERVE:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hr[i] / MAX_HR_ESTIMATED * 100;
+      break;
+    case F_HRV_COMPLEXITY:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hrv[i] / hr[i] * 10;
+      break;
+    case F_HRV_SQUARED:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hrv[i] * hrv[i];
+      break;
+    case F_HRV_CUBED:
+      for (size_t i = 0; i < n; i++)
+        o[i] = pow(hrv[i], 3.0);
+      break;
+    case F_LOG_HRV:
+      for (size_t i = 0; i < n; i++)
+        o[i] = log1p(fabs(hrv[i]));
+      break;
+    case F_HR_SQUARED:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hr[i] * hr[i];
+      break;
+    case F_HR_CUBED:
+      for (size_t i = 0; i < n; i++)
+        o[i] = pow(hr[i], 3.0);
+      break;
+    case F_LOG_HR:
+      for (size_t i = 0; i < n; i++)
+        o[i] = log1p(fabs(hr[i]));
+      break;
+    case F_RATIO_SQUARED:
+      for (size_t i = 0; i < n; i++)
+      {
+        double ratio = hr[i] / hrv[i];
+        o[i] = ratio * ratio;
+      }
+      break;
+    case F_RATIO_CUBED:
+      for (size_t i = 0; i < n; i++)
+        o[i] = pow(hr[i] / hrv[i], 3.0);
+      break;
+    case F_LOG_RATIO:
+      for (size_t i = 0; i < n; i++)
+        o[i] = log1p(fabs(hr[i] / hrv[i]));
+      break;
+    case F_HR_SBP:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hr[i] * sbp[i];
+      break;
+    case F_HR_SPO2:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hr[i] * spo2[i];
+      break;
+    case F_HRV_SPO2:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hrv[i] * spo2[i];
+      break;
+    case F_HRV_DBP:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hrv[i] / dbp[i];
+      break;
+    case F_SPO2_MAP:
+      for (size_t i = 0; i < n; i++)
+        o[i] = spo2[i] / (dbp[i] + (sbp[i] - dbp[i]) / 3);
+      break;
+    case F_HR_MAP:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hr[i] * (dbp[i] + (sbp[i] - dbp[i]) / 3) / 100;
+      break;
+    case F_HR_RESP:
+      for (size_t i = 0; i < n; i++)
+        o[i] = hr[i] / resp[i];
+      break;
+    }
+    // StandardScaler, then float32 as the trees see it
+    float *x = s.x.data() + f * BLOCK;
+    double mean = means[f], scale = scales[f];
+    for (size_t i = 0; i < n; i++)
+    {
+      double v = (o[i] - mean) / scale;
+      bad[i] |= !(fabs(v) <= 3.0e38);
+      x[i] = (float)v;
+    }
+  }
+}
+
+void StressModel::runTrees(const Member &m, size_t n, Scratch &s) const
+{
+  double *sum = s.sum.data();
+  std::fill(sum, sum + n, 0.0);
+  const float *x = s.x.data();
+  const Node *nodes = m.nodes.data();
+  for (size_t t = 0; t < m.roots.size(); t++)
+  {
+    const Node *root = nodes + m.roots[t];
+    // LANES windows down the tree together, one level of each per step and
+    // without branches, so their loads overlap and no comparison can be
+    // mispredicted. Every walk takes the tree's depth in steps; one at a
+    // leaf stays there.
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES)
+    {
+      const Node *at[LANES];
+      for (size_t j = 0; j < LANES; j++)
+        at[j] = root;
+      for (uint32_t d = 0; d < m.depths[t]; d++)
+      {
+        for (size_t j = 0; j < LANES; j++)
+        {
+          uint32_t link = at[j]->link;
+          uint32_t feature = link & 0xFF;
+          uint32_t inner = -(uint32_t)(feature != LEAF);
+          uint32_t right = link >> 8;
+          uint32_t left = -(uint32_t)(x[(feature & inner) * BLOCK + i + j] <= at[j]->threshold);
+          at[j] += (right ^ ((right ^ 1) & left)) & inner;
+        }
+      }
+      for (size_t j = 0; j < LANES; j++)
+        sum[i + j] += at[j]->threshold;
+    }
+    for (; i < n; i++)
+    {
+      const Node *node = root;
+      uint32_t feature;
+      while ((feature = node->link & 0xFF) != LEAF)
+        node = x[feature * BLOCK + i] <= node->threshold ? node + 1 : node + (node->link >> 8);
+      sum[i] += node->threshold;
+    }
+  }
+  float *acc = s.acc.data();
+  if (m.kind == FOREST)
+  {
+    double trees = m.roots.size();
+    for (size_t i = 0; i < n; i++)
+      acc[i] = (float)(sum[i] / trees);
+  }
+  else
+  {
+    for (size_t i = 0; i < n; i++)
+      acc[i] = (float)(1 / (1 + exp(-(m.init + m.learningRate * sum[i]))));
+  }
+}
+
+void StressModel::runMlp(const Member &m, size_t n, Scratch &s) const
+{
+  const float *a = s.x.data();
+  float *buffers[2] = {s.a.data(), s.b.data()};
+  for (size_t l = 0; l < m.layers.size(); l++)
+  {
+    const Layer &layer = m.layers[l];
+    float *out = buffers[l & 1];
+    for (uint32_t j = 0; j < layer.out; j++)
+    {
+      float *o = out + j * BLOCK;
+      float bias = layer.bias[j];
+      for (size_t i = 0; i < n; i++)
+        o[i] = bias;
+      for (uint32_t k = 0; k < layer.in; k++)
+      {
+        float w = layer.weights[(size_t)k * layer.out + j];
+        const float *ak = a + k * BLOCK;
+        for (size_t i = 0; i < n; i++)
+          o[i] += w * ak[i];
+      }
+      if (l + 1 < m.layers.size())
+        activate(m.activation, o, n);
+    }
+    a = out;
+  }
+  // A binary MLPClassifier ends in one logistic unit
+  float *acc = s.acc.data();
+  for (size_t i = 0; i < n; i++)
+    acc[i] = 1.0f / (1.0f + expf(-a[i]));
+}
+
+void StressModel::runSvm(const Member &m, size_t n, Scratch &s) const
+{
+  size_t featureCount = features.size();
+  const float *x = s.x.data();
+  float *df = s.a.data();
+  float *dist = s.b.data();
+  std::fill(df, df + n, 0.0f);
+  for (size_t v = 0; v < m.coefs.size(); v++)
+  {
+    const float *sv = m.vectors.data() + v * featureCount;
+    float coef = m.coefs[v];
+    if (m.kernel == LINEAR)
+    {
+      for (size_t k = 0; k < featureCount; k++)
+      {
+        float w = coef * sv[k];
+        const float *xk = x + k * BLOCK;
+        for (size_t i = 0; i < n; i++)
+          df[i] += w * xk[i];
+      }
+      continue;
+    }
+    // Four features a pass, to load and store dist a quarter as often
+    std::fill(dist, dist + n, 0.0f);
+    size_t k = 0;
+    for (; k + 4 <= featureCount; k += 4)
+    {
+      float c0 = sv[k], c1 = sv[k + 1], c2 = sv[k + 2], c3 = sv[k + 3];
+      const float *x0 = x + k * BLOCK, *x1 = x0 + BLOCK, *x2 = x1 + BLOCK, *x3 = x2 + BLOCK;
+      for (size_t i = 0; i < n; i++)
+      {
+        float d0 = x0[i] - c0, d1 = x1[i] - c1, d2 = x2[i] - c2, d3 = x3[i] - c3;
+        dist[i] += d0 * d0 + d1 * d1 + d2 * d2 + d3 * d3;
+      }
+    }
+    for (; k < featureCount; k++)
+    {
+      float c = sv[k];
+      const float *xk = x + k * BLOCK;
+      for (size_t i = 0; i < n; i++)
+      {
+        float d = xk[i] - c;
+        dist[i] += d * d;
+      }
+    }
+    float gamma = m.gamma;
+    for (size_t i = 0; i < n; i++)
+      df[i] += coef * expNegative(-gamma * dist[i]);
+  }
+  // libsvm's Platt scaling. Its decision value is scikit-learn's negated
+  // and its probability that of the first class, clamped as libsvm does.
+  float *acc = s.acc.data();
+  for (size_t i = 0; i < n; i++)
+  {
+    double fApB = -(df[i] + m.intercept) * m.probA + m.probB;
+    double relaxed = fApB >= 0 ? exp(-fApB) / (1 + exp(-fApB)) : 1 / (1 + exp(fApB));
+    relaxed = std::min(std::max(relaxed, 1e-7), 1 - 1e-7);
+    acc[i] = (float)(1 - relaxed);
+  }
+}
+
+void StressModel::score(const Columns &c, size_t begin, size_t end, float *out, float *const *memberOut,
+                        Scratch &s) const
+{
+  size_t width = features.size();
+  for (size_t m = 0; m < members.size(); m++)
+  {
+    for (size_t l = 0; l < members[m].layers.size(); l++)
+      width = std::max(width, (size_t)members[m].layers[l].out);
+  }
+  s.inputs.resize(INPUT_COUNT * BLOCK);
+  s.feature.resize(BLOCK);
+  s.x.resize(features.size() * BLOCK);
+  s.a.resize(width * BLOCK);
+  s.b.resize(width * BLOCK);
+  s.acc.resize(BLOCK);
+  s.sum.resize(2 * BLOCK);
+  s.bad.resize(BLOCK);
+  double *total = s.sum.data() + BLOCK;
+
+  for (size_t first = begin; first < end; first += BLOCK)
+  {
+    size_t n = std::min(BLOCK, end - first);
+    computeFeatures(c, first, n, s);
+    std::fill(total, total + n, 0.0);
+    for (size_t m = 0; m < members.size(); m++)
+    {
+      const Member &member = members[m];
+      if (member.kind == MLP)
+        runMlp(member, n, s);
+      else if (member.kind == SVM)
+        runSvm(member, n, s);
+      else
+        runTrees(member, n, s);
+      const float *acc = s.acc.data();
+      for (size_t i = 0; i < n; i++)
+        total[i] += member.weight * acc[i];
+      if (memberOut)
+      {
+        for (size_t i = 0; i < n; i++)
+          memberOut[m][first + i] = s.bad[i] ? NAN : acc[i];
+      }
+    }
+    for (size_t i = 0; i < n; i++)
+      out[first + i] = s.bad[i] ? NAN : (float)total[i];
+  }
+}
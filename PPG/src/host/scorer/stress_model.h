@@ -0,0 +1,138 @@
+#ifndef PPG_SCORER_STRESS_MODEL_H
+#define PPG_SCORER_STRESS_MODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Batch inference for the stress ensemble trained by src/mlmodel.py, as
+// exported by src/mlmodel_export.py. Windows are scored BLOCK at a time in
+// a structure-of-arrays layout: the engineered features (HR/HRV ratio, MAP,
+// powers, logs, interactions) and the standard scaling are computed one
+// feature column at a time, and the MLP and SVM members loop over the
+// block's windows innermost, so the compiler vectorises them; the RBF
+// kernel's exp is written out for that too. The trees visit a whole block
+// per tree, keeping the tree in cache, walking LANES windows at a time
+// without branches.
+//
+// Model file, little endian:
+//   "PSM1" features(4), per feature: nameLen(1) name
+//   mean(8) x features, scale(8) x features
+//   members(4), per member: kind(1) nameLen(1) name weight(8), then
+//     forest    trees(4), per tree: nodes(4), per node:
+//               feature(4, -1 for a leaf) threshold(8) left(4) right(4) value(8)
+//               numbered depth first (scikit-learn's default builder)
+//     boosting  init(8) learningRate(8), then trees as for a forest
+//     mlp       activation(1) layers(4), per layer:
+//               in(4) out(4) weights(8) x in*out (row per input) bias(8) x out
+//     svm       kernel(1) gamma(8) intercept(8) probA(8) probB(8) vectors(4),
+//               per vector: coef(8) x(8) x features
+// A forest leaf holds P(stressed) and a boosting leaf its raw value. A
+// linear SVM is exported as one vector, its weights, with coef 1.
+//
+// Trees compare float features against their thresholds, as scikit-learn
+// does; the MLP and SVM run in float where scikit-learn uses double, which
+// src/mlmodel_parity.py measures.
+class StressModel
+{
+public:
+  enum Input
+  {
+    HRV,
+    HEART_RATE,
+    SBP,
+    DBP,
+    SPO2,
+    RESP_RATE,
+    INPUT_COUNT
+  };
+
+  static const size_t BLOCK = 256;
+  static const size_t LANES = 8;
+  // Models have fewer features than this
+  static const uint32_t LEAF = 0xFF;
+
+  struct Columns
+  {
+    const float *inputs[INPUT_COUNT];
+    size_t rows;
+  };
+
+  // Per-thread buffers for score()
+  struct Scratch
+  {
+    std::vector<double> inputs, feature;
+    std::vector<float> x, a, b, acc;
+    std::vector<double> sum;
+    std::vector<uint8_t> bad;
+  };
+
+  bool load(const char *path, std::string &error);
+
+  size_t featureCount() const { return features.size(); }
+  size_t memberCount() const { return members.size(); }
+  const std::string &memberName(size_t m) const { return members[m].name; }
+
+  // P(stressed) for rows [begin, end) into out[begin..end), and per member
+  // into memberOut[m][begin..end) if memberOut is set. A window whose
+  // features are not finite (an HRV of 0, say) scores NAN.
+  void score(const Columns &c, size_t begin, size_t end, float *out, float *const *memberOut,
+             Scratch &s) const;
+
+private:
+  enum Kind
+  {
+    FOREST,
+    BOOSTING,
+    MLP,
+    SVM
+  };
+
+  // 8 bytes, so a forest takes half the cache it would with both children
+  struct Node
+  {
+    float threshold; // a leaf's value
+    uint32_t link;   // feature | right child's offset << 8; LEAF for a leaf
+  };
+
+  struct Layer
+  {
+    uint32_t in, out;
+    std::vector<float> weights; // in x out
+    std::vector<float> bias;
+  };
+
+  struct Member
+  {
+    Kind kind;
+    std::string name;
+    double weight;
+    // forest, boosting
+    std::vector<Node> nodes;
+    std::vector<uint32_t> roots;
+    std::vector<uint32_t> depths;
+    double init, learningRate;
+    // mlp
+    uint8_t activation;
+    std::vector<Layer> layers;
+    // svm
+    uint8_t kernel;
+    float gamma;
+    double intercept, probA, probB;
+    std::vector<float> coefs;
+    std::vector<float> vectors; // vector-major, featureCount() each
+  };
+
+  void computeFeatures(const Columns &c, size_t begin, size_t n, Scratch &s) const;
+  void runTrees(const Member &m, size_t n, Scratch &s) const;
+  void runMlp(const Member &m, size_t n, Scratch &s) const;
+  void runSvm(const Member &m, size_t n, Scratch &s) const;
+
+  std::vector<int> features; // engineered feature ids, model column order
+  std::vector<double> means, scales;
+  std::vector<Member> members;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "window_export.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+const char *const WINDOW_INPUT_NAMES[StressModel::INPUT_COUNT] = {"hrv", "heart_rate", "sbp", "dbp", "oxygen",
+                                                                  "resp_rate"};
+
+namespace
+{
+  // The session file's column for each input, by StressModel::Input
+  const char *const SESSION_INPUTS[StressModel::INPUT_COUNT] = {"sdnn", "heart_rate", "sbp", "dbp", "oxygen",
+                                                                "resp_rate"};
+
+  bool writeFile(const std::string &path, const void *data, size_t size)
+  {
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+      return false;
+    bool ok = fwrite(data, 1, size, f) == size;
+    return fclose(f) == 0 && ok;
+  }
+}
+
+bool addSessionWindows(const SessionFile &file, WindowColumns &windows, std::string &error)
+{
+  const SessionFile::Column *readingT = file.find("t_ms");
+  const SessionFile::Column *hrvT = file.find("hrv_t_ms");
+  const SessionFile::Column *inputs[StressModel::INPUT_COUNT];
+  const char *missing = !readingT || !SessionFile::i64(*readingT) ? "t_ms"
+                        : !hrvT || !SessionFile::i64(*hrvT)       ? "hrv_t_ms"
+                                                                  : nullptr;
+  for (int k = 0; k < StressModel::INPUT_COUNT; k++)
+  {
+    inputs[k] = file.find(SESSION_INPUTS[k]);
+    if (!missing && (!inputs[k] || !SessionFile::f32(*inputs[k])))
+      missing = SESSION_INPUTS[k];
+  }
+  if (missing)
+  {
+    error = std::string("no f32/i64 column ") + missing;
+    return false;
+  }
+
+  const int64_t *t = SessionFile::i64(*readingT);
+  const int64_t *windowT = SessionFile::i64(*hrvT);
+  uint64_t readings = readingT->rows, hrvWindows = hrvT->rows;
+  for (int k = 0; k < StressModel::INPUT_COUNT; k++)
+  {
+    uint64_t rows = k == StressModel::HRV ? hrvWindows : readings;
+    if (inputs[k]->rows != rows)
+    {
+      error = std::string(SESSION_INPUTS[k]) + " has a different row count";
+      return false;
+    }
+  }
+
+  // Both come in time order, so one pass pairs each window with its reading
+  uint64_t r = 0;
+  for (uint64_t w = 0; w < hrvWindows; w++)
+  {
+    while (r < readings && t[r] <= windowT[w])
+      r++;
+    if (r == 0)
+      continue;
+    // The gateway writes 0 for a reading the device did not have, and the
+    // device sends 0 for a respiration rate it has no estimate of yet and
+    // an SpO2 that is not valid. None of the inputs can really be 0, so
+    // those go to the scorer as NAN, which it scores NAN.
+    for (int k = 0; k < StressModel::INPUT_COUNT; k++)
+    {
+      float v = SessionFile::f32(*inputs[k])[k == StressModel::HRV ? w : r - 1];
+      windows.inputs[k].push_back(v > 0 ? v : NAN);
+    }
+    windows.tMs.push_back(windowT[w]);
+    windows.source.push_back(file.source());
+  }
+  return true;
+}
+
+bool writeWindows(const std::string &dir, const WindowColumns &windows, std::string &error)
+{
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+  {
+    error = "cannot create " + dir + ": " + strerror(errno);
+    return false;
+  }
+  bool ok = true;
+  for (int k = 0; k < StressModel::INPUT_COUNT && ok; k++)
+    ok = writeFile(dir + "/" + WINDOW_INPUT_NAMES[k] + ".col", windows.inputs[k].data(),
+                   windows.inputs[k].size() * sizeof(float));
+  ok = ok && writeFile(dir + "/t_ms.col", windows.tMs.data(), windows.tMs.size() * sizeof(int64_t)) &&
+       writeFile(dir + "/source.col", windows.source.data(), windows.source.size() * sizeof(uint32_t));
+  std::string schema = "source u32\nt_ms i64\n";
+  for (int k = 0; k < StressModel::INPUT_COUNT; k++)
+    schema += std::string(WINDOW_INPUT_NAMES[k]) + " f32\n";
+  ok = ok && writeFile(dir + "/schema", schema.data(), schema.size());
+  if (!ok)
+    error = "cannot write the windows to " + dir;
+  return ok;
+}
@@ -0,0 +1,38 @@
+#ifndef PPG_SCORER_WINDOW_EXPORT_H
+#define PPG_SCORER_WINDOW_EXPORT_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "session_file.h"
+#include "stress_model.h"
+
+// The scorer's input columns, built from the gateway's session files
+// (session_file.h). A window is one HRV window of a session: its SDNN, the
+// HRV the sensor reports for a session, with the latest reading at or
+// before it for heart rate, blood pressure, SpO2 and respiration rate.
+// HRV windows before a session's first reading are left out, and an input
+// of 0 or less, a reading the device did not have, becomes NAN. The time
+// and source columns let the scores be joined back to the sessions.
+struct WindowColumns
+{
+  std::vector<float> inputs[StressModel::INPUT_COUNT];
+  std::vector<int64_t> tMs;
+  std::vector<uint32_t> source;
+
+  size_t rows() const { return tMs.size(); }
+};
+
+// Column file names of the inputs, by StressModel::Input
+extern const char *const WINDOW_INPUT_NAMES[StressModel::INPUT_COUNT];
+
+// Appends the file's windows; false if it lacks one of the columns
+bool addSessionWindows(const SessionFile &file, WindowColumns &windows, std::string &error);
+
+// Writes <name>.col for each input, t_ms.col and source.col, and a schema
+// in the gateway's format (column_store.h)
+bool writeWindows(const std::string &dir, const WindowColumns &windows, std::string &error);
+
+#endif
@@ -0,0 +1,386 @@
+#include "host_hal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "profiler.h"
+#include "telemetry.h"
+
+namespace
+{
+  SimClock *sensorClock = nullptr;
+
+  int64_t monotonicNs()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+
+  uint64_t sensorClockUs()
+  {
+    return sensorClock->nowUs();
+  }
+
+  std::string trim(const std::string &s)
+  {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos)
+      return std::string();
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+  }
+}
+
+SimClock::SimClock(double speed) : speed(speed), startNs(monotonicNs()), virtualUs(0)
+{
+}
+
+uint64_t SimClock::nowUs()
+{
+  if (isVirtual())
+    return virtualUs;
+  return (uint64_t)((monotonicNs() - startNs) * speed / 1000);
+}
+
+void SimClock::sleepUs(uint64_t us)
+{
+  if (isVirtual())
+  {
+    virtualUs += us;
+    return;
+  }
+  uint64_t ns = (uint64_t)(us * 1000 / speed);
+  timespec ts = {(time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL)};
+  nanosleep(&ts, nullptr);
+}
+
+void SimClock::advanceTo(uint64_t us)
+{
+  if (isVirtual() && us > virtualUs)
+    virtualUs = us;
+}
+
+void HostPlatform::sleepMs(uint32_t ms)
+{
+  clock.sleepUs(ms * 1000ULL);
+  // An idle app on a virtual clock would otherwise spin a core
+  if (clock.isVirtual())
+    usleep(1000);
+}
+
+void HostPlatform::log(const char *line)
+{
+  if (quiet)
+    return;
+  uint64_t us = clock.nowUs();
+  printf("[%8.3f] %s\n", us / 1e6, line);
+}
+
+bool HostPlatform::loadSetting(const char *key, void *data, size_t len)
+{
+  auto it = settings.find(key);
+  if (it == settings.end() || it->second.size() != len)
+    return false;
+  memcpy(data, it->second.data(), len);
+  return true;
+}
+
+bool HostPlatform::saveSetting(const char *key, const void *data, size_t len)
+{
+  const uint8_t *bytes = (const uint8_t *)data;
+  settings[key].assign(bytes, bytes + len);
+  return true;
+}
+
+HostFlash::HostFlash(uint32_t size) : memory(size - size % SECTOR_SIZE, 0xFF)
+{
+}
+
+bool HostFlash::open(const char *file)
+{
+  path = file;
+  FILE *f = fopen(file, "rb");
+  if (f)
+  {
+    size_t n = fread(memory.data(), 1, memory.size(), f);
+    fclose(f);
+    if (n != memory.size())
+      fprintf(stderr, "%s: %zu of %zu bytes, rest treated as erased\n", file, n, memory.size());
+  }
+  // Create or extend the file to the full size
+  return persist(0, memory.size());
+}
+
+bool HostFlash::persist(uint32_t offset, size_t len)
+{
+  if (path.empty())
+    return true;
+  FILE *f = fopen(path.c_str(), "r+b");
+  if (!f)
+    f = fopen(path.c_str(), "w+b");
+  if (!f)
+    return false;
+  bool ok = fseek(f, offset, SEEK_SET) == 0 && fwrite(memory.data() + offset, 1, len, f) == len;
+  fclose(f);
+  return ok;
+}
+
+bool HostFlash::read(uint32_t offset, void *data, size_t len)
+{
+  if (offset + len > memory.size())
+    return false;
+  memcpy(data, memory.data() + offset, len);
+  return true;
+}
+
+bool HostFlash::write(uint32_t offset, const void *data, size_t len)
+{
+  if (offset + len > memory.size())
+    return false;
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (size_t i = 0; i < len; i++)
+    memory[offset + i] &= bytes[i];
+  return persist(offset, len);
+}
+
+bool HostFlash::eraseSector(uint32_t offset)
+{
+  offset -= offset % SECTOR_SIZE;
+  if (offset + SECTOR_SIZE > memory.size())
+    return false;
+  memset(memory.data() + offset, 0xFF, SECTOR_SIZE);
+  return persist(offset, SECTOR_SIZE);
+}
+
+SimSensor::SimSensor(SimClock &clock, const PpgSynthConfig &config) : clock(clock), part(sensorClockUs, config)
+{
+  sensorClock = &clock;
+}
+
+void SimSensor::read(uint32_t &ir, uint32_t &red)
+{
+  // Like Max30105Sensor, each call takes one sample from the FIFO and
+  // waits for the next one if it is empty
+  if (part.available() == 0)
+  {
+    clock.advanceTo(part.nextSampleUs());
+    part.check();
+  }
+  ir = part.getFIFOIR();
+  red = part.getFIFORed();
+  part.nextSample();
+}
+
+SocketTransport::~SocketTransport()
+{
+  for (Client &c : clients)
+    close(c.fd);
+  if (listenFd >= 0)
+    close(listenFd);
+}
+
+bool SocketTransport::begin(const char *deviceName, TransportCommandHandler commandHandler,
+                            TransportDisconnectHandler disconnected)
+{
+  handler = commandHandler;
+  disconnectHandler = disconnected;
+  listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (listenFd < 0)
+    return false;
+  int one = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd, 4) != 0)
+  {
+    fprintf(stderr, "Cannot listen on port %u: %s\n", port, strerror(errno));
+    close(listenFd);
+    listenFd = -1;
+    return false;
+  }
+  printf("%s listening on 127.0.0.1:%u\n", deviceName, port);
+  return true;
+}
+
+void SocketTransport::acceptClients()
+{
+  while (true)
+  {
+    int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+    if (fd < 0)
+      return;
+    if ((int)clients.size() >= MAX_CLIENTS)
+    {
+      close(fd);
+      continue;
+    }
+    // New clients get the summary stream, as over BLE
+    Client c = {fd, nextConnId++, STREAM_SUMMARY, std::string(), std::string()};
+    clients.push_back(c);
+    refreshMask();
+  }
+}
+
+// Returns false once the client has gone.
+bool SocketTransport::readClient(Client &c)
+{
+  char buffer[512];
+  while (true)
+  {
+    ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+    if (n == 0)
+      return false;
+    if (n < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    c.input.append(buffer, n);
+    size_t nl;
+    while ((nl = c.input.find('\n')) != std::string::npos)
+    {
+      std::string line = c.input.substr(0, nl);
+      c.input.erase(0, nl + 1);
+      handleLine(c, line);
+    }
+    if (c.input.size() > MAX_PAYLOAD)
+      c.input.clear();
+  }
+}
+
+void SocketTransport::handleLine(Client &c, std::string line)
+{
+  line = trim(line);
+  if (line.empty())
+    return;
+  // SUB/UNSUB change the subscriptions of the writing connection only
+  bool subscribe = line.compare(0, 3, "SUB") == 0;
+  bool unsubscribe = line.compare(0, 5, "UNSUB") == 0;
+  if (subscribe || unsubscribe)
+  {
+    uint8_t streams = parseStreamList(line.c_str() + (subscribe ? 3 : 5));
+    if (subscribe)
+      c.streams |= streams;
+    else
+      c.streams &= ~streams;
+    refreshMask();
+    char list[32], reply[64];
+    formatStreamList(c.streams, list, sizeof(list));
+    snprintf(reply, sizeof(reply), "{\"subscribed\":\"%s\"}", list);
+    queue(c, (const uint8_t *)reply, strlen(reply));
+    return;
+  }
+  if (handler)
+    handler(line.c_str(), c.connId);
+}
+
+bool SocketTransport::queue(Client &c, const uint8_t *data, size_t len)
+{
+  if (len > MAX_PAYLOAD || c.outbox.size() > OUTBOX_LIMIT)
+  {
+    droppedCount++;
+    return false;
+  }
+  char header[2] = {(char)(len & 0xFF), (char)(len >> 8)};
+  c.outbox.append(header, 2);
+  c.outbox.append((const char *)data, len);
+  sent++;
+  sentBytes += len;
+  return flush(c);
+}
+
+// Returns false if the connection failed.
+bool SocketTransport::flush(Client &c)
+{
+  while (!c.outbox.empty())
+  {
+    ssize_t n = ::send(c.fd, c.outbox.data(), c.outbox.size(), MSG_NOSIGNAL);
+    if (n < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    c.outbox.erase(0, n);
+  }
+  return true;
+}
+
+void SocketTransport::refreshMask()
+{
+  uint8_t mask = 0;
+  for (const Client &c : clients)
+    mask |= c.streams;
+  subscribedMask = mask;
+}
+
+void SocketTransport::poll()
+{
+  if (listenFd < 0)
+    return;
+  acceptClients();
+  // Commands may queue replies; clients are only removed afterwards
+  std::vector<int> gone;
+  std::vector<uint16_t> goneIds;
+  for (size_t i = 0; i < clients.size(); i++)
+  {
+    if (!readClient(clients[i]) || !flush(clients[i]))
+    {
+      gone.push_back(clients[i].fd);
+      goneIds.push_back(clients[i].connId);
+    }
+  }
+  if (gone.empty())
+    return;
+  clients.erase(std::remove_if(clients.begin(), clients.end(),
+                               [&](const Client &c)
+                               { return std::find(gone.begin(), gone.end(), c.fd) != gone.end(); }),
+                clients.end());
+  for (int fd : gone)
+    close(fd);
+  refreshMask();
+  if (disconnectHandler)
+  {
+    for (uint16_t connId : goneIds)
+      disconnectHandler(connId);
+  }
+}
+
+int SocketTransport::send(uint8_t stream, const uint8_t *data, size_t len)
+{
+  if (!(subscribedMask & stream))
+    return 0;
+  int reached = 0;
+  for (Client &c : clients)
+  {
+    if ((c.streams & stream) && queue(c, data, len))
+      reached++;
+  }
+  return reached;
+}
+
+bool SocketTransport::sendTo(uint16_t connId, const uint8_t *data, size_t len)
+{
+  for (Client &c : clients)
+  {
+    if (c.connId == connId)
+      return queue(c, data, len);
+  }
+  return false;
+}
+
+#ifdef PPG_PROFILE
+uint32_t profileCycles()
+{
+  return (uint32_t)monotonicNs();
+}
+
+uint32_t profileCyclesPerUs()
+{
+  return 1000;
+}
+#endif
@@ -0,0 +1,149 @@
+#ifndef PPG_HOST_HAL_H
+#define PPG_HOST_HAL_H
+
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ppg_hal.h"
+#include "ppg_synth.h"
+
+// Simulated time. At speed > 0 it runs that many times faster than the
+// wall clock; at speed 0 it only moves when something waits on it, so the
+// simulation runs as fast as the code allows.
+class SimClock
+{
+public:
+  explicit SimClock(double speed);
+
+  uint64_t nowUs();
+  void sleepUs(uint64_t us);
+  // Virtual clock only: jump forward to us if it is in the future
+  void advanceTo(uint64_t us);
+  bool isVirtual() const { return speed <= 0; }
+
+private:
+  double speed;
+  int64_t startNs;
+  uint64_t virtualUs;
+};
+
+class HostPlatform : public PpgPlatform
+{
+public:
+  HostPlatform(SimClock &clock, bool quiet) : clock(clock), quiet(quiet) {}
+
+  uint64_t micros() { return clock.nowUs(); }
+  void sleepMs(uint32_t ms);
+  void log(const char *line);
+  void lock() { mutex.lock(); }
+  void unlock() { mutex.unlock(); }
+  // Kept in memory: settings last as long as the process, like NVS across
+  // a session but not across runs.
+  bool loadSetting(const char *key, void *data, size_t len);
+  bool saveSetting(const char *key, const void *data, size_t len);
+
+private:
+  SimClock &clock;
+  bool quiet;
+  std::mutex mutex;
+  std::map<std::string, std::vector<uint8_t>> settings;
+};
+
+// Flash for the trend store, in memory and optionally mirrored to a file
+// so trends survive between runs. Writes clear bits as NOR flash does.
+class HostFlash : public PpgFlash
+{
+public:
+  explicit HostFlash(uint32_t size);
+
+  // Loads path if it exists and writes every change back to it
+  bool open(const char *path);
+
+  uint32_t size() { return (uint32_t)memory.size(); }
+  bool read(uint32_t offset, void *data, size_t len);
+  bool write(uint32_t offset, const void *data, size_t len);
+  bool eraseSector(uint32_t offset);
+
+private:
+  bool persist(uint32_t offset, size_t len);
+
+  std::vector<uint8_t> memory;
+  std::string path;
+};
+
+// A SimulatedMax30105 on the simulation clock. On a virtual clock each
+// read jumps time to the next sample instead of waiting for it. Only one
+// instance per process, as the part takes a plain function as its clock.
+class SimSensor : public PpgSensor
+{
+public:
+  SimSensor(SimClock &clock, const PpgSynthConfig &config);
+
+  bool begin() { return part.begin(); }
+  void read(uint32_t &ir, uint32_t &red);
+
+private:
+  SimClock &clock;
+  SimulatedMax30105 part;
+};
+
+// The BLE link over TCP. Each connection is one BLE client: it writes
+// newline-terminated commands (as to the RX characteristic) and receives
+// every notification as a 2-byte little-endian length plus the payload.
+// SUB/UNSUB and the default summary subscription behave as in
+// ble_server.cpp. A client that falls more than OUTBOX_LIMIT bytes behind
+// loses notifications, as a congested BLE link would.
+class SocketTransport : public PpgTransport
+{
+public:
+  static const int MAX_CLIENTS = 3;
+  static const size_t MAX_PAYLOAD = 512;
+  static const size_t OUTBOX_LIMIT = 64 * 1024;
+
+  explicit SocketTransport(uint16_t port) : port(port) {}
+  ~SocketTransport();
+
+  bool begin(const char *deviceName, TransportCommandHandler handler, TransportDisconnectHandler disconnected);
+  void poll();
+  uint8_t subscribedStreams() { return subscribedMask; }
+  int send(uint8_t stream, const uint8_t *data, size_t len);
+  bool sendTo(uint16_t connId, const uint8_t *data, size_t len);
+  using PpgTransport::send;
+  using PpgTransport::sendTo;
+
+  uint64_t notifications() const { return sent; }
+  uint64_t bytes() const { return sentBytes; }
+  uint64_t dropped() const { return droppedCount; }
+
+private:
+  struct Client
+  {
+    int fd;
+    uint16_t connId;
+    uint8_t streams;
+    std::string input;
+    std::string outbox;
+  };
+
+  void acceptClients();
+  bool readClient(Client &c);
+  void handleLine(Client &c, std::string line);
+  bool queue(Client &c, const uint8_t *data, size_t len);
+  bool flush(Client &c);
+  void refreshMask();
+
+  uint16_t port;
+  int listenFd = -1;
+  TransportCommandHandler handler = nullptr;
+  TransportDisconnectHandler disconnectHandler = nullptr;
+  std::vector<Client> clients;
+  uint16_t nextConnId = 0;
+  uint8_t subscribedMask = 0;
+  uint64_t sent = 0, sentBytes = 0, droppedCount = 0;
+};
+
+#endif
@@ -0,0 +1,163 @@
+// Runs the sensor application (ppg_app.h) as a Linux process: synthetic
+// PPG from a simulated MAX30105, the BLE link over TCP (see host_hal.h),
+// on a clock that can run faster than real time. Connect with any client
+// that speaks the length-prefixed framing, or pass --session to record
+// unattended and measure throughput.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <string>
+
+#include "host_hal.h"
+#include "ppg_app.h"
+#include "stage_stats.h"
+
+namespace
+{
+  struct Options
+  {
+    int port = 9760;
+    double speed = 1.0;  // simulated seconds per wall-clock second, 0 = unthrottled
+    int session = 0;     // record this many simulated seconds, then exit
+    bool quiet = false;
+    const char *flash = nullptr; // file backing the trend store, or in memory
+    PpgSynthConfig synth;
+  };
+
+  volatile sig_atomic_t stopRequested = 0;
+  PpgApp *runningApp = nullptr;
+
+  void onSignal(int)
+  {
+    stopRequested = 1;
+  }
+
+  int64_t monotonicNs()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+
+  void handleCommand(const char *command, uint16_t connId)
+  {
+    runningApp->handleCommand(command, connId);
+  }
+
+  void handleDisconnect(uint16_t connId)
+  {
+    runningApp->handleDisconnect(connId);
+  }
+
+  bool parseArgs(int argc, char **argv, Options &opts)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "--quiet")
+      {
+        opts.quiet = true;
+        continue;
+      }
+      if (i + 1 >= argc)
+        return false;
+      if (arg == "--port")
+        opts.port = atoi(argv[++i]);
+      else if (arg == "--speed")
+        opts.speed = atof(argv[++i]);
+      else if (arg == "--session")
+        opts.session = atoi(argv[++i]);
+      else if (arg == "--hr")
+        opts.synth.heartRate = atof(argv[++i]);
+      else if (arg == "--spo2")
+        opts.synth.spo2 = atof(argv[++i]);
+      else if (arg == "--motion")
+        opts.synth.motionPerMinute = atof(argv[++i]);
+      else if (arg == "--seed")
+        opts.synth.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+      else if (arg == "--flash")
+        opts.flash = argv[++i];
+      else
+        return false;
+    }
+    return opts.speed >= 0 && opts.session >= 0 && opts.synth.heartRate > 0;
+  }
+
+  void report(SimClock &clock, PpgApp &app, SocketTransport &transport, const StageStats &loopNs,
+              double wallS)
+  {
+    double simS = clock.nowUs() / 1e6;
+    printf("sim_s=%.1f wall_s=%.2f speed=%.1fx samples=%u (%.0f/s) notifications=%llu bytes=%llu dropped=%llu "
+           "loop_us mean=%.1f p99=%.1f max=%.1f spo2=%.1f conf=%.2f pi=%.2f\n",
+           simS, wallS, wallS > 0 ? simS / wallS : 0, app.samples(), wallS > 0 ? app.samples() / wallS : 0,
+           (unsigned long long)transport.notifications(), (unsigned long long)transport.bytes(),
+           (unsigned long long)transport.dropped(), loopNs.mean() / 1000.0, loopNs.percentile(99) / 1000.0,
+           loopNs.max() / 1000.0, app.oxygen().spo2, app.oxygen().confidence, app.oxygen().perfusion);
+    fflush(stdout);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options opts;
+  if (!parseArgs(argc, argv, opts))
+  {
+    fprintf(stderr,
+            "usage: %s [--port N] [--speed X (0 = unthrottled)] [--session SECONDS] [--quiet]\n"
+            "          [--hr BPM] [--spo2 PCT] [--motion PER_MIN] [--seed N] [--flash FILE]\n",
+            argv[0]);
+    return 2;
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  SimClock clock(opts.speed);
+  HostPlatform platform(clock, opts.quiet);
+  SimSensor sensor(clock, opts.synth);
+  SocketTransport transport(opts.port);
+  // The size of the ESP32 "trends" partition
+  HostFlash flash(0x60000);
+  if (opts.flash && !flash.open(opts.flash))
+  {
+    fprintf(stderr, "Cannot open %s\n", opts.flash);
+    return 1;
+  }
+  PpgApp app(platform, sensor, transport, &flash);
+  runningApp = &app;
+
+  app.begin();
+  if (!transport.begin("ESP32-PPG", handleCommand, handleDisconnect))
+    return 1;
+  sensor.begin();
+  if (opts.session > 0)
+    app.handleCommand("START", 0);
+
+  StageStats loopNs;
+  int64_t startNs = monotonicNs();
+  int64_t nextReportNs = startNs + 5000000000LL;
+  uint64_t sessionEndUs = clock.nowUs() + opts.session * 1000000ULL;
+  while (!stopRequested)
+  {
+    int64_t before = monotonicNs();
+    app.loop();
+    int64_t after = monotonicNs();
+    if (app.recording())
+      loopNs.add((uint32_t)(after - before));
+    if (after >= nextReportNs)
+    {
+      report(clock, app, transport, loopNs, (after - startNs) / 1e9);
+      nextReportNs += 5000000000LL;
+    }
+    if (opts.session > 0 && clock.nowUs() >= sessionEndUs)
+      break;
+  }
+  if (app.recording())
+    app.handleCommand("STOP", 0);
+  // Lets the app close the session's trend records
+  app.loop();
+  report(clock, app, transport, loopNs, (monotonicNs() - startNs) / 1e9);
+  return 0;
+}
@@ -15,7 +15,7 @@ import warnings
 warnings.filterwarnings('ignore')
 
 print("======= ENHANCED STRESS PREDICTION MODEL (NO XGBOOST) =======")
-print("FOCUSED VERSION: Using only HRV, Heart Rate, Blood Pressure, and Blood Oxygen")
+print("FOCUSED VERSION: Using only HRV, Heart Rate, Blood Pressure, Blood Oxygen and Respiration Rate")
 
 # Load the dataset
 df = pd.read_csv('stress_data.csv')
@@ -38,7 +38,8 @@ X = filtered_df[[
     'Heart Rate (BPM)', 
     'Systolic', 
     'Diastolic', 
-    'Oxygen Saturation (%)'
+    'Oxygen Saturation (%)',
+    'Respiration Rate (BPM)'  # estimated on the device from PPG modulation
 ]]
 
 # Create target variable
@@ -78,6 +79,7 @@ extended_df['HRV_Oxygen_Interaction'] = extended_df['HRV (ms)'] * extended_df['O
 extended_df['HRV_Diastolic'] = extended_df['HRV (ms)'] / extended_df['Diastolic']
 extended_df['Oxygen_BP_Ratio'] = extended_df['Oxygen Saturation (%)'] / extended_df['MAP']
 extended_df['HR_BP_Product'] = extended_df['Heart Rate (BPM)'] * extended_df['MAP'] / 100
+extended_df['HR_Resp_Ratio'] = extended_df['Heart Rate (BPM)'] / extended_df['Respiration Rate (BPM)'] # Cardiorespiratory coupling
 
 print(f"Extended feature matrix shape: {extended_df.shape}")
 
@@ -207,7 +209,7 @@ plt.savefig('feature_importance.png')
 print("Saved feature importance plot")
 
 # Create a prediction function using only the core metrics + derived features
-def predict_stress(hrv, heart_rate, systolic, diastolic, oxygen_saturation):
+def predict_stress(hrv, heart_rate, systolic, diastolic, oxygen_saturation, respiration_rate):
     """
     Predict stress level using advanced feature engineering and ensemble model
     """
@@ -217,7 +219,8 @@ def predict_stress(hrv, heart_rate, systolic, diastolic, oxygen_saturation):
         'Heart Rate (BPM)': heart_rate,
         'Systolic': systolic,
         'Diastolic': diastolic,
-        'Oxygen Saturation (%)': oxygen_saturation
+        'Oxygen Saturation (%)': oxygen_saturation,
+        'Respiration Rate (BPM)': respiration_rate
     }
     
     # Create all the derived features
@@ -245,6 +248,7 @@ def predict_stress(hrv, heart_rate, systolic, diastolic, oxygen_saturation):
     input_data['HRV_Diastolic'] = input_data['HRV (ms)'] / input_data['Diastolic']
     input_data['Oxygen_BP_Ratio'] = input_data['Oxygen Saturation (%)'] / input_data['MAP']
     input_data['HR_BP_Product'] = input_data['Heart Rate (BPM)'] * input_data['MAP'] / 100
+    input_data['HR_Resp_Ratio'] = input_data['Heart Rate (BPM)'] / input_data['Respiration Rate (BPM)']
     
     # Extract only the features used in the model
     input_selected = input_data[top_features]
@@ -264,7 +268,8 @@ state1, prob1 = predict_stress(
     heart_rate=110,      # High heart rate
     systolic=150,        # Elevated BP
     diastolic=95,
-    oxygen_saturation=96
+    oxygen_saturation=96,
+    respiration_rate=22  # Fast breathing
 )
 print(f"High stress profile: {state1} with {prob1:.2%} probability")
 
@@ -274,7 +279,8 @@ state2, prob2 = predict_stress(
     heart_rate=72,       # Normal heart rate
     systolic=120,        # Normal BP
     diastolic=80,
-    oxygen_saturation=99
+    oxygen_saturation=99,
+    respiration_rate=14  # Normal breathing
 )
 print(f"Low stress profile: {state2} with {prob2:.2%} probability")
 
@@ -0,0 +1,107 @@
+import argparse
+import struct
+
+import joblib
+import numpy as np
+
+# Exports the stress ensemble saved by src/mlmodel.py for the C++ batch
+# scorer (src/host/scorer, file format in stress_model.h):
+#
+#   python3 src/mlmodel_export.py enhanced_stress_model.pkl enhanced_model_metadata.pkl stress.psm
+#
+# The pipeline's StandardScaler and the soft-voting members are written as
+# they are: random forest and gradient boosting trees, the MLP's layers and
+# the SVMs' support vectors with their Platt scaling. A linear SVM is
+# written as its weight vector.
+
+FOREST, BOOSTING, MLP, SVM = range(4)
+ACTIVATIONS = {"identity": 0, "logistic": 1, "tanh": 2, "relu": 3}
+LINEAR, RBF = range(2)
+NODE = np.dtype([("feature", "<i4"), ("threshold", "<f8"), ("left", "<i4"), ("right", "<i4"), ("value", "<f8")])
+
+
+def name_bytes(name):
+    data = name.encode()
+    return struct.pack("<B", len(data)) + data
+
+
+def f64s(values):
+    return np.asarray(values, dtype="<f8").ravel().tobytes()
+
+
+def tree_bytes(tree, leaf_value):
+    nodes = np.zeros(tree.node_count, dtype=NODE)
+    leaf = tree.children_left < 0
+    nodes["feature"] = np.where(leaf, -1, tree.feature)
+    nodes["threshold"] = tree.threshold
+    nodes["left"] = tree.children_left
+    nodes["right"] = tree.children_right
+    nodes["value"] = leaf_value(tree.value)
+    return struct.pack("<I", tree.node_count) + nodes.tobytes()
+
+
+def trees_bytes(trees, leaf_value):
+    return struct.pack("<I", len(trees)) + b"".join(tree_bytes(t.tree_, leaf_value) for t in trees)
+
+
+def member_bytes(model, n_features):
+    kind = type(model).__name__
+    if kind == "RandomForestClassifier":
+        # P(stressed) per leaf; older scikit-learn stores counts
+        value = lambda v: v[:, 0, 1] / v[:, 0, :].sum(axis=1)
+        return FOREST, trees_bytes(model.estimators_, value)
+    if kind == "GradientBoostingClassifier":
+        init = float(model._raw_predict_init(np.zeros((1, n_features)))[0, 0])
+        value = lambda v: v[:, 0, 0]
+        stages = [stage[0] for stage in model.estimators_]
+        return BOOSTING, struct.pack("<dd", init, model.learning_rate) + trees_bytes(stages, value)
+    if kind == "MLPClassifier":
+        data = struct.pack("<BI", ACTIVATIONS[model.activation], len(model.coefs_))
+        for weights, bias in zip(model.coefs_, model.intercepts_):
+            data += struct.pack("<II", *weights.shape) + f64s(weights) + f64s(bias)
+        return MLP, data
+    if kind == "SVC":
+        if model.kernel == "linear":
+            kernel, coefs, vectors = LINEAR, [1.0], model.coef_
+        elif model.kernel == "rbf":
+            kernel, coefs, vectors = RBF, model.dual_coef_[0], model.support_vectors_
+        else:
+            raise SystemExit(f"unsupported SVM kernel {model.kernel}")
+        data = struct.pack("<Bdddd", kernel, model._gamma, model.intercept_[0], model.probA_[0], model.probB_[0])
+        data += struct.pack("<I", len(coefs))
+        for coef, vector in zip(coefs, vectors):
+            data += f64s([coef]) + f64s(vector)
+        return SVM, data
+    raise SystemExit(f"unsupported member {kind}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Export the stress model for the C++ batch scorer")
+    parser.add_argument("model", help="enhanced_stress_model.pkl")
+    parser.add_argument("metadata", help="enhanced_model_metadata.pkl")
+    parser.add_argument("out", help="model file to write, e.g. stress.psm")
+    args = parser.parse_args()
+
+    pipeline = joblib.load(args.model)
+    features = joblib.load(args.metadata)["feature_names"]
+    scaler = pipeline.named_steps["scaler"]
+    voting = pipeline.named_steps["model"]
+    if voting.voting != "soft" or list(voting.classes_) != [0, 1]:
+        raise SystemExit("expected a soft-voting classifier over classes 0 and 1")
+
+    data = b"PSM1" + struct.pack("<I", len(features))
+    data += b"".join(name_bytes(f) for f in features)
+    data += f64s(scaler.mean_) + f64s(scaler.scale_)
+    names = [name for name, _ in voting.estimators]
+    weights = voting.weights if voting.weights is not None else [1.0] * len(names)
+    data += struct.pack("<I", len(names))
+    for name, weight, member in zip(names, weights, voting.estimators_):
+        kind, body = member_bytes(member, len(features))
+        data += struct.pack("<B", kind) + name_bytes(name) + struct.pack("<d", weight) + body
+    with open(args.out, "wb") as f:
+        f.write(data)
+    print(f"{args.out}: {len(features)} features, members {', '.join(names)}, {len(data)} bytes")
+
+
+if __name__ == "__main__":
+    main()
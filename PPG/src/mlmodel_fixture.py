@@ -0,0 +1,186 @@
+import argparse
+import math
+import random
+import struct
+
+# Writes the small stress model the bench checks the batch scorer with
+# (src/host/bench/scorer_check.cpp), and the probabilities this script
+# computes for a set of windows in double precision, the way scikit-learn
+# does:
+#
+#   python3 src/mlmodel_fixture.py bench/stress_fixture
+#
+# gives bench/stress_fixture.psm, in mlmodel_export.py's format, and
+# bench/stress_fixture.csv. The members are random but have every shape
+# the export writes: a forest, gradient boosting, a ReLU MLP, an RBF SVM
+# and a linear one, over all of mlmodel.py's engineered features. Only
+# the standard library is needed, so the fixture can be regenerated
+# without the training environment. Trees compare float32 features, as
+# scikit-learn's do.
+
+FOREST, BOOSTING, MLP, SVM = range(4)
+RELU = 3
+LINEAR, RBF = range(2)
+INPUTS = ["hrv", "heart_rate", "sbp", "dbp", "oxygen", "resp_rate"]
+RANGES = [(15, 110), (50, 130), (100, 160), (60, 100), (92, 100), (10, 26)]
+FEATURES = [
+    "HRV (ms)", "Heart Rate (BPM)", "Systolic", "Diastolic", "Oxygen Saturation (%)", "Respiration Rate (BPM)",
+    "HR_HRV_Ratio", "Pulse_Pressure", "MAP", "RPP", "Max_HR_Estimated", "HR_Reserve_Used", "HRV_Complexity",
+    "HRV (ms)_squared", "HRV (ms)_cubed", "log_HRV (ms)", "Heart Rate (BPM)_squared", "Heart Rate (BPM)_cubed",
+    "log_Heart Rate (BPM)", "HR_HRV_Ratio_squared", "HR_HRV_Ratio_cubed", "log_HR_HRV_Ratio",
+    "HR_Systolic_Interaction", "HR_Oxygen_Interaction", "HRV_Oxygen_Interaction", "HRV_Diastolic",
+    "Oxygen_BP_Ratio", "HR_BP_Product", "HR_Resp_Ratio",
+]
+
+
+def f32(x):
+    return struct.unpack("<f", struct.pack("<f", x))[0]
+
+
+def engineer(hrv, hr, sbp, dbp, spo2, resp):
+    # src/mlmodel.py's features, in FEATURES order; ZeroDivisionError for
+    # a window the scorer gives NAN
+    ratio = hr / hrv
+    pulse = sbp - dbp
+    mean_ap = dbp + pulse / 3
+    return [
+        hrv, hr, sbp, dbp, spo2, resp, ratio, pulse, mean_ap, hr * sbp / 100, 195.0, hr / 195.0 * 100,
+        hrv / hr * 10, hrv ** 2, hrv ** 3, math.log1p(abs(hrv)), hr ** 2, hr ** 3, math.log1p(abs(hr)),
+        ratio ** 2, ratio ** 3, math.log1p(abs(ratio)), hr * sbp, hr * spo2, hrv * spo2, hrv / dbp,
+        spo2 / mean_ap, hr * mean_ap / 100, hr / resp,
+    ]
+
+
+def tree(rng, depth, leaf_value):
+    # (feature, threshold, left, right, value), numbered depth first
+    nodes = []
+
+    def build(d):
+        k = len(nodes)
+        nodes.append(None)
+        if d == depth or (d > 1 and rng.random() < 0.25):
+            nodes[k] = (-1, -2.0, -1, -1, leaf_value())
+            return k
+        feature, threshold = rng.randrange(len(FEATURES)), rng.gauss(0, 1)
+        left = build(d + 1)
+        right = build(d + 1)
+        nodes[k] = (feature, threshold, left, right, 0.0)
+        return k
+
+    build(0)
+    return nodes
+
+
+def walk(nodes, x32):
+    k = 0
+    while nodes[k][0] >= 0:
+        feature, threshold, left, right, _ = nodes[k]
+        k = left if x32[feature] <= threshold else right
+    return nodes[k][4]
+
+
+def sigmoid(z):
+    return 1 / (1 + math.exp(-z)) if z > -700 else 0.0
+
+
+def platt(decision, a, b):
+    # libsvm's, as SVC.predict_proba gives it for class 1
+    f = -decision * a + b
+    p = math.exp(-f) / (1 + math.exp(-f)) if f >= 0 else 1 / (1 + math.exp(f))
+    return 1 - min(max(p, 1e-7), 1 - 1e-7)
+
+
+def name_bytes(name):
+    return struct.pack("<B", len(name)) + name.encode()
+
+
+def f64s(values):
+    return struct.pack("<%dd" % len(values), *values)
+
+
+def trees_bytes(trees):
+    data = struct.pack("<I", len(trees))
+    for nodes in trees:
+        data += struct.pack("<I", len(nodes)) + b"".join(struct.pack("<idiid", *n) for n in nodes)
+    return data
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Write the bench's stress model fixture")
+    parser.add_argument("out", help="path without extension, e.g. bench/stress_fixture")
+    parser.add_argument("--windows", type=int, default=300)
+    parser.add_argument("--seed", type=int, default=47)
+    args = parser.parse_args()
+    rng = random.Random(args.seed)
+    n = len(FEATURES)
+
+    # Scaler fitted on windows over the training ranges; a constant
+    # feature gets scale 1, as StandardScaler does
+    sample = [engineer(*[rng.uniform(lo, hi) for lo, hi in RANGES]) for _ in range(2000)]
+    means = [sum(c) / len(c) for c in zip(*sample)]
+    scales = [math.sqrt(sum((v - m) ** 2 for v in c) / len(c)) or 1.0 for c, m in zip(zip(*sample), means)]
+
+    forest = [tree(rng, 6, rng.random) for _ in range(6)]
+    boosting = [tree(rng, 4, lambda: rng.gauss(0, 0.8)) for _ in range(6)]
+    boost_init, boost_rate = -0.2, 0.3
+    sizes = [n, 12, 6, 1]
+    mlp = [([[rng.gauss(0, 1 / math.sqrt(a)) for _ in range(b)] for _ in range(a)],
+            [rng.gauss(0, 0.1) for _ in range(b)]) for a, b in zip(sizes, sizes[1:])]
+    vectors = [(rng.gauss(0, 1), [rng.gauss(0, 1) for _ in range(n)]) for _ in range(24)]
+    gamma, rbf_intercept, rbf_a, rbf_b = 1 / n, 0.3, -1.7, 0.05
+    weights = [rng.gauss(0, 0.3) for _ in range(n)]
+    linear_intercept, linear_a, linear_b = -0.2, -2.1, -0.1
+    members = ["rf", "gbm", "mlp", "svm_rbf", "svm_linear"]
+
+    data = b"PSM1" + struct.pack("<I", n) + b"".join(name_bytes(f) for f in FEATURES)
+    data += f64s(means) + f64s(scales) + struct.pack("<I", len(members))
+    data += struct.pack("<B", FOREST) + name_bytes("rf") + f64s([1.0]) + trees_bytes(forest)
+    data += struct.pack("<B", BOOSTING) + name_bytes("gbm") + f64s([1.0, boost_init, boost_rate])
+    data += trees_bytes(boosting)
+    data += struct.pack("<B", MLP) + name_bytes("mlp") + f64s([1.0]) + struct.pack("<BI", RELU, len(mlp))
+    for w, bias in mlp:
+        data += struct.pack("<II", len(w), len(bias)) + b"".join(f64s(row) for row in w) + f64s(bias)
+    data += struct.pack("<B", SVM) + name_bytes("svm_rbf") + f64s([1.0])
+    data += struct.pack("<B", RBF) + f64s([gamma, rbf_intercept, rbf_a, rbf_b]) + struct.pack("<I", len(vectors))
+    for coef, v in vectors:
+        data += f64s([coef] + v)
+    data += struct.pack("<B", SVM) + name_bytes("svm_linear") + f64s([1.0])
+    data += struct.pack("<B", LINEAR) + f64s([gamma, linear_intercept, linear_a, linear_b]) + struct.pack("<I", 1)
+    data += f64s([1.0] + weights)
+    with open(args.out + ".psm", "wb") as f:
+        f.write(data)
+
+    # Windows as the scorer reads them, in float32, including ones with a
+    # zero HRV, diastolic or respiration rate that it must give NAN
+    windows = [[f32(rng.uniform(lo, hi)) for lo, hi in RANGES] for _ in range(args.windows)]
+    for row, column in ((7, 0), (100, 3), (263, 5)):
+        if row < len(windows):
+            windows[row][column] = 0.0
+    with open(args.out + ".csv", "w") as f:
+        f.write(",".join(INPUTS + ["stress"] + ["stress_" + m for m in members]) + "\n")
+        for w in windows:
+            try:
+                x = [(v - m) / s for v, m, s in zip(engineer(*w), means, scales)]
+            except ZeroDivisionError:
+                f.write(",".join(["%.9g" % v for v in w] + ["nan"] * (len(members) + 1)) + "\n")
+                continue
+            x32 = [f32(v) for v in x]
+            p_forest = sum(walk(t, x32) for t in forest) / len(forest)
+            p_boosting = sigmoid(boost_init + boost_rate * sum(walk(t, x32) for t in boosting))
+            a = x
+            for layer, (w_layer, bias) in enumerate(mlp):
+                a = [bias[j] + sum(w_layer[k][j] * a[k] for k in range(len(a))) for j in range(len(bias))]
+                if layer < len(mlp) - 1:
+                    a = [max(0.0, v) for v in a]
+            p_mlp = sigmoid(a[0])
+            rbf = sum(c * math.exp(-gamma * sum((x[k] - v[k]) ** 2 for k in range(n))) for c, v in vectors)
+            p_rbf = platt(rbf + rbf_intercept, rbf_a, rbf_b)
+            p_linear = platt(sum(wk * xk for wk, xk in zip(weights, x)) + linear_intercept, linear_a, linear_b)
+            p = [p_forest, p_boosting, p_mlp, p_rbf, p_linear]
+            f.write(",".join(["%.9g" % v for v in w + [sum(p) / len(p)] + p]) + "\n")
+    print(f"{args.out}.psm: {n} features, members {', '.join(members)}, {len(data)} bytes; "
+          f"{args.out}.csv: {len(windows)} windows")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,118 @@
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+import joblib
+import numpy as np
+import pandas as pd
+
+# Parity report of the C++ batch scorer (src/host/scorer) against the
+# Python stress model it was exported from (src/mlmodel_export.py):
+#
+#   pio run -e scorer
+#   python3 src/mlmodel_parity.py enhanced_stress_model.pkl enhanced_model_metadata.pkl stress.psm \
+#       --csv stress_data.csv --random 100000
+#
+# Scores the training CSV's windows and/or random windows over the same
+# ranges with both, the ensemble and each member, and reports the largest,
+# mean and 99th percentile probability differences and how many windows
+# change label at 0.5. Inputs are rounded to float32 first, as the scorer
+# reads them. Exits non-zero if the ensemble differs by more than
+# --tolerance anywhere.
+
+INPUTS = ["hrv", "heart_rate", "sbp", "dbp", "oxygen", "resp_rate"]
+RANGES = [(15, 110), (50, 130), (100, 160), (60, 100), (92, 100), (10, 26)]
+
+
+def engineer(base):
+    # src/mlmodel.py's feature engineering, column for column
+    df = pd.DataFrame({
+        'HRV (ms)': base[:, 0], 'Heart Rate (BPM)': base[:, 1], 'Systolic': base[:, 2],
+        'Diastolic': base[:, 3], 'Oxygen Saturation (%)': base[:, 4], 'Respiration Rate (BPM)': base[:, 5],
+    })
+    df['HR_HRV_Ratio'] = df['Heart Rate (BPM)'] / df['HRV (ms)']
+    df['Pulse_Pressure'] = df['Systolic'] - df['Diastolic']
+    df['MAP'] = df['Diastolic'] + (df['Pulse_Pressure'] / 3)
+    df['RPP'] = df['Heart Rate (BPM)'] * df['Systolic'] / 100
+    df['Max_HR_Estimated'] = 220 - 25
+    df['HR_Reserve_Used'] = (df['Heart Rate (BPM)'] / df['Max_HR_Estimated']) * 100
+    df['HRV_Complexity'] = df['HRV (ms)'] / df['Heart Rate (BPM)'] * 10
+    for col in ['HRV (ms)', 'Heart Rate (BPM)', 'HR_HRV_Ratio']:
+        df[f'{col}_squared'] = df[col] ** 2
+        df[f'{col}_cubed'] = df[col] ** 3
+        df[f'log_{col}'] = np.log1p(np.abs(df[col]))
+    df['HR_Systolic_Interaction'] = df['Heart Rate (BPM)'] * df['Systolic']
+    df['HR_Oxygen_Interaction'] = df['Heart Rate (BPM)'] * df['Oxygen Saturation (%)']
+    df['HRV_Oxygen_Interaction'] = df['HRV (ms)'] * df['Oxygen Saturation (%)']
+    df['HRV_Diastolic'] = df['HRV (ms)'] / df['Diastolic']
+    df['Oxygen_BP_Ratio'] = df['Oxygen Saturation (%)'] / df['MAP']
+    df['HR_BP_Product'] = df['Heart Rate (BPM)'] * df['MAP'] / 100
+    df['HR_Resp_Ratio'] = df['Heart Rate (BPM)'] / df['Respiration Rate (BPM)']
+    return df
+
+
+def csv_windows(path):
+    df = pd.read_csv(path)
+    bp = df['Blood Pressure (mmHg)'].str.split('/', expand=True).astype(float)
+    return np.column_stack([df['HRV (ms)'], df['Heart Rate (BPM)'], bp[0], bp[1],
+                            df['Oxygen Saturation (%)'], df['Respiration Rate (BPM)']]).astype(float)
+
+
+def report(name, python, native):
+    diff = np.abs(python - native)
+    flips = int(np.sum((python > 0.5) != (native > 0.5)))
+    print(f"  {name:<12} max={diff.max():.2e} mean={diff.mean():.2e} p99={np.percentile(diff, 99):.2e} "
+          f"label flips={flips}")
+    return diff.max()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Parity of the C++ batch scorer against the Python stress model")
+    parser.add_argument("model", help="enhanced_stress_model.pkl")
+    parser.add_argument("metadata", help="enhanced_model_metadata.pkl")
+    parser.add_argument("psm", help="the same model exported by mlmodel_export.py")
+    parser.add_argument("--scorer", default=".pio/build/scorer/program")
+    parser.add_argument("--csv", help="score the windows of this training CSV")
+    parser.add_argument("--random", type=int, default=0, help="also score this many random windows")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--tolerance", type=float, default=1e-4)
+    args = parser.parse_args()
+
+    parts = []
+    if args.csv:
+        parts.append(csv_windows(args.csv))
+    if args.random:
+        rng = np.random.default_rng(args.seed)
+        parts.append(np.column_stack([rng.uniform(lo, hi, args.random) for lo, hi in RANGES]))
+    if not parts:
+        sys.exit("nothing to score: give --csv and/or --random")
+    base = np.vstack(parts).astype(np.float32)
+
+    windows = tempfile.mkdtemp()
+    for k, name in enumerate(INPUTS):
+        base[:, k].tofile(os.path.join(windows, f"{name}.col"))
+    run = subprocess.run([args.scorer, "--model", args.psm, "--windows", windows, "--members"],
+                         check=True, capture_output=True, text=True)
+    print(run.stdout, end="")
+
+    pipeline = joblib.load(args.model)
+    features = joblib.load(args.metadata)["feature_names"]
+    x = engineer(base.astype(np.float64))[features]
+    scaled = pipeline.named_steps["scaler"].transform(x)
+    voting = pipeline.named_steps["model"]
+    scores = os.path.join(windows, "scores")
+
+    print(f"parity over {len(base)} windows:")
+    worst = report("ensemble", pipeline.predict_proba(x)[:, 1],
+                   np.fromfile(os.path.join(scores, "stress.col"), dtype="<f4"))
+    for (name, _), member in zip(voting.estimators, voting.estimators_):
+        native = np.fromfile(os.path.join(scores, f"stress_{name}.col"), dtype="<f4")
+        report(name, member.predict_proba(scaled)[:, 1], native)
+    if worst > args.tolerance:
+        sys.exit(f"ensemble differs by {worst:.2e} > {args.tolerance:.0e}")
+
+
+if __name__ == "__main__":
+    main()
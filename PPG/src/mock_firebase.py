@@ -0,0 +1,147 @@
+import argparse
+import json
+import random
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+# Offline stand-in for the Realtime Database REST API used by the WiFi
+# build's uploader. Build the firmware with
+#   build_flags = -DUPLOAD_URL=\"http://<this machine>:8080\"
+# and watch request/record counts to measure batching, retries and loss.
+# src/cloud_writes.py drives the app's write-behind buffer against it.
+
+parser = argparse.ArgumentParser(description="Mock Firebase Realtime Database endpoint")
+parser.add_argument("--port", type=int, default=8080)
+parser.add_argument("--fail-rate", type=float, default=0.0, help="fraction of requests answered with 503")
+parser.add_argument("--latency-ms", type=int, default=0, help="delay added to every request")
+parser.add_argument("--dump", help="write the final database tree to this JSON file")
+args = parser.parse_args()
+
+lock = threading.Lock()
+tree = {}
+stats = {"requests": 0, "failed": 0, "bytes": 0, "records": 0, "duplicates": 0}
+seen_keys = set()
+
+
+def node_for(path, create):
+    node = tree
+    for part in [p for p in path.split("/") if p]:
+        if part not in node:
+            if not create:
+                return None
+            node[part] = {}
+        node = node[part]
+    return node
+
+
+class Handler(BaseHTTPRequestHandler):
+    def log_message(self, format, *args):
+        pass
+
+    def reply(self, code, body):
+        data = json.dumps(body).encode()
+        self.send_response(code)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def db_path(self):
+        return self.path.split("?")[0].removesuffix(".json")
+
+    def do_GET(self):
+        with lock:
+            node = node_for(self.db_path(), False)
+        self.reply(200, node)
+
+    def do_PATCH(self):
+        length = int(self.headers.get("Content-Length", 0))
+        body = self.rfile.read(length)
+        if args.latency_ms:
+            time.sleep(args.latency_ms / 1000)
+        with lock:
+            stats["requests"] += 1
+            stats["bytes"] += length
+            if random.random() < args.fail_rate:
+                stats["failed"] += 1
+                self.reply(503, {"error": "injected failure"})
+                return
+        try:
+            update = json.loads(body)
+        except ValueError:
+            self.reply(400, {"error": "invalid JSON"})
+            return
+        path = self.db_path()
+        with lock:
+            # Keys may be paths (multi-location update, as the app's
+            # write-behind buffer sends from the root)
+            for key, value in update.items():
+                store(f"{path}/{key}", value)
+        self.reply(200, update)
+
+    do_PUT = do_PATCH
+
+    def do_POST(self):
+        # push(): one request per record, as the app did before batching
+        length = int(self.headers.get("Content-Length", 0))
+        body = self.rfile.read(length)
+        with lock:
+            stats["requests"] += 1
+            stats["bytes"] += length
+            if random.random() < args.fail_rate:
+                stats["failed"] += 1
+                self.reply(503, {"error": "injected failure"})
+                return
+            key = f"-push{stats['requests']:015d}"
+            store(f"{self.db_path()}/{key}", json.loads(body))
+        self.reply(200, {"name": key})
+
+
+def store(full, value):
+    full = "/" + "/".join(p for p in full.split("/") if p)
+    parent, _, leaf = full.rpartition("/")
+    if parent.endswith("/readings"):
+        if full in seen_keys:
+            stats["duplicates"] += 1
+        else:
+            seen_keys.add(full)
+            stats["records"] += 1
+    node_for(parent, True)[leaf] = server_values(value)
+
+
+def server_values(value):
+    # {".sv": "timestamp"}, which the sensor uses to stamp sessionIndex
+    if isinstance(value, dict):
+        if value == {".sv": "timestamp"}:
+            return int(time.time() * 1000)
+        return {k: server_values(v) for k, v in value.items()}
+    return value
+
+
+def report():
+    with lock:
+        s = dict(stats)
+    per_request = s["records"] / max(1, s["requests"] - s["failed"])
+    print(f"requests={s['requests']} failed={s['failed']} records={s['records']} "
+          f"duplicates={s['duplicates']} bytes={s['bytes']} records/request={per_request:.1f}")
+
+
+def report_loop():
+    while True:
+        time.sleep(10)
+        report()
+
+
+server = ThreadingHTTPServer(("0.0.0.0", args.port), Handler)
+threading.Thread(target=report_loop, daemon=True).start()
+print(f"Mock database on port {args.port} (fail rate {args.fail_rate}, latency {args.latency_ms} ms)")
+try:
+    server.serve_forever()
+except KeyboardInterrupt:
+    print("\nExiting...")
+finally:
+    report()
+    if args.dump:
+        with open(args.dump, "w") as f:
+            json.dump(tree, f, indent=1)
@@ -0,0 +1,204 @@
+#include "net_service.h"
+
+#include <WiFi.h>
+#include <WiFiUdp.h>
+
+namespace
+{
+  const int MAX_CLIENTS = 4;
+  const size_t MAX_LINE = 128;
+  const unsigned long CLIENT_TIMEOUT_MS = 5000;
+  const unsigned long RECONNECT_MIN_MS = 5000;
+  const unsigned long RECONNECT_MAX_MS = 30000;
+
+  struct CommandClient
+  {
+    WiFiClient client;
+    char line[MAX_LINE];
+    size_t len;
+    unsigned long since;
+    bool active;
+  };
+
+  WiFiServer server(COMMAND_PORT);
+  WiFiUDP udp;
+  CommandClient clients[MAX_CLIENTS];
+  NetCommandHandler commandHandler = nullptr;
+
+  // Written from the WiFi event task, read from loop().
+  volatile bool connected = false;
+  volatile bool linkChanged = false;
+  volatile uint8_t lastDisconnectReason = 0;
+
+  unsigned long reconnectAt = 0;
+  unsigned long reconnectDelay = RECONNECT_MIN_MS;
+  bool servicesStarted = false;
+
+  void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info)
+  {
+    switch (event)
+    {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+      connected = true;
+      linkChanged = true;
+      break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+      lastDisconnectReason = info.wifi_sta_disconnected.reason;
+      // fall through
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+      if (connected)
+        linkChanged = true;
+      connected = false;
+      break;
+    default:
+      break;
+    }
+  }
+
+  void handleLinkChange()
+  {
+    linkChanged = false;
+    if (connected)
+    {
+      Serial.println("WiFi connected! IP: " + WiFi.localIP().toString());
+      reconnectDelay = RECONNECT_MIN_MS;
+      if (!servicesStarted)
+      {
+        server.begin();
+        server.setNoDelay(true);
+        udp.begin(DISCOVERY_PORT);
+        servicesStarted = true;
+        Serial.println("Discovery service started on port " + String(DISCOVERY_PORT));
+      }
+    }
+    else
+    {
+      // Sampling and recording carry on; the uploader queues readings.
+      Serial.printf("WiFi lost (reason %u), reconnecting in background\n", lastDisconnectReason);
+      reconnectAt = millis() + reconnectDelay;
+    }
+  }
+
+  void maintainConnection()
+  {
+    if (connected || (long)(millis() - reconnectAt) < 0)
+      return;
+    // WiFi.reconnect() only starts the attempt; the outcome arrives as an
+    // event, so a dead access point never stalls loop().
+    WiFi.reconnect();
+    reconnectAt = millis() + reconnectDelay;
+    reconnectDelay = min(reconnectDelay * 2, RECONNECT_MAX_MS);
+  }
+
+  void handleDiscoveryRequests()
+  {
+    int packetSize = udp.parsePacket();
+    if (!packetSize)
+      return;
+    char incomingPacket[255];
+    int len = udp.read(incomingPacket, sizeof(incomingPacket) - 1);
+    incomingPacket[len > 0 ? len : 0] = 0;
+
+    String request = String(incomingPacket);
+    if (request == "DISCOVER_ESP32")
+    {
+      String response = "ESP32_DEVICE:" + WiFi.macAddress();
+      udp.beginPacket(udp.remoteIP(), udp.remotePort());
+      udp.print(response);
+      udp.endPacket();
+    }
+  }
+
+  void acceptClients()
+  {
+    while (server.hasClient())
+    {
+      CommandClient *slot = nullptr;
+      for (CommandClient &c : clients)
+      {
+        if (!c.active)
+        {
+          slot = &c;
+          break;
+        }
+      }
+      WiFiClient incoming = server.available();
+      if (!slot)
+      {
+        incoming.println("ERROR: Busy");
+        incoming.stop();
+        continue;
+      }
+      slot->client = incoming;
+      slot->len = 0;
+      slot->since = millis();
+      slot->active = true;
+    }
+  }
+
+  void finishClient(CommandClient &c, const String &reply)
+  {
+    c.client.println(reply);
+    c.client.stop();
+    c.active = false;
+  }
+
+  // Reads whatever bytes have arrived; a command runs once its newline does.
+  void serviceClients()
+  {
+    for (CommandClient &c : clients)
+    {
+      if (!c.active)
+        continue;
+      while (c.client.available())
+      {
+        char ch = c.client.read();
+        if (ch == '\n')
+        {
+          c.line[c.len] = '\0';
+          String command = String(c.line);
+          command.trim();
+          finishClient(c, commandHandler ? commandHandler(command) : String("ERROR: Unknown command"));
+          break;
+        }
+        if (c.len < MAX_LINE - 1)
+          c.line[c.len++] = ch;
+      }
+      if (c.active && (!c.client.connected() || millis() - c.since > CLIENT_TIMEOUT_MS))
+      {
+        c.client.stop();
+        c.active = false;
+      }
+    }
+  }
+}
+
+void netBegin(NetCommandHandler handler)
+{
+  commandHandler = handler;
+  // Reconnects are scheduled by netLoop() so they can back off.
+  WiFi.setAutoReconnect(false);
+  WiFi.onEvent(onWiFiEvent);
+  if (WiFi.status() == WL_CONNECTED)
+  {
+    connected = true;
+    linkChanged = true;
+  }
+}
+
+void netLoop()
+{
+  if (linkChanged)
+    handleLinkChange();
+  maintainConnection();
+  if (!connected || !servicesStarted)
+    return;
+  handleDiscoveryRequests();
+  acceptClients();
+  serviceClients();
+}
+
+bool netConnected()
+{
+  return connected;
+}
@@ -0,0 +1,21 @@
+#ifndef PPG_NET_SERVICE_H
+#define PPG_NET_SERVICE_H
+
+#include <Arduino.h>
+
+// Network housekeeping for the WiFi build, driven from loop() without ever
+// blocking it: WiFi state comes from driver events and reconnects are
+// scheduled with backoff, the TCP command server reads lines from several
+// clients incrementally, and UDP discovery is answered in the same pass.
+
+const int COMMAND_PORT = 80;
+const int DISCOVERY_PORT = 8266;
+
+// Handles one command line and returns the reply sent back to the client.
+typedef String (*NetCommandHandler)(const String &command);
+
+void netBegin(NetCommandHandler handler);
+void netLoop();
+bool netConnected();
+
+#endif
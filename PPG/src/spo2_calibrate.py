@@ -0,0 +1,185 @@
+import argparse
+import csv
+import math
+import socket
+import struct
+import sys
+
+# Fits the SpO2 calibration curve (SpO2 = a R^2 + b R + c, see
+# lib/ppg_core/src/spo2_estimator.h) from recordings taken alongside a
+# reference oximeter. Each recording is a CSV in the bench trace format
+# (time_ms,ir,red,...,spo2) with the reference reading in the spo2 column.
+# Samples go through the firmware's filter and 100-sample windows, and
+# windows the firmware would score below --min-conf are left out, so the
+# fit sees the ratios the sensor will actually report.
+#
+#   python3 src/spo2_calibrate.py session1.csv session2.csv
+#   python3 src/spo2_calibrate.py --send 127.0.0.1:9760 session*.csv   (simulator)
+#
+# Print the resulting CAL command and write it to the RX characteristic,
+# or pass --send to deliver it over the simulator's TCP transport.
+
+STANDARD = (-45.060, 30.354, 94.845)
+WINDOW = 100
+FILTER_ALPHA_Q15 = round(0.7 * 32768)
+MIN_DC = 50000
+PI_FLOOR, PI_GOOD, PI_HIGH, PI_CEIL = 0.5, 1.5, 4.0, 8.0
+CORR_FLOOR, CORR_GOOD = 0.5, 0.9
+# Below this spread of reference readings a quadratic is not identifiable;
+# only the offset of the standard curve is fitted.
+MIN_SPAN_PCT = 6
+
+
+def ema(values):
+    # emaFilter() in ppg_pipeline.cpp, including the pass-through first sample
+    out, prev = [], 0
+    for v in values:
+        prev = v if prev == 0 else prev + (((v - prev) * FILTER_ALPHA_Q15) >> 15)
+        out.append(prev)
+    return out
+
+
+def score(value, floor, good):
+    if value <= floor:
+        return 0.0
+    return 1.0 if value >= good else (value - floor) / (good - floor)
+
+
+def window_ratio(ir, red):
+    # estimateSpo2() without the curve: returns (R, confidence) or None
+    n = len(ir)
+    ir_dc, red_dc = sum(ir) / n, sum(red) / n
+    sxx = sum((x - ir_dc) ** 2 for x in ir)
+    syy = sum((y - red_dc) ** 2 for y in red)
+    sxy = sum((x - ir_dc) * (y - red_dc) for x, y in zip(ir, red))
+    if ir_dc < MIN_DC or red_dc <= 0 or sxx <= 0 or syy <= 0:
+        return None
+    r = (math.sqrt(syy / n) / red_dc) / (math.sqrt(sxx / n) / ir_dc)
+    if r < 0.2 or r > 1.8:
+        return None
+    pi = 100.0 * (max(ir) - min(ir)) / ir_dc
+    pi_score = score(pi, PI_FLOOR, PI_GOOD) if pi <= PI_HIGH else 1 - score(pi, PI_HIGH, PI_CEIL)
+    return r, pi_score * score(sxy / math.sqrt(sxx * syy), CORR_FLOOR, CORR_GOOD)
+
+
+def load_windows(path, min_conf):
+    with open(path, newline="") as f:
+        rows = list(csv.DictReader(f))
+    if not rows or "spo2" not in rows[0]:
+        sys.exit(f"{path}: needs time_ms, ir, red and spo2 columns")
+    ir = ema(int(row["ir"]) for row in rows)
+    red = ema(int(row["red"]) for row in rows)
+    points, skipped = [], 0
+    for start in range(0, len(rows) - WINDOW + 1, WINDOW):
+        refs = [float(row["spo2"]) for row in rows[start:start + WINDOW] if row["spo2"]]
+        refs = [v for v in refs if v > 0]
+        est = window_ratio(ir[start:start + WINDOW], red[start:start + WINDOW])
+        if len(refs) < WINDOW // 2 or est is None or est[1] < min_conf:
+            skipped += 1
+            continue
+        points.append((est[0], sum(refs) / len(refs)))
+    return points, skipped
+
+
+def solve3(m, v):
+    # Gaussian elimination with partial pivoting
+    a = [row[:] + [v[i]] for i, row in enumerate(m)]
+    for col in range(3):
+        pivot = max(range(col, 3), key=lambda r: abs(a[r][col]))
+        if abs(a[pivot][col]) < 1e-12:
+            return None
+        a[col], a[pivot] = a[pivot], a[col]
+        for r in range(col + 1, 3):
+            k = a[r][col] / a[col][col]
+            for c in range(col, 4):
+                a[r][c] -= k * a[col][c]
+    x = [0.0] * 3
+    for r in (2, 1, 0):
+        x[r] = (a[r][3] - sum(a[r][c] * x[c] for c in range(r + 1, 3))) / a[r][r]
+    return x
+
+
+def curve(coeffs, r):
+    a, b, c = coeffs
+    return (a * r + b) * r + c
+
+
+def fit(points):
+    spo2s = [s for _, s in points]
+    if max(spo2s) - min(spo2s) >= MIN_SPAN_PCT:
+        # Least squares on [R^2, R, 1]
+        sums = [sum(r ** k for r, _ in points) for k in range(5)]
+        m = [[sums[4], sums[3], sums[2]], [sums[3], sums[2], sums[1]], [sums[2], sums[1], sums[0]]]
+        v = [sum(s * r * r for r, s in points), sum(s * r for r, s in points), sum(spo2s)]
+        coeffs = solve3(m, v)
+        if coeffs is not None:
+            return tuple(coeffs), "quadratic"
+    offset = sum(s - curve(STANDARD, r) for r, s in points) / len(points)
+    return (STANDARD[0], STANDARD[1], STANDARD[2] + offset), "offset"
+
+
+def valid(coeffs):
+    # spo2CalibrationValid() in spo2_estimator.cpp
+    prev = math.inf
+    for i in range(9):
+        spo2 = curve(coeffs, 0.4 + 0.1 * i)
+        if not 50 <= spo2 <= 105 or spo2 >= prev:
+            return False
+        prev = spo2
+    return True
+
+
+def rmse(coeffs, points):
+    return math.sqrt(sum((min(curve(coeffs, r), 100) - s) ** 2 for r, s in points) / len(points))
+
+
+def send(address, command):
+    host, port = address.rsplit(":", 1)
+    with socket.create_connection((host, int(port)), timeout=5) as s:
+        s.sendall(command.encode() + b"\n")
+        buf = b""
+        while True:
+            while len(buf) >= 2:
+                n = struct.unpack("<H", buf[:2])[0]
+                if len(buf) < 2 + n:
+                    break
+                payload, buf = buf[2:2 + n], buf[2 + n:]
+                if payload.startswith(b'{"type":"cal"'):
+                    return payload.decode()
+            chunk = s.recv(4096)
+            if not chunk:
+                return None
+            buf += chunk
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fit the SpO2 calibration curve from reference recordings")
+    parser.add_argument("recordings", nargs="+")
+    parser.add_argument("--min-conf", type=float, default=0.5, help="drop windows scored below this")
+    parser.add_argument("--send", metavar="HOST:PORT", help="send the CAL command to a simulator")
+    args = parser.parse_args()
+
+    points = []
+    for path in args.recordings:
+        p, skipped = load_windows(path, args.min_conf)
+        print(f"{path}: {len(p)} windows, {skipped} skipped")
+        points += p
+    if len(points) < 10:
+        sys.exit("need at least 10 usable windows")
+
+    coeffs, kind = fit(points)
+    print(f"reference SpO2 {min(s for _, s in points):.1f}-{max(s for _, s in points):.1f}%, "
+          f"R {min(r for r, _ in points):.3f}-{max(r for r, _ in points):.3f}")
+    print(f"standard curve RMSE {rmse(STANDARD, points):.2f}%")
+    print(f"fitted ({kind}) RMSE {rmse(coeffs, points):.2f}%")
+    if not valid(coeffs):
+        sys.exit("fitted curve is not monotonic within 50-105% over R 0.4-1.2; the firmware would reject it")
+    command = "CAL {:.4f} {:.4f} {:.4f}".format(*coeffs)
+    print(command)
+    if args.send:
+        reply = send(args.send, command)
+        print(reply if reply else "no reply")
+
+
+if __name__ == "__main__":
+    main()
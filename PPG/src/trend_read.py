@@ -0,0 +1,184 @@
+import argparse
+import asyncio
+import csv
+import json
+import math
+import socket
+import struct
+import sys
+import time
+
+# Reads the long-term trend store (lib/ppg_core/src/trend_store.h) off a
+# sensor in one bulk transfer per tier and prints it, or writes it as CSV.
+#
+#   python3 src/trend_read.py day session
+#   python3 src/trend_read.py --since 1200 --csv minutes.csv minute
+#   python3 src/trend_read.py --sim 127.0.0.1:9760 session        (simulator)
+#
+# Day records are rewritten after every session of that day; only the
+# newest one per day is kept here.
+
+DEVICE_NAME = "ESP32-PPG"
+RX_CHAR_UUID = "6e400002-b5a3-f393-e0a9-e50e24dcca9e"  # Write (App -> ESP)
+TX_CHAR_UUID = "6e400003-b5a3-f393-e0a9-e50e24dcca9e"  # Notify (ESP -> App)
+FRAME_MAGIC = 0xA7
+FRAME_VERSION = 1
+RECORD = struct.Struct("<IIHHHHHHBBbxH")
+FIELDS = ["seq", "start", "session", "minutes", "heartRate", "rmssd", "sdnn", "spo2", "sbp", "dbp", "stress"]
+TIMEOUT_S = 10
+
+
+def crc16(data):
+    # CRC-16/CCITT, as in trend_store.cpp
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1) & 0xFFFF
+    return crc
+
+
+def decode_record(raw):
+    seq, start, session, minutes, hr, rmssd, sdnn, spo2, sbp, dbp, stress, crc = RECORD.unpack(raw)
+    if crc16(raw[:-2]) != crc:
+        return None
+    tenths = lambda v: math.nan if v == 0xFFFF else v / 10
+    mmhg = lambda v: math.nan if v == 0xFF else float(v)
+    return {
+        "seq": seq,
+        "start": time.strftime("%Y-%m-%d %H:%M", time.gmtime(start)) if start else "",
+        "session": session,
+        "minutes": minutes,
+        "heartRate": tenths(hr),
+        "rmssd": tenths(rmssd),
+        "sdnn": tenths(sdnn),
+        "spo2": tenths(spo2),
+        "sbp": mmhg(sbp),
+        "dbp": mmhg(dbp),
+        "stress": math.nan if stress == -128 else stress / 10,
+    }
+
+
+class TrendReader:
+    # Collects one TREND reply: header, frames, trendEnd
+    def __init__(self, tier):
+        self.tier = tier
+        self.header = None
+        self.records = []
+        self.bad = 0
+        self.done = asyncio.Event()
+        self.error = None
+
+    def feed(self, data):
+        data = bytes(data)
+        if data and data[0] == FRAME_MAGIC:
+            if data[1] != FRAME_VERSION:
+                self.error = f"unknown trend frame version {data[1]}"
+                self.done.set()
+                return
+            count = data[3]
+            for i in range(count):
+                raw = data[4 + i * RECORD.size:4 + (i + 1) * RECORD.size]
+                record = decode_record(raw) if len(raw) == RECORD.size else None
+                if record is None:
+                    self.bad += 1
+                else:
+                    self.records.append(record)
+            return
+        if not data.startswith(b'{"type":"trend'):
+            return
+        message = json.loads(data)
+        if "error" in message:
+            self.error = message["error"]
+            self.done.set()
+        elif message["type"] == "trend":
+            self.header = message
+        elif message["type"] == "trendEnd":
+            self.done.set()
+
+
+def newest_per_day(records):
+    days = {}
+    for r in records:
+        days[r["start"]] = r
+    return sorted(days.values(), key=lambda r: r["start"])
+
+
+async def read_ble(tiers, since):
+    from bleak import BleakClient, BleakScanner
+
+    device = await BleakScanner.find_device_by_name(DEVICE_NAME, timeout=TIMEOUT_S)
+    if device is None:
+        sys.exit(f"{DEVICE_NAME} not found")
+    results = {}
+    async with BleakClient(device) as client:
+        max_bytes = min(client.mtu_size - 3, 512)
+        reader = None
+        await client.start_notify(TX_CHAR_UUID, lambda _, data: reader and reader.feed(data))
+        for tier in tiers:
+            reader = TrendReader(tier)
+            await client.write_gatt_char(RX_CHAR_UUID, f"TREND {tier} {since} {max_bytes}".encode(), response=True)
+            await asyncio.wait_for(reader.done.wait(), TIMEOUT_S * 6)
+            results[tier] = reader
+    return results
+
+
+async def read_sim(address, tiers, since):
+    # The simulator's TCP transport: 2-byte little endian length + payload
+    host, port = address.rsplit(":", 1)
+    reader_stream, writer = await asyncio.open_connection(host, int(port))
+    results = {}
+    for tier in tiers:
+        reader = TrendReader(tier)
+        writer.write(f"TREND {tier} {since} 512\n".encode())
+        await writer.drain()
+        while not reader.done.is_set():
+            n = struct.unpack("<H", await asyncio.wait_for(reader_stream.readexactly(2), TIMEOUT_S))[0]
+            reader.feed(await reader_stream.readexactly(n))
+        results[tier] = reader
+    writer.close()
+    return results
+
+
+def print_table(tier, records):
+    print(f"{tier}: {len(records)} records")
+    print("  ".join(f"{f:>9}" for f in FIELDS))
+    for r in records:
+        print("  ".join(f"{r[f]:>9.1f}" if isinstance(r[f], float) else f"{r[f]:>9}" for f in FIELDS))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Read the sensor's long-term trend store")
+    parser.add_argument("tiers", nargs="*", default=["day"], choices=["minute", "session", "day"])
+    parser.add_argument("--since", type=int, default=0, help="first sequence number to read")
+    parser.add_argument("--csv", help="write the records to this file instead of printing them")
+    parser.add_argument("--sim", metavar="HOST:PORT", help="read from the simulator instead of over BLE")
+    args = parser.parse_args()
+
+    if args.sim:
+        results = asyncio.run(read_sim(args.sim, args.tiers, args.since))
+    else:
+        results = asyncio.run(read_ble(args.tiers, args.since))
+
+    rows = []
+    for tier in args.tiers:
+        reader = results[tier]
+        if reader.error:
+            sys.exit(f"{tier}: {reader.error}")
+        records = newest_per_day(reader.records) if tier == "day" else reader.records
+        if reader.bad:
+            print(f"{tier}: {reader.bad} records failed their CRC", file=sys.stderr)
+        if args.csv:
+            rows += [dict(r, tier=tier) for r in records]
+        else:
+            print_table(tier, records)
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            out = csv.DictWriter(f, fieldnames=["tier"] + FIELDS)
+            out.writeheader()
+            out.writerows(rows)
+        print(f"{len(rows)} records written to {args.csv}")
+
+
+if __name__ == "__main__":
+    main()
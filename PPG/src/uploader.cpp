@@ -0,0 +1,264 @@
+#include "uploader.h"
+
+#include <HTTPClient.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+
+namespace
+{
+  const size_t BODY_CAPACITY = UPLOAD_BATCH_RECORDS * 128;
+
+  // A session being uploaded. Readings from seq firstSeq onwards belong to
+  // it; the previous slot keeps draining its backlog after a new START.
+  struct SessionSlot
+  {
+    bool active;
+    uint32_t firstSeq;
+    char path[96];
+    // The app's history sync watches users/<uid>/sessionIndex for changed
+    // sessions; each metadata write bumps this session's entry there
+    char indexPath[72];
+    char indexBody[48];
+    char startFields[96];
+    char endFields[64];
+    uint32_t metaVersion; // bumped on every change, 0 once uploaded
+  };
+
+  UploadRecord queueStorage[UPLOAD_QUEUE_CAPACITY];
+  UploadQueue queue(queueStorage, UPLOAD_QUEUE_CAPACITY);
+  SessionSlot sessions[2];
+  int currentSession = 0;
+  uint32_t nextSeq = 0;
+  uint32_t deviceId = 0;
+  UploaderStats stats = {};
+  // A spinlock with interrupts off: hold it only to copy finished records
+  // in or out, never to format them
+  portMUX_TYPE queueMux = portMUX_INITIALIZER_UNLOCKED;
+
+  String baseUrl;
+  String authToken;
+  bool secure = true;
+  WiFiClientSecure secureClient;
+  WiFiClient plainClient;
+  HTTPClient http;
+  TaskHandle_t uploadTask = nullptr;
+
+  Backoff backoff(1000, 60000);
+  unsigned long retryAt = 0;
+  unsigned long lastUpload = 0;
+  bool flushRequested = false;
+
+  bool sendPatch(const char *path, const char *body, size_t len)
+  {
+    String url = baseUrl + path + ".json";
+    if (authToken.length() > 0)
+      url += "?auth=" + authToken;
+    bool ok = secure ? http.begin(secureClient, url) : http.begin(plainClient, url);
+    if (!ok)
+      return false;
+    http.setReuse(true);
+    http.setTimeout(5000);
+    http.addHeader("Content-Type", "application/json");
+    unsigned long start = millis();
+    int code = http.sendRequest("PATCH", (uint8_t *)body, len);
+    http.end();
+    stats.requests++;
+    stats.lastLatencyMs = millis() - start;
+    if (code < 200 || code >= 300)
+    {
+      Serial.printf("Upload of %u bytes failed: %d\n", (unsigned)len, code);
+      return false;
+    }
+    return true;
+  }
+
+  void scheduleRetry()
+  {
+    stats.failures++;
+    retryAt = millis() + backoff.next(esp_random());
+  }
+
+  // Returns true if there was metadata to send, whether or not it succeeded.
+  bool uploadSessionMeta()
+  {
+    for (SessionSlot &slot : sessions)
+    {
+      SessionSlot copy;
+      portENTER_CRITICAL(&queueMux);
+      uint32_t version = slot.active ? slot.metaVersion : 0;
+      if (version != 0)
+        copy = slot;
+      portEXIT_CRITICAL(&queueMux);
+      if (version == 0)
+        continue;
+      char meta[200];
+      snprintf(meta, sizeof(meta), "{%s%s%s}", copy.startFields, copy.endFields[0] ? "," : "", copy.endFields);
+      if (sendPatch(copy.path, meta, strlen(meta)) &&
+          sendPatch(copy.indexPath, copy.indexBody, strlen(copy.indexBody)))
+      {
+        portENTER_CRITICAL(&queueMux);
+        // A STOP may have updated the metadata while it was being sent.
+        if (slot.metaVersion == version)
+          slot.metaVersion = 0;
+        portEXIT_CRITICAL(&queueMux);
+        backoff.reset();
+      }
+      else
+      {
+        scheduleRetry();
+      }
+      return true;
+    }
+    return false;
+  }
+
+  void uploadReadings()
+  {
+    static UploadRecord batch[UPLOAD_BATCH_RECORDS];
+    static char body[BODY_CAPACITY];
+    char slotPath[sizeof(SessionSlot::path)];
+    char path[sizeof(SessionSlot::path) + 16];
+
+    portENTER_CRITICAL(&queueMux);
+    size_t n = queue.size();
+    bool due = n >= UPLOAD_BATCH_RECORDS || flushRequested || millis() - lastUpload >= UPLOAD_FLUSH_INTERVAL_MS;
+    if (n == 0 || !due)
+    {
+      portEXIT_CRITICAL(&queueMux);
+      return;
+    }
+    n = queue.peek(batch, UPLOAD_BATCH_RECORDS);
+    // Records older than the current session belong to the previous one;
+    // never mix the two in one request.
+    const SessionSlot &cur = sessions[currentSession];
+    const SessionSlot &prev = sessions[1 - currentSession];
+    const SessionSlot *slot = &cur;
+    if (prev.active && (int32_t)(batch[0].seq - cur.firstSeq) < 0)
+    {
+      slot = &prev;
+      size_t k = 0;
+      while (k < n && (int32_t)(batch[k].seq - cur.firstSeq) < 0)
+        k++;
+      n = k;
+    }
+    memcpy(slotPath, slot->path, sizeof(slotPath));
+    portEXIT_CRITICAL(&queueMux);
+    snprintf(path, sizeof(path), "%s/readings", slotPath);
+
+    size_t len = buildPatchBody(batch, n, deviceId, body, sizeof(body));
+    if (len == 0 || !sendPatch(path, body, len))
+    {
+      scheduleRetry();
+      return;
+    }
+    portENTER_CRITICAL(&queueMux);
+    queue.pop(n);
+    stats.uploaded += n;
+    if (queue.empty())
+      flushRequested = false;
+    portEXIT_CRITICAL(&queueMux);
+    backoff.reset();
+    lastUpload = millis();
+  }
+
+  void uploadLoop(void *)
+  {
+    for (;;)
+    {
+      // Woken early by uploaderEndSession(), otherwise poll once a second.
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+      if (WiFi.status() != WL_CONNECTED || (long)(millis() - retryAt) < 0)
+        continue;
+      if (!uploadSessionMeta())
+        uploadReadings();
+    }
+  }
+}
+
+void uploaderBegin(const char *databaseUrl, const char *auth)
+{
+  baseUrl = databaseUrl;
+  if (baseUrl.indexOf("://") < 0)
+    baseUrl = "https://" + baseUrl;
+  while (baseUrl.length() > 0 && baseUrl[baseUrl.length() - 1] == '/')
+    baseUrl.remove(baseUrl.length() - 1);
+  secure = baseUrl.startsWith("https://");
+  authToken = auth;
+  // Legacy database secrets are used as in the Firebase client this
+  // replaces; the connection is not pinned to a certificate.
+  secureClient.setInsecure();
+  deviceId = (uint32_t)ESP.getEfuseMac();
+  xTaskCreatePinnedToCore(uploadLoop, "uploader", 12288, nullptr, 1, &uploadTask, 0);
+  Serial.println("Uploader started for " + baseUrl);
+}
+
+void uploaderStartSession(const String &userId, const String &sessionId, const String &startTime,
+                          const String &deviceMac)
+{
+  SessionSlot fresh;
+  fresh.active = true;
+  snprintf(fresh.path, sizeof(fresh.path), "/users/%s/sessions/%s", userId.c_str(), sessionId.c_str());
+  snprintf(fresh.indexPath, sizeof(fresh.indexPath), "/users/%s/sessionIndex", userId.c_str());
+  snprintf(fresh.indexBody, sizeof(fresh.indexBody), "{\"%s\":{\".sv\":\"timestamp\"}}", sessionId.c_str());
+  snprintf(fresh.startFields, sizeof(fresh.startFields), "\"startTime\":\"%s\",\"deviceId\":\"%s\"",
+           startTime.c_str(), deviceMac.c_str());
+  fresh.endFields[0] = '\0';
+  fresh.metaVersion = 1;
+
+  portENTER_CRITICAL(&queueMux);
+  if (sessions[currentSession].active)
+  {
+    // Only two sessions can be in flight. If the one before last still has
+    // a backlog its slot is about to be reused, so that backlog is dropped.
+    uint32_t keepFrom = sessions[currentSession].firstSeq;
+    UploadRecord oldest;
+    while (queue.peek(&oldest, 1) == 1 && (int32_t)(oldest.seq - keepFrom) < 0)
+    {
+      queue.pop(1);
+      stats.dropped++;
+    }
+    currentSession = 1 - currentSession;
+  }
+  fresh.firstSeq = nextSeq;
+  sessions[currentSession] = fresh;
+  portEXIT_CRITICAL(&queueMux);
+}
+
+void uploaderEndSession(const String &endTime, float hrv)
+{
+  char endFields[sizeof(SessionSlot::endFields)];
+  // Save HRV only if it is greater than 0
+  if (hrv > 0)
+    snprintf(endFields, sizeof(endFields), "\"endTime\":\"%s\",\"hrv\":%.2f", endTime.c_str(), hrv);
+  else
+    snprintf(endFields, sizeof(endFields), "\"endTime\":\"%s\"", endTime.c_str());
+
+  portENTER_CRITICAL(&queueMux);
+  SessionSlot &slot = sessions[currentSession];
+  memcpy(slot.endFields, endFields, sizeof(endFields));
+  slot.metaVersion++;
+  flushRequested = true;
+  portEXIT_CRITICAL(&queueMux);
+  if (uploadTask)
+    xTaskNotifyGive(uploadTask);
+}
+
+void uploaderEnqueue(float heartRate, float avgHeartRate, int oxygen, int64_t timestampMs)
+{
+  UploadRecord record = {timestampMs, 0, heartRate, avgHeartRate, (int16_t)oxygen};
+  portENTER_CRITICAL(&queueMux);
+  record.seq = nextSeq++;
+  uint32_t droppedBefore = queue.dropped();
+  queue.push(record);
+  stats.queued++;
+  stats.dropped += queue.dropped() - droppedBefore;
+  portEXIT_CRITICAL(&queueMux);
+}
+
+UploaderStats uploaderStats()
+{
+  portENTER_CRITICAL(&queueMux);
+  UploaderStats copy = stats;
+  portEXIT_CRITICAL(&queueMux);
+  return copy;
+}
@@ -0,0 +1,37 @@
+#ifndef PPG_UPLOADER_H
+#define PPG_UPLOADER_H
+
+#include <Arduino.h>
+#include "upload_batch.h"
+
+// Background upload of readings for the WiFi build. loop() only enqueues;
+// a FreeRTOS task on the WiFi core batches the queue into multi-record
+// PATCH requests so an HTTPS round-trip never stalls sampling.
+const size_t UPLOAD_QUEUE_CAPACITY = 900;   // 15 min of 1 Hz readings
+const size_t UPLOAD_BATCH_RECORDS = 30;     // records per PATCH
+const uint32_t UPLOAD_FLUSH_INTERVAL_MS = 10000;
+
+struct UploaderStats
+{
+  uint32_t queued;
+  uint32_t uploaded;
+  uint32_t dropped;
+  uint32_t requests;
+  uint32_t failures;
+  uint32_t lastLatencyMs;
+};
+
+// databaseUrl is the Realtime Database root (FIREBASE_HOST), or a mock
+// endpoint such as http://192.168.1.20:8080 (see src/mock_firebase.py).
+void uploaderBegin(const char *databaseUrl, const char *auth);
+
+// Session metadata is queued like readings and written by the upload task.
+void uploaderStartSession(const String &userId, const String &sessionId, const String &startTime,
+                          const String &deviceId);
+void uploaderEndSession(const String &endTime, float hrv);
+
+void uploaderEnqueue(float heartRate, float avgHeartRate, int oxygen, int64_t timestampMs);
+
+UploaderStats uploaderStats();
+
+#endif
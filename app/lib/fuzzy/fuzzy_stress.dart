@@ -1,3 +1,7 @@
+// The post-session stress rules, as in PPG/lib/ppg_analytics/src/fuzzy_stress.cpp.
+// Used only where the app runs without libppg_core (native/ppg_core.dart);
+// a change to the rules goes into both.
+
 class FuzzyStress {
   double hrLowTrapezoid(double hr) {
     if (hr <= 45) return 1;
@@ -117,6 +121,19 @@ class FuzzyStress {
     return 1;
   }
 
+  // Memberships from the sensor's per-athlete z-scores (see
+  // athlete_baseline.h): "high" ramps in from 1 to 2 standard deviations
+  // above the athlete's own mean, "low" likewise below it.
+  double zHigh(double z) {
+    if (z <= 1) return 0;
+    if (z > 1 && z < 2) return z - 1;
+    return 1;
+  }
+
+  double zLow(double z) => zHigh(-z);
+
+  double zNormal(double z) => 1 - _max(zHigh(z), zLow(z));
+
   double _min(double a, double b) => a < b ? a : b;
   double _min3(double a, double b, double c) => _min(_min(a, b), c);
   double _max(double a, double b) => a > b ? a : b;
@@ -131,12 +148,15 @@ class FuzzyStress {
     required double hrv,
     required double sbp,
     required double dbp,
-    
+    // Session z-scores against the athlete's baseline, when the sensor
+    // had one; they replace the absolute HR and HRV ranges.
+    double? hrZ,
+    double? hrvZ,
   }) {
     // fuxifying inputs
-    final hrHigh = hrHighTrapezoid(hr);
-    final hrNormal = hrNormalTrapezoid(hr);
-    final hrLow = hrLowTrapezoid(hr);
+    final hrHigh = hrZ != null ? zHigh(hrZ) : hrHighTrapezoid(hr);
+    final hrNormal = hrZ != null ? zNormal(hrZ) : hrNormalTrapezoid(hr);
+    final hrLow = hrZ != null ? zLow(hrZ) : hrLowTrapezoid(hr);
 
     final sleepPoor = lowSleep(sleepScore);
     final sleepMid = sleepAverage(sleepScore);
@@ -146,9 +166,9 @@ class FuzzyStress {
 
     final spo2LowVal = spo2Low(spo2);
 
-    final hrvLow = hrvLowTrapezoid(hrv);
-    final hrvNormal = hrvNormalTrapezoid(hrv);
-    final hrvHigh = hrvHighTrapezoid(hrv);
+    final hrvLow = hrvZ != null ? zLow(hrvZ) : hrvLowTrapezoid(hrv);
+    final hrvNormal = hrvZ != null ? zNormal(hrvZ) : hrvNormalTrapezoid(hrv);
+    final hrvHigh = hrvZ != null ? zHigh(hrvZ) : hrvHighTrapezoid(hrv);
 
     final sbpLow = sbpLowTrapezoid(sbp);
     final sbpNormal = sbpNormalTrapezoid(sbp);
@@ -0,0 +1,1724 @@
+import 'dart:async';
+import 'dart:collection';
+import 'dart:convert';
+import 'dart:ffi';
+import 'dart:io';
+import 'dart:math' as math;
+import 'dart:typed_data';
+
+import 'package:CalmPetitor/fuzzy/fuzzy_stress.dart';
+import 'package:ffi/ffi.dart';
+import 'package:fl_chart/fl_chart.dart';
+
+// Bindings for the sensor's analytics core, the C ABI in
+// PPG/lib/ppg_analytics/src/ppg_analytics.h. The Linux desktop runner builds it
+// as lib/libppg_core.so next to the executable (app/linux/CMakeLists.txt).
+// Other targets do not bundle it yet; there SessionAnalytics and
+// LiveSeries fall back to plain Dart and the Dart port of the stress rules
+// (fuzzy/fuzzy_stress.dart), ReadingWriter writes each reading straight
+// away and SessionCache keeps the history in memory only. CompetitionTrends
+// has no fallback and is null there.
+
+final class _PpgSession extends Opaque {}
+
+final class _PpgSeries extends Opaque {}
+
+final class _PpgWriteBehind extends Opaque {}
+
+final class _PpgSessionCache extends Opaque {}
+
+final class _PpgFinaliser extends Opaque {}
+
+final class _PpgTrends extends Opaque {}
+
+typedef _AbiVersionC = Uint32 Function();
+typedef _AbiVersion = int Function();
+typedef _SessionNew = Pointer<_PpgSession> Function();
+typedef _SessionResetC = Void Function(Pointer<_PpgSession>);
+typedef _SessionReset = void Function(Pointer<_PpgSession>);
+typedef _SessionAddC =
+    Void Function(Pointer<_PpgSession>, Float, Float, Float, Float);
+typedef _SessionAdd =
+    void Function(Pointer<_PpgSession>, double, double, double, double);
+typedef _SessionAddHrvC = Void Function(Pointer<_PpgSession>, Float, Float, Float);
+typedef _SessionAddHrv = void Function(Pointer<_PpgSession>, double, double, double);
+typedef _SessionMeanC = Float Function(Pointer<_PpgSession>, Int32);
+typedef _SessionMean = double Function(Pointer<_PpgSession>, int);
+typedef _SeriesNewC = Pointer<_PpgSeries> Function(Uint32, Float);
+typedef _SeriesNew = Pointer<_PpgSeries> Function(int, double);
+typedef _SeriesResetC = Void Function(Pointer<_PpgSeries>);
+typedef _SeriesReset = void Function(Pointer<_PpgSeries>);
+typedef _SeriesPushC = Void Function(Pointer<_PpgSeries>, Uint32, Float);
+typedef _SeriesPush = void Function(Pointer<_PpgSeries>, int, double);
+typedef _SeriesSizeC = Uint32 Function(Pointer<_PpgSeries>);
+typedef _SeriesSize = int Function(Pointer<_PpgSeries>);
+typedef _SeriesStatC = Float Function(Pointer<_PpgSeries>, Int32);
+typedef _SeriesStat = double Function(Pointer<_PpgSeries>, int);
+typedef _SeriesDecimateC = Uint32 Function(Pointer<_PpgSeries>, Uint32);
+typedef _SeriesDecimate = int Function(Pointer<_PpgSeries>, int);
+typedef _SeriesPoints = Pointer<Float> Function(Pointer<_PpgSeries>);
+typedef _WbOpenC =
+    Pointer<_PpgWriteBehind> Function(Pointer<Utf8>, Uint32, Uint32, Uint32);
+typedef _WbOpen =
+    Pointer<_PpgWriteBehind> Function(Pointer<Utf8>, int, int, int);
+typedef _WbVoidC = Void Function(Pointer<_PpgWriteBehind>);
+typedef _WbVoid = void Function(Pointer<_PpgWriteBehind>);
+typedef _WbAppendC =
+    Int32 Function(Pointer<_PpgWriteBehind>, Pointer<Utf8>, Pointer<Utf8>, Int64);
+typedef _WbAppend =
+    int Function(Pointer<_PpgWriteBehind>, Pointer<Utf8>, Pointer<Utf8>, int);
+typedef _WbDueC = Int32 Function(Pointer<_PpgWriteBehind>, Int64);
+typedef _WbDue = int Function(Pointer<_PpgWriteBehind>, int);
+typedef _WbCountC = Uint32 Function(Pointer<_PpgWriteBehind>);
+typedef _WbCount = int Function(Pointer<_PpgWriteBehind>);
+typedef _WbTakeC = Uint32 Function(Pointer<_PpgWriteBehind>, Int64);
+typedef _WbTake = int Function(Pointer<_PpgWriteBehind>, int);
+typedef _WbString = Pointer<Utf8> Function(Pointer<_PpgWriteBehind>);
+typedef _WbAckC = Void Function(Pointer<_PpgWriteBehind>, Int32, Int64);
+typedef _WbAck = void Function(Pointer<_PpgWriteBehind>, int, int);
+typedef _CacheOpen = Pointer<_PpgSessionCache> Function(Pointer<Utf8>);
+typedef _CacheVoidC = Void Function(Pointer<_PpgSessionCache>);
+typedef _CacheVoid = void Function(Pointer<_PpgSessionCache>);
+typedef _CacheInt64C = Int64 Function(Pointer<_PpgSessionCache>);
+typedef _CacheInt = int Function(Pointer<_PpgSessionCache>);
+typedef _CacheSetInt64C = Void Function(Pointer<_PpgSessionCache>, Int64);
+typedef _CacheSetInt = void Function(Pointer<_PpgSessionCache>, int);
+typedef _CacheUint32C = Uint32 Function(Pointer<_PpgSessionCache>);
+typedef _CacheInt32C = Int32 Function(Pointer<_PpgSessionCache>);
+typedef _CacheFindC = Int32 Function(Pointer<_PpgSessionCache>, Pointer<Utf8>);
+typedef _CacheFind = int Function(Pointer<_PpgSessionCache>, Pointer<Utf8>);
+typedef _CacheUpsertC =
+    Int32 Function(Pointer<_PpgSessionCache>, Pointer<Utf8>, Int64);
+typedef _CacheUpsert = int Function(Pointer<_PpgSessionCache>, Pointer<Utf8>, int);
+typedef _CacheStringAtC = Pointer<Utf8> Function(Pointer<_PpgSessionCache>, Uint32);
+typedef _CacheStringAt = Pointer<Utf8> Function(Pointer<_PpgSessionCache>, int);
+typedef _CacheInt64AtC = Int64 Function(Pointer<_PpgSessionCache>, Uint32);
+typedef _CacheUint32AtC = Uint32 Function(Pointer<_PpgSessionCache>, Uint32);
+typedef _CacheInt32AtC = Int32 Function(Pointer<_PpgSessionCache>, Uint32);
+typedef _CacheIntAt = int Function(Pointer<_PpgSessionCache>, int);
+typedef _CacheStatC = Float Function(Pointer<_PpgSessionCache>, Uint32, Int32);
+typedef _CacheStat = double Function(Pointer<_PpgSessionCache>, int, int);
+typedef _CacheAddReadingC =
+    Int32 Function(
+      Pointer<_PpgSessionCache>,
+      Uint32,
+      Pointer<Utf8>,
+      Float,
+      Float,
+      Float,
+      Float,
+    );
+typedef _CacheAddReading =
+    int Function(
+      Pointer<_PpgSessionCache>,
+      int,
+      Pointer<Utf8>,
+      double,
+      double,
+      double,
+      double,
+    );
+typedef _CacheSetSessionC =
+    Void Function(Pointer<_PpgSessionCache>, Uint32, Float, Float, Int32);
+typedef _CacheSetSession =
+    void Function(Pointer<_PpgSessionCache>, int, double, double, int);
+typedef _CacheSetMetaC =
+    Int32 Function(Pointer<_PpgSessionCache>, Uint32, Pointer<Utf8>);
+typedef _CacheSetMeta = int Function(Pointer<_PpgSessionCache>, int, Pointer<Utf8>);
+typedef _CacheReadings = Pointer<Float> Function(Pointer<_PpgSessionCache>);
+typedef _FinaliserNew = Pointer<_PpgFinaliser> Function();
+typedef _FinaliserVoidC = Void Function(Pointer<_PpgFinaliser>);
+typedef _FinaliserVoid = void Function(Pointer<_PpgFinaliser>);
+typedef _FinaliserAddC =
+    Void Function(Pointer<_PpgFinaliser>, Float, Float, Float, Float);
+typedef _FinaliserAdd =
+    void Function(Pointer<_PpgFinaliser>, double, double, double, double);
+typedef _FinaliserCountC = Uint32 Function(Pointer<_PpgFinaliser>);
+typedef _FinaliserCount = int Function(Pointer<_PpgFinaliser>);
+typedef _FinaliserJson = Pointer<Utf8> Function(Pointer<_PpgFinaliser>);
+typedef _TrendsNew = Pointer<_PpgTrends> Function();
+typedef _TrendsResetC = Void Function(Pointer<_PpgTrends>);
+typedef _TrendsReset = void Function(Pointer<_PpgTrends>);
+typedef _TrendsAddC =
+    Int32 Function(
+      Pointer<_PpgTrends>,
+      Int32,
+      Float,
+      Float,
+      Float,
+      Float,
+      Float,
+      Float,
+      Float,
+      Float,
+    );
+typedef _TrendsAdd =
+    int Function(
+      Pointer<_PpgTrends>,
+      int,
+      double,
+      double,
+      double,
+      double,
+      double,
+      double,
+      double,
+      double,
+    );
+typedef _TrendsCountC = Uint32 Function(Pointer<_PpgTrends>);
+typedef _TrendsCount = int Function(Pointer<_PpgTrends>);
+typedef _TrendsStateSizeC = Uint32 Function();
+typedef _TrendsStateSize = int Function();
+typedef _TrendsState = Pointer<Uint8> Function(Pointer<_PpgTrends>);
+typedef _TrendsRestoreC = Int32 Function(Pointer<_PpgTrends>, Pointer<Uint8>, Uint32);
+typedef _TrendsRestore = int Function(Pointer<_PpgTrends>, Pointer<Uint8>, int);
+typedef _TrendsJson = Pointer<Utf8> Function(Pointer<_PpgTrends>);
+typedef _StressScoreC =
+    Float Function(Float, Float, Int32, Float, Float, Float, Float, Float, Float);
+typedef _StressScore =
+    double Function(
+      double,
+      double,
+      int,
+      double,
+      double,
+      double,
+      double,
+      double,
+      double,
+    );
+
+// $XDG_DATA_HOME/CalmPetitor[/sub], created if missing, as the Linux
+// runner has no path_provider. Null where it cannot be created.
+String? appDataDirectory([String? sub]) {
+  final env = Platform.environment;
+  final base =
+      env['XDG_DATA_HOME'] ??
+      (env['HOME'] != null ? '${env['HOME']}/.local/share' : null);
+  if (base == null) return null;
+  try {
+    final path = sub == null ? '$base/CalmPetitor' : '$base/CalmPetitor/$sub';
+    return (Directory(path)..createSync(recursive: true)).path;
+  } on FileSystemException {
+    return null;
+  }
+}
+
+class PpgCore {
+  // PPG_ANALYTICS_ABI_VERSION
+  static const int abiVersion = 2;
+
+  // Null where the library is missing or speaks another ABI version
+  static final PpgCore? instance = _open();
+
+  final _SessionNew sessionNew;
+  final _SessionReset sessionReset;
+  final _SessionAdd sessionAddHeart;
+  final _SessionAddHrv sessionAddHrv;
+  final _SessionMean sessionMean;
+  final _StressScore stressScore;
+  final NativeFinalizer sessionFinalizer;
+  final _SeriesNew seriesNew;
+  final _SeriesReset seriesReset;
+  final _SeriesPush seriesPush;
+  final _SeriesSize seriesSize;
+  final _SeriesStat seriesStat;
+  final _SeriesDecimate seriesDecimate;
+  final _SeriesPoints seriesPoints;
+  final NativeFinalizer seriesFinalizer;
+  final _WbOpen wbOpen;
+  final _WbVoid wbClose;
+  final _WbAppend wbAppend;
+  final _WbVoid wbFlushSoon;
+  final _WbDue wbDue;
+  final _WbTake wbTakeBatch;
+  final _WbString wbBatchBody;
+  final _WbString wbBatchPath;
+  final _WbAck wbAck;
+  final _WbCount wbPending;
+  final _CacheOpen cacheOpen;
+  final _CacheVoid cacheClose;
+  final _CacheInt cacheWatermark;
+  final _CacheSetInt cacheSetWatermark;
+  final _CacheInt cacheSize;
+  final _CacheFind cacheFind;
+  final _CacheUpsert cacheUpsert;
+  final _CacheStringAt cacheSessionId;
+  final _CacheStringAt cacheLastKey;
+  final _CacheIntAt cacheModified;
+  final _CacheIntAt cacheReadingCount;
+  final _CacheIntAt cacheEnded;
+  final _CacheStat cacheStat;
+  final _CacheAddReading cacheAddReading;
+  final _CacheSetSession cacheSetSession;
+  final _CacheSetMeta cacheSetMeta;
+  final _CacheStringAt cacheMeta;
+  final _CacheIntAt cacheLoadReadings;
+  final _CacheReadings cacheReadings;
+  final _CacheInt cacheCommit;
+  final _CacheSetMeta cacheSetFinalised;
+  final _CacheStringAt cacheFinalised;
+  final _FinaliserNew finaliserNew;
+  final _FinaliserVoid finaliserReset;
+  final _FinaliserAdd finaliserAdd;
+  final _FinaliserCount finaliserSize;
+  final _FinaliserCount finaliserFinish;
+  final _FinaliserJson finaliserJson;
+  final NativeFinalizer finaliserFree;
+  final _TrendsNew trendsNew;
+  final _TrendsReset trendsReset;
+  final _TrendsAdd trendsAddSession;
+  final _TrendsCount trendsSessions;
+  final _TrendsStateSize trendsStateSize;
+  final _TrendsState trendsState;
+  final _TrendsRestore trendsRestore;
+  final _TrendsCount trendsReport;
+  final _TrendsJson trendsJson;
+  final NativeFinalizer trendsFree;
+
+  PpgCore._(DynamicLibrary lib)
+    : sessionNew = lib.lookupFunction<_SessionNew, _SessionNew>('ppg_session_new'),
+      sessionReset = lib.lookupFunction<_SessionResetC, _SessionReset>(
+        'ppg_session_reset',
+      ),
+      sessionAddHeart = lib.lookupFunction<_SessionAddC, _SessionAdd>(
+        'ppg_session_add_heart',
+      ),
+      sessionAddHrv = lib.lookupFunction<_SessionAddHrvC, _SessionAddHrv>(
+        'ppg_session_add_hrv',
+      ),
+      sessionMean = lib.lookupFunction<_SessionMeanC, _SessionMean>(
+        'ppg_session_mean',
+      ),
+      stressScore = lib.lookupFunction<_StressScoreC, _StressScore>(
+        'ppg_stress_score',
+      ),
+      sessionFinalizer = NativeFinalizer(
+        lib.lookup<NativeFunction<Void Function(Pointer<Void>)>>(
+          'ppg_session_free',
+        ),
+      ),
+      seriesNew = lib.lookupFunction<_SeriesNewC, _SeriesNew>('ppg_series_new'),
+      seriesReset = lib.lookupFunction<_SeriesResetC, _SeriesReset>(
+        'ppg_series_reset',
+      ),
+      seriesPush = lib.lookupFunction<_SeriesPushC, _SeriesPush>(
+        'ppg_series_push',
+      ),
+      seriesSize = lib.lookupFunction<_SeriesSizeC, _SeriesSize>(
+        'ppg_series_size',
+      ),
+      seriesStat = lib.lookupFunction<_SeriesStatC, _SeriesStat>(
+        'ppg_series_stat',
+      ),
+      seriesDecimate = lib.lookupFunction<_SeriesDecimateC, _SeriesDecimate>(
+        'ppg_series_decimate',
+      ),
+      seriesPoints = lib.lookupFunction<_SeriesPoints, _SeriesPoints>(
+        'ppg_series_points',
+      ),
+      seriesFinalizer = NativeFinalizer(
+        lib.lookup<NativeFunction<Void Function(Pointer<Void>)>>(
+          'ppg_series_free',
+        ),
+      ),
+      wbOpen = lib.lookupFunction<_WbOpenC, _WbOpen>('ppg_wb_open'),
+      wbClose = lib.lookupFunction<_WbVoidC, _WbVoid>('ppg_wb_close'),
+      wbAppend = lib.lookupFunction<_WbAppendC, _WbAppend>('ppg_wb_append'),
+      wbFlushSoon = lib.lookupFunction<_WbVoidC, _WbVoid>('ppg_wb_flush_soon'),
+      wbDue = lib.lookupFunction<_WbDueC, _WbDue>('ppg_wb_due'),
+      wbTakeBatch = lib.lookupFunction<_WbTakeC, _WbTake>(
+        'ppg_wb_take_batch',
+      ),
+      wbBatchBody = lib.lookupFunction<_WbString, _WbString>(
+        'ppg_wb_batch_body',
+      ),
+      wbBatchPath = lib.lookupFunction<_WbString, _WbString>(
+        'ppg_wb_batch_path',
+      ),
+      wbAck = lib.lookupFunction<_WbAckC, _WbAck>('ppg_wb_ack'),
+      wbPending = lib.lookupFunction<_WbCountC, _WbCount>('ppg_wb_pending'),
+      cacheOpen = lib.lookupFunction<_CacheOpen, _CacheOpen>('ppg_cache_open'),
+      cacheClose = lib.lookupFunction<_CacheVoidC, _CacheVoid>(
+        'ppg_cache_close',
+      ),
+      cacheWatermark = lib.lookupFunction<_CacheInt64C, _CacheInt>(
+        'ppg_cache_watermark',
+      ),
+      cacheSetWatermark = lib.lookupFunction<_CacheSetInt64C, _CacheSetInt>(
+        'ppg_cache_set_watermark',
+      ),
+      cacheSize = lib.lookupFunction<_CacheUint32C, _CacheInt>(
+        'ppg_cache_size',
+      ),
+      cacheFind = lib.lookupFunction<_CacheFindC, _CacheFind>(
+        'ppg_cache_find',
+      ),
+      cacheUpsert = lib.lookupFunction<_CacheUpsertC, _CacheUpsert>(
+        'ppg_cache_upsert',
+      ),
+      cacheSessionId = lib.lookupFunction<_CacheStringAtC, _CacheStringAt>(
+        'ppg_cache_session_id',
+      ),
+      cacheLastKey = lib.lookupFunction<_CacheStringAtC, _CacheStringAt>(
+        'ppg_cache_last_key',
+      ),
+      cacheModified = lib.lookupFunction<_CacheInt64AtC, _CacheIntAt>(
+        'ppg_cache_modified',
+      ),
+      cacheReadingCount = lib.lookupFunction<_CacheUint32AtC, _CacheIntAt>(
+        'ppg_cache_reading_count',
+      ),
+      cacheEnded = lib.lookupFunction<_CacheInt32AtC, _CacheIntAt>(
+        'ppg_cache_ended',
+      ),
+      cacheStat = lib.lookupFunction<_CacheStatC, _CacheStat>(
+        'ppg_cache_stat',
+      ),
+      cacheAddReading = lib.lookupFunction<_CacheAddReadingC, _CacheAddReading>(
+        'ppg_cache_add_reading',
+      ),
+      cacheSetSession = lib.lookupFunction<_CacheSetSessionC, _CacheSetSession>(
+        'ppg_cache_set_session',
+      ),
+      cacheSetMeta = lib.lookupFunction<_CacheSetMetaC, _CacheSetMeta>(
+        'ppg_cache_set_meta',
+      ),
+      cacheMeta = lib.lookupFunction<_CacheStringAtC, _CacheStringAt>(
+        'ppg_cache_meta',
+      ),
+      cacheLoadReadings = lib.lookupFunction<_CacheUint32AtC, _CacheIntAt>(
+        'ppg_cache_load_readings',
+      ),
+      cacheReadings = lib.lookupFunction<_CacheReadings, _CacheReadings>(
+        'ppg_cache_readings',
+      ),
+      cacheCommit = lib.lookupFunction<_CacheInt32C, _CacheInt>(
+        'ppg_cache_commit',
+      ),
+      cacheSetFinalised = lib.lookupFunction<_CacheSetMetaC, _CacheSetMeta>(
+        'ppg_cache_set_finalised',
+      ),
+      cacheFinalised = lib.lookupFunction<_CacheStringAtC, _CacheStringAt>(
+        'ppg_cache_finalised',
+      ),
+      finaliserNew = lib.lookupFunction<_FinaliserNew, _FinaliserNew>(
+        'ppg_finaliser_new',
+      ),
+      finaliserReset = lib.lookupFunction<_FinaliserVoidC, _FinaliserVoid>(
+        'ppg_finaliser_reset',
+      ),
+      finaliserAdd = lib.lookupFunction<_FinaliserAddC, _FinaliserAdd>(
+        'ppg_finaliser_add',
+      ),
+      finaliserSize = lib.lookupFunction<_FinaliserCountC, _FinaliserCount>(
+        'ppg_finaliser_size',
+      ),
+      finaliserFinish = lib.lookupFunction<_FinaliserCountC, _FinaliserCount>(
+        'ppg_finaliser_finish',
+      ),
+      finaliserJson = lib.lookupFunction<_FinaliserJson, _FinaliserJson>(
+        'ppg_finaliser_json',
+      ),
+      finaliserFree = NativeFinalizer(
+        lib.lookup<NativeFunction<Void Function(Pointer<Void>)>>(
+          'ppg_finaliser_free',
+        ),
+      ),
+      trendsNew = lib.lookupFunction<_TrendsNew, _TrendsNew>('ppg_trends_new'),
+      trendsReset = lib.lookupFunction<_TrendsResetC, _TrendsReset>(
+        'ppg_trends_reset',
+      ),
+      trendsAddSession = lib.lookupFunction<_TrendsAddC, _TrendsAdd>(
+        'ppg_trends_add_session',
+      ),
+      trendsSessions = lib.lookupFunction<_TrendsCountC, _TrendsCount>(
+        'ppg_trends_sessions',
+      ),
+      trendsStateSize = lib.lookupFunction<_TrendsStateSizeC, _TrendsStateSize>(
+        'ppg_trends_state_size',
+      ),
+      trendsState = lib.lookupFunction<_TrendsState, _TrendsState>(
+        'ppg_trends_state',
+      ),
+      trendsRestore = lib.lookupFunction<_TrendsRestoreC, _TrendsRestore>(
+        'ppg_trends_restore',
+      ),
+      trendsReport = lib.lookupFunction<_TrendsCountC, _TrendsCount>(
+        'ppg_trends_report',
+      ),
+      trendsJson = lib.lookupFunction<_TrendsJson, _TrendsJson>(
+        'ppg_trends_json',
+      ),
+      trendsFree = NativeFinalizer(
+        lib.lookup<NativeFunction<Void Function(Pointer<Void>)>>(
+          'ppg_trends_free',
+        ),
+      );
+
+  static PpgCore? _open() {
+    if (!Platform.isLinux) return null;
+    final bundled =
+        '${File(Platform.resolvedExecutable).parent.path}/lib/libppg_core.so';
+    for (final path in [bundled, 'libppg_core.so']) {
+      try {
+        final lib = DynamicLibrary.open(path);
+        final version = lib.lookupFunction<_AbiVersionC, _AbiVersion>(
+          'ppg_analytics_abi_version',
+        );
+        return version() == abiVersion ? PpgCore._(lib) : null;
+      } on ArgumentError {
+        // Not there; try the next location.
+      }
+    }
+    return null;
+  }
+}
+
+// Indices match PPG_FIELD_*
+enum SessionField { heartRate, rmssd, sdnn, spo2, sbp, dbp, stressZ }
+
+// Session means and the post-session stress score. Adding a reading is
+// O(1); readings of 0 are "not measured yet" and skipped, and a mean is
+// NaN until its field has been measured.
+abstract class SessionAnalytics {
+  factory SessionAnalytics() {
+    final core = PpgCore.instance;
+    return core != null ? _NativeSession(core) : _DartSession();
+  }
+
+  bool get isNative;
+  void reset();
+  void addHeart(double heartRate, double spo2, double sbp, double dbp);
+  // stressZ is the window's baseline stress z, NaN without a baseline
+  void addHrv(double rmssd, double sdnn, double stressZ);
+  double mean(SessionField field);
+
+  double stressScore({
+    required double hr,
+    required double sleepScore,
+    required bool hadCoffee,
+    required double spo2,
+    required double hrv,
+    required double sbp,
+    required double dbp,
+    double? hrZ,
+    double? hrvZ,
+  });
+}
+
+class _NativeSession implements SessionAnalytics, Finalizable {
+  final PpgCore core;
+  final Pointer<_PpgSession> handle;
+
+  _NativeSession(this.core) : handle = core.sessionNew() {
+    if (handle == nullptr) throw StateError('ppg_session_new failed');
+    core.sessionFinalizer.attach(this, handle.cast());
+  }
+
+  @override
+  bool get isNative => true;
+
+  @override
+  void reset() => core.sessionReset(handle);
+
+  @override
+  void addHeart(double heartRate, double spo2, double sbp, double dbp) =>
+      core.sessionAddHeart(handle, heartRate, spo2, sbp, dbp);
+
+  @override
+  void addHrv(double rmssd, double sdnn, double stressZ) =>
+      core.sessionAddHrv(handle, rmssd, sdnn, stressZ);
+
+  @override
+  double mean(SessionField field) => core.sessionMean(handle, field.index);
+
+  @override
+  double stressScore({
+    required double hr,
+    required double sleepScore,
+    required bool hadCoffee,
+    required double spo2,
+    required double hrv,
+    required double sbp,
+    required double dbp,
+    double? hrZ,
+    double? hrvZ,
+  }) => core.stressScore(
+    hr,
+    sleepScore,
+    hadCoffee ? 1 : 0,
+    spo2,
+    hrv,
+    sbp,
+    dbp,
+    hrZ ?? double.nan,
+    hrvZ ?? double.nan,
+  );
+}
+
+// TrendAccumulator (trend_store.h) with unit weights
+class _DartSession implements SessionAnalytics {
+  final _sums = List<double>.filled(SessionField.values.length, 0);
+  final _counts = List<int>.filled(SessionField.values.length, 0);
+
+  @override
+  bool get isNative => false;
+
+  void _add(SessionField field, double value) {
+    if (value.isNaN) return;
+    _sums[field.index] += value;
+    _counts[field.index]++;
+  }
+
+  @override
+  void reset() {
+    _sums.fillRange(0, _sums.length, 0);
+    _counts.fillRange(0, _counts.length, 0);
+  }
+
+  @override
+  void addHeart(double heartRate, double spo2, double sbp, double dbp) {
+    if (heartRate > 0) _add(SessionField.heartRate, heartRate);
+    if (spo2 > 0) _add(SessionField.spo2, spo2);
+    if (sbp > 0) _add(SessionField.sbp, sbp);
+    if (dbp > 0) _add(SessionField.dbp, dbp);
+  }
+
+  @override
+  void addHrv(double rmssd, double sdnn, double stressZ) {
+    _add(SessionField.rmssd, rmssd);
+    _add(SessionField.sdnn, sdnn);
+    _add(SessionField.stressZ, stressZ);
+  }
+
+  @override
+  double mean(SessionField field) =>
+      _counts[field.index] > 0
+          ? _sums[field.index] / _counts[field.index]
+          : double.nan;
+
+  @override
+  double stressScore({
+    required double hr,
+    required double sleepScore,
+    required bool hadCoffee,
+    required double spo2,
+    required double hrv,
+    required double sbp,
+    required double dbp,
+    double? hrZ,
+    double? hrvZ,
+  }) => FuzzyStress().computeStress(
+    hr: hr,
+    sleepScore: sleepScore,
+    hadCoffee: hadCoffee,
+    spo2: spo2,
+    hrv: hrv,
+    sbp: sbp,
+    dbp: dbp,
+    hrZ: hrZ,
+    hrvZ: hrvZ,
+  );
+}
+
+// Indices match PPG_STAT_*
+enum _Stat { mean, min, max, last, ema }
+
+// The last `capacity` points of a live chart (rolling_series.h), with its
+// window mean, min and max and an EMA over the whole session. push() is
+// O(1); NaN values are dropped. points() is meant for the chart, once per
+// frame: at most maxPoints spots, keeping each bucket's min and max.
+abstract class LiveSeries {
+  factory LiveSeries(int capacity, {double emaAlpha = 0.1}) {
+    final core = PpgCore.instance;
+    return core != null
+        ? _NativeSeries(core, capacity, emaAlpha)
+        : _DartSeries(capacity, emaAlpha);
+  }
+
+  int get length;
+  // NaN while empty
+  double get mean;
+  double get min;
+  double get max;
+  double get last;
+  double get ema;
+
+  void reset();
+  void push(int x, double value);
+  List<FlSpot> points(int maxPoints);
+}
+
+class _NativeSeries implements LiveSeries, Finalizable {
+  final PpgCore core;
+  final Pointer<_PpgSeries> handle;
+
+  _NativeSeries(this.core, int capacity, double emaAlpha)
+    : handle = core.seriesNew(capacity, emaAlpha) {
+    if (handle == nullptr) throw ArgumentError('ppg_series_new failed');
+    core.seriesFinalizer.attach(this, handle.cast());
+  }
+
+  @override
+  int get length => core.seriesSize(handle);
+  @override
+  double get mean => core.seriesStat(handle, _Stat.mean.index);
+  @override
+  double get min => core.seriesStat(handle, _Stat.min.index);
+  @override
+  double get max => core.seriesStat(handle, _Stat.max.index);
+  @override
+  double get last => core.seriesStat(handle, _Stat.last.index);
+  @override
+  double get ema => core.seriesStat(handle, _Stat.ema.index);
+
+  @override
+  void reset() => core.seriesReset(handle);
+
+  @override
+  void push(int x, double value) => core.seriesPush(handle, x, value);
+
+  @override
+  List<FlSpot> points(int maxPoints) {
+    final n = core.seriesDecimate(handle, maxPoints);
+    final xy = core.seriesPoints(handle).asTypedList(2 * n);
+    return [for (var i = 0; i < n; i++) FlSpot(xy[2 * i], xy[2 * i + 1])];
+  }
+}
+
+// Ring buffer with a running sum; min and max are scanned when read,
+// which the chart does once per frame
+class _DartSeries implements LiveSeries {
+  final int capacity;
+  final double emaAlpha;
+  final List<int> _xs;
+  final List<double> _values;
+  int _start = 0;
+  int _length = 0;
+  double _sum = 0;
+  double _ema = double.nan;
+
+  _DartSeries(this.capacity, this.emaAlpha)
+    : _xs = List<int>.filled(capacity, 0),
+      _values = List<double>.filled(capacity, 0);
+
+  double _at(int i) => _values[(_start + i) % capacity];
+
+  @override
+  int get length => _length;
+  @override
+  double get mean => _length > 0 ? _sum / _length : double.nan;
+  @override
+  double get min => _fold((a, b) => a < b ? a : b);
+  @override
+  double get max => _fold((a, b) => a > b ? a : b);
+  @override
+  double get last => _length > 0 ? _at(_length - 1) : double.nan;
+  @override
+  double get ema => _ema;
+
+  double _fold(double Function(double, double) pick) {
+    if (_length == 0) return double.nan;
+    var result = _at(0);
+    for (var i = 1; i < _length; i++) {
+      result = pick(result, _at(i));
+    }
+    return result;
+  }
+
+  @override
+  void reset() {
+    _start = _length = 0;
+    _sum = 0;
+    _ema = double.nan;
+  }
+
+  @override
+  void push(int x, double value) {
+    if (value.isNaN) return;
+    if (_length == capacity) {
+      _sum -= _values[_start];
+      _start = (_start + 1) % capacity;
+      _length--;
+    }
+    final slot = (_start + _length) % capacity;
+    _xs[slot] = x;
+    _values[slot] = value;
+    _sum += value;
+    _length++;
+    _ema = _ema.isNaN ? value : _ema + emaAlpha * (value - _ema);
+  }
+
+  // Not decimated: the fallback only serves short windows
+  @override
+  List<FlSpot> points(int maxPoints) => [
+    for (var i = 0; i < _length; i++)
+      FlSpot(_xs[(_start + i) % capacity].toDouble(), _at(i)),
+  ];
+}
+
+// Sends one Realtime Database update: children keyed under path
+typedef UpdateWriter =
+    Future<void> Function(String path, Map<String, dynamic> children);
+// Adds one reading under path with a new push() key
+typedef PushWriter =
+    Future<void> Function(String path, Map<String, dynamic> reading);
+
+// Cloud writes of live readings. Where the core is bundled, readings go
+// through its write-behind buffer (write_behind.h): journalled on disk,
+// then sent as one update per readings node every flushInterval, or
+// sooner once maxBatchBytes have built up or flush() is called at session
+// end. A failed update is retried with backoff for its readings node
+// only, so other sessions' readings keep going out, and readings still
+// pending when the app exits are sent after the next start. Each user has
+// a journal of their own. Elsewhere, or if the journal cannot be opened,
+// every reading is pushed on its own.
+//
+// pump() sends whatever is due and is meant to run from a periodic timer.
+abstract class ReadingWriter {
+  factory ReadingWriter({
+    required String uid,
+    required UpdateWriter update,
+    required PushWriter push,
+    Duration flushInterval = const Duration(seconds: 10),
+    int maxBatchBytes = 16384,
+  }) {
+    final core = PpgCore.instance;
+    final dir = appDataDirectory('sessions/$uid');
+    final journal = dir != null ? '$dir/readings.journal' : null;
+    if (core != null && journal != null) {
+      final writer = _BufferedWriter.open(
+        core,
+        journal,
+        update,
+        push,
+        flushInterval,
+        maxBatchBytes,
+      );
+      if (writer != null) return writer;
+    }
+    return _DirectWriter(push);
+  }
+
+  // Readings waiting for the cloud, including any from before a restart
+  int get pending;
+  void add(String path, String readingJson);
+  Future<void> pump();
+  // Sends everything pending now; what fails stays for later pumps
+  Future<void> flush();
+  void close();
+}
+
+class _BufferedWriter implements ReadingWriter {
+  final PpgCore core;
+  final UpdateWriter update;
+  final PushWriter push;
+  Pointer<_PpgWriteBehind> handle;
+  bool _sending = false;
+
+  _BufferedWriter._(this.core, this.handle, this.update, this.push);
+
+  static _BufferedWriter? open(
+    PpgCore core,
+    String journal,
+    UpdateWriter update,
+    PushWriter push,
+    Duration flushInterval,
+    int maxBatchBytes,
+  ) {
+    final path = journal.toNativeUtf8();
+    try {
+      // Only used for keys of readings added from here on; a journal that
+      // already exists keeps the id it was created with
+      final writerId = math.Random.secure().nextInt(1 << 32);
+      final handle = core.wbOpen(
+        path,
+        writerId,
+        flushInterval.inMilliseconds,
+        maxBatchBytes,
+      );
+      return handle == nullptr ? null : _BufferedWriter._(core, handle, update, push);
+    } finally {
+      malloc.free(path);
+    }
+  }
+
+  static int _nowMs() => DateTime.now().millisecondsSinceEpoch;
+
+  @override
+  int get pending => handle == nullptr ? 0 : core.wbPending(handle);
+
+  @override
+  void add(String path, String readingJson) {
+    var added = 0;
+    if (handle != nullptr) {
+      final p = path.toNativeUtf8();
+      final j = readingJson.toNativeUtf8();
+      added = core.wbAppend(handle, p, j, _nowMs());
+      malloc.free(p);
+      malloc.free(j);
+    }
+    // Journal full or unwritable, or an odd path: do not lose the reading
+    if (added == 0) {
+      unawaited(push(path, json.decode(readingJson) as Map<String, dynamic>));
+    }
+  }
+
+  @override
+  Future<void> pump() async {
+    if (_sending) return;
+    _sending = true;
+    try {
+      while (handle != nullptr && core.wbDue(handle, _nowMs()) != 0) {
+        core.wbTakeBatch(handle, _nowMs());
+        final path = core.wbBatchPath(handle).toDartString();
+        final body = core.wbBatchBody(handle).toDartString();
+        var ok = true;
+        try {
+          await update(path, json.decode(body) as Map<String, dynamic>);
+        } catch (e) {
+          ok = false;
+        }
+        // close() may have run while the update was out
+        if (handle == nullptr) return;
+        core.wbAck(handle, ok ? 1 : 0, _nowMs());
+      }
+    } finally {
+      _sending = false;
+    }
+  }
+
+  @override
+  Future<void> flush() {
+    if (handle != nullptr) core.wbFlushSoon(handle);
+    return pump();
+  }
+
+  @override
+  void close() {
+    if (handle == nullptr) return;
+    core.wbClose(handle);
+    handle = nullptr;
+  }
+}
+
+class _DirectWriter implements ReadingWriter {
+  final PushWriter push;
+
+  _DirectWriter(this.push);
+
+  @override
+  int get pending => 0;
+
+  @override
+  void add(String path, String readingJson) {
+    unawaited(push(path, json.decode(readingJson) as Map<String, dynamic>));
+  }
+
+  @override
+  Future<void> pump() async {}
+
+  @override
+  Future<void> flush() async {}
+
+  @override
+  void close() {}
+}
+
+// Indices match PPG_CACHE_*
+enum _CacheStat {
+  meanHeartRate,
+  meanSpo2,
+  meanSbp,
+  meanDbp,
+  minHeartRate,
+  maxHeartRate,
+  hrv,
+  stressScore,
+}
+
+// A cached session's summary, kept up to date as readings are added.
+// Statistics are NaN where nothing was measured.
+class CachedSession {
+  final String id;
+  final int modifiedMs;
+  // Newest cached reading; the next sync resumes after it
+  final String lastKey;
+  final int readings;
+  final bool ended;
+  final double meanHeartRate;
+  final double meanSpo2;
+  final double meanSbp;
+  final double meanDbp;
+  final double minHeartRate;
+  final double maxHeartRate;
+  final double hrv;
+  final double stressScore;
+
+  const CachedSession({
+    required this.id,
+    required this.modifiedMs,
+    required this.lastKey,
+    required this.readings,
+    required this.ended,
+    required this.meanHeartRate,
+    required this.meanSpo2,
+    required this.meanSbp,
+    required this.meanDbp,
+    required this.minHeartRate,
+    required this.maxHeartRate,
+    required this.hrv,
+    required this.stressScore,
+  });
+}
+
+// Readings are cached in tenths; 0 where not measured
+class SessionReading {
+  final double heartRate;
+  final double spo2;
+  final double sbp;
+  final double dbp;
+
+  const SessionReading(this.heartRate, this.spo2, this.sbp, this.dbp);
+}
+
+// One athlete's sessions for the history page (session_cache.h), filled
+// and kept current by SessionSync (sync/session_sync.dart). Where the
+// core is bundled it lives on disk under appDataDirectory, so the page
+// opens from it without touching the database; sessions() reads only the
+// summaries. Elsewhere it lasts as long as the app.
+abstract class SessionCache {
+  factory SessionCache(String uid) {
+    final core = PpgCore.instance;
+    final dir = appDataDirectory('sessions/$uid');
+    if (core != null && dir != null) {
+      final path = dir.toNativeUtf8();
+      final handle = core.cacheOpen(path);
+      malloc.free(path);
+      if (handle != nullptr) return _NativeSessionCache(core, handle);
+    }
+    return _DartSessionCache();
+  }
+
+  bool get isNative;
+  // Server time of the newest sessionIndex entry synced, 0 before the
+  // first sync. Setting it only ever raises it.
+  int get watermark;
+  set watermark(int ms);
+
+  // In id order, which is start time order
+  List<CachedSession> sessions();
+  CachedSession? session(String id);
+  // Adds the session if new; false for an id that cannot be cached
+  bool upsert(String id, int modifiedMs);
+  // Readings must come in key order; returns false for a repeat
+  bool addReading(String id, String key, SessionReading reading);
+  void setSession(
+    String id, {
+    double? hrv,
+    double? stressScore,
+    bool ended = false,
+  });
+  void setMeta(String id, Map<String, dynamic> meta);
+  Map<String, dynamic>? meta(String id);
+  // The session's stats and charts from SessionFinaliser, as JSON
+  void setFinalised(String id, String summaryJson);
+  String? finalised(String id);
+  List<SessionReading> readings(String id);
+  // Persists what changed, watermark included
+  void commit();
+  void close();
+}
+
+class _NativeSessionCache implements SessionCache {
+  final PpgCore core;
+  Pointer<_PpgSessionCache> handle;
+
+  _NativeSessionCache(this.core, this.handle);
+
+  int _find(String id) {
+    if (handle == nullptr) return -1;
+    final p = id.toNativeUtf8();
+    final index = core.cacheFind(handle, p);
+    malloc.free(p);
+    return index;
+  }
+
+  CachedSession _at(int i) {
+    double stat(_CacheStat s) => core.cacheStat(handle, i, s.index);
+    return CachedSession(
+      id: core.cacheSessionId(handle, i).toDartString(),
+      modifiedMs: core.cacheModified(handle, i),
+      lastKey: core.cacheLastKey(handle, i).toDartString(),
+      readings: core.cacheReadingCount(handle, i),
+      ended: core.cacheEnded(handle, i) != 0,
+      meanHeartRate: stat(_CacheStat.meanHeartRate),
+      meanSpo2: stat(_CacheStat.meanSpo2),
+      meanSbp: stat(_CacheStat.meanSbp),
+      meanDbp: stat(_CacheStat.meanDbp),
+      minHeartRate: stat(_CacheStat.minHeartRate),
+      maxHeartRate: stat(_CacheStat.maxHeartRate),
+      hrv: stat(_CacheStat.hrv),
+      stressScore: stat(_CacheStat.stressScore),
+    );
+  }
+
+  @override
+  bool get isNative => true;
+
+  @override
+  int get watermark => handle == nullptr ? 0 : core.cacheWatermark(handle);
+
+  @override
+  set watermark(int ms) {
+    if (handle != nullptr) core.cacheSetWatermark(handle, ms);
+  }
+
+  @override
+  List<CachedSession> sessions() => [
+    if (handle != nullptr)
+      for (var i = 0; i < core.cacheSize(handle); i++) _at(i),
+  ];
+
+  @override
+  CachedSession? session(String id) {
+    final i = _find(id);
+    return i < 0 ? null : _at(i);
+  }
+
+  @override
+  bool upsert(String id, int modifiedMs) {
+    if (handle == nullptr) return false;
+    final p = id.toNativeUtf8();
+    final index = core.cacheUpsert(handle, p, modifiedMs);
+    malloc.free(p);
+    return index >= 0;
+  }
+
+  @override
+  bool addReading(String id, String key, SessionReading reading) {
+    final i = _find(id);
+    if (i < 0) return false;
+    final k = key.toNativeUtf8();
+    final added = core.cacheAddReading(
+      handle,
+      i,
+      k,
+      reading.heartRate,
+      reading.spo2,
+      reading.sbp,
+      reading.dbp,
+    );
+    malloc.free(k);
+    return added != 0;
+  }
+
+  @override
+  void setSession(
+    String id, {
+    double? hrv,
+    double? stressScore,
+    bool ended = false,
+  }) {
+    final i = _find(id);
+    if (i < 0) return;
+    core.cacheSetSession(
+      handle,
+      i,
+      hrv ?? double.nan,
+      stressScore ?? double.nan,
+      ended ? 1 : 0,
+    );
+  }
+
+  @override
+  void setMeta(String id, Map<String, dynamic> meta) {
+    final i = _find(id);
+    if (i < 0) return;
+    final j = json.encode(meta).toNativeUtf8();
+    core.cacheSetMeta(handle, i, j);
+    malloc.free(j);
+  }
+
+  @override
+  Map<String, dynamic>? meta(String id) {
+    final i = _find(id);
+    if (i < 0) return null;
+    final p = core.cacheMeta(handle, i);
+    if (p == nullptr) return null;
+    try {
+      return json.decode(p.toDartString()) as Map<String, dynamic>;
+    } on FormatException {
+      return null;
+    }
+  }
+
+  @override
+  void setFinalised(String id, String summaryJson) {
+    final i = _find(id);
+    if (i < 0) return;
+    final j = summaryJson.toNativeUtf8();
+    core.cacheSetFinalised(handle, i, j);
+    malloc.free(j);
+  }
+
+  @override
+  String? finalised(String id) {
+    final i = _find(id);
+    if (i < 0) return null;
+    final p = core.cacheFinalised(handle, i);
+    return p == nullptr ? null : p.toDartString();
+  }
+
+  @override
+  List<SessionReading> readings(String id) {
+    final i = _find(id);
+    if (i < 0) return const [];
+    final n = core.cacheLoadReadings(handle, i);
+    if (n == 0) return const [];
+    final v = core.cacheReadings(handle).asTypedList(4 * n);
+    return [
+      for (var k = 0; k < n; k++)
+        SessionReading(v[4 * k], v[4 * k + 1], v[4 * k + 2], v[4 * k + 3]),
+    ];
+  }
+
+  @override
+  void commit() {
+    if (handle != nullptr) core.cacheCommit(handle);
+  }
+
+  @override
+  void close() {
+    if (handle == nullptr) return;
+    core.cacheClose(handle);
+    handle = nullptr;
+  }
+}
+
+class _DartEntry {
+  String lastKey = '';
+  int modifiedMs = 0;
+  bool ended = false;
+  double hrv = double.nan;
+  double stressScore = double.nan;
+  Map<String, dynamic>? meta;
+  String? finalised;
+  final readings = <SessionReading>[];
+}
+
+class _DartSessionCache implements SessionCache {
+  final _entries = SplayTreeMap<String, _DartEntry>();
+  int _watermark = 0;
+
+  @override
+  bool get isNative => false;
+
+  @override
+  int get watermark => _watermark;
+
+  @override
+  set watermark(int ms) {
+    if (ms > _watermark) _watermark = ms;
+  }
+
+  static double _mean(Iterable<double> values) {
+    var sum = 0.0;
+    var n = 0;
+    for (final v in values) {
+      if (v > 0) {
+        sum += v;
+        n++;
+      }
+    }
+    return n > 0 ? sum / n : double.nan;
+  }
+
+  CachedSession _summary(String id, _DartEntry e) {
+    final hr = e.readings.map((r) => r.heartRate).where((v) => v > 0);
+    return CachedSession(
+      id: id,
+      modifiedMs: e.modifiedMs,
+      lastKey: e.lastKey,
+      readings: e.readings.length,
+      ended: e.ended,
+      meanHeartRate: _mean(hr),
+      meanSpo2: _mean(e.readings.map((r) => r.spo2)),
+      meanSbp: _mean(e.readings.map((r) => r.sbp)),
+      meanDbp: _mean(e.readings.map((r) => r.dbp)),
+      minHeartRate: hr.isEmpty ? double.nan : hr.reduce((a, b) => a < b ? a : b),
+      maxHeartRate: hr.isEmpty ? double.nan : hr.reduce((a, b) => a > b ? a : b),
+      hrv: e.hrv,
+      stressScore: e.stressScore,
+    );
+  }
+
+  @override
+  List<CachedSession> sessions() => [
+    for (final e in _entries.entries) _summary(e.key, e.value),
+  ];
+
+  @override
+  CachedSession? session(String id) {
+    final e = _entries[id];
+    return e == null ? null : _summary(id, e);
+  }
+
+  @override
+  bool upsert(String id, int modifiedMs) {
+    if (id.isEmpty) return false;
+    final e = _entries.putIfAbsent(id, _DartEntry.new);
+    if (modifiedMs > e.modifiedMs) e.modifiedMs = modifiedMs;
+    return true;
+  }
+
+  @override
+  bool addReading(String id, String key, SessionReading reading) {
+    final e = _entries[id];
+    if (e == null || (e.lastKey.isNotEmpty && key.compareTo(e.lastKey) <= 0)) {
+      return false;
+    }
+    e.lastKey = key;
+    e.readings.add(reading);
+    return true;
+  }
+
+  @override
+  void setSession(
+    String id, {
+    double? hrv,
+    double? stressScore,
+    bool ended = false,
+  }) {
+    final e = _entries[id];
+    if (e == null) return;
+    if (hrv != null && !hrv.isNaN) e.hrv = hrv;
+    if (stressScore != null && !stressScore.isNaN) e.stressScore = stressScore;
+    if (ended) e.ended = true;
+  }
+
+  @override
+  void setMeta(String id, Map<String, dynamic> meta) => _entries[id]?.meta = meta;
+
+  @override
+  Map<String, dynamic>? meta(String id) => _entries[id]?.meta;
+
+  @override
+  void setFinalised(String id, String summaryJson) =>
+      _entries[id]?.finalised = summaryJson;
+
+  @override
+  String? finalised(String id) => _entries[id]?.finalised;
+
+  @override
+  List<SessionReading> readings(String id) =>
+      List.unmodifiable(_entries[id]?.readings ?? const <SessionReading>[]);
+
+  @override
+  void commit() {}
+
+  @override
+  void close() {}
+}
+
+// Runs when a session stops (session_finaliser.h): takes the session's
+// readings in order and builds the JSON stored at
+// users/<uid>/sessions/<sid>/summary, per channel (heartRate, spo2, sbp,
+// dbp) the count, mean, min and max of the measured readings and
+// LTTB-downsampled charts of at most 120 and 480 points, keyed by
+// resolution. The history page draws those instead of every reading.
+abstract class SessionFinaliser {
+  static const resolutions = [120, 480];
+  static const channels = ['heartRate', 'spo2', 'sbp', 'dbp'];
+
+  factory SessionFinaliser() {
+    final core = PpgCore.instance;
+    return core != null ? _NativeFinaliser(core) : _DartFinaliser();
+  }
+
+  int get length;
+  void reset();
+  // 0 where not measured
+  void add(double heartRate, double spo2, double sbp, double dbp);
+  String finish();
+}
+
+class _NativeFinaliser implements SessionFinaliser, Finalizable {
+  final PpgCore core;
+  final Pointer<_PpgFinaliser> handle;
+
+  _NativeFinaliser(this.core) : handle = core.finaliserNew() {
+    if (handle == nullptr) throw StateError('ppg_finaliser_new failed');
+    core.finaliserFree.attach(this, handle.cast());
+  }
+
+  @override
+  int get length => core.finaliserSize(handle);
+
+  @override
+  void reset() => core.finaliserReset(handle);
+
+  @override
+  void add(double heartRate, double spo2, double sbp, double dbp) =>
+      core.finaliserAdd(handle, heartRate, spo2, sbp, dbp);
+
+  @override
+  String finish() {
+    core.finaliserFinish(handle);
+    return core.finaliserJson(handle).toDartString();
+  }
+}
+
+// lttb() in session_finaliser.cpp
+List<int> _lttb(List<double> x, List<double> y, int threshold) {
+  final n = y.length;
+  if (threshold >= n || threshold < 3) return List.generate(n, (i) => i);
+  final every = (n - 2) / (threshold - 2);
+  final picked = <int>[0];
+  var a = 0;
+  for (var b = 0; b < threshold - 2; b++) {
+    final start = (b * every).floor() + 1;
+    final end = ((b + 1) * every).floor() + 1;
+    final nextEnd = math.min(((b + 2) * every).floor() + 1, n);
+    var avgX = x[n - 1], avgY = y[n - 1];
+    if (nextEnd > end) {
+      avgX = avgY = 0;
+      for (var i = end; i < nextEnd; i++) {
+        avgX += x[i];
+        avgY += y[i];
+      }
+      avgX /= nextEnd - end;
+      avgY /= nextEnd - end;
+    }
+    var best = -1.0;
+    var pick = start;
+    for (var i = start; i < end; i++) {
+      final area =
+          ((x[a] - avgX) * (y[i] - y[a]) - (x[a] - x[i]) * (avgY - y[a])).abs();
+      if (area > best) {
+        best = area;
+        pick = i;
+      }
+    }
+    picked.add(pick);
+    a = pick;
+  }
+  picked.add(n - 1);
+  return picked;
+}
+
+class _DartFinaliser implements SessionFinaliser {
+  final _xs = List.generate(4, (_) => <double>[]);
+  final _ys = List.generate(4, (_) => <double>[]);
+  int _count = 0;
+
+  @override
+  int get length => _count;
+
+  @override
+  void reset() {
+    for (final l in [..._xs, ..._ys]) {
+      l.clear();
+    }
+    _count = 0;
+  }
+
+  @override
+  void add(double heartRate, double spo2, double sbp, double dbp) {
+    final values = [heartRate, spo2, sbp, dbp];
+    for (var c = 0; c < 4; c++) {
+      if (values[c] > 0) {
+        _xs[c].add(_count.toDouble());
+        _ys[c].add(values[c]);
+      }
+    }
+    _count++;
+  }
+
+  double _tenths(double v) => (v * 10).roundToDouble() / 10;
+
+  @override
+  String finish() {
+    final stats = <String, dynamic>{};
+    final charts = <String, dynamic>{
+      for (final r in SessionFinaliser.resolutions) '$r': <String, dynamic>{},
+    };
+    for (var c = 0; c < 4; c++) {
+      final name = SessionFinaliser.channels[c];
+      final y = _ys[c];
+      stats[name] = {
+        'count': y.length,
+        if (y.isNotEmpty) ...{
+          'mean': (y.reduce((a, b) => a + b) / y.length * 100).round() / 100,
+          'min': _tenths(y.reduce(math.min)),
+          'max': _tenths(y.reduce(math.max)),
+        },
+      };
+      for (final r in SessionFinaliser.resolutions) {
+        final picked = _lttb(_xs[c], y, r);
+        charts['$r'][name] = {
+          'x': [for (final i in picked) _xs[c][i].toInt()],
+          'y': [for (final i in picked) _tenths(y[i])],
+        };
+      }
+    }
+    return json.encode({'readings': _count, 'stats': stats, 'charts': charts});
+  }
+}
+
+// One athlete's trends across days in the lead-up to competitions
+// (competition_trends.h): rolling baselines, day-over-day deltas,
+// changepoints, correlations with the questionnaire's answers and the
+// deviation by days before competition. Each closed session is added
+// once, when its questionnaire is submitted on this phone or when
+// SessionSync first caches it; the state is saved under appDataDirectory after every
+// session, so nothing is recomputed from the history. The history from
+// before the trends is replayed once (addHistory), and trends.seeded
+// records that it was, with the ids of the sessions added since. One
+// instance per user is shared by the pages, so none saves a stale state
+// over another's. Null where the core is not bundled.
+class CompetitionTrends implements Finalizable {
+  static final _open = <String, CompetitionTrends>{};
+
+  final PpgCore core;
+  final Pointer<_PpgTrends> handle;
+  final File _file;
+  final File _seeded;
+  final _added = <String>{};
+
+  CompetitionTrends._(this.core, this.handle, this._file)
+      : _seeded = File('${_file.path}.seeded') {
+    core.trendsFree.attach(this, handle.cast());
+  }
+
+  static CompetitionTrends? open(String uid) {
+    if (_open[uid] case final trends?) return trends;
+    final core = PpgCore.instance;
+    final dir = appDataDirectory('sessions/$uid');
+    if (core == null || dir == null) return null;
+    final handle = core.trendsNew();
+    if (handle == nullptr) return null;
+    final trends = CompetitionTrends._(core, handle, File('$dir/trends.state'));
+    trends._load();
+    return _open[uid] = trends;
+  }
+
+  // Local days since 1970
+  static int dayOf(DateTime time) {
+    final local = time.toLocal();
+    return DateTime.utc(local.year, local.month, local.day)
+            .millisecondsSinceEpoch ~/
+        Duration.millisecondsPerDay;
+  }
+
+  int get sessions => core.trendsSessions(handle);
+
+  // Measurements of 0 and unanswered questions are skipped. False, with
+  // nothing learned, for a session added before or from before the last
+  // one added.
+  bool addSession(
+    String id,
+    DateTime time, {
+    required double hrv,
+    required double heartRate,
+    required double sbp,
+    required double dbp,
+    double? sleepQuality,
+    bool? hadCoffee,
+    double? stressLevel,
+    double? daysPreCompetition,
+  }) {
+    if (_added.contains(id)) return false;
+    final added = _add(
+      time,
+      hrv,
+      heartRate,
+      sbp,
+      dbp,
+      sleepQuality,
+      hadCoffee,
+      stressLevel,
+      daysPreCompetition,
+    );
+    if (added) {
+      _save();
+      _record(id);
+    }
+    return added;
+  }
+
+  // A questionnaire as stored under the session, for one SessionSync has
+  // just cached
+  bool addQuestionnaire(String id, Map<String, dynamic> q) {
+    if (_added.contains(id) || !_addQuestionnaire(q)) return false;
+    _save();
+    _record(id);
+    return true;
+  }
+
+  // A session the sensor ended with no questionnaire, from its cached
+  // means and the HRV it wrote
+  bool addEnded(CachedSession s) {
+    if (_added.contains(s.id) || !_addEnded(s)) return false;
+    _save();
+    _record(s.id);
+    return true;
+  }
+
+  // Session ids are the UTC start time, yyyyMMddHHmmss
+  static DateTime _started(CachedSession s) {
+    final id = s.id;
+    final parsed =
+        id.length == 14
+            ? DateTime.tryParse('${id.substring(0, 8)}T${id.substring(8)}Z')
+            : null;
+    return parsed ?? DateTime.fromMillisecondsSinceEpoch(s.modifiedMs);
+  }
+
+  bool _addQuestionnaire(Map<String, dynamic> q) {
+    if (q['timestamp'] is! num) return false;
+    double? number(Object? v) => v is num ? v.toDouble() : null;
+    return _add(
+      DateTime.fromMillisecondsSinceEpoch((q['timestamp'] as num).toInt()),
+      number(q['hrv']) ?? 0,
+      number(q['averageHeartRate']) ?? 0,
+      number(q['averageSBP']) ?? 0,
+      number(q['averageDBP']) ?? 0,
+      number(q['sleepQuality']),
+      q['hadCoffee'] is bool ? q['hadCoffee'] as bool : null,
+      number(q['stressLevel']),
+      number(q['daysPreCompetition']),
+    );
+  }
+
+  bool _addEnded(CachedSession s) {
+    double measured(double v) => v.isNaN ? 0 : v;
+    return _add(
+      _started(s),
+      measured(s.hrv),
+      measured(s.meanHeartRate),
+      measured(s.meanSbp),
+      measured(s.meanDbp),
+      null,
+      null,
+      null,
+      null,
+    );
+  }
+
+  bool _add(
+    DateTime time,
+    double hrv,
+    double heartRate,
+    double sbp,
+    double dbp,
+    double? sleepQuality,
+    bool? hadCoffee,
+    double? stressLevel,
+    double? daysPreCompetition,
+  ) {
+    return core.trendsAddSession(
+      handle,
+      dayOf(time),
+      hrv,
+      heartRate,
+      sbp,
+      dbp,
+      sleepQuality ?? double.nan,
+      hadCoffee == null ? double.nan : (hadCoffee ? 1 : 0),
+      stressLevel ?? double.nan,
+      daysPreCompetition ?? double.nan,
+    ) !=
+        0;
+  }
+
+  // Rebuilds the trends from a synced cache, oldest first: the
+  // questionnaires, and the sessions the sensor ended without one, unless
+  // that was done before. Sessions from before the open day are refused,
+  // so a history that predates the trends cannot be added after a live
+  // session; the rebuild starts over instead, and the live sessions come
+  // back with the cache's questionnaires. True if it rebuilt.
+  bool addHistory(SessionCache cache) {
+    if (_seeded.existsSync()) return false;
+    core.trendsReset(handle);
+    _added.clear();
+    final history = <(int, CachedSession, Map<String, dynamic>?)>[];
+    for (final s in cache.sessions()) {
+      final meta = cache.meta(s.id);
+      if (meta == null && s.ended) {
+        history.add((_started(s).millisecondsSinceEpoch, s, null));
+      } else if (meta?['timestamp'] case final num ms) {
+        history.add((ms.toInt(), s, meta));
+      }
+    }
+    history.sort((a, b) => a.$1.compareTo(b.$1));
+    for (final (_, s, q) in history) {
+      if (q != null ? _addQuestionnaire(q) : _addEnded(s)) _added.add(s.id);
+    }
+    _save();
+    try {
+      _seeded.writeAsStringSync(_added.map((id) => '$id\n').join());
+    } on FileSystemException {
+      // Rebuilt again next time.
+    }
+    return true;
+  }
+
+  // Appended to the marker, which only exists once seeded: before that
+  // the rebuild replays every session anyway
+  void _record(String id) {
+    _added.add(id);
+    try {
+      if (_seeded.existsSync()) {
+        _seeded.writeAsStringSync('$id\n', mode: FileMode.append);
+      }
+    } on FileSystemException {
+      // Known for this run; a later copy from the sync is refused by day.
+    }
+  }
+
+  // CompetitionTrends::toJson, decoded
+  Map<String, dynamic> report() {
+    core.trendsReport(handle);
+    return json.decode(core.trendsJson(handle).toDartString())
+        as Map<String, dynamic>;
+  }
+
+  // A state from another build of the core is dropped and the trends
+  // start over, from the history again
+  void _load() {
+    var restored = false;
+    try {
+      final bytes = _file.existsSync() ? _file.readAsBytesSync() : Uint8List(0);
+      if (bytes.isNotEmpty) {
+        final buffer = malloc<Uint8>(bytes.length);
+        buffer.asTypedList(bytes.length).setAll(0, bytes);
+        restored = core.trendsRestore(handle, buffer, bytes.length) != 0;
+        malloc.free(buffer);
+      }
+      if (!_seeded.existsSync()) return;
+      if (!restored) {
+        _seeded.deleteSync();
+      } else {
+        _added.addAll(_seeded.readAsLinesSync().where((id) => id.isNotEmpty));
+      }
+    } on FileSystemException {
+      // Unreadable; start over.
+    }
+  }
+
+  // Written aside and renamed over, so a crash leaves the last state
+  void _save() {
+    final state = core.trendsState(handle);
+    final bytes = Uint8List.fromList(
+      state.asTypedList(core.trendsStateSize()),
+    );
+    try {
+      final tmp = File('${_file.path}.tmp')..writeAsBytesSync(bytes, flush: true);
+      tmp.renameSync(_file.path);
+    } on FileSystemException {
+      // Kept in memory; the next session tries again.
+    }
+  }
+}
@@ -1,7 +1,9 @@
 import 'dart:async';
 import 'dart:convert';
-import 'package:CalmPetitor/fuzzy/fuzzy_stress.dart';
+import 'package:CalmPetitor/native/ppg_core.dart';
+import 'package:CalmPetitor/sync/session_sync.dart';
 import 'package:flutter/material.dart';
+import 'package:flutter/scheduler.dart';
 import 'package:flutter_blue/flutter_blue.dart';
 import 'package:firebase_auth/firebase_auth.dart';
 import 'package:firebase_database/firebase_database.dart';
@@ -180,15 +182,21 @@ class _LiveSensorDataState extends State<LiveSensorData> {
   BluetoothCharacteristic? notifyChar; // TX (notify)
   StreamSubscription<List<int>>? notifySub;
   StreamSubscription<BluetoothDeviceState>? deviceStateSub;
+  Timer? clockSyncTimer;
+  int clockSyncSeq = 0;
   bool isBleConnected = false;
   bool isRecording = false;
   String sessionId = "";
 
   List<Map<String, dynamic>> readings = [];
-  List<FlSpot> heartRateData = [];
-  List<FlSpot> oxygenData = [];
-  List<FlSpot> sbpData = [];
-  List<FlSpot> dbpData = [];
+  // Points kept and drawn per chart
+  static const int chartWindow = 100;
+  final heartRateData = LiveSeries(chartWindow);
+  final oxygenData = LiveSeries(chartWindow);
+  final sbpData = LiveSeries(chartWindow);
+  final dbpData = LiveSeries(chartWindow);
+  // Notifications only update the series; the page redraws once per frame
+  bool redrawScheduled = false;
   int chartTime = 0;
   int readingsCount = 0;
 
@@ -197,6 +205,19 @@ class _LiveSensorDataState extends State<LiveSensorData> {
   double averageSBP = 0;
   double averageDBP = 0;
   double sessionHRV = 0;
+  // Session z-scores against this athlete's baseline, sent by the sensor
+  // with the session HRV once it has learned one
+  double? sessionHrZ;
+  double? sessionRmssdZ;
+  // Running session means, from the sensor's analytics core where the
+  // platform bundles it (native/ppg_core.dart)
+  final session = SessionAnalytics();
+  // Summary stats and downsampled charts of the uploaded readings, built
+  // at STOP and stored with the session for the history page
+  final finaliser = SessionFinaliser();
+
+  // The averages are shown and uploaded as 0 until measured
+  double _measured(double mean) => mean.isNaN ? 0 : mean;
 
   final String serviceUuid = "6e400001-b5a3-f393-e0a9-e50e24dcca9e";
   final String rxCharUuid = "6e400002-b5a3-f393-e0a9-e50e24dcca9e";
@@ -204,8 +225,55 @@ class _LiveSensorDataState extends State<LiveSensorData> {
 
   DateTime? sessionStartTime;
 
+  // Live readings go to the cloud in batched updates, journalled until
+  // they are acknowledged (ReadingWriter in native/ppg_core.dart). Each
+  // update also stamps the session for the history sync. The journal is
+  // the signed-in user's; another sign-in opens theirs.
+  ReadingWriter? readingWriter;
+  String? readingWriterUid;
+  Timer? uploadTimer;
+
+  ReadingWriter _readingWriterFor(String uid) {
+    final current = readingWriter;
+    if (current != null && readingWriterUid == uid) return current;
+    // What the previous user still has pending is sent after they sign in
+    // again
+    current?.flush().whenComplete(current.close);
+    readingWriterUid = uid;
+    return readingWriter = ReadingWriter(
+      uid: uid,
+      update:
+          (path, children) => FirebaseDatabase.instance.ref().update({
+            for (final child in children.entries)
+              '$path/${child.key}': child.value,
+            ...sessionStamp(path),
+          }),
+      push: (path, reading) {
+        final key = FirebaseDatabase.instance.ref(path).push().key;
+        return FirebaseDatabase.instance.ref().update({
+          '$path/$key': reading,
+          ...sessionStamp(path),
+        });
+      },
+    );
+  }
+
+  @override
+  void initState() {
+    super.initState();
+    // Also sends readings left over from a previous run
+    uploadTimer = Timer.periodic(const Duration(seconds: 1), (_) {
+      final user = FirebaseAuth.instance.currentUser;
+      if (user != null) _readingWriterFor(user.uid).pump();
+    });
+  }
+
   @override
   void dispose() {
+    uploadTimer?.cancel();
+    final writer = readingWriter;
+    writer?.flush().whenComplete(writer.close);
+    clockSyncTimer?.cancel();
     notifySub?.cancel();
     deviceStateSub?.cancel();
     espDevice?.disconnect();
@@ -215,6 +283,13 @@ class _LiveSensorDataState extends State<LiveSensorData> {
   Future<void> connectToDevice(BluetoothDevice device) async {
     espDevice = device;
     await espDevice!.connect(autoConnect: false);
+    // The sensor does not fragment notifications and summaries do not fit
+    // the default 23-byte MTU. iOS negotiates on its own and rejects this.
+    try {
+      await espDevice!.requestMtu(517);
+    } catch (e) {
+      print("MTU request failed: $e");
+    }
     setState(() {
       isBleConnected = true;
     });
@@ -223,6 +298,7 @@ class _LiveSensorDataState extends State<LiveSensorData> {
     deviceStateSub?.cancel();
     deviceStateSub = espDevice!.state.listen((state) {
       if (state == BluetoothDeviceState.disconnected) {
+        clockSyncTimer?.cancel();
         setState(() {
           isBleConnected = false;
           espDevice = null;
@@ -248,70 +324,96 @@ class _LiveSensorDataState extends State<LiveSensorData> {
     if (notifyChar != null) {
       await notifyChar!.setNotifyValue(true);
       notifySub = notifyChar!.value.listen(onBleData);
+      _startClockSync();
+    }
+  }
+
+  // Lets the ESP32 map its sample clock onto phone time, so readings carry
+  // a "ts" that lines up with app events and other devices. A burst of
+  // rounds after connecting, then one every 30 s to track drift.
+  void _startClockSync() {
+    clockSyncTimer?.cancel();
+    for (var i = 0; i < 8; i++) {
+      Future.delayed(Duration(milliseconds: 250 * i), _sendClockSync);
+    }
+    clockSyncTimer = Timer.periodic(
+      const Duration(seconds: 30),
+      (_) => _sendClockSync(),
+    );
+  }
+
+  double _nowMs() => DateTime.now().microsecondsSinceEpoch / 1000.0;
+
+  Future<void> _sendClockSync() async {
+    if (commandChar == null || !isBleConnected) return;
+    try {
+      await commandChar!.write(
+        utf8.encode("SYNC ${clockSyncSeq++} ${_nowMs().toStringAsFixed(3)}"),
+      );
+    } catch (e) {
+      // A missed round is harmless; the next one replaces it.
+    }
+  }
+
+  Future<void> _finishClockSync(Map<String, dynamic> reply) async {
+    final t4 = _nowMs();
+    try {
+      await commandChar?.write(
+        utf8.encode("SYNCFIN ${reply['seq']} ${t4.toStringAsFixed(3)}"),
+      );
+    } catch (e) {
+      // See _sendClockSync.
     }
   }
 
   void onBleData(List<int> value) {
     try {
+      final jsonStr = utf8.decode(value);
+      final data = json.decode(jsonStr);
+      if (data['type'] == 'sync') {
+        _finishClockSync(Map<String, dynamic>.from(data));
+        return;
+      }
       // Ignore first 3 seconds of data after session start
       if (sessionStartTime != null &&
           DateTime.now().difference(sessionStartTime!).inSeconds < 3) {
         return;
       }
-      final jsonStr = utf8.decode(value);
-      final data = json.decode(jsonStr);
       readingsCount++;
       if (readingsCount <= 0) return;
-      setState(() {
-        readings.add(data);
-        double hr = (data['heartRate'] ?? 0).toDouble();
-        double sbp = (data['sbp'] ?? 0).toDouble();
-        double dbp = (data['dbp'] ?? 0).toDouble();
-        double spo2 = (data['oxygen'] ?? 0).toDouble();
-
-        heartRateData.add(FlSpot(chartTime.toDouble(), hr));
-        sbpData.add(FlSpot(chartTime.toDouble(), sbp));
-        dbpData.add(FlSpot(chartTime.toDouble(), dbp));
-        // Only add valid SpO2 readings
-        if (spo2 >= 50) {
-          oxygenData.add(FlSpot(chartTime.toDouble(), spo2));
-        }
-        chartTime++;
-        if (heartRateData.length > 100) heartRateData.removeAt(0);
-        if (sbpData.length > 100) sbpData.removeAt(0);
-        if (dbpData.length > 100) dbpData.removeAt(0);
-        if (oxygenData.length > 100) oxygenData.removeAt(0);
-
-        averageHeartRate =
-            heartRateData.isNotEmpty
-                ? heartRateData.map((e) => e.y).reduce((a, b) => a + b) /
-                    heartRateData.length
-                : 0;
-        averageSBP =
-            sbpData.isNotEmpty
-                ? sbpData.map((e) => e.y).reduce((a, b) => a + b) /
-                    sbpData.length
-                : 0;
-        averageDBP =
-            dbpData.isNotEmpty
-                ? dbpData.map((e) => e.y).reduce((a, b) => a + b) /
-                    dbpData.length
-                : 0;
-        averageOxygen =
-            oxygenData.isNotEmpty
-                ? oxygenData.map((e) => e.y).reduce((a, b) => a + b) /
-                    oxygenData.length
-                : 0;
-        if (data.containsKey('hrv')) {
-          sessionHRV = (data['hrv'] ?? 0).toDouble();
-        }
-      });
+      readings.add(data);
+      double hr = (data['heartRate'] ?? 0).toDouble();
+      double sbp = (data['sbp'] ?? 0).toDouble();
+      double dbp = (data['dbp'] ?? 0).toDouble();
+      double spo2 = (data['oxygen'] ?? 0).toDouble();
+
+      heartRateData.push(chartTime, hr);
+      sbpData.push(chartTime, sbp);
+      dbpData.push(chartTime, dbp);
+      // Only add valid SpO2 readings
+      if (spo2 >= 50) {
+        oxygenData.push(chartTime, spo2);
+      }
+      chartTime++;
+
+      session.addHeart(hr, spo2 >= 50 ? spo2 : 0, sbp, dbp);
+      averageHeartRate = _measured(session.mean(SessionField.heartRate));
+      averageSBP = _measured(session.mean(SessionField.sbp));
+      averageDBP = _measured(session.mean(SessionField.dbp));
+      averageOxygen = _measured(session.mean(SessionField.spo2));
+      if (data.containsKey('hrv')) {
+        sessionHRV = (data['hrv'] ?? 0).toDouble();
+        sessionHrZ = (data['hrZ'] as num?)?.toDouble();
+        sessionRmssdZ = (data['rmssdZ'] as num?)?.toDouble();
+      } else {
+        finaliser.add(hr, spo2 >= 50 ? spo2 : 0, sbp, dbp);
+      }
+      _scheduleRedraw();
       final user = FirebaseAuth.instance.currentUser;
       if (user != null && sessionId.isNotEmpty) {
-        final db = FirebaseDatabase.instance.ref();
         final readingsPath = "users/${user.uid}/sessions/$sessionId/readings";
         if (!data.containsKey('hrv')) {
-          db.child(readingsPath).push().set(data);
+          _readingWriterFor(user.uid).add(readingsPath, jsonStr);
         }
       }
     } catch (e) {
@@ -319,6 +421,15 @@ class _LiveSensorDataState extends State<LiveSensorData> {
     }
   }
 
+  void _scheduleRedraw() {
+    if (redrawScheduled) return;
+    redrawScheduled = true;
+    SchedulerBinding.instance.scheduleFrameCallback((_) {
+      redrawScheduled = false;
+      if (mounted) setState(() {});
+    });
+  }
+
   Future<void> sendBleCommand(String command) async {
     if (espDevice == null || commandChar == null || !isBleConnected) {
       ScaffoldMessenger.of(
@@ -347,21 +458,28 @@ class _LiveSensorDataState extends State<LiveSensorData> {
       setState(() {
         isRecording = true;
         sessionHRV = 0;
+        sessionHrZ = null;
+        sessionRmssdZ = null;
         readings.clear();
-        heartRateData.clear();
-        sbpData.clear();
-        dbpData.clear();
-        oxygenData.clear();
+        heartRateData.reset();
+        sbpData.reset();
+        dbpData.reset();
+        oxygenData.reset();
+        session.reset();
+        finaliser.reset();
+        averageHeartRate = averageSBP = averageDBP = averageOxygen = 0;
         chartTime = 0;
         readingsCount = 0;
         sessionStartTime = DateTime.now();
       });
-      await sendBleCommand("START");
+      // The sensor keeps a baseline per athlete, keyed by this id
+      await sendBleCommand("START $uid");
     } else {
       setState(() {
         isRecording = false;
       });
       await sendBleCommand("STOP");
+      _readingWriterFor(user.uid).flush();
       _showPostSessionQuestionnaire();
       uploadSessionToFirebase();
     }
@@ -375,13 +493,16 @@ class _LiveSensorDataState extends State<LiveSensorData> {
     final db = FirebaseDatabase.instance.ref();
 
     // Upload summary
-    await db.child(questionnairePath).update({
-      'averageHeartRate': averageHeartRate,
-      'averageSBP': averageSBP,
-      'averageDBP': averageDBP,
-      'averageOxygen': averageOxygen,
-      'hrv': sessionHRV,
-      'timestamp': ServerValue.timestamp,
+    final summary = json.decode(finaliser.finish());
+    await db.update({
+      '$sessionPath/summary': summary,
+      '$questionnairePath/averageHeartRate': averageHeartRate,
+      '$questionnairePath/averageSBP': averageSBP,
+      '$questionnairePath/averageDBP': averageDBP,
+      '$questionnairePath/averageOxygen': averageOxygen,
+      '$questionnairePath/hrv': sessionHRV,
+      '$questionnairePath/timestamp': ServerValue.timestamp,
+      ...sessionStamp(sessionPath),
     });
   }
 
@@ -523,8 +644,7 @@ class _LiveSensorDataState extends State<LiveSensorData> {
                   onPressed: () async {
                     final user = FirebaseAuth.instance.currentUser;
                     if (user == null || sessionId.isEmpty) return;
-                    final fuzzy = FuzzyStress();
-                    final stressScore = fuzzy.computeStress(
+                    final stressScore = session.stressScore(
                       hr: averageHeartRate,
                       sleepScore: sleepQuality.toDouble(),
                       hadCoffee: hadCoffee,
@@ -532,6 +652,8 @@ class _LiveSensorDataState extends State<LiveSensorData> {
                       hrv: sessionHRV,
                       sbp: averageSBP,
                       dbp: averageDBP,
+                      hrZ: sessionHrZ,
+                      hrvZ: sessionRmssdZ,
                     );
                     final questionnaireData = {
                       'stressLevel': stressLevel,
@@ -545,13 +667,29 @@ class _LiveSensorDataState extends State<LiveSensorData> {
                       'averageDBP': averageDBP,
                       'averageOxygen': averageOxygen,
                       'hrv': sessionHRV,
+                      'hrZ': sessionHrZ,
+                      'rmssdZ': sessionRmssdZ,
                       'stressScore': stressScore,
                       'timestamp': ServerValue.timestamp,
                     };
-                    final databaseRef = FirebaseDatabase.instance.ref().child(
-                      "users/${user.uid}/sessions/$sessionId/questionnaire",
+                    final questionnairePath =
+                        "users/${user.uid}/sessions/$sessionId/questionnaire";
+                    await FirebaseDatabase.instance.ref().update({
+                      questionnairePath: questionnaireData,
+                      ...sessionStamp(questionnairePath),
+                    });
+                    CompetitionTrends.open(user.uid)?.addSession(
+                      sessionId,
+                      DateTime.now(),
+                      hrv: sessionHRV,
+                      heartRate: averageHeartRate,
+                      sbp: averageSBP,
+                      dbp: averageDBP,
+                      sleepQuality: sleepQuality.toDouble(),
+                      hadCoffee: hadCoffee,
+                      stressLevel: stressLevel.toDouble(),
+                      daysPreCompetition: daysPreComp.toDouble(),
                     );
-                    await databaseRef.set(questionnaireData);
                     await uploadSessionToFirebase();
                     Navigator.of(context).pop();
                     showDialog(
@@ -770,16 +908,11 @@ class _LiveSensorDataState extends State<LiveSensorData> {
     );
   }
 
-  Widget buildLiveChart(List<FlSpot> data, String title, Color color) {
-    double centerValue = data.isNotEmpty ? data.last.y : 0;
-    double minY =
-        data.isNotEmpty
-            ? data.map((e) => e.y).reduce((a, b) => a < b ? a : b)
-            : centerValue - 10;
-    double maxY =
-        data.isNotEmpty
-            ? data.map((e) => e.y).reduce((a, b) => a > b ? a : b)
-            : centerValue + 10;
+  Widget buildLiveChart(LiveSeries series, String title, Color color) {
+    final data = series.points(chartWindow);
+    double centerValue = data.isNotEmpty ? series.last : 0;
+    double minY = data.isNotEmpty ? series.min : centerValue - 10;
+    double maxY = data.isNotEmpty ? series.max : centerValue + 10;
     if (minY == maxY) {
       minY -= 5;
       maxY += 5;
@@ -1,9 +1,11 @@
 import 'package:flutter/material.dart';
 import 'package:firebase_auth/firebase_auth.dart';
-import 'package:firebase_database/firebase_database.dart';
 import 'package:fl_chart/fl_chart.dart';
 import 'package:intl/intl.dart';
 import 'dart:async';
+import 'dart:convert';
+import 'package:CalmPetitor/native/ppg_core.dart';
+import 'package:CalmPetitor/sync/session_sync.dart';
 
 class HistoricalSensorData extends StatefulWidget {
   const HistoricalSensorData({Key? key}) : super(key: key);
@@ -13,15 +15,36 @@ class HistoricalSensorData extends StatefulWidget {
 }
 
 class _HistoricalSensorDataState extends State<HistoricalSensorData> {
-  final DatabaseReference _databaseRef = FirebaseDatabase.instance.ref();
-  Map<String, dynamic> historicalData = {};
+  // Sessions come from a local cache kept in step with the database by
+  // delta syncs (sync/session_sync.dart), not from the whole sessions tree
+  SessionSync? _sync;
+  List<CachedSession> sessions = [];
   bool isLoading = true;
   String? selectedSessionId;
+  // Chart points of the selected session per channel (heartRate, spo2,
+  // sbp, dbp)
+  Map<String, List<FlSpot>> selectedCharts = {};
+  Map<String, dynamic>? selectedQuestionnaire;
+  // Across sessions (CompetitionTrends), the instance the live page and
+  // the sync add to; null where the core is not bundled
+  CompetitionTrends? _trends;
+  Map<String, dynamic>? trendsReport;
   Timer? _pollingTimer;
 
   @override
   void initState() {
     super.initState();
+    final user = FirebaseAuth.instance.currentUser;
+    if (user == null) {
+      print('Error fetching historical data: User not authenticated');
+      isLoading = false;
+      return;
+    }
+    _sync = SessionSync(user.uid);
+    sessions = _sync!.cache.sessions();
+    _trends = CompetitionTrends.open(user.uid);
+    _loadTrends();
+    isLoading = sessions.isEmpty;
     fetchHistoricalData();
     _startPolling();
   }
@@ -35,42 +58,86 @@ class _HistoricalSensorDataState extends State<HistoricalSensorData> {
   @override
   void dispose() {
     _pollingTimer?.cancel(); // Cancel the timer
+    _sync?.close();
     super.dispose();
   }
 
   Future<void> fetchHistoricalData() async {
+    final sync = _sync;
+    if (sync == null) return;
     try {
-      final user = FirebaseAuth.instance.currentUser;
-      if (user == null) {
-        throw Exception('User not authenticated');
-      }
-
-      final snapshot =
-          await _databaseRef.child('users/${user.uid}/sessions').get();
-      if (snapshot.exists) {
-        final data = snapshot.value as Map<dynamic, dynamic>;
-        setState(() {
-          historicalData = data.map(
-            (key, value) => MapEntry(
-              key.toString(),
-              value != null ? Map<String, dynamic>.from(value as Map) : {},
-            ),
-          );
-          isLoading = false;
-        });
-      } else {
-        setState(() {
-          isLoading = false;
-        });
-      }
+      final changed = await sync.sync();
+      // Only once the cache has the athlete's whole history
+      final seeded = _trends?.addHistory(sync.cache) ?? false;
+      if (!mounted || (!changed && !seeded && !isLoading)) return;
+      setState(() {
+        sessions = sync.cache.sessions();
+        _loadTrends();
+        if (selectedSessionId != null) _loadSession(selectedSessionId!);
+        isLoading = false;
+      });
     } catch (e) {
       print('Error fetching historical data: $e');
+      if (!mounted) return;
       setState(() {
         isLoading = false;
       });
     }
   }
 
+  void _loadTrends() {
+    final trends = _trends;
+    if (trends == null) return;
+    trendsReport = trends.sessions > 0 ? trends.report() : null;
+  }
+
+  // Points drawn per chart of a finalised session
+  static const int chartResolution = 480;
+
+  void _loadSession(String sessionId) {
+    selectedCharts = _loadCharts(sessionId);
+    selectedQuestionnaire = _sync!.cache.meta(sessionId);
+  }
+
+  // From the session's finalised summary when it has one; a session still
+  // recording is drawn from its readings
+  Map<String, List<FlSpot>> _loadCharts(String sessionId) {
+    final finalised = _sync!.cache.finalised(sessionId);
+    if (finalised != null) {
+      final summary = json.decode(finalised) as Map<String, dynamic>;
+      final charts = summary['charts']?['$chartResolution'];
+      if (charts is Map) {
+        return {
+          for (final channel in SessionFinaliser.channels)
+            channel: _spots(charts[channel]),
+        };
+      }
+    }
+    final charts = {
+      for (final channel in SessionFinaliser.channels) channel: <FlSpot>[],
+    };
+    final readings = _sync!.cache.readings(sessionId);
+    for (var i = 0; i < readings.length; i++) {
+      final reading = readings[i];
+      final x = i.toDouble();
+      charts['heartRate']!.add(FlSpot(x, reading.heartRate));
+      if (reading.spo2 > 0) charts['spo2']!.add(FlSpot(x, reading.spo2));
+      charts['sbp']!.add(FlSpot(x, reading.sbp));
+      charts['dbp']!.add(FlSpot(x, reading.dbp));
+    }
+    return charts;
+  }
+
+  List<FlSpot> _spots(Object? chart) {
+    if (chart is! Map) return [];
+    final xs = chart['x'] as List? ?? const [];
+    final ys = chart['y'] as List? ?? const [];
+    return [
+      for (var i = 0; i < xs.length && i < ys.length; i++)
+        FlSpot((xs[i] as num).toDouble(), (ys[i] as num).toDouble()),
+    ];
+  }
+
   String formatSessionId(String sessionId) {
     try {
       DateTime dateTime;
@@ -121,12 +188,8 @@ class _HistoricalSensorDataState extends State<HistoricalSensorData> {
     }
   }
 
-  bool sessionHasData(String sessionId) {
-    final sessionData = historicalData[sessionId] as Map<String, dynamic>?;
-    if (sessionData == null) return false;
-    final readings = sessionData['readings'] as Map<dynamic, dynamic>?;
-    return readings != null && readings.isNotEmpty;
-  }
+  // Statistics are NaN until measured; shown as 0
+  double _shown(double value) => value.isNaN ? 0 : value;
 
   String getHeartRateInterpretation(double hr) {
     if (hr < 60) return 'Bradycardia (low)';
@@ -394,6 +457,104 @@ class _HistoricalSensorDataState extends State<HistoricalSensorData> {
     );
   }
 
+  static const _trendMetrics = {
+    'hrv': 'HRV',
+    'heartRate': 'Heart Rate',
+    'sbp': 'Systolic BP',
+    'dbp': 'Diastolic BP',
+  };
+
+  static const _trendAnswers = {
+    'sleepQuality': 'sleep',
+    'hadCoffee': 'coffee',
+    'stressLevel': 'stress',
+    'daysPreCompetition': 'days to competition',
+  };
+
+  // Today against the athlete's baseline, the change since the last day
+  // measured, the last changepoint and the answer that tracks each metric
+  // most closely
+  Widget buildTrendsCard(Map<String, dynamic> report) {
+    final metrics = report['metrics'] as Map<String, dynamic>;
+    final correlations = report['correlations'] as Map<String, dynamic>;
+    final today = report['day'] as int?;
+    String signed(num v) => '${v >= 0 ? '+' : ''}${v.toStringAsFixed(1)}';
+    return Card(
+      elevation: 6,
+      color: Colors.white.withOpacity(0.97),
+      shape: RoundedRectangleBorder(borderRadius: BorderRadius.circular(18)),
+      child: Padding(
+        padding: const EdgeInsets.all(18),
+        child: Column(
+          crossAxisAlignment: CrossAxisAlignment.start,
+          children: [
+            Row(
+              children: const [
+                Icon(Icons.trending_up, color: Colors.blueGrey, size: 22),
+                SizedBox(width: 8),
+                Text(
+                  'Trends',
+                  style: TextStyle(
+                    fontSize: 18,
+                    fontWeight: FontWeight.bold,
+                    color: Colors.black87,
+                  ),
+                ),
+              ],
+            ),
+            const Divider(height: 24, thickness: 1.2),
+            for (final entry in _trendMetrics.entries)
+              if (metrics[entry.key] case final Map<String, dynamic> m) ...[
+                Text(
+                  entry.value,
+                  style: const TextStyle(fontWeight: FontWeight.w600),
+                ),
+                Padding(
+                  padding: const EdgeInsets.only(left: 12, top: 2),
+                  child: Text(
+                    [
+                      if (m['today'] != null)
+                        'today ${(m['today'] as num).toStringAsFixed(1)}',
+                      if (m['baseline'] != null)
+                        'baseline ${(m['baseline'] as num).toStringAsFixed(1)} '
+                            '(z ${signed(m['z'] as num)})'
+                      else
+                        'baseline after ${m['baselineDays']} of 7 days',
+                      if (m['delta'] != null)
+                        '${signed(m['delta'] as num)} over ${m['deltaDays']} '
+                            '${m['deltaDays'] == 1 ? 'day' : 'days'}',
+                      if (m['change'] != null && today != null)
+                        'shifted ${m['change']} '
+                            '${today - (m['changeDay'] as int)} days ago',
+                      if (_strongest(correlations[entry.key]) case final c?)
+                        'tracks $c',
+                    ].join(' · '),
+                  ),
+                ),
+                const SizedBox(height: 10),
+              ],
+          ],
+        ),
+      ),
+    );
+  }
+
+  // The answer with the largest |r| of at least 0.3, as "sleep (r +0.45)"
+  String? _strongest(Object? correlations) {
+    if (correlations is! Map) return null;
+    String? best;
+    num bestR = 0.3;
+    for (final entry in _trendAnswers.entries) {
+      final r = correlations[entry.key];
+      if (r is num && r.abs() >= bestR) {
+        bestR = r.abs();
+        best =
+            '${entry.value} (r ${r >= 0 ? '+' : ''}${r.toStringAsFixed(2)})';
+      }
+    }
+    return best;
+  }
+
   Widget buildQuestionnaireCard(Map questionnaire) {
     return Card(
       elevation: 6,
@@ -543,10 +704,9 @@ class _HistoricalSensorDataState extends State<HistoricalSensorData> {
 
   @override
   Widget build(BuildContext context) {
+    final summaries = {for (final s in sessions) s.id: s};
     List<String> sessionsWithData =
-        historicalData.keys
-            .where((sessionId) => sessionHasData(sessionId))
-            .toList();
+        sessions.where((s) => s.readings > 0).map((s) => s.id).toList();
     sessionsWithData.sort((a, b) {
       DateTime? dateA = parseSessionDateTime(a);
       DateTime? dateB = parseSessionDateTime(b);
@@ -574,7 +734,7 @@ class _HistoricalSensorDataState extends State<HistoricalSensorData> {
                 ? const Center(
                   child: CircularProgressIndicator(color: Colors.white),
                 )
-                : historicalData.isEmpty || sessionsWithData.isEmpty
+                : sessionsWithData.isEmpty
                 ? const Center(
                   child: Text(
                     'No Historical Data Available',
@@ -659,130 +819,37 @@ class _HistoricalSensorDataState extends State<HistoricalSensorData> {
                                 onChanged: (value) {
                                   setState(() {
                                     selectedSessionId = value;
+                                    if (value != null) _loadSession(value);
                                   });
                                 },
                               ),
                             ),
                           ),
+                          if (trendsReport case final report?) ...[
+                            const SizedBox(height: 28),
+                            buildTrendsCard(report),
+                          ],
                           const SizedBox(height: 28),
                           if (selectedSessionId != null)
                             Builder(
                               builder: (context) {
-                                final sessionData =
-                                    historicalData[selectedSessionId!]
-                                        as Map<String, dynamic>;
-                                final readings =
-                                    sessionData['readings']
-                                        as Map<dynamic, dynamic>?;
-                                final questionnaire =
-                                    sessionData['questionnaire']
-                                        as Map<dynamic, dynamic>?;
-
-                                List<FlSpot> heartRateData = [];
-                                List<FlSpot> oxygenData = [];
-                                List<FlSpot> sbpData = [];
-                                List<FlSpot> dbpData = [];
-                                int timeCounter = 0;
-
-                                double totalHeartRate = 0,
-                                    totalOxygen = 0,
-                                    totalSbp = 0,
-                                    totalDbp = 0;
-                                int validHeartRateReadings = 0,
-                                    validOxygenReadings = 0,
-                                    validSbpReadings = 0,
-                                    validDbpReadings = 0;
-
-                                if (readings != null) {
-                                  var sortedReadings =
-                                      readings.entries.toList()..sort(
-                                        (a, b) => a.key.toString().compareTo(
-                                          b.key.toString(),
-                                        ),
-                                      );
+                                final summary =
+                                    summaries[selectedSessionId!]!;
+                                final questionnaire = selectedQuestionnaire;
+
+                                final heartRateData =
+                                    selectedCharts['heartRate'] ?? [];
+                                final oxygenData = selectedCharts['spo2'] ?? [];
+                                final sbpData = selectedCharts['sbp'] ?? [];
+                                final dbpData = selectedCharts['dbp'] ?? [];
 
-                                  for (var entry in sortedReadings) {
-                                    if (entry.value is Map<dynamic, dynamic>) {
-                                      final reading =
-                                          entry.value as Map<dynamic, dynamic>;
-                                      double hr =
-                                          (reading['heartRate'] ?? 0)
-                                              .toDouble();
-                                      double ox =
-                                          (reading['oxygen'] ?? 0).toDouble();
-                                      double sbp =
-                                          (reading['sbp'] ?? 0).toDouble();
-                                      double dbp =
-                                          (reading['dbp'] ?? 0).toDouble();
-
-                                      if (hr > 0) {
-                                        heartRateData.add(
-                                          FlSpot(timeCounter.toDouble(), hr),
-                                        );
-                                        totalHeartRate += hr;
-                                        validHeartRateReadings++;
-                                      } else {
-                                        heartRateData.add(
-                                          FlSpot(timeCounter.toDouble(), 0),
-                                        );
-                                      }
-                                      if (ox > 0) {
-                                        oxygenData.add(
-                                          FlSpot(timeCounter.toDouble(), ox),
-                                        );
-                                        totalOxygen += ox;
-                                        validOxygenReadings++;
-                                      }
-                                      if (sbp > 0) {
-                                        sbpData.add(
-                                          FlSpot(timeCounter.toDouble(), sbp),
-                                        );
-                                        totalSbp += sbp;
-                                        validSbpReadings++;
-                                      } else {
-                                        sbpData.add(
-                                          FlSpot(timeCounter.toDouble(), 0),
-                                        );
-                                      }
-                                      if (dbp > 0) {
-                                        dbpData.add(
-                                          FlSpot(timeCounter.toDouble(), dbp),
-                                        );
-                                        totalDbp += dbp;
-                                        validDbpReadings++;
-                                      } else {
-                                        dbpData.add(
-                                          FlSpot(timeCounter.toDouble(), 0),
-                                        );
-                                      }
-                                      timeCounter++;
-                                    }
-                                  }
-                                }
-
-                                double avgHeartRate =
-                                    validHeartRateReadings > 0
-                                        ? totalHeartRate /
-                                            validHeartRateReadings
-                                        : 0;
-                                double avgOxygen =
-                                    validOxygenReadings > 0
-                                        ? totalOxygen / validOxygenReadings
-                                        : 0;
-                                double avgSbp =
-                                    validSbpReadings > 0
-                                        ? totalSbp / validSbpReadings
-                                        : 0;
-                                double avgDbp =
-                                    validDbpReadings > 0
-                                        ? totalDbp / validDbpReadings
-                                        : 0;
-                                double sessionHRV = 0;
-                                if (questionnaire != null &&
-                                    questionnaire['hrv'] != null) {
-                                  sessionHRV =
-                                      (questionnaire['hrv'] as num).toDouble();
-                                }
+                                double avgHeartRate = _shown(
+                                  summary.meanHeartRate,
+                                );
+                                double avgOxygen = _shown(summary.meanSpo2);
+                                double avgSbp = _shown(summary.meanSbp);
+                                double avgDbp = _shown(summary.meanDbp);
+                                double sessionHRV = _shown(summary.hrv);
 
                                 return Column(
                                   crossAxisAlignment: CrossAxisAlignment.center,
@@ -808,14 +875,9 @@ class _HistoricalSensorDataState extends State<HistoricalSensorData> {
                                       avgSbp: avgSbp,
                                       avgDbp: avgDbp,
                                       sessionHRV: sessionHRV,
-                                      stressScore:
-                                          questionnaire != null &&
-                                                  questionnaire['stressScore'] !=
-                                                      null
-                                              ? (questionnaire['stressScore']
-                                                      as num)
-                                                  .toDouble()
-                                              : 0,
+                                      stressScore: _shown(
+                                        summary.stressScore,
+                                      ),
                                     ),
                                     const SizedBox(height: 24),
                                     buildGraph(
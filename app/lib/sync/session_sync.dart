@@ -0,0 +1,200 @@
+import 'dart:convert';
+
+import 'package:CalmPetitor/native/ppg_core.dart';
+import 'package:firebase_database/firebase_database.dart';
+
+// Every write to users/<uid>/sessions/<sid> also stamps
+// users/<uid>/sessionIndex/<sid> with the server time, in the same
+// update. SessionSync watches that small index instead of the sessions
+// tree. path is the session node or anything under it.
+Map<String, Object> sessionStamp(String path) {
+  final parts = path.split('/').where((p) => p.isNotEmpty).toList();
+  if (parts.length < 4 || parts[0] != 'users' || parts[2] != 'sessions') {
+    return const {};
+  }
+  return {'users/${parts[1]}/sessionIndex/${parts[3]}': ServerValue.timestamp};
+}
+
+// Keeps a SessionCache in step with an athlete's sessions. Each sync asks
+// for the sessionIndex entries newer than the cache's watermark and, per
+// changed session, only the readings after its newest cached key plus
+// its questionnaire. The very first sync downloads the sessions tree once
+// to take in sessions recorded before the index existed.
+//
+// A session's stats and charts come from the summary the app stores at
+// STOP (SessionFinaliser). Ended sessions without one, recorded before it
+// existed or stopped on the sensor alone, are finalised here from the
+// cached readings and kept in the cache only.
+//
+// Sessions changed during this run are checked again on every sync until
+// they have been quiet for `settle`: the sensor stamps the index when a
+// session starts and stops, and its last readings can land after that.
+//
+// Each closed session also goes into the athlete's CompetitionTrends when
+// it is first cached: once its questionnaire is answered, or, for one the
+// sensor ended with no questionnaire, from its cached means. Sessions
+// recorded on another phone or by the sensor over WiFi reach the trends
+// this way; the trends skip ones already added.
+class SessionSync {
+  static const Duration settle = Duration(minutes: 2);
+
+  final String uid;
+  final SessionCache cache;
+  final CompetitionTrends? _trends;
+  final DatabaseReference _user;
+  final _settling = <String, DateTime>{};
+  bool _running = false;
+
+  SessionSync(this.uid)
+    : cache = SessionCache(uid),
+      _trends = CompetitionTrends.open(uid),
+      _user = FirebaseDatabase.instance.ref('users/$uid');
+
+  // Returns whether the cache changed
+  Future<bool> sync() async {
+    if (_running) return false;
+    _running = true;
+    try {
+      final changed = cache.watermark == 0 ? await _seed() : await _delta();
+      cache.commit();
+      return changed;
+    } finally {
+      _running = false;
+    }
+  }
+
+  void close() => cache.close();
+
+  Future<bool> _delta() async {
+    final index =
+        await _user
+            .child('sessionIndex')
+            .orderByValue()
+            .startAfter(cache.watermark)
+            .get();
+    final now = DateTime.now();
+    _settling.removeWhere((_, since) => now.difference(since) > settle);
+    final due = <String, int>{for (final id in _settling.keys) id: 0};
+    var newest = cache.watermark;
+    for (final entry in index.children) {
+      final ms = (entry.value as num?)?.toInt() ?? 0;
+      due[entry.key!] = ms;
+      if (ms > newest) newest = ms;
+    }
+    var changed = false;
+    for (final entry in due.entries) {
+      if (await _refresh(entry.key, entry.value) || entry.value > 0) {
+        _settling[entry.key] = now;
+        changed = true;
+      }
+    }
+    cache.watermark = newest;
+    return changed;
+  }
+
+  Future<bool> _refresh(String id, int modifiedMs) async {
+    if (!cache.upsert(id, modifiedMs)) return false;
+    final session = _user.child('sessions/$id');
+    final lastKey = cache.session(id)?.lastKey ?? '';
+    Query readings = session.child('readings').orderByKey();
+    if (lastKey.isNotEmpty) readings = readings.startAfter(lastKey);
+    final added = _addReadings(id, (await readings.get()).children);
+    final questionnaire = await session.child('questionnaire').get();
+    final endTime = await session.child('endTime').get();
+    final hrv = await session.child('hrv').get();
+    _setMeta(id, questionnaire.value, endTime.exists, hrv.value);
+    final summary = await session.child('summary').get();
+    _setFinalised(id, summary.value, added > 0);
+    return added > 0;
+  }
+
+  Future<bool> _seed() async {
+    // The index first: a change landing between the two reads is newer
+    // than the watermark and comes in with the next delta
+    final index = await _user.child('sessionIndex').get();
+    var newest = 1;
+    for (final entry in index.children) {
+      final ms = (entry.value as num?)?.toInt() ?? 0;
+      if (ms > newest) newest = ms;
+    }
+    final sessions = await _user.child('sessions').get();
+    for (final session in sessions.children) {
+      final id = session.key!;
+      if (!cache.upsert(id, 0)) continue;
+      final readings =
+          session.child('readings').children.toList()
+            ..sort((a, b) => a.key!.compareTo(b.key!));
+      _addReadings(id, readings);
+      _setMeta(
+        id,
+        session.child('questionnaire').value,
+        session.child('endTime').exists,
+        session.child('hrv').value,
+      );
+      _setFinalised(id, session.child('summary').value, true);
+    }
+    cache.watermark = newest;
+    return true;
+  }
+
+  int _addReadings(String id, Iterable<DataSnapshot> readings) {
+    var added = 0;
+    for (final r in readings) {
+      final value = r.value;
+      if (value is! Map) continue;
+      double field(String name) => (value[name] as num?)?.toDouble() ?? 0;
+      final reading = SessionReading(
+        field('heartRate'),
+        field('oxygen'),
+        field('sbp'),
+        field('dbp'),
+      );
+      if (cache.addReading(id, r.key!, reading)) added++;
+    }
+    return added;
+  }
+
+  // hrv is the one the sensor writes with endTime
+  void _setMeta(String id, Object? questionnaire, bool hasEndTime, Object? hrv) {
+    if (questionnaire is! Map) {
+      if (hasEndTime) {
+        cache.setSession(
+          id,
+          hrv: hrv is num ? hrv.toDouble() : null,
+          ended: true,
+        );
+        if (cache.session(id) case final s?) _trends?.addEnded(s);
+      }
+      return;
+    }
+    final q = Map<String, dynamic>.from(questionnaire);
+    // The app writes the session's averages at STOP and the answers once
+    // the questionnaire is submitted
+    final answered = cache.meta(id)?['stressLevel'] != null;
+    cache.setMeta(id, q);
+    cache.setSession(
+      id,
+      hrv: (q['hrv'] as num?)?.toDouble(),
+      stressScore: (q['stressScore'] as num?)?.toDouble(),
+      ended: true,
+    );
+    if (!answered && q['stressLevel'] != null) {
+      _trends?.addQuestionnaire(id, q);
+    }
+  }
+
+  void _setFinalised(String id, Object? summary, bool readingsAdded) {
+    if (summary is Map) {
+      cache.setFinalised(id, json.encode(summary));
+      return;
+    }
+    final session = cache.session(id);
+    if (session == null || !session.ended) return;
+    if (!readingsAdded && cache.finalised(id) != null) return;
+    final finaliser = SessionFinaliser();
+    for (final r in cache.readings(id)) {
+      finaliser.add(r.heartRate, r.spo2 >= 50 ? r.spo2 : 0, r.sbp, r.dbp);
+    }
+    cache.setFinalised(id, finaliser.finish());
+  }
+}